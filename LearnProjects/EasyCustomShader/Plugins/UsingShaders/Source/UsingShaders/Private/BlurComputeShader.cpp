@@ -1,43 +1,44 @@
 #include "BlurComputeShader.h"
 #include "GlobalShader.h"
-#include "ShaderParameterUtils.h"
+#include "ShaderParameterStruct.h"
+#include "ShaderPermutation.h"
 #include "RHIStaticStates.h"
-#include "Engine/Texture.h"
-#include "GameFramework/Actor.h"
-#include "Engine/World.h"
-#include "SceneInterface.h"
 #include "RHICommandList.h"
-#include "Engine/Engine.h"
+#include "RenderGraphBuilder.h"
+#include "RenderGraphUtils.h"
+#include "RenderTargetPool.h"
 
-BEGIN_GLOBAL_SHADER_PARAMETER_STRUCT(FBlurComputeShaderData, )
-//SHADER_PARAMETER(TArray<float>, )
-END_GLOBAL_SHADER_PARAMETER_STRUCT()
+// Threads of a group along the blurred axis, each group caches one tile of a row or a column
+#define BLUR_TILE_SIZE 64
 
+// Largest radius of one pass, larger sigmas are blurred at a lower resolution
+#define BLUR_MAX_RADIUS 32
 
-IMPLEMENT_GLOBAL_SHADER_PARAMETER_STRUCT(FBlurComputeShaderData, "FBlurData");   
+#define BLUR_WEIGHT_VECTORS ((BLUR_MAX_RADIUS + 4) / 4)
 
-//߳߳ӦshaderеĶ
-#define GROUP_THREAD_COUNTS 64        
+/** Variance of the 11 taps kernel which was repeated BlurCounts times, the variances of repeated blurs add up */
+static const float BaseBlurVariance = 6.9f;
 
-template<int Index>
-class FBlurComputeShader : public FGlobalShader
+class FBlurComputeShaderCS : public FGlobalShader
 {
-	DECLARE_SHADER_TYPE(FBlurComputeShader, Global)
+	DECLARE_GLOBAL_SHADER(FBlurComputeShaderCS);
+	SHADER_USE_PARAMETER_STRUCT(FBlurComputeShaderCS, FGlobalShader)
+
+	class FIsVerticalBlur : SHADER_PERMUTATION_BOOL("BLUR_VERTICAL");
+	using FPermutationDomain = TShaderPermutationDomain<FIsVerticalBlur>;
 public:
-	FBlurComputeShader() {}
 
-	FBlurComputeShader(const ShaderMetaType::CompiledShaderInitializerType& Initializer) :
-		FGlobalShader(Initializer)
-	{
-		InputSurface.Bind(Initializer.ParameterMap, TEXT("InputTexture"));
-		InputSampler.Bind(Initializer.ParameterMap, TEXT("TextureSampler"));
-		OutputSurface.Bind(Initializer.ParameterMap, TEXT("OutputTexture"));
-	}
+	BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
+		SHADER_PARAMETER(FIntPoint, DstSize)
+		SHADER_PARAMETER(FVector2D, InvDstSize)
+		SHADER_PARAMETER(int32, BlurRadius)
+		SHADER_PARAMETER_ARRAY(FVector4, BlurWeights, [BLUR_WEIGHT_VECTORS])
+		SHADER_PARAMETER_RDG_TEXTURE_SRV(Texture2D, SrcTexture)
+		SHADER_PARAMETER_SAMPLER(SamplerState, SrcSampler)
+		SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture2D<float4>, RWDstTexture)
+	END_SHADER_PARAMETER_STRUCT()
 
-	static bool ShouldCache(EShaderPlatform Platform)
-	{
-		return true;
-	}
+public:
 
 	static bool ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Paramers)
 	{
@@ -47,92 +48,150 @@ public:
 	static void ModifyCompilationEnvironment(const FGlobalShaderPermutationParameters& Parameters, FShaderCompilerEnvironment& OutEnvironment)
 	{
 		FGlobalShader::ModifyCompilationEnvironment(Parameters, OutEnvironment);
-		OutEnvironment.SetDefine(TEXT("BLUR_MICRO"), 1);
+		OutEnvironment.SetDefine(TEXT("BLUR_TILE_SIZE"), BLUR_TILE_SIZE);
+		OutEnvironment.SetDefine(TEXT("BLUR_MAX_RADIUS"), BLUR_MAX_RADIUS);
+		OutEnvironment.SetDefine(TEXT("BLUR_WEIGHT_VECTORS"), BLUR_WEIGHT_VECTORS);
 	}
+};
 
-	void SetParameters(FRHICommandListImmediate& RHICmdList, FRHITexture* InTexture, FRHIUnorderedAccessView* OutputUAV)
-	{
-		if (OutputSurface.IsBound())
-			RHICmdList.SetUAVParameter(GetComputeShader(), OutputSurface.GetBaseIndex(), OutputUAV);
-		
-		//RHICmdList.SetShaderTexture(GetComputeShader(), InputSurface.GetBaseIndex(), InTexture);
-		SetTextureParameter(RHICmdList, GetComputeShader(), InputSurface, InputSampler, TStaticSamplerState<SF_AnisotropicLinear, AM_Clamp, AM_Clamp, AM_Clamp>::GetRHI(), InTexture);
+IMPLEMENT_GLOBAL_SHADER(FBlurComputeShaderCS, "/Plugins/Shaders/Private/BlurComputeShader.usf", "BlurCS", SF_Compute);
 
-		//SetUniformBufferParameter(RHICmdList, GetPixelShader(), GetUniformBufferParameter<FBlurComputeShaderData>(), FBlurComputeShaderData::CreateUniformBuffer(BlurData, EUniformBufferUsage::UniformBuffer_SingleDraw));
-	}
+class FBlurUpsampleCS : public FGlobalShader
+{
+	DECLARE_GLOBAL_SHADER(FBlurUpsampleCS);
+	SHADER_USE_PARAMETER_STRUCT(FBlurUpsampleCS, FGlobalShader)
+public:
+
+	BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
+		SHADER_PARAMETER(FIntPoint, DstSize)
+		SHADER_PARAMETER(FVector2D, InvDstSize)
+		SHADER_PARAMETER_RDG_TEXTURE_SRV(Texture2D, SrcTexture)
+		SHADER_PARAMETER_SAMPLER(SamplerState, SrcSampler)
+		SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture2D<float4>, RWDstTexture)
+	END_SHADER_PARAMETER_STRUCT()
+
+public:
 
-	//UAVҪԱطʹ
-	void UnbindUAV(FRHICommandList& RHICmdList)
+	static bool ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Paramers)
 	{
-		if (OutputSurface.IsBound())
-			RHICmdList.SetUAVParameter(GetComputeShader(), OutputSurface.GetBaseIndex(), nullptr);
+		return true;
 	}
 
-	virtual bool Serialize(FArchive& Ar) override
+	static void ModifyCompilationEnvironment(const FGlobalShaderPermutationParameters& Parameters, FShaderCompilerEnvironment& OutEnvironment)
 	{
-		bool bShaderHasOutdatedParameters = FGlobalShader::Serialize(Ar);
-		Ar << InputSurface << OutputSurface;
-		return bShaderHasOutdatedParameters;
+		FGlobalShader::ModifyCompilationEnvironment(Parameters, OutEnvironment);
+		OutEnvironment.SetDefine(TEXT("BLUR_TILE_SIZE"), BLUR_TILE_SIZE);
+		OutEnvironment.SetDefine(TEXT("BLUR_MAX_RADIUS"), BLUR_MAX_RADIUS);
+		OutEnvironment.SetDefine(TEXT("BLUR_WEIGHT_VECTORS"), BLUR_WEIGHT_VECTORS);
 	}
+};
+
+IMPLEMENT_GLOBAL_SHADER(FBlurUpsampleCS, "/Plugins/Shaders/Private/BlurComputeShader.usf", "UpsampleCS", SF_Compute);
+
+static EPixelFormat GetBlurPixelFormat(EBlurTextureFormat Format)
+{
+	return Format == EBlurTextureFormat::FloatR11G11B10 ? PF_FloatR11G11B10 : PF_FloatRGBA;
+}
 
-private:
-	FShaderResourceParameter InputSurface;
+static FRDGTextureRef CreateBlurTexture(FRDGBuilder& GraphBuilder, FIntPoint Size, EBlurTextureFormat Format, const TCHAR* Name)
+{
+	FRDGTextureDesc Desc = FRDGTextureDesc::Create2DDesc(Size, GetBlurPixelFormat(Format), FClearValueBinding::None, TexCreate_None, TexCreate_UAV | TexCreate_ShaderResource, false);
+	return GraphBuilder.CreateTexture(Desc, Name);
+}
 
-	FShaderResourceParameter InputSampler;
+static void AddBlurPass(FRDGBuilder& GraphBuilder, FGlobalShaderMap* ShaderMap, bool bVertical, int32 BlurRadius, const FVector4* BlurWeights, FRDGTextureRef SrcTexture, FRDGTextureRef DstTexture)
+{
+	const FIntPoint DstSize = DstTexture->Desc.Extent;
 
-	FShaderResourceParameter OutputSurface;
-};
+	FBlurComputeShaderCS::FPermutationDomain PermutationVector;
+	PermutationVector.Set<FBlurComputeShaderCS::FIsVerticalBlur>(bVertical);
+	TShaderMapRef<FBlurComputeShaderCS> BlurCS(ShaderMap, PermutationVector);
 
-IMPLEMENT_SHADER_TYPE(template<>, FBlurComputeShader<1>, TEXT("/Plugins/Shaders/Private/BlurComputeShader.usf"), TEXT("HorzBlurCS"), SF_Compute)
-IMPLEMENT_SHADER_TYPE(template<>, FBlurComputeShader<2>, TEXT("/Plugins/Shaders/Private/BlurComputeShader.usf"), TEXT("VertBlurCS"), SF_Compute)
+	FBlurComputeShaderCS::FParameters* PassParameters = GraphBuilder.AllocParameters<FBlurComputeShaderCS::FParameters>();
+	PassParameters->DstSize = DstSize;
+	PassParameters->InvDstSize = FVector2D(1.f / DstSize.X, 1.f / DstSize.Y);
+	PassParameters->BlurRadius = BlurRadius;
+	for (int32 i = 0; i < BLUR_WEIGHT_VECTORS; ++i)
+	{
+		PassParameters->BlurWeights[i] = BlurWeights[i];
+	}
+	PassParameters->SrcTexture = GraphBuilder.CreateSRV(FRDGTextureSRVDesc(SrcTexture, 0));
+	PassParameters->SrcSampler = TStaticSamplerState<SF_Bilinear, AM_Clamp, AM_Clamp, AM_Clamp>::GetRHI();
+	PassParameters->RWDstTexture = GraphBuilder.CreateUAV(FRDGTextureUAVDesc(DstTexture));
 
-static void ExcuteBlurComputeShader_RenderThread(
-		FRHICommandListImmediate& RHICmdList,
-		ERHIFeatureLevel::Type FeatureLevel,
-		int32 BlurCounts,
-		FRHITexture* InTexture,
-		FRHITexture* UAVSource,
-		FRHIUnorderedAccessView* OutputUAV)
+	const FIntVector GroupCount = bVertical ?
+		FIntVector(DstSize.X, FMath::DivideAndRoundUp(DstSize.Y, BLUR_TILE_SIZE), 1) :
+		FIntVector(FMath::DivideAndRoundUp(DstSize.X, BLUR_TILE_SIZE), DstSize.Y, 1);
 
+	FComputeShaderUtils::AddPass(GraphBuilder, RDG_EVENT_NAME("%sBlurCS %dx%d Radius=%d", bVertical ? TEXT("Vert") : TEXT("Horz"), DstSize.X, DstSize.Y, BlurRadius), *BlurCS, PassParameters, GroupCount);
+}
+
+FRDGTextureRef AddBlurComputeShaderPasses(FRDGBuilder& GraphBuilder, ERHIFeatureLevel::Type FeatureLevel, FRDGTextureRef InputTexture, int32 BlurCounts, EBlurTextureFormat Format)
 {
-	check(IsInRenderingThread())
+	check(IsInRenderingThread());
+
+	FGlobalShaderMap* ShaderMap = GetGlobalShaderMap(FeatureLevel);
+	const FIntPoint Size = InputTexture->Desc.Extent;
 
-	TShaderMapRef<FBlurComputeShader<1>> ComputeShaderHorz(GetGlobalShaderMap(FeatureLevel));
-	TShaderMapRef<FBlurComputeShader<2>> ComputeShaderVert(GetGlobalShaderMap(FeatureLevel));
+	// One gaussian with the sigma of BlurCounts repeated passes, halve the resolution until the radius fits in a tile
+	const float Sigma = FMath::Sqrt(BaseBlurVariance * FMath::Max(BlurCounts, 0));
+	int32 Downsample = 1;
+	while (Sigma / Downsample > BLUR_MAX_RADIUS / 3.f)
+	{
+		Downsample *= 2;
+	}
+	const float BlurSigma = Sigma / Downsample;
+	const int32 BlurRadius = FMath::Clamp(FMath::CeilToInt(3.f * BlurSigma), 0, BLUR_MAX_RADIUS);
 
-	//UAVͼ
-	FRHIResourceCreateInfo RHIResourceCreateInfo;
-	FTexture2DRHIRef TempTexture = RHICreateTexture2D(InTexture->GetSizeXYZ().X, InTexture->GetSizeXYZ().Y, PF_A32B32G32R32F, 1, 1, TexCreate_ShaderResource | TexCreate_UAV, RHIResourceCreateInfo);
-	FUnorderedAccessViewRHIRef TempTextureUAV = RHICreateUnorderedAccessView(TempTexture);
+	FVector4 BlurWeights[BLUR_WEIGHT_VECTORS];
+	float* Weights = &BlurWeights[0].X;
+	float WeightSum = 0.f;
+	for (int32 i = 0; i < BLUR_WEIGHT_VECTORS * 4; ++i)
+	{
+		Weights[i] = i <= BlurRadius ? FMath::Exp(-i * i / FMath::Max(2.f * BlurSigma * BlurSigma, SMALL_NUMBER)) : 0.f;
+		WeightSum += i == 0 ? Weights[i] : 2.f * Weights[i];
+	}
+	for (int32 i = 0; i < BLUR_WEIGHT_VECTORS * 4; ++i)
+	{
+		Weights[i] /= WeightSum;
+	}
 
-	//GEngine->AddOnScreenDebugMessage(-1, 10, FColor::Blue, InTexture->GetSizeXYZ().ToString());
-	FRHITexture* IterTexture = InTexture;
+	const FIntPoint BlurSize(FMath::DivideAndRoundUp(Size.X, Downsample), FMath::DivideAndRoundUp(Size.Y, Downsample));
+	FRDGTextureRef HorzTexture = CreateBlurTexture(GraphBuilder, BlurSize, Format, TEXT("BlurHorz"));
+	FRDGTextureRef OutputTexture = CreateBlurTexture(GraphBuilder, Size, Format, TEXT("BlurOutput"));
+	FRDGTextureRef VertTexture = Downsample == 1 ? OutputTexture : CreateBlurTexture(GraphBuilder, BlurSize, Format, TEXT("BlurVert"));
 
-	//ģ
-	for (int32 i = 0; i < BlurCounts; ++i)
+	AddBlurPass(GraphBuilder, ShaderMap, false, BlurRadius, BlurWeights, InputTexture, HorzTexture);
+	AddBlurPass(GraphBuilder, ShaderMap, true, BlurRadius, BlurWeights, HorzTexture, VertTexture);
+
+	if (Downsample > 1)
 	{
-		RHICmdList.SetComputeShader(ComputeShaderHorz->GetComputeShader());
-		ComputeShaderHorz->SetParameters(RHICmdList, IterTexture, TempTextureUAV);
-		DispatchComputeShader(RHICmdList, *ComputeShaderHorz, InTexture->GetSizeXYZ().X / GROUP_THREAD_COUNTS, InTexture->GetSizeXYZ().Y, 1);        //ɫ
-		ComputeShaderHorz->UnbindUAV(RHICmdList);
-
-		RHICmdList.SetComputeShader(ComputeShaderVert->GetComputeShader());
-		ComputeShaderVert->SetParameters(RHICmdList, TempTexture, OutputUAV);
-		DispatchComputeShader(RHICmdList, *ComputeShaderVert, InTexture->GetSizeXYZ().X, InTexture->GetSizeXYZ().Y / GROUP_THREAD_COUNTS, 1);        //ɫ
-		ComputeShaderVert->UnbindUAV(RHICmdList);
-		IterTexture = UAVSource;
+		TShaderMapRef<FBlurUpsampleCS> UpsampleCS(ShaderMap);
+		FBlurUpsampleCS::FParameters* PassParameters = GraphBuilder.AllocParameters<FBlurUpsampleCS::FParameters>();
+		PassParameters->DstSize = Size;
+		PassParameters->InvDstSize = FVector2D(1.f / Size.X, 1.f / Size.Y);
+		PassParameters->SrcTexture = GraphBuilder.CreateSRV(FRDGTextureSRVDesc(VertTexture, 0));
+		PassParameters->SrcSampler = TStaticSamplerState<SF_Bilinear, AM_Clamp, AM_Clamp, AM_Clamp>::GetRHI();
+		PassParameters->RWDstTexture = GraphBuilder.CreateUAV(FRDGTextureUAVDesc(OutputTexture));
+		FComputeShaderUtils::AddPass(GraphBuilder, RDG_EVENT_NAME("BlurUpsampleCS x%d", Downsample), *UpsampleCS, PassParameters, FIntVector(FMath::DivideAndRoundUp(Size.X, 8), FMath::DivideAndRoundUp(Size.Y, 8), 1));
 	}
-	
-	TempTextureUAV.SafeRelease();
+
+	return OutputTexture;
 }
 
-void DrawBlurComputeShaderRenderTarget(AActor* Ac, int32 BlurCounts, FRHITexture* MyTexture, FRHITexture* UAVSource, FRHIUnorderedAccessView* TextureUAV)
+TRefCountPtr<IPooledRenderTarget> BlurTexture_RenderThread(FRHICommandListImmediate& RHICmdList, ERHIFeatureLevel::Type FeatureLevel, FRHITexture* InputTexture, int32 BlurCounts, EBlurTextureFormat Format)
 {
-	UWorld* World = Ac->GetWorld();
-	ERHIFeatureLevel::Type FeatureLevel = World->Scene->GetFeatureLevel();
+	check(IsInRenderingThread());
+
+	TRefCountPtr<IPooledRenderTarget> BlurredTexture;
 
-	ENQUEUE_RENDER_COMMAND(CaptureCommand)([FeatureLevel, BlurCounts, MyTexture, UAVSource, TextureUAV](FRHICommandListImmediate& RHICmdList)
+	FRDGBuilder GraphBuilder(RHICmdList);
 	{
-		ExcuteBlurComputeShader_RenderThread(RHICmdList, FeatureLevel, BlurCounts, MyTexture, UAVSource, TextureUAV);
-	});
+		FRDGTextureRef Input = GraphBuilder.RegisterExternalTexture(CreateRenderTarget(InputTexture, TEXT("BlurInput")), TEXT("BlurInput"));
+		FRDGTextureRef Output = AddBlurComputeShaderPasses(GraphBuilder, FeatureLevel, Input, BlurCounts, Format);
+		GraphBuilder.QueueTextureExtraction(Output, &BlurredTexture);
+	}
+	GraphBuilder.Execute();
+
+	return BlurredTexture;
 }
@@ -0,0 +1,29 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Common.h"
+
+TGlobalResource<FCommonVertexDeclaration> GCommonVertexDeclaration;
+
+TGlobalResource<FCommonQuadBuffer> GCommonQuadBuffer;
+
+void FCommonQuadBuffer::InitRHI()
+{
+	TResourceArray<FUVertexInput, VERTEXBUFFER_ALIGNMENT> Vertices;
+	Vertices.SetNumUninitialized(NumVertices);
+	Vertices[0].Position.Set(-1.0f, 1.0f, 0, 1.0f);
+	Vertices[1].Position.Set(1.0f, 1.0f, 0, 1.0f);
+	Vertices[2].Position.Set(-1.0f, -1.0f, 0, 1.0f);
+	Vertices[3].Position.Set(1.0f, -1.0f, 0, 1.0f);
+	Vertices[0].UV = FVector2D(0.0f, 1.0f);
+	Vertices[1].UV = FVector2D(1.0f, 1.0f);
+	Vertices[2].UV = FVector2D(0.0f, 0.0f);
+	Vertices[3].UV = FVector2D(1.0f, 0.0f);
+	FRHIResourceCreateInfo VertexCreateInfo(&Vertices);
+	VertexBuffer = RHICreateVertexBuffer(Vertices.GetResourceDataSize(), BUF_Static, VertexCreateInfo);
+
+	TResourceArray<uint16, INDEXBUFFER_ALIGNMENT> Indices;
+	Indices.Append({ 0, 1, 2, 2, 1, 3 });
+	FRHIResourceCreateInfo IndexCreateInfo(&Indices);
+	IndexBuffer = RHICreateIndexBuffer(sizeof(uint16), Indices.GetResourceDataSize(), BUF_Static, IndexCreateInfo);
+}
@@ -11,11 +11,16 @@
 #include "Engine/Public/SceneView.h"
 #include "ShaderParameterStruct.h"
 #include "FFTWaveSimulator.h"
+#include "WaveSimulation.h"
 #include "RHI.h"
 #include "PipelineStateCache.h"
 #include "Common.h"
 #include "Engine/TextureRenderTarget.h"
 #include "RHIUtilities.h"
+#include "Async/ParallelFor.h"
+#include "WaveBenchmark.h"
+#include "Engine/TextureRenderTarget2D.h"
+#include "Misc/App.h"
 
 #define WAVE_GROUP_THREAD_COUNTS 32
 
@@ -39,9 +44,10 @@ public:
 		GridLength.Bind(Initializer.ParameterMap, TEXT("GridLength"));
 		WaveAmplitude.Bind(Initializer.ParameterMap, TEXT("WaveAmplitude"));
 		WindSpeed.Bind(Initializer.ParameterMap, TEXT("WindSpeed"));
+		SpectrumKMin.Bind(Initializer.ParameterMap, TEXT("SpectrumKMin"));
+		SpectrumKMax.Bind(Initializer.ParameterMap, TEXT("SpectrumKMax"));
 		RandomTable.Bind(Initializer.ParameterMap, TEXT("RandomTable"));
 		RWSpectrum.Bind(Initializer.ParameterMap, TEXT("RWSpectrum"));
-		RWSpectrumConj.Bind(Initializer.ParameterMap, TEXT("RWSpectrumConj"));
 	}
 
 	static bool ShouldCache(EShaderPlatform Platform)
@@ -66,26 +72,26 @@ public:
 		float InGridLength,
 		float InWaveAmplitude,
 		FVector InWindSpeed,
+		float InSpectrumKMin,
+		float InSpectrumKMax,
 		FRHIShaderResourceView* RandomTableSRV,
-		FRHIUnorderedAccessView* InSpectrum,
-		FRHIUnorderedAccessView* InSpectrumConj
+		FRHIUnorderedAccessView* InSpectrum
 	)
 	{
 		SetShaderValue(RHICmdList, GetComputeShader(), WaveSize, InWaveSize);
 		SetShaderValue(RHICmdList, GetComputeShader(), GridLength, InGridLength);
 		SetShaderValue(RHICmdList, GetComputeShader(), WaveAmplitude, InWaveAmplitude);
 		SetShaderValue(RHICmdList, GetComputeShader(), WindSpeed, InWindSpeed);
+		SetShaderValue(RHICmdList, GetComputeShader(), SpectrumKMin, InSpectrumKMin);
+		SetShaderValue(RHICmdList, GetComputeShader(), SpectrumKMax, InSpectrumKMax);
 		SetSRVParameter(RHICmdList, GetComputeShader(), RandomTable, RandomTableSRV);
 		//if (RWSpectrum.IsBound())
 			RHICmdList.SetUAVParameter(GetComputeShader(), RWSpectrum.GetBaseIndex(), InSpectrum);
-		//if (RWSpectrumConj.IsBound())
-			RHICmdList.SetUAVParameter(GetComputeShader(), RWSpectrumConj.GetBaseIndex(), InSpectrumConj);
 	}
 
 	void UnbindUAV(FRHICommandList& RHICmdList)
 	{
 		RHICmdList.SetUAVParameter(GetComputeShader(), RWSpectrum.GetBaseIndex(), nullptr);
-		RHICmdList.SetUAVParameter(GetComputeShader(), RWSpectrumConj.GetBaseIndex(), nullptr);
 	}
 
 	virtual bool Serialize(FArchive& Ar) override
@@ -95,9 +101,10 @@ public:
 		Ar << GridLength;
 		Ar << WaveAmplitude;
 		Ar << WindSpeed;
+		Ar << SpectrumKMin;
+		Ar << SpectrumKMax;
 		Ar << RandomTable;
 		Ar << RWSpectrum;
-		Ar << RWSpectrumConj;
 
 		return bShaderHasOutdatedParameters;
 	}
@@ -107,33 +114,51 @@ private:
 	FShaderParameter GridLength;
 	FShaderParameter WaveAmplitude;
 	FShaderParameter WindSpeed;
+	FShaderParameter SpectrumKMin;
+	FShaderParameter SpectrumKMax;
 
 	FShaderResourceParameter RandomTable;
 	FShaderResourceParameter RWSpectrum;
-	FShaderResourceParameter RWSpectrumConj;
 };
 
 IMPLEMENT_SHADER_TYPE(, FPhillipsSpectrumCS,  TEXT("/Plugins/Shaders/Private/FFTWave.usf"), TEXT("PhillipsSpectrumCS"), SF_Compute)
 
-class FPrepareFFTCS : public FGlobalShader
+template<int T>
+class FWaveFFTCS : public FGlobalShader
 {
-	DECLARE_SHADER_TYPE(FPrepareFFTCS, Global)
+	DECLARE_SHADER_TYPE(FWaveFFTCS, Global)
+
+	//BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
+	//	SHADER_PARAMETER(FVector2D, ViewResolution)
+	//	SHADER_PARAMETER(float, TimeSeconds)
+	//	SHADER_PARAMETER(int32, WaveSize)
+	//	SHADER_PARAMETER(int32, StartIndex)
+	//	SHADER_PARAMETER_STRUCT_REF(FViewUniformShaderParameters, View)
+	//	SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture2D<float2>, HeightBuffer)
+	//	SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture2D<float4>, SlopeBuffer)
+	//	SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture2D<float4>, DisplacementBuffer)
+	//	SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture2D<float2>, Spectrum)
+	//END_SHADER_PARAMETER_STRUCT()
 
 public:
-	FPrepareFFTCS() {};
+	
+	FWaveFFTCS() {}
 
-	FPrepareFFTCS(const ShaderMetaType::CompiledShaderInitializerType& Initializer) :
+	FWaveFFTCS(const ShaderMetaType::CompiledShaderInitializerType& Initializer) :
 		FGlobalShader(Initializer)
 	{
 		TimeSeconds.Bind(Initializer.ParameterMap, TEXT("TimeSeconds"));
 		WaveSize.Bind(Initializer.ParameterMap, TEXT("WaveSize"));
 		GridLength.Bind(Initializer.ParameterMap, TEXT("GridLength"));
+		StartIndex.Bind(Initializer.ParameterMap, TEXT("StartIndex"));
 		DispersionTable.Bind(Initializer.ParameterMap, TEXT("DispersionTable"));
 		Spectrum.Bind(Initializer.ParameterMap, TEXT("Spectrum"));
-		SpectrumConj.Bind(Initializer.ParameterMap, TEXT("SpectrumConj"));
+
 		RWHeightBuffer.Bind(Initializer.ParameterMap, TEXT("RWHeightBuffer"));
 		RWSlopeBuffer.Bind(Initializer.ParameterMap, TEXT("RWSlopeBuffer"));
 		RWDisplacementBuffer.Bind(Initializer.ParameterMap, TEXT("RWDisplacementBuffer"));
+
+		ButterflyLookupTable.Bind(Initializer.ParameterMap, TEXT("ButterflyLookUpTable"));
 	}
 
 	static bool ShouldCache(EShaderPlatform Platform)
@@ -149,59 +174,72 @@ public:
 	static void ModifyCompilationEnvironment(const FGlobalShaderPermutationParameters& Parameters, FShaderCompilerEnvironment& OutEnvironment)
 	{
 		FGlobalShader::ModifyCompilationEnvironment(Parameters, OutEnvironment);
+
 		OutEnvironment.SetDefine(TEXT("THREAD_GROUP_SIZE"), WAVE_GROUP_THREAD_COUNTS);
 	}
 
 	void SetParameters(
-		FRHICommandListImmediate& RHICmdList,
+		FRHICommandListImmediate& RHICmdList, 
 		float InTimeSeconds,
 		int32 InWaveSize,
 		float InGridLength,
+		int32 InStartIndex,
+		FRHIShaderResourceView*  InButterflyLookupTable,
 		FRHIShaderResourceView* DispersionTableSRV,
 		FRHIShaderResourceView* InSpectrum,
-		FRHIShaderResourceView* InSpectrumConj,
 		FUnorderedAccessViewRHIRef HeightBufferUAV, 
 		FUnorderedAccessViewRHIRef SlopeBufferUAV, 
 		FUnorderedAccessViewRHIRef DisplacementBufferUAV
-	)
+		)
 	{
+		SetShaderValue(RHICmdList, GetComputeShader(), TimeSeconds, InTimeSeconds);
 		SetShaderValue(RHICmdList, GetComputeShader(), WaveSize, InWaveSize);
 		SetShaderValue(RHICmdList, GetComputeShader(), GridLength, InGridLength);
-		SetShaderValue(RHICmdList, GetComputeShader(), TimeSeconds, InTimeSeconds);
-
-		SetSRVParameter(RHICmdList, GetComputeShader(), DispersionTable, DispersionTableSRV);
-	
-		SetSRVParameter(RHICmdList, GetComputeShader(), Spectrum, InSpectrum);
-		SetSRVParameter(RHICmdList, GetComputeShader(), SpectrumConj, InSpectrumConj);
-
+		SetShaderValue(RHICmdList, GetComputeShader(), StartIndex, InStartIndex);
+		//SetShaderValueArray(RHICmdList, GetComputeShader(), ButterflyLookupTable, InButterflyLookupTable.GetData(), InButterflyLookupTable.Num());
+		/*FRHIUnorderedAccessView* OutUAVs[] = { RWHeightBuffer.UAV, RWSlopeBuffer.UAV, RWDisplacementBuffer.UAV };
+		RHICmdList.TransitionResources(EResourceTransitionAccess::EWritable, EResourceTransitionPipeline::EComputeToCompute, OutUAVs, UE_ARRAY_COUNT(OutUAVs));*/
+		
 		if (RWHeightBuffer.IsBound())
-			RHICmdList.SetUAVParameter(GetComputeShader(), RWHeightBuffer.GetBaseIndex(), HeightBufferUAV);
+			SetUAVParameter(RHICmdList, GetComputeShader(), RWHeightBuffer, HeightBufferUAV);
 		if (RWSlopeBuffer.IsBound())
-			RHICmdList.SetUAVParameter(GetComputeShader(), RWSlopeBuffer.GetBaseIndex(), SlopeBufferUAV);
+			SetUAVParameter(RHICmdList, GetComputeShader(), RWSlopeBuffer, SlopeBufferUAV);
 		if (RWDisplacementBuffer.IsBound())
-			RHICmdList.SetUAVParameter(GetComputeShader(), RWDisplacementBuffer.GetBaseIndex(), DisplacementBufferUAV);
+			SetUAVParameter(RHICmdList, GetComputeShader(), RWDisplacementBuffer, DisplacementBufferUAV);
+
+		SetSRVParameter(RHICmdList, GetComputeShader(), ButterflyLookupTable, InButterflyLookupTable);
+		// Only the first horizontal pass reads them, it evolves the spectrum itself
+		SetSRVParameter(RHICmdList, GetComputeShader(), DispersionTable, DispersionTableSRV);
+		SetSRVParameter(RHICmdList, GetComputeShader(), Spectrum, InSpectrum);
 	}
 
+	//UAVҪԱطʹ
 	void UnbindUAV(FRHICommandList& RHICmdList)
 	{
-		RHICmdList.SetUAVParameter(GetComputeShader(), RWHeightBuffer.GetBaseIndex(), nullptr);
-		RHICmdList.SetUAVParameter(GetComputeShader(), RWSlopeBuffer.GetBaseIndex(), nullptr);
-		RHICmdList.SetUAVParameter(GetComputeShader(), RWDisplacementBuffer.GetBaseIndex(), nullptr);
+		/*FRHIUnorderedAccessView* OutUAVs[] = { RWHeightBuffer.UAV, RWSlopeBuffer.UAV, RWDisplacementBuffer.UAV };
+		RHICmdList.TransitionResources(EResourceTransitionAccess::EReadable, EResourceTransitionPipeline::EComputeToCompute, OutUAVs, UE_ARRAY_COUNT(OutUAVs));*/
+
+		if (RWHeightBuffer.IsBound())
+			SetUAVParameter(RHICmdList, GetComputeShader(), RWHeightBuffer, nullptr);
+		if (RWSlopeBuffer.IsBound())
+			SetUAVParameter(RHICmdList, GetComputeShader(), RWSlopeBuffer, nullptr);
+		if (RWDisplacementBuffer.IsBound())
+			SetUAVParameter(RHICmdList, GetComputeShader(), RWDisplacementBuffer, nullptr);
 	}
 
 	virtual bool Serialize(FArchive& Ar) override
 	{
 		bool bShaderHasOutdatedParameters = FGlobalShader::Serialize(Ar);
 		Ar << TimeSeconds;
-		Ar << WaveSize;
+		Ar << WaveSize; 
 		Ar << GridLength;
-		Ar << DispersionTable;
-		Ar << Spectrum;
-		Ar << SpectrumConj;
+		Ar << StartIndex;
 		Ar << RWHeightBuffer;
 		Ar << RWSlopeBuffer;
 		Ar << RWDisplacementBuffer;
-
+		Ar << ButterflyLookupTable;
+		Ar << DispersionTable;
+		Ar << Spectrum;
 		return bShaderHasOutdatedParameters;
 	}
 
@@ -209,50 +247,40 @@ private:
 	FShaderParameter TimeSeconds;
 	FShaderParameter WaveSize;
 	FShaderParameter GridLength;
+	FShaderParameter StartIndex;
 
+	FShaderResourceParameter ButterflyLookupTable;
 	FShaderResourceParameter DispersionTable;
 	FShaderResourceParameter Spectrum;
-	FShaderResourceParameter SpectrumConj;
+
 	FShaderResourceParameter RWHeightBuffer;
 	FShaderResourceParameter RWSlopeBuffer;
 	FShaderResourceParameter RWDisplacementBuffer;
 };
 
-IMPLEMENT_SHADER_TYPE(, FPrepareFFTCS,  TEXT("/Plugins/Shaders/Private/FFTWave.usf"), TEXT("PrepareFFTCS"), SF_Compute)
+IMPLEMENT_SHADER_TYPE(template<>, FWaveFFTCS<1>,  TEXT("/Plugins/Shaders/Private/FFTWave.usf"), TEXT("PerformFFTCS_Horizontal"), SF_Compute)
+IMPLEMENT_SHADER_TYPE(template<>, FWaveFFTCS<2>,  TEXT("/Plugins/Shaders/Private/FFTWave.usf"), TEXT("PerformFFTCS_Vertical"), SF_Compute)
 
-template<int T>
-class FWaveFFTCS : public FGlobalShader
+/** Whole row (Direction 1) or column (Direction 2) FFT of the three fields in one dispatch, FFTSize is the WaveSize it is compiled for */
+template<int Direction, int FFTSize>
+class FWaveSharedFFTCS : public FGlobalShader
 {
-	DECLARE_SHADER_TYPE(FWaveFFTCS, Global)
-
-	//BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
-	//	SHADER_PARAMETER(FVector2D, ViewResolution)
-	//	SHADER_PARAMETER(float, TimeSeconds)
-	//	SHADER_PARAMETER(int32, WaveSize)
-	//	SHADER_PARAMETER(int32, StartIndex)
-	//	SHADER_PARAMETER_STRUCT_REF(FViewUniformShaderParameters, View)
-	//	SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture2D<float2>, HeightBuffer)
-	//	SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture2D<float4>, SlopeBuffer)
-	//	SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture2D<float4>, DisplacementBuffer)
-	//	SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture2D<float2>, Spectrum)
-	//END_SHADER_PARAMETER_STRUCT()
+	DECLARE_SHADER_TYPE(FWaveSharedFFTCS, Global)
 
 public:
-	
-	FWaveFFTCS() {}
+	FWaveSharedFFTCS() {}
 
-	FWaveFFTCS(const ShaderMetaType::CompiledShaderInitializerType& Initializer) :
+	FWaveSharedFFTCS(const ShaderMetaType::CompiledShaderInitializerType& Initializer) :
 		FGlobalShader(Initializer)
 	{
 		TimeSeconds.Bind(Initializer.ParameterMap, TEXT("TimeSeconds"));
 		WaveSize.Bind(Initializer.ParameterMap, TEXT("WaveSize"));
-		StartIndex.Bind(Initializer.ParameterMap, TEXT("StartIndex"));
-
+		GridLength.Bind(Initializer.ParameterMap, TEXT("GridLength"));
+		DispersionTable.Bind(Initializer.ParameterMap, TEXT("DispersionTable"));
+		Spectrum.Bind(Initializer.ParameterMap, TEXT("Spectrum"));
 		RWHeightBuffer.Bind(Initializer.ParameterMap, TEXT("RWHeightBuffer"));
 		RWSlopeBuffer.Bind(Initializer.ParameterMap, TEXT("RWSlopeBuffer"));
 		RWDisplacementBuffer.Bind(Initializer.ParameterMap, TEXT("RWDisplacementBuffer"));
-
-		ButterflyLookupTable.Bind(Initializer.ParameterMap, TEXT("ButterflyLookUpTable"));
 	}
 
 	static bool ShouldCache(EShaderPlatform Platform)
@@ -268,44 +296,37 @@ public:
 	static void ModifyCompilationEnvironment(const FGlobalShaderPermutationParameters& Parameters, FShaderCompilerEnvironment& OutEnvironment)
 	{
 		FGlobalShader::ModifyCompilationEnvironment(Parameters, OutEnvironment);
-
-		OutEnvironment.SetDefine(TEXT("THREAD_GROUP_SIZE"), WAVE_GROUP_THREAD_COUNTS);
+		OutEnvironment.SetDefine(TEXT("FFT_SIZE"), FFTSize);
 	}
 
 	void SetParameters(
-		FRHICommandListImmediate& RHICmdList, 
+		FRHICommandListImmediate& RHICmdList,
 		float InTimeSeconds,
-		int32 InWaveSize,
-		int32 InStartIndex,
-		FRHIShaderResourceView*  InButterflyLookupTable,
-		FUnorderedAccessViewRHIRef HeightBufferUAV, 
-		FUnorderedAccessViewRHIRef SlopeBufferUAV, 
+		float InGridLength,
+		FRHIShaderResourceView* DispersionTableSRV,
+		FRHIShaderResourceView* InSpectrum,
+		FUnorderedAccessViewRHIRef HeightBufferUAV,
+		FUnorderedAccessViewRHIRef SlopeBufferUAV,
 		FUnorderedAccessViewRHIRef DisplacementBufferUAV
 		)
 	{
+		// The horizontal pass evolves the spectrum, the vertical one has none of them bound
 		SetShaderValue(RHICmdList, GetComputeShader(), TimeSeconds, InTimeSeconds);
-		SetShaderValue(RHICmdList, GetComputeShader(), WaveSize, InWaveSize);
-		SetShaderValue(RHICmdList, GetComputeShader(), StartIndex, InStartIndex);
-		//SetShaderValueArray(RHICmdList, GetComputeShader(), ButterflyLookupTable, InButterflyLookupTable.GetData(), InButterflyLookupTable.Num());
-		/*FRHIUnorderedAccessView* OutUAVs[] = { RWHeightBuffer.UAV, RWSlopeBuffer.UAV, RWDisplacementBuffer.UAV };
-		RHICmdList.TransitionResources(EResourceTransitionAccess::EWritable, EResourceTransitionPipeline::EComputeToCompute, OutUAVs, UE_ARRAY_COUNT(OutUAVs));*/
-		
+		SetShaderValue(RHICmdList, GetComputeShader(), WaveSize, FFTSize);
+		SetShaderValue(RHICmdList, GetComputeShader(), GridLength, InGridLength);
+		SetSRVParameter(RHICmdList, GetComputeShader(), DispersionTable, DispersionTableSRV);
+		SetSRVParameter(RHICmdList, GetComputeShader(), Spectrum, InSpectrum);
+
 		if (RWHeightBuffer.IsBound())
 			SetUAVParameter(RHICmdList, GetComputeShader(), RWHeightBuffer, HeightBufferUAV);
 		if (RWSlopeBuffer.IsBound())
 			SetUAVParameter(RHICmdList, GetComputeShader(), RWSlopeBuffer, SlopeBufferUAV);
 		if (RWDisplacementBuffer.IsBound())
 			SetUAVParameter(RHICmdList, GetComputeShader(), RWDisplacementBuffer, DisplacementBufferUAV);
-
-		SetSRVParameter(RHICmdList, GetComputeShader(), ButterflyLookupTable, InButterflyLookupTable);
 	}
 
-	//UAVҪԱطʹ
 	void UnbindUAV(FRHICommandList& RHICmdList)
 	{
-		/*FRHIUnorderedAccessView* OutUAVs[] = { RWHeightBuffer.UAV, RWSlopeBuffer.UAV, RWDisplacementBuffer.UAV };
-		RHICmdList.TransitionResources(EResourceTransitionAccess::EReadable, EResourceTransitionPipeline::EComputeToCompute, OutUAVs, UE_ARRAY_COUNT(OutUAVs));*/
-
 		if (RWHeightBuffer.IsBound())
 			SetUAVParameter(RHICmdList, GetComputeShader(), RWHeightBuffer, nullptr);
 		if (RWSlopeBuffer.IsBound())
@@ -318,29 +339,40 @@ public:
 	{
 		bool bShaderHasOutdatedParameters = FGlobalShader::Serialize(Ar);
 		Ar << TimeSeconds;
-		Ar << WaveSize; 
-		Ar << StartIndex;
+		Ar << WaveSize;
+		Ar << GridLength;
+		Ar << DispersionTable;
+		Ar << Spectrum;
 		Ar << RWHeightBuffer;
 		Ar << RWSlopeBuffer;
 		Ar << RWDisplacementBuffer;
-		Ar << ButterflyLookupTable;
 		return bShaderHasOutdatedParameters;
 	}
 
 private:
 	FShaderParameter TimeSeconds;
 	FShaderParameter WaveSize;
-	FShaderParameter StartIndex;
-
-	FShaderResourceParameter ButterflyLookupTable;
+	FShaderParameter GridLength;
 
+	FShaderResourceParameter DispersionTable;
+	FShaderResourceParameter Spectrum;
 	FShaderResourceParameter RWHeightBuffer;
 	FShaderResourceParameter RWSlopeBuffer;
 	FShaderResourceParameter RWDisplacementBuffer;
 };
 
-IMPLEMENT_SHADER_TYPE(template<>, FWaveFFTCS<1>,  TEXT("/Plugins/Shaders/Private/FFTWave.usf"), TEXT("PerformFFTCS_Horizontal"), SF_Compute)
-IMPLEMENT_SHADER_TYPE(template<>, FWaveFFTCS<2>,  TEXT("/Plugins/Shaders/Private/FFTWave.usf"), TEXT("PerformFFTCS_Vertical"), SF_Compute)
+// A comma in the template arguments can not go through IMPLEMENT_SHADER_TYPE, so every size is typedefed first
+#define IMPLEMENT_WAVE_SHARED_FFT_TYPE(Size) \
+	typedef FWaveSharedFFTCS<1, Size> FWaveSharedFFTCS_Horizontal##Size; \
+	typedef FWaveSharedFFTCS<2, Size> FWaveSharedFFTCS_Vertical##Size; \
+	IMPLEMENT_SHADER_TYPE(template<>, FWaveSharedFFTCS_Horizontal##Size, TEXT("/Plugins/Shaders/Private/FFTWave.usf"), TEXT("PerformSharedFFTCS_Horizontal"), SF_Compute) \
+	IMPLEMENT_SHADER_TYPE(template<>, FWaveSharedFFTCS_Vertical##Size, TEXT("/Plugins/Shaders/Private/FFTWave.usf"), TEXT("PerformSharedFFTCS_Vertical"), SF_Compute)
+
+IMPLEMENT_WAVE_SHARED_FFT_TYPE(32)
+IMPLEMENT_WAVE_SHARED_FFT_TYPE(64)
+IMPLEMENT_WAVE_SHARED_FFT_TYPE(128)
+IMPLEMENT_WAVE_SHARED_FFT_TYPE(256)
+IMPLEMENT_WAVE_SHARED_FFT_TYPE(512)
 
 class FComputePosAndNormalShader : public FGlobalShader
 {
@@ -447,22 +479,40 @@ public:
 IMPLEMENT_SHADER_TYPE(, FComputePosAndNormalVS, TEXT("/Plugins/Shaders/Private/FFTWave.usf"), TEXT("ComputePosAndNormalVS"), SF_Vertex)
 IMPLEMENT_SHADER_TYPE(, FComputePosAndNormalPS, TEXT("/Plugins/Shaders/Private/FFTWave.usf"), TEXT("ComputePosAndNormalPS"), SF_Pixel)
 
-extern void ComputeRandomTable(int32 Size, TArray<FVector2D>& OutTable)
+// PCG hash (Jarkko and Olano, "Hash Functions for GPU Rendering"), a counter based generator, the same on every platform
+static uint32 PCGHash(uint32 Input)
 {
+	const uint32 State = Input * 747796405u + 2891336453u;
+	const uint32 Word = ((State >> ((State >> 28u) + 4u)) ^ State) * 277803737u;
+	return (Word >> 22u) ^ Word;
+}
+
+// Standard normal approximated by the sum of 12 uniforms (Irwin-Hall, variance 1, tails cut at 6).
+// Only integer math and one exact power of two scale, so no libm is involved and every platform gets the same bits
+static float PCGGaussian(uint32 Seed, uint32 Index, uint32 Stream)
+{
+	uint32 State = PCGHash(PCGHash(PCGHash(Seed) ^ Index) ^ Stream);
+	int32 Sum = 0;
+	for (int32 i = 0; i < 6; ++i)
+	{
+		State = PCGHash(State);
+		Sum += (int32)(State & 0xffff) + (int32)(State >> 16);
+	}
+	// Each 16 bit value k is the uniform (k + 0.5) / 65536, |Sum + 6 - 6 * 65536| < 2^24 so the float is exact
+	return (float)(Sum + 6 - 6 * 65536) * (1.f / 65536.f);
+}
+
+extern void ComputeRandomTable(int32 Size, uint32 Seed, TArray<FVector2D>& OutTable)
+{
+	// Every entry only depends on (Seed, Index), so rows are filled on any thread in any order
 	OutTable.SetNum(Size * Size);
-	for (int32 i = 0; i < OutTable.Num(); ++i)
+	ParallelFor(Size, [&](int32 Row)
 	{
-		float x1, x2, w;
-		do
+		for (int32 i = Row * Size; i < (Row + 1) * Size; ++i)
 		{
-			x1 = 2.0f * FMath::FRand() - 1.0f;
-			x2 = 2.0f * FMath::FRand() - 1.0f;
-			w = x1 * x1 + x2 * x2;
-		} while (w >= 1.0f);
-
-		w = sqrt((-2.0f * log(w)) / w);
-		OutTable[i] = FVector2D(x1 * w, x2 * w);
-	}
+			OutTable[i] = FVector2D(PCGGaussian(Seed, i, 0), PCGGaussian(Seed, i, 1));
+		}
+	});
 }
 
 int32 BitReverse(int32 i, int32 Size)
@@ -540,53 +590,32 @@ static void ComputePhillipsSpecturm_RenderThread(
 	float GridLength,
     float WaveAmplitude,
 	FVector WindSpeed,
+	float SpectrumKMin,
+	float SpectrumKMax,
 	FRHIShaderResourceView*  RandomTableSRV,
-	FUnorderedAccessViewRHIRef Spectrum,
-	FUnorderedAccessViewRHIRef SpectrumConj)
+	FUnorderedAccessViewRHIRef Spectrum)
 {
 	RHICmdList.BeginComputePass(TEXT("ComputePhillipsSpecturmPass"));
 	TShaderMapRef<FPhillipsSpectrumCS> PhillipsSpecturmShader(GetGlobalShaderMap(FeatureLevel));
 
 	RHICmdList.SetComputeShader(PhillipsSpecturmShader->GetComputeShader());
-	PhillipsSpecturmShader->SetParameters(RHICmdList, WaveSize, GridLength, WaveAmplitude, WindSpeed, RandomTableSRV, Spectrum, SpectrumConj);
+	PhillipsSpecturmShader->SetParameters(RHICmdList, WaveSize, GridLength, WaveAmplitude, WindSpeed, SpectrumKMin, SpectrumKMax, RandomTableSRV, Spectrum);
 	DispatchComputeShader(RHICmdList, *PhillipsSpecturmShader, FMath::DivideAndRoundUp(WaveSize + 1, WAVE_GROUP_THREAD_COUNTS), FMath::DivideAndRoundUp(WaveSize + 1, WAVE_GROUP_THREAD_COUNTS), 1); 
 	PhillipsSpecturmShader->UnbindUAV(RHICmdList);
 	RHICmdList.EndComputePass();
 }
 
-static void PrepareFFT_RenderThread(
-	FRHICommandListImmediate& RHICmdList,
-	ERHIFeatureLevel::Type FeatureLevel,
-	float TimeSeconds,
-	int32 WaveSize,
-	float GridLength,
-	FRHIShaderResourceView*  DispersionTableSRV,
-	FRWBuffer* Spectrum,
-	FRWBuffer* SpectrumConj,
-	FTextureRWBuffer2D* HeightBuffer, 
-	FTextureRWBuffer2D* SlopeBuffer, 
-	FTextureRWBuffer2D* DisplacementBuffer
-)
-{
-	check(IsInRenderingThread());
-
-	RHICmdList.BeginComputePass(TEXT("PrepareFFTPass"));
-	TShaderMapRef<FPrepareFFTCS> PrepareFFTShader(GetGlobalShaderMap(FeatureLevel));
-
-	RHICmdList.SetComputeShader(PrepareFFTShader->GetComputeShader());
-	PrepareFFTShader->SetParameters(RHICmdList, TimeSeconds, WaveSize, GridLength, DispersionTableSRV, Spectrum->SRV, SpectrumConj->SRV, HeightBuffer->UAV, SlopeBuffer->UAV, DisplacementBuffer->UAV);
-	DispatchComputeShader(RHICmdList, *PrepareFFTShader, FMath::DivideAndRoundUp(WaveSize, WAVE_GROUP_THREAD_COUNTS), FMath::DivideAndRoundUp(WaveSize, WAVE_GROUP_THREAD_COUNTS), 1); 
-	PrepareFFTShader->UnbindUAV(RHICmdList);
-	RHICmdList.EndComputePass();
-}
-
+// The first horizontal pass evolves h(k,t) from the spectrum, there is no pass writing the frequency domain before it
 static void EvaluateWavesFFT_RenderThread(
 	FRHICommandListImmediate& RHICmdList,
 	ERHIFeatureLevel::Type FeatureLevel,
 	float TimeSeconds,
 	int32 WaveSize,
+	float GridLength,
 	int32 StartIndex,
 	FRHIShaderResourceView*  ButterflyLookupTableSRV,
+	FRHIShaderResourceView*  DispersionTableSRV,
+	FRHIShaderResourceView*  SpectrumSRV,
 	FTextureRWBuffer2D* HeightBuffer,
 	FTextureRWBuffer2D* SlopeBuffer,
 	FTextureRWBuffer2D* DisplacementBuffer)
@@ -603,7 +632,7 @@ static void EvaluateWavesFFT_RenderThread(
 	for (int32 i = 0; i < Passes; ++i)
 	{
 		RHICmdList.SetComputeShader(WaveFFTCS1->GetComputeShader());
-		WaveFFTCS1->SetParameters(RHICmdList, TimeSeconds, WaveSize, i, ButterflyLookupTableSRV, HeightBuffer->UAV, SlopeBuffer->UAV, DisplacementBuffer->UAV);
+		WaveFFTCS1->SetParameters(RHICmdList, TimeSeconds, WaveSize, GridLength, i, ButterflyLookupTableSRV, DispersionTableSRV, SpectrumSRV, HeightBuffer->UAV, SlopeBuffer->UAV, DisplacementBuffer->UAV);
 		DispatchComputeShader(RHICmdList, *WaveFFTCS1, FMath::DivideAndRoundUp(WaveSize, WAVE_GROUP_THREAD_COUNTS), FMath::DivideAndRoundUp(WaveSize, WAVE_GROUP_THREAD_COUNTS), 1);
 		WaveFFTCS1->UnbindUAV(RHICmdList);
 	}
@@ -611,13 +640,67 @@ static void EvaluateWavesFFT_RenderThread(
 	for (int32 i = 0; i < Passes; ++i)
 	{
 		RHICmdList.SetComputeShader(WaveFFTCS2->GetComputeShader());
-		WaveFFTCS2->SetParameters(RHICmdList, TimeSeconds, WaveSize, i, ButterflyLookupTableSRV, HeightBuffer->UAV, SlopeBuffer->UAV, DisplacementBuffer->UAV);
+		WaveFFTCS2->SetParameters(RHICmdList, TimeSeconds, WaveSize, GridLength, i, ButterflyLookupTableSRV, nullptr, nullptr, HeightBuffer->UAV, SlopeBuffer->UAV, DisplacementBuffer->UAV);
 		DispatchComputeShader(RHICmdList, *WaveFFTCS2, FMath::DivideAndRoundUp(WaveSize, WAVE_GROUP_THREAD_COUNTS), FMath::DivideAndRoundUp(WaveSize, WAVE_GROUP_THREAD_COUNTS), 1);
 		WaveFFTCS2->UnbindUAV(RHICmdList);
 	}
 	RHICmdList.EndComputePass();
 }
 
+template<int FFTSize>
+static void EvaluateWavesSharedFFT_RenderThread(
+	FRHICommandListImmediate& RHICmdList,
+	ERHIFeatureLevel::Type FeatureLevel,
+	float TimeSeconds,
+	float GridLength,
+	FRHIShaderResourceView* DispersionTableSRV,
+	FRHIShaderResourceView* SpectrumSRV,
+	FTextureRWBuffer2D* HeightBuffer,
+	FTextureRWBuffer2D* SlopeBuffer,
+	FTextureRWBuffer2D* DisplacementBuffer)
+{
+	TShaderMapRef<FWaveSharedFFTCS<1, FFTSize>> HorizontalCS(GetGlobalShaderMap(FeatureLevel));
+	TShaderMapRef<FWaveSharedFFTCS<2, FFTSize>> VerticalCS(GetGlobalShaderMap(FeatureLevel));
+
+	RHICmdList.BeginComputePass(TEXT("EvaluateSharedFFTPass"));
+	RHICmdList.SetComputeShader(HorizontalCS->GetComputeShader());
+	HorizontalCS->SetParameters(RHICmdList, TimeSeconds, GridLength, DispersionTableSRV, SpectrumSRV, HeightBuffer->UAV, SlopeBuffer->UAV, DisplacementBuffer->UAV);
+	DispatchComputeShader(RHICmdList, *HorizontalCS, FFTSize, 1, 1);
+	HorizontalCS->UnbindUAV(RHICmdList);
+
+	RHICmdList.SetComputeShader(VerticalCS->GetComputeShader());
+	VerticalCS->SetParameters(RHICmdList, TimeSeconds, GridLength, nullptr, nullptr, HeightBuffer->UAV, SlopeBuffer->UAV, DisplacementBuffer->UAV);
+	DispatchComputeShader(RHICmdList, *VerticalCS, FFTSize, 1, 1);
+	VerticalCS->UnbindUAV(RHICmdList);
+	RHICmdList.EndComputePass();
+}
+
+/** Two dispatches instead of 2 * log2(WaveSize), the horizontal one evolves the spectrum too, false if there is no kernel of the size */
+static bool EvaluateWavesSharedFFT_RenderThread(
+	FRHICommandListImmediate& RHICmdList,
+	ERHIFeatureLevel::Type FeatureLevel,
+	float TimeSeconds,
+	int32 WaveSize,
+	float GridLength,
+	FRHIShaderResourceView* DispersionTableSRV,
+	FRHIShaderResourceView* SpectrumSRV,
+	FTextureRWBuffer2D* HeightBuffer,
+	FTextureRWBuffer2D* SlopeBuffer,
+	FTextureRWBuffer2D* DisplacementBuffer)
+{
+	check(IsInRenderingThread());
+
+	switch (WaveSize)
+	{
+	case 32: EvaluateWavesSharedFFT_RenderThread<32>(RHICmdList, FeatureLevel, TimeSeconds, GridLength, DispersionTableSRV, SpectrumSRV, HeightBuffer, SlopeBuffer, DisplacementBuffer); return true;
+	case 64: EvaluateWavesSharedFFT_RenderThread<64>(RHICmdList, FeatureLevel, TimeSeconds, GridLength, DispersionTableSRV, SpectrumSRV, HeightBuffer, SlopeBuffer, DisplacementBuffer); return true;
+	case 128: EvaluateWavesSharedFFT_RenderThread<128>(RHICmdList, FeatureLevel, TimeSeconds, GridLength, DispersionTableSRV, SpectrumSRV, HeightBuffer, SlopeBuffer, DisplacementBuffer); return true;
+	case 256: EvaluateWavesSharedFFT_RenderThread<256>(RHICmdList, FeatureLevel, TimeSeconds, GridLength, DispersionTableSRV, SpectrumSRV, HeightBuffer, SlopeBuffer, DisplacementBuffer); return true;
+	case 512: EvaluateWavesSharedFFT_RenderThread<512>(RHICmdList, FeatureLevel, TimeSeconds, GridLength, DispersionTableSRV, SpectrumSRV, HeightBuffer, SlopeBuffer, DisplacementBuffer); return true;
+	default: return false;
+	}
+}
+
 static void ComputePosAndNormal_RenderThread(
 	FRHICommandListImmediate& RHICmdList,
 	ERHIFeatureLevel::Type FeatureLevel,
@@ -644,8 +727,6 @@ static void ComputePosAndNormal_RenderThread(
 		FRHIRenderPassInfo PassInfo(2, ColorRTs, ERenderTargetActions::Load_Store);
 		//FRHIRenderPassInfo PassInfo(OutputRenderTargetResource->GetRenderTargetTexture(), ERenderTargetActions::Load_Store, OutputRenderTargetResource->TextureRHI);
 		RHICmdList.BeginRenderPass(PassInfo, TEXT("ComputeWavePosPass"));
-		FCommonVertexDeclaration VertexDeclaration;
-		VertexDeclaration.InitRHI();
 
 		FGraphicsPipelineStateInitializer GraphicPSPoint;
 		RHICmdList.ApplyCachedRenderTargets(GraphicPSPoint);
@@ -653,154 +734,353 @@ static void ComputePosAndNormal_RenderThread(
 		GraphicPSPoint.BlendState = TStaticBlendState<>::GetRHI();
 		GraphicPSPoint.RasterizerState = TStaticRasterizerState<>::GetRHI();
 		GraphicPSPoint.PrimitiveType = PT_TriangleList;        //ƵͼԪ
-		GraphicPSPoint.BoundShaderState.VertexDeclarationRHI = VertexDeclaration.VertexDeclarationRHI;
+		GraphicPSPoint.BoundShaderState.VertexDeclarationRHI = GCommonVertexDeclaration.VertexDeclarationRHI;
 		GraphicPSPoint.BoundShaderState.VertexShaderRHI = GETSAFERHISHADER_VERTEX(*ComputePosAndNormalVS);
 		GraphicPSPoint.BoundShaderState.PixelShaderRHI = GETSAFERHISHADER_PIXEL(*ComputePosAndNormalPS);
 		SetGraphicsPipelineState(RHICmdList, GraphicPSPoint);
 
 		ComputePosAndNormalPS->SetParameters(RHICmdList, InWaveSize, InGridLength, HeightBuffer->Buffer, SlopeBuffer->Buffer, DisplacementBuffer->Buffer);
 
-		FUVertexInput Vertices[4];
-		Vertices[0].Position.Set(-1.0f, 1.0f, 0, 1.0f);
-		Vertices[1].Position.Set(1.0f, 1.0f, 0, 1.0f);
-		Vertices[2].Position.Set(-1.0f, -1.0f, 0, 1.0f);
-		Vertices[3].Position.Set(1.0f, -1.0f, 0, 1.0f);
-		Vertices[0].UV = FVector2D(0.0f, 1.0f);
-		Vertices[1].UV = FVector2D(1.0f, 1.0f);
-		Vertices[2].UV = FVector2D(0.0f, 0.0f);
-		Vertices[3].UV = FVector2D(1.0f, 0.0f);
-		static const uint16 Indices[6] =  
-		{  
-			0, 1, 2,  
-			2, 1, 3  
-		};  
-
-		DrawIndexedPrimitiveUP_Custom(RHICmdList, PT_TriangleList, 0, ARRAY_COUNT(Vertices), 2, Indices, sizeof(Indices[0]), Vertices, sizeof(Vertices[0]));
+		DrawCommonQuad(RHICmdList);
 
 		RHICmdList.EndRenderPass();
 	}
 }
 
-void AFFTWaveSimulator::ComputeSpectrum()
+/** Gpu buffers of one cascade of a FWaveSimulation, created and used on render thread */
+struct FWaveCascadeRenderData
+{
+	int32 WaveSize;
+	float PatchLength;
+	float SpectrumKMin;
+	float SpectrumKMax;
+
+	/** h_0(k) and conj of h_0(-k) packed in one float4, only rebuilt when the spectrum parameters change */
+	FRWBuffer Spectrum;
+
+	FTextureRWBuffer2D HeightBuffer;
+	FTextureRWBuffer2D SlopeBuffer;
+	FTextureRWBuffer2D DisplacementBuffer;
+
+	FVertexBufferRHIRef RandomTableVB;
+	FShaderResourceViewRHIRef RandomTableSRV;
+
+	FVertexBufferRHIRef ButterflyLookupTableVB;
+	FShaderResourceViewRHIRef ButterflyLookupTableSRV;
+
+	FVertexBufferRHIRef DispersionTableVB;
+	FShaderResourceViewRHIRef DispersionTableSRV;
+};
+
+/** Gpu data of a FWaveSimulation, created and used on render thread */
+struct FWaveSimulationRenderData
+{
+	ERHIFeatureLevel::Type FeatureLevel;
+
+	TIndirectArray<FWaveCascadeRenderData, TInlineAllocator<MAX_WAVE_CASCADES>> Cascades;
+};
+
+template<typename T>
+static void CreateTableSRV(const TArray<T>& Table, EPixelFormat Format, FVertexBufferRHIRef& OutVB, FShaderResourceViewRHIRef& OutSRV)
+{
+	FRHIResourceCreateInfo CreateInfo;
+	OutVB = RHICreateVertexBuffer(Table.Num() * sizeof(T), BUF_ShaderResource, CreateInfo);
+	OutSRV = RHICreateShaderResourceView(OutVB, sizeof(T), Format);
+
+	void* LockedData = RHILockVertexBuffer(OutVB, 0, Table.Num() * sizeof(T), RLM_WriteOnly);
+	FPlatformMemory::Memcpy(LockedData, Table.GetData(), Table.Num() * sizeof(T));
+	RHIUnlockVertexBuffer(OutVB);
+}
+
+// Buffers of the passes and the tables, Data.WaveSize is set
+static void InitCascadeRenderData_RenderThread(FWaveCascadeRenderData& Data, const TArray<FVector2D>& RandomTable, const TArray<float>& ButterflyLookupTable, const TArray<float>& DispersionTable)
+{
+	check(IsInRenderingThread());
+
+	const int32 WaveSize = Data.WaveSize;
+	Data.Spectrum.Initialize(sizeof(float) * 4, (WaveSize + 1) * (WaveSize + 1), EPixelFormat::PF_A32B32G32R32F, BUF_Static);
+	Data.HeightBuffer.Initialize(sizeof(float) * 2, WaveSize, WaveSize * 2, EPixelFormat::PF_G32R32F);
+	Data.SlopeBuffer.Initialize(sizeof(float) * 4, WaveSize, WaveSize * 2, EPixelFormat::PF_A32B32G32R32F);
+	Data.DisplacementBuffer.Initialize(sizeof(float) * 4, WaveSize, WaveSize * 2, EPixelFormat::PF_A32B32G32R32F);
+
+	CreateTableSRV(RandomTable, PF_G32R32F, Data.RandomTableVB, Data.RandomTableSRV);
+	CreateTableSRV(ButterflyLookupTable, PF_R32_FLOAT, Data.ButterflyLookupTableVB, Data.ButterflyLookupTableSRV);
+	CreateTableSRV(DispersionTable, PF_R32_FLOAT, Data.DispersionTableVB, Data.DispersionTableSRV);
+}
+
+void FWaveSimulation::CreateRenderData()
+{
+	TSharedPtr<FWaveSimulationRenderData, ESPMode::ThreadSafe> NewRenderData = MakeShared<FWaveSimulationRenderData, ESPMode::ThreadSafe>();
+	NewRenderData->FeatureLevel = Key.World->Scene->GetFeatureLevel();
+	RenderData = NewRenderData;
+
+	for (int32 CascadeIndex = 0; CascadeIndex < Cascades.Num(); ++CascadeIndex)
+	{
+		const FWaveCascadeKey& CascadeKey = Key.Cascades[CascadeIndex];
+		const FCascade& Cascade = Cascades[CascadeIndex];
+		FWaveCascadeRenderData* NewCascade = new FWaveCascadeRenderData();
+		NewCascade->WaveSize = CascadeKey.WaveSize;
+		NewCascade->PatchLength = CascadeKey.PatchLength;
+		NewCascade->SpectrumKMin = CascadeKey.SpectrumKMin;
+		NewCascade->SpectrumKMax = CascadeKey.SpectrumKMax;
+		NewRenderData->Cascades.Add(NewCascade);
+
+		ENQUEUE_RENDER_COMMAND(FComputeFFT)([NewRenderData, NewCascade, RandomTable = Cascade.RandomTable, ButterflyLookupTable = Cascade.ButterflyLookupTable, DispersionTable = Cascade.DispersionTable, WaveAmplitude = Key.WaveAmplitude, WindSpeed = Key.WindSpeed](FRHICommandListImmediate& RHICmdList)
+		{
+			FWaveCascadeRenderData& Data = *NewCascade;
+			InitCascadeRenderData_RenderThread(Data, RandomTable, ButterflyLookupTable, DispersionTable);
+			ComputePhillipsSpecturm_RenderThread(RHICmdList, NewRenderData->FeatureLevel, Data.WaveSize, Data.PatchLength, WaveAmplitude, WindSpeed, Data.SpectrumKMin, Data.SpectrumKMax, Data.RandomTableSRV, Data.Spectrum.UAV);
+		});
+	}
+}
+
+void FWaveSimulation::UpdateRenderSpectrum(const TArray<bool, TInlineAllocator<MAX_WAVE_CASCADES>>& DispersionChanged)
 {
-	ENQUEUE_RENDER_COMMAND(FComputeFFT)([this](FRHICommandListImmediate& RHICmdList)
+	for (int32 CascadeIndex = 0; CascadeIndex < Cascades.Num(); ++CascadeIndex)
 	{
-		FRHIResourceCreateInfo RHIResourceCreateInfo;
-	
-		/// Test texture stride
-		/*FTexture2DRHIRef TestTexture = RHICreateTexture2D(256, 3, PF_R32_FLOAT, 1, 1, TexCreate_ShaderResource | TexCreate_UAV, RHIResourceCreateInfo);
-		uint32 Stride;
-		int32* Data = static_cast<int32*>(RHILockTexture2D(TestTexture, 0, EResourceLockMode::RLM_WriteOnly, Stride, false));
-		*Data++ = 1;
-		*Data++ = 2;
-		*Data++ = 3;
-		*Data++ = 4;
-		RHIUnlockTexture2D(TestTexture, 0, false);
-
-		int8* Data2 = static_cast<int8*>(RHILockTexture2D(TestTexture, 0, EResourceLockMode::RLM_ReadOnly, Stride, false));
-		int32 a = *(int32*)Data2;
-		int32 b = *(int32*)(Data2 + 4);
-		Data2 += Stride;
-		int32 c = *(int32*)Data2;
-		int32 d = *(int32*)(Data2 + 4);
-		RHIUnlockTexture2D(TestTexture, 0, false);*/
-
-		UWorld* World = GetWorld();
-		ERHIFeatureLevel::Type FeatureLevel = World->Scene->GetFeatureLevel();
-
-		CreateResources();
-		ComputePhillipsSpecturm_RenderThread(RHICmdList, FeatureLevel, WaveSize, PatchLength, WaveAmplitude, WindSpeed, RandomTableSRV, Spectrum->UAV, SpectrumConj->UAV);
+		const FWaveCascadeKey& CascadeKey = Key.Cascades[CascadeIndex];
+		TArray<float> DispersionTable;
+		if (DispersionChanged[CascadeIndex])
+			DispersionTable = Cascades[CascadeIndex].DispersionTable;
+
+		// The buffers are kept, so the frames already enqueued read either the old or the new spectrum, never a released one
+		ENQUEUE_RENDER_COMMAND(FUpdateWaveSpectrum)([Data = RenderData, CascadeIndex, CascadeKey, DispersionTable = MoveTemp(DispersionTable), WaveAmplitude = Key.WaveAmplitude, WindSpeed = Key.WindSpeed](FRHICommandListImmediate& RHICmdList)
+		{
+			FWaveCascadeRenderData& Cascade = Data->Cascades[CascadeIndex];
+			Cascade.PatchLength = CascadeKey.PatchLength;
+			Cascade.SpectrumKMin = CascadeKey.SpectrumKMin;
+			Cascade.SpectrumKMax = CascadeKey.SpectrumKMax;
+			if (DispersionTable.Num() > 0)
+				CreateTableSRV(DispersionTable, PF_R32_FLOAT, Cascade.DispersionTableVB, Cascade.DispersionTableSRV);
+			ComputePhillipsSpecturm_RenderThread(RHICmdList, Data->FeatureLevel, Cascade.WaveSize, Cascade.PatchLength, WaveAmplitude, WindSpeed, Cascade.SpectrumKMin, Cascade.SpectrumKMax, Cascade.RandomTableSRV, Cascade.Spectrum.UAV);
+		});
+	}
+}
+
+void FWaveSimulation::EvaluateWavesFFT(float TimeSeconds, bool bLongWavesOnly)
+{
+	// The render target resources are only got on game thread
+	TArray<TPair<FTextureRenderTargetResource*, FTextureRenderTargetResource*>, TInlineAllocator<MAX_WAVE_CASCADES>> OutputResources;
+	for (const FWaveCascadeKey& CascadeKey : Key.Cascades)
+	{
+		UTextureRenderTarget* HeightMapRenderTarget = CascadeKey.HeightMapRenderTarget.Get();
+		UTextureRenderTarget* NormalRenderTarget = CascadeKey.NormalRenderTarget.Get();
+		FTextureRenderTargetResource* HeightMapResource = HeightMapRenderTarget ? HeightMapRenderTarget->GameThread_GetRenderTargetResource() : nullptr;
+		FTextureRenderTargetResource* NormalResource = NormalRenderTarget ? NormalRenderTarget->GameThread_GetRenderTargetResource() : nullptr;
+		OutputResources.Emplace(HeightMapResource, NormalResource);
+	}
+
+	// All cascades in one command, every pass is issued for all of them before the next pass
+	ENQUEUE_RENDER_COMMAND(FEvaluateWavesFFT)([Data = RenderData, TimeSeconds, bUseSharedMemoryFFT = Key.bUseSharedMemoryFFT, bLongWavesOnly, OutputResources](FRHICommandListImmediate& RHICmdList)
+	{
+		// The cascades of the short waves keep their last result
+		auto IsSkipped = [&](const FWaveCascadeRenderData& Cascade)
+		{
+			return bLongWavesOnly && Cascade.PatchLength < Data->Cascades[0].PatchLength;
+		};
+
+		for (FWaveCascadeRenderData& Cascade : Data->Cascades)
+		{
+			if (IsSkipped(Cascade))
+				continue;
+			if (!bUseSharedMemoryFFT || !EvaluateWavesSharedFFT_RenderThread(RHICmdList, Data->FeatureLevel, TimeSeconds, Cascade.WaveSize, Cascade.PatchLength, Cascade.DispersionTableSRV, Cascade.Spectrum.SRV, &Cascade.HeightBuffer, &Cascade.SlopeBuffer, &Cascade.DisplacementBuffer))
+				EvaluateWavesFFT_RenderThread(RHICmdList, Data->FeatureLevel, TimeSeconds, Cascade.WaveSize, Cascade.PatchLength, 0, Cascade.ButterflyLookupTableSRV, Cascade.DispersionTableSRV, Cascade.Spectrum.SRV, &Cascade.HeightBuffer, &Cascade.SlopeBuffer, &Cascade.DisplacementBuffer);
+		}
+
+		for (int32 CascadeIndex = 0; CascadeIndex < Data->Cascades.Num(); ++CascadeIndex)
+		{
+			FWaveCascadeRenderData& Cascade = Data->Cascades[CascadeIndex];
+			FTextureRenderTargetResource* HeightMapResource = OutputResources[CascadeIndex].Key;
+			FTextureRenderTargetResource* NormalResource = OutputResources[CascadeIndex].Value;
+			if (HeightMapResource && NormalResource && !IsSkipped(Cascade))
+				ComputePosAndNormal_RenderThread(RHICmdList, Data->FeatureLevel, HeightMapResource, NormalResource, Cascade.WaveSize, Cascade.PatchLength, &Cascade.HeightBuffer, &Cascade.SlopeBuffer, &Cascade.DisplacementBuffer);
+		}
 	});
 }
 
-void AFFTWaveSimulator::PrepareForFFT(float TimeSeconds)
+void FWaveSimulation::UploadAnimationFrame()
 {
-	//float KX, KY, Len, Lambda = -1.f;
-	//int32 Index;
-	//uint32 Stride;
-	//FVector2D* HeightBufferData = static_cast<FVector2D*>(RHILockTexture2D(HeightBuffer, 0, EResourceLockMode::RLM_WriteOnly, Stride, false));
-	//HeightBufferData += Stride / sizeof(FVector2D);
-	//FVector4* SlopeBufferData = static_cast<FVector4*>(RHILockTexture2D(SlopeBuffer, 0, EResourceLockMode::RLM_WriteOnly, Stride, false));
-	//SlopeBufferData += Stride / sizeof(FVector4);
-	//FVector4* DisplacementBufferData = static_cast<FVector4*>(RHILockTexture2D(DisplacementBuffer, 0, EResourceLockMode::RLM_WriteOnly, Stride, false));
-	//DisplacementBufferData += Stride / sizeof(FVector4);
-
-	////Test buffer data
-	//TArray<FVector2D> HeightData;
-	//for (int32 i = 0; i < WaveSize * WaveSize; ++i)
-	//{
-	//	HeightData.Add(HeightBufferData[i]);
-	//}
-
-	//for (int32 m = 0; m < WaveSize; ++m)
-	//{
-	//	KY = PI * (2.f*m - WaveSize) / GridLength;
-	//	for (int32 n = 0; n < WaveSize; ++n)
-	//	{
-	//		KX = PI * (2.f*n - WaveSize) / GridLength;
-	//		Len = FMath::Sqrt(KX * KX + KY * KY);
-	//		Index = m * WaveSize + n;
-
-	//		FVector2D C = InitSpectrum(TimeSeconds, n, m);
-
-	//		HeightBufferData[Index].X = C.X;
-	//		HeightBufferData[Index].Y = C.Y;
-
-	//		SlopeBufferData[Index].X = -C.Y * KX;
-	//		SlopeBufferData[Index].Z = C.X * KX;
-	//		SlopeBufferData[Index].Y = -C.Y * KY;
-	//		SlopeBufferData[Index].Z = C.X * KY;
-
-	//		if (Len < 0.000001f)
-	//		{
-	//			DisplacementBufferData[Index].X = 0.f;
-	//			DisplacementBufferData[Index].Y = 0.f;
-	//			DisplacementBufferData[Index].Z = 0.f;
-	//			DisplacementBufferData[Index].W = 0.f;
-	//		}
-	//		else
-	//		{
-	//			DisplacementBufferData[Index].X = -C.Y * -(KX / Len);
-	//			DisplacementBufferData[Index].Y = C.X * -(KX / Len);
-	//			DisplacementBufferData[Index].Z = -C.Y * -(KY / Len);
-	//			DisplacementBufferData[Index].W = C.X * -(KY / Len);
-	//		}
-	//	}
-	//}
-
-	//// Unlock the buffers
-	//RHIUnlockTexture2D(HeightBuffer, 0, false);
-	//RHIUnlockTexture2D(SlopeBuffer, 0, false);
-	//RHIUnlockTexture2D(DisplacementBuffer, 0, false);
+	TArray<FWaveFFTGrid, TInlineAllocator<MAX_WAVE_CASCADES>> Grids;
+	TArray<TPair<FTextureRenderTargetResource*, FTextureRenderTargetResource*>, TInlineAllocator<MAX_WAVE_CASCADES>> OutputResources;
+	for (int32 CascadeIndex = 0; CascadeIndex < Cascades.Num(); ++CascadeIndex)
+	{
+		const FWaveCascadeKey& CascadeKey = Key.Cascades[CascadeIndex];
+		Grids.Add(Cascades[CascadeIndex].CachedGrid);
+
+		UTextureRenderTarget* HeightMapRenderTarget = CascadeKey.HeightMapRenderTarget.Get();
+		UTextureRenderTarget* NormalRenderTarget = CascadeKey.NormalRenderTarget.Get();
+		FTextureRenderTargetResource* HeightMapResource = HeightMapRenderTarget ? HeightMapRenderTarget->GameThread_GetRenderTargetResource() : nullptr;
+		FTextureRenderTargetResource* NormalResource = NormalRenderTarget ? NormalRenderTarget->GameThread_GetRenderTargetResource() : nullptr;
+		OutputResources.Emplace(HeightMapResource, NormalResource);
+	}
+
+	// The frame goes to the half where the FFT leaves its result, so ComputePosAndNormal reads it the same way
+	ENQUEUE_RENDER_COMMAND(FUploadWaveAnimationFrame)([Data = RenderData, Grids = MoveTemp(Grids), OutputResources](FRHICommandListImmediate& RHICmdList)
+	{
+		for (int32 CascadeIndex = 0; CascadeIndex < Data->Cascades.Num(); ++CascadeIndex)
+		{
+			FWaveCascadeRenderData& Cascade = Data->Cascades[CascadeIndex];
+			const FWaveFFTGrid& Grid = Grids[CascadeIndex];
+			const int32 WaveSize = Cascade.WaveSize;
+			check(Grid.WaveSize == WaveSize);
+
+			const FUpdateTextureRegion2D ResultRegion(0, WaveSize, 0, 0, WaveSize, WaveSize);
+			RHIUpdateTexture2D(Cascade.HeightBuffer.Buffer, 0, ResultRegion, WaveSize * sizeof(FVector2D), (const uint8*)Grid.Height.GetData());
+			RHIUpdateTexture2D(Cascade.SlopeBuffer.Buffer, 0, ResultRegion, WaveSize * sizeof(FVector4), (const uint8*)Grid.Slope.GetData());
+			RHIUpdateTexture2D(Cascade.DisplacementBuffer.Buffer, 0, ResultRegion, WaveSize * sizeof(FVector4), (const uint8*)Grid.Displacement.GetData());
+
+			FTextureRenderTargetResource* HeightMapResource = OutputResources[CascadeIndex].Key;
+			FTextureRenderTargetResource* NormalResource = OutputResources[CascadeIndex].Value;
+			if (HeightMapResource && NormalResource)
+				ComputePosAndNormal_RenderThread(RHICmdList, Data->FeatureLevel, HeightMapResource, NormalResource, WaveSize, Cascade.PatchLength, &Cascade.HeightBuffer, &Cascade.SlopeBuffer, &Cascade.DisplacementBuffer);
+		}
+	});
 }
 
-void AFFTWaveSimulator::EvaluateWavesFFT(float TimeSeconds)
+bool FWaveBenchmark::RunGPU(const FWaveBenchmarkConfig& Config, FWaveBenchmarkResult& OutResult)
 {
-	UWorld* World = GetWorld();
-	ERHIFeatureLevel::Type FeatureLevel = World->Scene->GetFeatureLevel();
+	check(IsInGameThread());
+	if (!FApp::CanEverRender() || !FMath::IsPowerOfTwo(Config.WaveSize))
+		return false;
+
+	const FWaveSimulationKey Key = MakeKey(Config);
+	OutResult = FWaveBenchmarkResult();
+	OutResult.Config = Config;
+	OutResult.Backend = TEXT("GPU");
+	OutResult.Stages.SetNum(EWaveBenchmarkStage::Num);
+	for (int32 StageIndex = 0; StageIndex < EWaveBenchmarkStage::Num; ++StageIndex)
+	{
+		OutResult.Stages[StageIndex].Name = GetStageName((EWaveBenchmarkStage::Type)StageIndex);
+	}
 
-	TWeakObjectPtr<AFFTWaveSimulator> WaveSimulatorPtr(this);
-	//GEngine->GetPreRenderDelegate().AddLambda();
-	if (!GEngine->PreRenderDelegate.IsBoundToObject(this))
+	// Tables are made on cpu as FWaveSimulation does
+	TArray<TArray<FVector2D>> RandomTables;
+	TArray<TArray<float>> ButterflyLookupTables;
+	TArray<TArray<float>> DispersionTables;
+	RandomTables.SetNum(Key.Cascades.Num());
+	ButterflyLookupTables.SetNum(Key.Cascades.Num());
+	DispersionTables.SetNum(Key.Cascades.Num());
+	double StartTime = FPlatformTime::Seconds();
+	for (int32 CascadeIndex = 0; CascadeIndex < Key.Cascades.Num(); ++CascadeIndex)
 	{
-		GEngine->PreRenderDelegate.AddWeakLambda(this, [FeatureLevel, this]() {
-			if (!bHasInit)return;
-			if (Spectrum && SpectrumConj && DisplacementBuffer && HeightBuffer && SlopeBuffer)
+		FWaveSimulation::CreateCascadeTables(Key.Cascades[CascadeIndex], Key.GetCascadeSeed(CascadeIndex), RandomTables[CascadeIndex], ButterflyLookupTables[CascadeIndex], DispersionTables[CascadeIndex]);
+	}
+	OutResult.Stages[EWaveBenchmarkStage::Tables].CPUMilliseconds = (FPlatformTime::Seconds() - StartTime) * 1000.0;
+
+	// Transient outputs of ComputePosAndNormal, the same format as the usual wave render targets
+	TArray<UTextureRenderTarget2D*> RenderTargets;
+	TArray<TPair<FTextureRenderTargetResource*, FTextureRenderTargetResource*>> OutputResources;
+	for (int32 CascadeIndex = 0; CascadeIndex < Key.Cascades.Num(); ++CascadeIndex)
+	{
+		FTextureRenderTargetResource* Resources[2];
+		for (int32 TargetIndex = 0; TargetIndex < 2; ++TargetIndex)
+		{
+			UTextureRenderTarget2D* RenderTarget = NewObject<UTextureRenderTarget2D>();
+			RenderTarget->AddToRoot();
+			RenderTarget->InitCustomFormat(Config.WaveSize, Config.WaveSize, PF_FloatRGBA, true);
+			RenderTarget->UpdateResourceImmediate(true);
+			RenderTargets.Add(RenderTarget);
+			Resources[TargetIndex] = RenderTarget->GameThread_GetRenderTargetResource();
+		}
+		OutputResources.Emplace(Resources[0], Resources[1]);
+	}
+
+	const ERHIFeatureLevel::Type FeatureLevel = GMaxRHIFeatureLevel;
+	ENQUEUE_RENDER_COMMAND(FWaveBenchmarkGPU)([&](FRHICommandListImmediate& RHICmdList)
+	{
+		// Every stage is flushed and waited alone, so the gpu time of it is not hidden by the next one
+		auto MeasureStage = [&](EWaveBenchmarkStage::Type Stage, TFunctionRef<void()> Work)
+		{
+			FRenderQueryRHIRef BeginQuery = RHICreateRenderQuery(RQT_AbsoluteTime);
+			FRenderQueryRHIRef EndQuery = RHICreateRenderQuery(RQT_AbsoluteTime);
+			RHICmdList.EndRenderQuery(BeginQuery);
+			const double StageStartTime = FPlatformTime::Seconds();
+			Work();
+			OutResult.Stages[Stage].CPUMilliseconds += (FPlatformTime::Seconds() - StageStartTime) * 1000.0;
+			RHICmdList.EndRenderQuery(EndQuery);
+			RHICmdList.ImmediateFlush(EImmediateFlushType::FlushRHIThread);
+
+			uint64 BeginMicroseconds = 0, EndMicroseconds = 0;
+			if (RHIGetRenderQueryResult(BeginQuery, BeginMicroseconds, true) && RHIGetRenderQueryResult(EndQuery, EndMicroseconds, true))
+				OutResult.Stages[Stage].GPUMilliseconds = FMath::Max(OutResult.Stages[Stage].GPUMilliseconds, 0.0) + (EndMicroseconds - BeginMicroseconds) / 1000.0;
+		};
+
+		TIndirectArray<FWaveCascadeRenderData, TInlineAllocator<MAX_WAVE_CASCADES>> Cascades;
+		for (int32 CascadeIndex = 0; CascadeIndex < Key.Cascades.Num(); ++CascadeIndex)
+		{
+			const FWaveCascadeKey& CascadeKey = Key.Cascades[CascadeIndex];
+			FWaveCascadeRenderData* Cascade = new FWaveCascadeRenderData();
+			Cascade->WaveSize = CascadeKey.WaveSize;
+			Cascade->PatchLength = CascadeKey.PatchLength;
+			Cascade->SpectrumKMin = CascadeKey.SpectrumKMin;
+			Cascade->SpectrumKMax = CascadeKey.SpectrumKMax;
+			Cascades.Add(Cascade);
+		}
+
+		MeasureStage(EWaveBenchmarkStage::Upload, [&]()
+		{
+			for (int32 CascadeIndex = 0; CascadeIndex < Cascades.Num(); ++CascadeIndex)
 			{
-				FRHICommandListImmediate& RHICmdList = GetImmediateCommandList_ForRenderCommand();
-				PrepareFFT_RenderThread(RHICmdList, FeatureLevel, GetWorld()->TimeSeconds * TimeRate, WaveSize, PatchLength, DispersionTableSRV, Spectrum, SpectrumConj, HeightBuffer, SlopeBuffer, DisplacementBuffer);
-				EvaluateWavesFFT_RenderThread(RHICmdList, FeatureLevel, GetWorld()->TimeSeconds, WaveSize, 0, ButterflyLookupTableSRV, HeightBuffer, SlopeBuffer, DisplacementBuffer);
+				InitCascadeRenderData_RenderThread(Cascades[CascadeIndex], RandomTables[CascadeIndex], ButterflyLookupTables[CascadeIndex], DispersionTables[CascadeIndex]);
+			}
+		});
 
-				ComputePositionAndNormal();
-				if (WaveHeightMapRenderTarget && WaveNormalRenderTarget)
-					ComputePosAndNormal_RenderThread(RHICmdList, FeatureLevel, WaveHeightMapRenderTarget->GetRenderTargetResource(), WaveNormalRenderTarget->GetRenderTargetResource(), WaveSize, PatchLength, HeightBuffer, SlopeBuffer, DisplacementBuffer);
+		MeasureStage(EWaveBenchmarkStage::PhillipsSpectrum, [&]()
+		{
+			for (FWaveCascadeRenderData& Cascade : Cascades)
+			{
+				ComputePhillipsSpecturm_RenderThread(RHICmdList, FeatureLevel, Cascade.WaveSize, Cascade.PatchLength, Key.WaveAmplitude, Key.WindSpeed, Cascade.SpectrumKMin, Cascade.SpectrumKMax, Cascade.RandomTableSRV, Cascade.Spectrum.UAV);
 			}
 		});
-	}
-	
 
-	/*ENQUEUE_RENDER_COMMAND(FComputeFFT)([FeatureLevel, TimeSeconds, WaveSimulatorPtr](FRHICommandListImmediate& RHICmdList)
+		for (int32 Frame = 0; Frame < Config.NumFrames; ++Frame)
+		{
+			const float TimeSeconds = Frame / 60.f;
+			// PrepareFFT is folded into the first FFT pass, so its time is in the FFT stage
+			MeasureStage(EWaveBenchmarkStage::FFT, [&]()
+			{
+				for (FWaveCascadeRenderData& Cascade : Cascades)
+				{
+					if (!Config.bUseSharedMemoryFFT || !EvaluateWavesSharedFFT_RenderThread(RHICmdList, FeatureLevel, TimeSeconds, Cascade.WaveSize, Cascade.PatchLength, Cascade.DispersionTableSRV, Cascade.Spectrum.SRV, &Cascade.HeightBuffer, &Cascade.SlopeBuffer, &Cascade.DisplacementBuffer))
+						EvaluateWavesFFT_RenderThread(RHICmdList, FeatureLevel, TimeSeconds, Cascade.WaveSize, Cascade.PatchLength, 0, Cascade.ButterflyLookupTableSRV, Cascade.DispersionTableSRV, Cascade.Spectrum.SRV, &Cascade.HeightBuffer, &Cascade.SlopeBuffer, &Cascade.DisplacementBuffer);
+				}
+			});
+
+			MeasureStage(EWaveBenchmarkStage::PosAndNormal, [&]()
+			{
+				for (int32 CascadeIndex = 0; CascadeIndex < Cascades.Num(); ++CascadeIndex)
+				{
+					FWaveCascadeRenderData& Cascade = Cascades[CascadeIndex];
+					ComputePosAndNormal_RenderThread(RHICmdList, FeatureLevel, OutputResources[CascadeIndex].Key, OutputResources[CascadeIndex].Value, Cascade.WaveSize, Cascade.PatchLength, &Cascade.HeightBuffer, &Cascade.SlopeBuffer, &Cascade.DisplacementBuffer);
+				}
+			});
+		}
+
+		for (const FWaveCascadeRenderData& Cascade : Cascades)
+		{
+			const int64 SpectrumSize = (int64)(Cascade.WaveSize + 1) * (Cascade.WaveSize + 1);
+			const int64 TextureSize = (int64)Cascade.WaveSize * Cascade.WaveSize * 2;
+			OutResult.MemoryBytes += SpectrumSize * sizeof(FVector4);
+			OutResult.MemoryBytes += TextureSize * (sizeof(FVector2D) + sizeof(FVector4) * 2);
+			OutResult.MemoryBytes += Cascade.RandomTableVB->GetSize() + Cascade.ButterflyLookupTableVB->GetSize() + Cascade.DispersionTableVB->GetSize();
+			// Height and normal targets of PF_FloatRGBA
+			OutResult.MemoryBytes += (int64)Cascade.WaveSize * Cascade.WaveSize * 8 * 2;
+		}
+	});
+	FlushRenderingCommands();
+
+	for (UTextureRenderTarget2D* RenderTarget : RenderTargets)
 	{
+		RenderTarget->RemoveFromRoot();
+	}
 
-	});*/
-}
\ No newline at end of file
+	// Per frame stages are reported for one frame
+	for (int32 StageIndex = EWaveBenchmarkStage::PrepareFFT; StageIndex < EWaveBenchmarkStage::Num; ++StageIndex)
+	{
+		FWaveBenchmarkStage& Stage = OutResult.Stages[StageIndex];
+		Stage.CPUMilliseconds /= FMath::Max(Config.NumFrames, 1);
+		if (Stage.GPUMilliseconds >= 0.0)
+			Stage.GPUMilliseconds /= FMath::Max(Config.NumFrames, 1);
+	}
+	return true;
+}
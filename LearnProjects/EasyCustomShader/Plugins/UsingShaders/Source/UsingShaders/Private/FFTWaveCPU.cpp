@@ -0,0 +1,302 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "FFTWaveCPU.h"
+#include "Async/ParallelFor.h"
+
+// Same constants as FFTWave.usf, the shader uses a short PI so the cpu does too
+#define WAVE_SHADER_PI 3.1415f
+#define WAVE_SHADER_GRAVITY 9.8f
+
+/** FFT() of FFTWave.usf for two complex numbers, A + W * B, WReal is (wr, wr, wr, wr) and WImag is (-wi, wi, -wi, wi) */
+static FORCEINLINE VectorRegister ButterflyTwoComplex(const VectorRegister& A, const VectorRegister& B, const VectorRegister& WReal, const VectorRegister& WImag)
+{
+	return VectorMultiplyAdd(WImag, VectorSwizzle(B, 1, 0, 3, 2), VectorMultiplyAdd(WReal, B, A));
+}
+
+static FORCEINLINE FVector2D ButterflyComplex(const FVector2D& A, const FVector2D& B, float WR, float WI)
+{
+	return FVector2D(A.X + WR * B.X - WI * B.Y, A.Y + WI * B.X + WR * B.Y);
+}
+
+void FWaveFFTCPU::Init(int32 InWaveSize, float InPatchLength, float InWaveAmplitude, const FVector& InWindSpeed, const TArray<FVector2D>& RandomTable, const TArray<float>& InDispersionTable, const TArray<float>& InButterflyLookupTable, float InSpectrumKMin, float InSpectrumKMax)
+{
+	check(FMath::IsPowerOfTwo(InWaveSize) && InWaveSize >= 2);
+
+	WaveSize = InWaveSize;
+	Passes = FMath::RoundToInt(FMath::Log2(WaveSize));
+	PatchLength = InPatchLength;
+	WaveAmplitude = InWaveAmplitude;
+	WindSpeed = InWindSpeed;
+	SpectrumKMin = InSpectrumKMin;
+	SpectrumKMax = InSpectrumKMax;
+	DispersionTable = InDispersionTable;
+	ButterflyLookupTable = InButterflyLookupTable;
+	check(DispersionTable.Num() >= (WaveSize + 1) * (WaveSize + 1));
+	check(ButterflyLookupTable.Num() >= WaveSize * Passes * 4);
+
+	// PhillipsSpectrumCS
+	const int32 SpectrumSize = WaveSize + 1;
+	Spectrum.SetNumUninitialized(SpectrumSize * SpectrumSize);
+	for (int32 m = 0; m < SpectrumSize; ++m)
+	{
+		for (int32 n = 0; n < SpectrumSize; ++n)
+		{
+			const int32 Index = m * SpectrumSize + n;
+			const FVector2D H0 = GetSpectrum(RandomTable, n, m);
+			const FVector2D Conj = GetSpectrum(RandomTable, -n, -m);
+			Spectrum[Index] = FVector4(H0.X, H0.Y, Conj.X, -Conj.Y);
+		}
+	}
+
+	Grids[0].Init(WaveSize);
+	Grids[1].Init(WaveSize);
+	ResultIndex = 1;
+}
+
+void FWaveFFTCPU::Release()
+{
+	WaveSize = 0;
+	Passes = 0;
+	Spectrum.Empty();
+	DispersionTable.Empty();
+	ButterflyLookupTable.Empty();
+	Grids[0] = FWaveFFTGrid();
+	Grids[1] = FWaveFFTGrid();
+}
+
+SIZE_T FWaveFFTCPU::GetAllocatedSize() const
+{
+	SIZE_T Size = Spectrum.GetAllocatedSize() + DispersionTable.GetAllocatedSize() + ButterflyLookupTable.GetAllocatedSize();
+	for (const FWaveFFTGrid& Grid : Grids)
+	{
+		Size += Grid.Height.GetAllocatedSize() + Grid.Slope.GetAllocatedSize() + Grid.Displacement.GetAllocatedSize();
+	}
+	return Size;
+}
+
+float FWaveFFTCPU::PhillipsSpectrum(int32 n, int32 m) const
+{
+	FVector2D K(WAVE_SHADER_PI * (2 * n - WaveSize) / PatchLength, WAVE_SHADER_PI * (2 * m - WaveSize) / PatchLength);
+	const float KLength = K.Size();
+	if (KLength < 0.000001f || KLength < SpectrumKMin || KLength >= SpectrumKMax)
+		return 0.f;
+	const float KLength2 = KLength * KLength;
+	const float KLength4 = KLength2 * KLength2;
+
+	K /= KLength;
+	const float KDotW = K | FVector2D(WindSpeed).GetSafeNormal();
+	const float KDotW2 = KDotW * KDotW;
+
+	const float WindLength = FVector2D(WindSpeed).Size();
+	const float L = WindLength * WindLength / WAVE_SHADER_GRAVITY;
+	const float L2 = L * L;
+
+	const float Damping = 0.001f;
+	const float DampingL2 = L2 * Damping * Damping;
+	return WaveAmplitude * FMath::Exp(-1.f / (KLength2 * L2)) / KLength4 * KDotW2 * FMath::Exp(-KLength2 * DampingL2);
+}
+
+FVector2D FWaveFFTCPU::GetSpectrum(const TArray<FVector2D>& RandomTable, int32 n, int32 m) const
+{
+	// The index is a uint in the shader, the negative ones of the conj read out of the buffer and get zero
+	const int32 Index = m * (WaveSize + 1) + n;
+	const FVector2D Random = RandomTable.IsValidIndex(Index) ? RandomTable[Index] : FVector2D::ZeroVector;
+	return Random * FMath::Sqrt(PhillipsSpectrum(n, m) / 2.f);
+}
+
+FVector2D FWaveFFTCPU::InitSpectrum(float TimeSeconds, int32 n, int32 m) const
+{
+	const int32 Index = m * (WaveSize + 1) + n;
+	const float Omegat = DispersionTable[Index] * TimeSeconds;
+
+	float Sin, Cos;
+	FMath::SinCos(&Sin, &Cos, Omegat);
+
+	const FVector4& H0 = Spectrum[Index];
+	const float C0a = H0.X * Cos - H0.Y * Sin;
+	const float C0b = H0.X * Sin + H0.Y * Cos;
+	const float C1a = H0.Z * Cos - H0.W * -Sin;
+	const float C1b = H0.Z * -Sin + H0.W * Cos;
+	return FVector2D(C0a + C1a, C0b + C1b);
+}
+
+void FWaveFFTCPU::PrepareForFFT(float TimeSeconds, bool bForceSingleThread)
+{
+	check(IsInitialized());
+
+	// The first horizontal pass reads the half which is not written by it, same as the gpu textures
+	FWaveFFTGrid& Dest = Grids[1];
+	ParallelFor(WaveSize, [&](int32 m)
+	{
+		const float KY = WAVE_SHADER_PI * (2.f * m - WaveSize) / PatchLength;
+		for (int32 n = 0; n < WaveSize; ++n)
+		{
+			const float KX = WAVE_SHADER_PI * (2.f * n - WaveSize) / PatchLength;
+			const float Len = FMath::Sqrt(KX * KX + KY * KY);
+			const int32 Index = m * WaveSize + n;
+
+			const FVector2D C = InitSpectrum(TimeSeconds, n, m);
+			Dest.Height[Index] = C;
+			Dest.Slope[Index] = FVector4(-C.Y * KX, C.X * KX, -C.X * KY, C.Y * KY);
+			Dest.Displacement[Index] = Len < 0.000001f ? FVector4(0.f, 0.f, 0.f, 0.f) : FVector4(-C.Y * -(KX / Len), C.X * -(KX / Len), -C.Y * -(KY / Len), C.X * -(KY / Len));
+		}
+	}, bForceSingleThread);
+}
+
+void FWaveFFTCPU::PerformFFTPass(bool bHorizontal, int32 Pass, const FWaveFFTGrid& Source, FWaveFFTGrid& Dest, bool bForceSingleThread) const
+{
+	const float* PassTable = &ButterflyLookupTable[4 * Pass * WaveSize];
+
+	ParallelFor(WaveSize, [&](int32 Row)
+	{
+		const int32 RowOffset = Row * WaveSize;
+		if (bHorizontal)
+		{
+			// Every texel of the row has its own butterfly
+			for (int32 Column = 0; Column < WaveSize; ++Column)
+			{
+				const float* Butterfly = &PassTable[4 * Column];
+				const int32 X = RowOffset + (int32)Butterfly[0];
+				const int32 Y = RowOffset + (int32)Butterfly[1];
+				const VectorRegister WReal = VectorSetFloat1(Butterfly[2]);
+				const VectorRegister WImag = MakeVectorRegister(-Butterfly[3], Butterfly[3], -Butterfly[3], Butterfly[3]);
+				const int32 Index = RowOffset + Column;
+
+				Dest.Height[Index] = ButterflyComplex(Source.Height[X], Source.Height[Y], Butterfly[2], Butterfly[3]);
+				VectorStore(ButterflyTwoComplex(VectorLoad(&Source.Slope[X]), VectorLoad(&Source.Slope[Y]), WReal, WImag), &Dest.Slope[Index]);
+				VectorStore(ButterflyTwoComplex(VectorLoad(&Source.Displacement[X]), VectorLoad(&Source.Displacement[Y]), WReal, WImag), &Dest.Displacement[Index]);
+			}
+		}
+		else
+		{
+			// The whole row shares one butterfly and reads two source rows, two heights fit in one register
+			const float* Butterfly = &PassTable[4 * Row];
+			const int32 X = (int32)Butterfly[0] * WaveSize;
+			const int32 Y = (int32)Butterfly[1] * WaveSize;
+			const VectorRegister WReal = VectorSetFloat1(Butterfly[2]);
+			const VectorRegister WImag = MakeVectorRegister(-Butterfly[3], Butterfly[3], -Butterfly[3], Butterfly[3]);
+
+			for (int32 Column = 0; Column < WaveSize; Column += 2)
+			{
+				VectorStore(ButterflyTwoComplex(VectorLoad(&Source.Height[X + Column]), VectorLoad(&Source.Height[Y + Column]), WReal, WImag), &Dest.Height[RowOffset + Column]);
+			}
+			for (int32 Column = 0; Column < WaveSize; ++Column)
+			{
+				VectorStore(ButterflyTwoComplex(VectorLoad(&Source.Slope[X + Column]), VectorLoad(&Source.Slope[Y + Column]), WReal, WImag), &Dest.Slope[RowOffset + Column]);
+				VectorStore(ButterflyTwoComplex(VectorLoad(&Source.Displacement[X + Column]), VectorLoad(&Source.Displacement[Y + Column]), WReal, WImag), &Dest.Displacement[RowOffset + Column]);
+			}
+		}
+	}, bForceSingleThread);
+}
+
+void FWaveFFTCPU::EvaluateFFT(bool bForceSingleThread)
+{
+	check(IsInitialized());
+
+	int32 SourceIndex = 1;
+	for (int32 Pass = 0; Pass < Passes; ++Pass)
+	{
+		PerformFFTPass(true, Pass, Grids[SourceIndex], Grids[1 - SourceIndex], bForceSingleThread);
+		SourceIndex = 1 - SourceIndex;
+	}
+	for (int32 Pass = 0; Pass < Passes; ++Pass)
+	{
+		PerformFFTPass(false, Pass, Grids[SourceIndex], Grids[1 - SourceIndex], bForceSingleThread);
+		SourceIndex = 1 - SourceIndex;
+	}
+	ResultIndex = SourceIndex;
+}
+
+void FWaveFFTCPU::Evaluate(float TimeSeconds, bool bForceSingleThread)
+{
+	PrepareForFFT(TimeSeconds, bForceSingleThread);
+	EvaluateFFT(bForceSingleThread);
+}
+
+void FWaveFFTGrid::GetPosOffsetAndNormal(int32 X, int32 Y, FVector& OutPosOffset, FVector& OutNormal) const
+{
+	// The shader reads the texel (Y, X), so row is X here
+	X = X & (WaveSize - 1);
+	Y = Y & (WaveSize - 1);
+	const int32 Index = X * WaveSize + Y;
+	const float Sign = ((X + Y) & 1) ? -1.f : 1.f;
+	const float Lambda = -1.f;
+
+	const FVector4& DisplacementTexel = Displacement[Index];
+	const FVector4& SlopeTexel = Slope[Index];
+	OutPosOffset = FVector(DisplacementTexel.Z * Lambda * Sign, DisplacementTexel.X * Lambda * Sign, Height[Index].X * Lambda * Sign);
+	OutNormal = FVector(-SlopeTexel.Z * Sign, -SlopeTexel.X * Sign, 1.f).GetSafeNormal();
+}
+
+void FWaveSurfaceMirror::Build(const FWaveFFTCPU& Wave, float InTimeSeconds, bool bForceSingleThread)
+{
+	check(Wave.IsInitialized());
+	Build(Wave.GetResult(), InTimeSeconds, bForceSingleThread);
+}
+
+void FWaveSurfaceMirror::Build(const FWaveFFTGrid& Grid, float InTimeSeconds, bool bForceSingleThread)
+{
+	check(Grid.WaveSize > 0);
+
+	WaveSize = Grid.WaveSize;
+	TimeSeconds = InTimeSeconds;
+	PosOffset.SetNumUninitialized(WaveSize * WaveSize);
+	Normal.SetNumUninitialized(WaveSize * WaveSize);
+	ParallelFor(WaveSize, [&](int32 Y)
+	{
+		for (int32 X = 0; X < WaveSize; ++X)
+		{
+			FVector TexelOffset, TexelNormal;
+			Grid.GetPosOffsetAndNormal(X, Y, TexelOffset, TexelNormal);
+			PosOffset[Y * WaveSize + X] = FVector4(TexelOffset, 0.f);
+			Normal[Y * WaveSize + X] = FVector4(TexelNormal, 0.f);
+		}
+	}, bForceSingleThread);
+}
+
+void FWaveSurfaceMirror::Sample(const FVector2D& TexelCoord, FVector& OutPosOffset, FVector& OutNormal) const
+{
+	check(WaveSize > 0);
+
+	// Same as ComputePosAndNormalPS, the 4 texels around are blended
+	const float FloorX = FMath::FloorToFloat(TexelCoord.X);
+	const float FloorY = FMath::FloorToFloat(TexelCoord.Y);
+	const int32 X0 = (int32)FloorX & (WaveSize - 1);
+	const int32 Y0 = (int32)FloorY & (WaveSize - 1);
+	const int32 X1 = (X0 + 1) & (WaveSize - 1);
+	const int32 Y1 = (Y0 + 1) & (WaveSize - 1);
+	const VectorRegister FracX = VectorSetFloat1(TexelCoord.X - FloorX);
+	const VectorRegister FracY = VectorSetFloat1(TexelCoord.Y - FloorY);
+
+	auto Bilinear = [&](const TArray<FVector4>& Grid)
+	{
+		const VectorRegister V00 = VectorLoad(&Grid[Y0 * WaveSize + X0]);
+		const VectorRegister V10 = VectorLoad(&Grid[Y0 * WaveSize + X1]);
+		const VectorRegister V01 = VectorLoad(&Grid[Y1 * WaveSize + X0]);
+		const VectorRegister V11 = VectorLoad(&Grid[Y1 * WaveSize + X1]);
+		const VectorRegister Top = VectorMultiplyAdd(VectorSubtract(V10, V00), FracX, V00);
+		const VectorRegister Bottom = VectorMultiplyAdd(VectorSubtract(V11, V01), FracX, V01);
+		return VectorMultiplyAdd(VectorSubtract(Bottom, Top), FracY, Top);
+	};
+
+	FVector4 Result;
+	VectorStore(Bilinear(PosOffset), &Result);
+	OutPosOffset = FVector(Result);
+	VectorStore(Bilinear(Normal), &Result);
+	OutNormal = FVector(Result).GetSafeNormal();
+}
+
+void FWaveSurfaceCascadeMirrors::Sample(const FVector2D& TexelCoord, FVector& OutPosOffset, FVector& OutNormal) const
+{
+	OutPosOffset = FVector::ZeroVector;
+	FVector2D Slope = FVector2D::ZeroVector;
+	for (const FWaveSurfaceMirror& Cascade : Cascades)
+	{
+		FVector CascadeOffset, CascadeNormal;
+		Cascade.Sample(TexelCoord * Cascade.TexelScale, CascadeOffset, CascadeNormal);
+		OutPosOffset += CascadeOffset;
+		Slope += FVector2D(CascadeNormal) / FMath::Max(CascadeNormal.Z, KINDA_SMALL_NUMBER);
+	}
+	OutNormal = FVector(Slope, 1.f).GetSafeNormal();
+}
@@ -13,10 +13,6 @@
 #include "Materials/MaterialInstanceDynamic.h"
 #include "Components/StaticMeshComponent.h"
 
-#define GRAVITY 9.8f
-
-extern void ComputeRandomTable(int32 Size, TArray<FVector2D>& OutTable);
-extern void ComputeButterflyLookuptable(int32 Size, int32 Passes, TArray<float>& OutTable);
 //extern int32 GHZBOcclusion;
 
 TMap<TSubclassOf<AFFTWaveSimulator>, TArray<AFFTWaveSimulator*>> GlobalRunningFFTWave;
@@ -61,31 +57,101 @@ void CreateWaveGridMesh(int32 HoriTiles, int32 VertTiles, int32 NumX, int32 NumY
 	}
 }
 
+// Vertices of a clipmap level farther than this from its center, in the half size of the level, start to morph to the next level
+static const float ClipmapMorphStart = 0.75f;
+
+/**
+ * Nested grids of GridCount cells across, level 0 is a full grid with the spacing GridSpacing and every next level is a ring
+ * around the last one with twice the spacing. Near the outer edge of a level the vertices morph to the even vertices of the level,
+ * which are the vertices of the next level, and the ones on the edge morph fully, so the levels meet without cracks.
+ * Vertices are relative to the center of the clipmap.
+ */
+void CreateWaveClipmapMesh(int32 Levels, int32 GridCount, float GridSpacing, TArray<int32>& Triangles, TArray<FVector>& Vertices)
+{
+	Triangles.Empty();
+	Vertices.Empty();
+
+	if (Levels < 1 || GridCount < 4 || GridCount % 4 != 0)
+		return;
+
+	const int32 HalfCount = GridCount / 2;
+	const int32 NumX = GridCount + 1;
+	TArray<int32> VertexIndices;
+	for (int32 Level = 0; Level < Levels; ++Level)
+	{
+		const float Spacing = GridSpacing * (1 << Level);
+		VertexIndices.Init(INDEX_NONE, NumX * NumX);
+		auto GetVertex = [&](int32 X, int32 Y)
+		{
+			int32& Index = VertexIndices[Y * NumX + X];
+			if (Index == INDEX_NONE)
+			{
+				const int32 GridX = X - HalfCount;
+				const int32 GridY = Y - HalfCount;
+				const float Distance = (float)FMath::Max(FMath::Abs(GridX), FMath::Abs(GridY)) / HalfCount;
+				const float Morph = FMath::Clamp((Distance - ClipmapMorphStart) / (1.f - ClipmapMorphStart), 0.f, 1.f);
+				// Odd vertices fall on the even one before them, as CDLOD does
+				const FVector2D Fine(GridX, GridY);
+				const FVector2D Coarse(GridX - (GridX & 1), GridY - (GridY & 1));
+				const FVector2D Position = FMath::Lerp(Fine, Coarse, Morph) * Spacing;
+				Index = Vertices.Add(FVector(Position, 0.f));
+			}
+			return Index;
+		};
+
+		for (int32 i = 0; i < GridCount; i++)
+		{
+			for (int32 j = 0; j < GridCount; j++)
+			{
+				// The hole is covered by the last level
+				const bool bInHole = Level > 0 && i >= HalfCount / 2 && i < HalfCount * 3 / 2 && j >= HalfCount / 2 && j < HalfCount * 3 / 2;
+				if (bInHole)
+					continue;
+
+				Triangles.Add(GetVertex(j, i));
+				Triangles.Add(GetVertex(j, i + 1));
+				Triangles.Add(GetVertex(j + 1, i));
+
+				Triangles.Add(GetVertex(j + 1, i));
+				Triangles.Add(GetVertex(j, i + 1));
+				Triangles.Add(GetVertex(j + 1, i + 1));
+			}
+		}
+	}
+}
+
 // Sets default values
 AFFTWaveSimulator::AFFTWaveSimulator():
 	WaveMesh(nullptr),
 	bUseStaticMesh(false),
 	WaveStaticMeshGridSize(100.f),
+	bUseClipmap(false),
+	ClipmapLevels(5),
+	ClipmapGridCount(64),
 	HorizontalTileCount(1),
 	VerticalTileCount(1),
 	MeshGridLength(100.f),
 	TimeRate(2.f),
 	WaveSize(64),
+	bUseSharedMemoryFFT(true),
+	bSimulateOnCPU(false),
+	bPlayAnimationCache(false),
+	AnimationCacheFrames(64),
 	PatchLength(1.f),
+	WaveSeed(0),
 	WaveHeightMapRenderTarget(nullptr),
+	bUseSignificance(true),
+	DistantSimulationDistance(100000.f),
+	DistantUpdateRate(10.f),
+	HiddenDelay(0.5f),
+	HiddenTickInterval(0.25f),
 	DrawNormal(false),
-	bHasInit(false)
+	bHasInit(false),
+	ClipmapCenter(FVector2D(BIG_NUMBER, BIG_NUMBER))
 {
  	// Set this actor to call Tick() every frame.  You can turn this off to improve performance if you don't need it.
 	PrimaryActorTick.bCanEverTick = true;
 
-	Spectrum = new FRWBuffer();
-	SpectrumConj = new FRWBuffer();
-
-	HeightBuffer = new FTextureRWBuffer2D();
-	SlopeBuffer = new FTextureRWBuffer2D();
-	DisplacementBuffer = new FTextureRWBuffer2D();
-
 	WindSpeed = FVector(10.f, 10.f, 0.f);
 	WaveAmplitude = 0.05f;
 	//if (bUseStaticMesh && GridMaterial)
@@ -173,19 +239,8 @@ void AFFTWaveSimulator::Destroyed()
 
 void AFFTWaveSimulator::ReleaseResource()
 {
-	ENQUEUE_RENDER_COMMAND(FRelseaseWaveResource)([=](FRHICommandListImmediate& RHICmdList)
-	{
-		if(Spectrum)delete Spectrum;
-		if(SpectrumConj)delete SpectrumConj;
-		if(HeightBuffer)delete HeightBuffer;
-		if(SlopeBuffer)delete SlopeBuffer;
-		if(DisplacementBuffer)delete DisplacementBuffer;
-	});
-	Spectrum = nullptr;
-	SpectrumConj = nullptr;
-	HeightBuffer = nullptr;
-	SlopeBuffer = nullptr;
-	DisplacementBuffer = nullptr;
+	// The simulation releases its buffers when the last tile leaves it
+	Simulation.Reset();
 }
 
 // Called every frame
@@ -195,19 +250,31 @@ void AFFTWaveSimulator::Tick(float DeltaTime)
 
 	InitWaveResource();
 
+	if (IsUsingClipmap())
+		UpdateClipmap();
+
 	if (GetWorld())
 	{
 		auto CurClass = GetClass();
 		TArray<AFFTWaveSimulator*>* Result = GlobalRunningFFTWave.Find(CurClass);
-		if (Result && (*Result).Num() > 0 && (*Result)[0] == this)
+		if (Simulation.IsValid())
 		{
-			EvaluateWavesFFT(GetWorld()->TimeSeconds);
+			// Only the first tile of the frame evaluates the shared simulation
+			const FWaveSignificance Significance = ComputeSignificance();
+			Simulation->Tick(ShouldSimulateOnCPU(), Significance);
+
+			// Nothing to do for a hidden tile until it is seen again, unless the cpu wave is still asked for
+			const bool bIdle = !Significance.IsNeeded() && !ShouldSimulateOnCPU() && !Simulation->ShouldSimulateOnCPU();
+			const float TickInterval = bIdle ? HiddenTickInterval : 0.f;
+			if (GetActorTickInterval() != TickInterval)
+				SetActorTickInterval(TickInterval);
 			
 			if (DrawNormal)
 			{
-				for (int32 i = 0; i < WaveVertices.Num(); ++i)
+				ComputePositionAndNormal();
+				for (int32 i = 0; i < WavePosition.Num(); ++i)
 				{
-					DrawDebugDirectionalArrow(GetWorld(), GetActorLocation() + WaveVertices[i] * (MeshGridLength / PatchLength), GetActorLocation() + WaveVertices[i] * (MeshGridLength / PatchLength) + WaveNormals[i] * 100.f, 20.f, FColor::Red, false, -1.f, 0, 5.f);
+					DrawDebugDirectionalArrow(GetWorld(), GetActorLocation() + WavePosition[i] * (MeshGridLength / PatchLength), GetActorLocation() + WavePosition[i] * (MeshGridLength / PatchLength) + WaveNormals[i] * 100.f, 20.f, FColor::Red, false, -1.f, 0, 5.f);
 				}
 
 				TArray<FColor> Colors;
@@ -232,57 +299,47 @@ void AFFTWaveSimulator::InitWaveResource()
 	if (WaveMesh)
 		WaveMesh->Bounds.BoxExtent.Z = 0.f;
 	CreateWaveGrid();
-	ComputeSpectrum();
 
-	bHasInit = true;
-}
+	// Tiles with the same spectrum share the tables, buffers and evaluation, a tile alone keeps its buffers when only the spectrum changes
+	if (GetWorld())
+		Simulation = FWaveSimulation::FindOrUpdate(Simulation, MakeSimulationKey());
 
-FVector2D AFFTWaveSimulator::InitSpectrum(float TimeSeconds, int32 n, int32 m)
-{
-	int32 Index = m * (WaveSize + 1) + n;
-	float Omegat = DispersionTable[Index] * TimeSeconds;
-
-	float Cos = FMath::Cos(Omegat);
-	float Sin = FMath::Sin(Omegat);
-
-	//uint32 Stride;
-	//if (Spectrum->GetSizeX() > (uint32)Index && SpectrumConj->GetSizeX() > (uint32)Index)
-	//{
-	//	FVector2D* SpectrumData = static_cast<FVector2D*>(RHILockTexture2D(Spectrum, 0, EResourceLockMode::RLM_ReadOnly, Stride, false));
-	//	//SpectrumData += m * Stride / sizeof(FVector2D);
-	//	float C0a = SpectrumData[Index].X*Cos - SpectrumData[Index].Y*Sin;
-	//	float C0b = SpectrumData[Index].X*Sin - SpectrumData[Index].Y*Cos;
-
-	//	TArray<FVector2D> AllData;
-	//	AllData.SetNum((WaveSize + 1)*(WaveSize + 1));
-	//	for (int32 i = 0; i < AllData.Num(); ++i)
-	//	{
-	//		AllData[i] = SpectrumData[i];
-	//	}
-
-	//	FVector2D* SpectrumConjData = static_cast<FVector2D*>(RHILockTexture2D(SpectrumConj, 0, EResourceLockMode::RLM_ReadOnly, Stride, false));
-	//	//SpectrumConjData += m * Stride / sizeof(FVector2D);
- //		float C1a = SpectrumConjData[Index].X*Cos - SpectrumConjData[Index].Y*-Sin;
-	//	float C1b = SpectrumConjData[Index].X*-Sin - SpectrumConjData[Index].Y*Cos;
-
-	//	//Unlock
-	//	RHIUnlockTexture2D(Spectrum, 0, false);
-	//	RHIUnlockTexture2D(SpectrumConj, 0, false);
-
-	//	return FVector2D(C0a + C1a, C0b + C1b);
-	//}
-
-	return FVector2D::ZeroVector;
+	bHasInit = true;
 }
 
-float AFFTWaveSimulator::Dispersion(int32 n, int32 m)
+FWaveSimulationKey AFFTWaveSimulator::MakeSimulationKey() const
 {
-	//float W_0 = 2.0f * PI / 200.f;  // Use this value, time will be slow, so that the wave will be slow too 
-	float W_0 = 1.f;
-	float KX = PI * (2 * n - WaveSize) / PatchLength; //k=2*PI*n/L
-	float KY = PI * (2 * m - WaveSize) / PatchLength;
-	// w=sqrt(g*|k|)
-	return FMath::FloorToFloat(FMath::Sqrt(GRAVITY * FMath::Sqrt(KX * KX + KY * KY) / W_0)) * W_0;
+	FWaveSimulationKey Key;
+	Key.World = GetWorld();
+	Key.Seed = (uint32)WaveSeed;
+	Key.WaveAmplitude = WaveAmplitude;
+	Key.WindSpeed = WindSpeed;
+	Key.TimeRate = TimeRate;
+	Key.bUseSharedMemoryFFT = bUseSharedMemoryFFT;
+	Key.AnimationCacheFrames = bPlayAnimationCache ? FMath::Max(AnimationCacheFrames, 2) : 0;
+
+	FWaveCascadeKey& TileCascade = Key.Cascades.AddDefaulted_GetRef();
+	TileCascade.WaveSize = WaveSize;
+	TileCascade.PatchLength = PatchLength;
+	TileCascade.HeightMapRenderTarget = WaveHeightMapRenderTarget;
+	TileCascade.NormalRenderTarget = WaveNormalRenderTarget;
+
+	for (const FWaveCascade& ExtraCascade : ExtraCascades)
+	{
+		if (Key.Cascades.Num() == MAX_WAVE_CASCADES)
+			break;
+		// The FFT passes only work on power of two sizes, like the tile cascade
+		if (ExtraCascade.WaveSize < 2 || !FMath::IsPowerOfTwo(ExtraCascade.WaveSize) || ExtraCascade.PatchLength <= 0.f)
+			continue;
+
+		FWaveCascadeKey& Cascade = Key.Cascades.AddDefaulted_GetRef();
+		Cascade.WaveSize = ExtraCascade.WaveSize;
+		Cascade.PatchLength = ExtraCascade.PatchLength;
+		Cascade.HeightMapRenderTarget = ExtraCascade.WaveHeightMapRenderTarget;
+		Cascade.NormalRenderTarget = ExtraCascade.WaveNormalRenderTarget;
+	}
+	Key.LimitCascadeBands();
+	return Key;
 }
 
 void AFFTWaveSimulator::CreateWaveGrid()
@@ -328,20 +385,34 @@ void AFFTWaveSimulator::CreateWaveGrid()
 		TArray<FProcMeshTangent> Tangents;
 		if (WaveMesh && WaveMesh->GetBodySetup())
 			WaveMesh->GetBodySetup()->bNeverNeedsCookedCollisionData = true;
-		CreateWaveGridMesh(HorizontalTileCount, VerticalTileCount, WaveSize + 1, WaveSize + 1, Triangles, WaveVertices, UVs, PatchLength);
+		if (bUseClipmap)
+		{
+			// Vertices are relative to the center, placed around the view by UpdateClipmap
+			CreateWaveClipmapMesh(FMath::Clamp(ClipmapLevels, 1, 8), FMath::Max(4, ClipmapGridCount / 4 * 4), PatchLength, Triangles, WaveVertices);
+			WaveNormals.Init(FVector::UpVector, WaveVertices.Num());
+			WavePosition.SetNum(WaveVertices.Num());
+			if (!GetClipmapCenter(ClipmapCenter))
+				ClipmapCenter = FVector2D::ZeroVector;
+			BuildClipmapVertices();
+		}
+		else
+		{
+			CreateWaveGridMesh(HorizontalTileCount, VerticalTileCount, WaveSize + 1, WaveSize + 1, Triangles, WaveVertices, UVs, PatchLength);
 
-		WaveNormals.SetNum((WaveSize + 1) * (WaveSize + 1));
-		WavePosition.SetNum((WaveSize + 1) * (WaveSize + 1));
+			WaveNormals.SetNum((WaveSize + 1) * (WaveSize + 1));
+			WavePosition.SetNum((WaveSize + 1) * (WaveSize + 1));
+		}
 
+		const TArray<FVector>& SectionVertices = bUseClipmap ? WavePosition : WaveVertices;
 		if (NewMesh)
 		{
 			if (NewMesh->GetNumSections() > 0)
 			{
 				NewMesh->ClearAllMeshSections();
-				NewMesh->CreateMeshSection(0, WaveVertices, Triangles, WaveNormals, UVs, Colors, Tangents, false);
+				NewMesh->CreateMeshSection(0, SectionVertices, Triangles, WaveNormals, UVs, Colors, Tangents, false);
 			}
 			else
-				NewMesh->CreateMeshSection(0, WaveVertices, Triangles, WaveNormals, UVs, Colors, Tangents, false);
+				NewMesh->CreateMeshSection(0, SectionVertices, Triangles, WaveNormals, UVs, Colors, Tangents, false);
 		}
 		WaveMesh = NewMesh;
 		SetRootComponent(WaveMesh);
@@ -355,137 +426,128 @@ void AFFTWaveSimulator::CreateWaveGrid()
 		DynMaterial->SetScalarParameterValue(WaveDisplacementScale, MeshGridLength / PatchLength);
 		DynMaterial->SetScalarParameterValue(WaveTexelOffset, 1.f / WaveSize);
 		DynMaterial->SetScalarParameterValue(WaveGradientZ, PatchLength);
-	}
 
-	DispersionTable.SetNum((WaveSize + 1) * (WaveSize + 1));
+		// A patch of the tile covers PatchLength / Cascade.PatchLength patches of the cascade
+		for (const FWaveCascade& ExtraCascade : ExtraCascades)
+		{
+			if (ExtraCascade.PatchLength <= 0.f)
+				continue;
+			if (ExtraCascade.WaveHeightMapRenderTarget)
+				DynMaterial->SetTextureParameterValue(ExtraCascade.HeightMapParameter, ExtraCascade.WaveHeightMapRenderTarget);
+			if (ExtraCascade.WaveNormalRenderTarget)
+				DynMaterial->SetTextureParameterValue(ExtraCascade.NormalMapParameter, ExtraCascade.WaveNormalRenderTarget);
+			DynMaterial->SetScalarParameterValue(ExtraCascade.UVScaleParameter, PatchLength / ExtraCascade.PatchLength);
+		}
+	}
+}
 
-	for (int32 i = 0; i < WaveSize + 1; ++i)
+void AFFTWaveSimulator::ComputePositionAndNormal()
+{
+	const FWaveFFTGrid* WaveResult = Simulation.IsValid() ? Simulation->GetWaveResult() : nullptr;
+	if (!WaveResult)
+		return;
+
+	// Same grid as CreateWaveGridMesh, the wave repeats every WaveSize vertices
+	const int32 HoriNum = WaveSize * HorizontalTileCount + 1;
+	const int32 VertNum = WaveSize * VerticalTileCount + 1;
+	if (WaveVertices.Num() != HoriNum * VertNum)
+		return;
+
+	WavePosition.SetNum(WaveVertices.Num());
+	WaveNormals.SetNum(WaveVertices.Num());
+	for (int32 i = 0; i < VertNum; ++i)
 	{
-		for (int32 j = 0; j < WaveSize + 1; ++j)
+		for (int32 j = 0; j < HoriNum; ++j)
 		{
-			int32 Index = i * (WaveSize + 1) + j;
-			DispersionTable[Index] = Dispersion(j, i);
+			const int32 Index = i * HoriNum + j;
+			FVector PosOffset;
+			WaveResult->GetPosOffsetAndNormal(j, i, PosOffset, WaveNormals[Index]);
+			WavePosition[Index] = WaveVertices[Index] + PosOffset;
 		}
 	}
 }
 
-void AFFTWaveSimulator::CreateResources()
+bool AFFTWaveSimulator::IsUsingClipmap() const
 {
-	if(Spectrum) Spectrum->Initialize(sizeof(float) * 2, (WaveSize + 1) * (WaveSize + 1), EPixelFormat::PF_G32R32F, BUF_Static);
-	if(SpectrumConj) SpectrumConj->Initialize(sizeof(float) * 2, (WaveSize + 1) * (WaveSize + 1), EPixelFormat::PF_G32R32F, BUF_Static);
-	if(HeightBuffer) HeightBuffer->Initialize(sizeof(float) * 2, WaveSize, WaveSize * 2, EPixelFormat::PF_G32R32F);
-	if(SlopeBuffer) SlopeBuffer->Initialize(sizeof(float) * 4, WaveSize, WaveSize * 2, EPixelFormat::PF_A32B32G32R32F);
-	if(DisplacementBuffer) DisplacementBuffer->Initialize(sizeof(float) * 4, WaveSize, WaveSize * 2, EPixelFormat::PF_A32B32G32R32F);
-	//FUnorderedAccessViewRHIRef TempTextureUAV = RHICreateUnorderedAccessView(TempTexture);
-
-	ComputeRandomTable(WaveSize + 1, RandomTable);
-	ComputeButterflyLookuptable(WaveSize, (int32)FMath::Log2(WaveSize), ButterflyLookupTable);
-
-	RandomTableVB.SafeRelease();
-	RandomTableSRV.SafeRelease();
-	ButterflyLookupTableVB.SafeRelease();
-	ButterflyLookupTableSRV.SafeRelease();
-	DispersionTableVB.SafeRelease();
-	DispersionTableSRV.SafeRelease();
-	FRHIResourceCreateInfo CreateInfo;
-	RandomTableVB = RHICreateVertexBuffer(RandomTable.Num() * sizeof(FVector2D), BUF_ShaderResource, CreateInfo);
-	RandomTableSRV = RHICreateShaderResourceView(RandomTableVB, sizeof(FVector2D), PF_G32R32F);
-
-	ButterflyLookupTableVB = RHICreateVertexBuffer(ButterflyLookupTable.Num() * sizeof(float), BUF_ShaderResource, CreateInfo);
-	ButterflyLookupTableSRV = RHICreateShaderResourceView(ButterflyLookupTableVB, sizeof(float), PF_R32_FLOAT);
-
-	DispersionTableVB = RHICreateVertexBuffer(DispersionTable.Num() * sizeof(float), BUF_ShaderResource, CreateInfo);
-	DispersionTableSRV = RHICreateShaderResourceView(DispersionTableVB, sizeof(float), PF_R32_FLOAT);
-
-	void* RandomTableData = RHILockVertexBuffer(RandomTableVB, 0, RandomTable.Num() * sizeof(FVector2D), RLM_WriteOnly);
-	FPlatformMemory::Memcpy(RandomTableData, RandomTable.GetData(), RandomTable.Num() * sizeof(FVector2D));
-	RHIUnlockVertexBuffer(RandomTableVB);
-
-	void* ButterflyLockedData = RHILockVertexBuffer(ButterflyLookupTableVB, 0, ButterflyLookupTable.Num() * sizeof(float), RLM_WriteOnly);
-	FPlatformMemory::Memcpy(ButterflyLockedData, ButterflyLookupTable.GetData(), ButterflyLookupTable.Num() * sizeof(float));
-	RHIUnlockVertexBuffer(ButterflyLookupTableVB);
-	
-	void* DispersionTableData = RHILockVertexBuffer(DispersionTableVB, 0, DispersionTable.Num() * sizeof(float), RLM_WriteOnly);
-	FPlatformMemory::Memcpy(DispersionTableData, DispersionTable.GetData(), DispersionTable.Num() * sizeof(float));
-	RHIUnlockVertexBuffer(DispersionTableVB);
+	return bUseClipmap && !(bUseStaticMesh && WaveStaticMesh) && Cast<UProceduralMeshComponent>(WaveMesh);
 }
 
-void AFFTWaveSimulator::ComputePositionAndNormal()
+float AFFTWaveSimulator::GetClipmapExtent() const
+{
+	return PatchLength * FMath::Max(4, ClipmapGridCount / 4 * 4) / 2 * (1 << (FMath::Clamp(ClipmapLevels, 1, 8) - 1));
+}
+
+bool AFFTWaveSimulator::GetClipmapCenter(FVector2D& OutCenter) const
 {
-	//if (DrawNormal && 
-	//	(int32)HeightBuffer->GetSizeX() >= WaveSize * WaveSize &&
-	//	(int32)SlopeBuffer->GetSizeX() >= WaveSize * WaveSize && 
-	//	(int32)DisplacementBuffer->GetSizeX() >= WaveSize * WaveSize && 
-	//	WaveVertices.Num() >= (WaveSize + 1) * (WaveSize + 1)
-	//	)
-	//{
-	//	uint32 Stride;
-	//	FVector2D* HeightBufferData = static_cast<FVector2D*>(RHILockTexture2D(HeightBuffer, 0, EResourceLockMode::RLM_ReadOnly, Stride, false));
-	//	HeightBufferData += Stride / sizeof(FVector2D);
-	//	FVector4* SlopeBufferData = static_cast<FVector4*>(RHILockTexture2D(SlopeBuffer, 0, EResourceLockMode::RLM_ReadOnly, Stride, false));
-	//	SlopeBufferData += Stride / sizeof(FVector4);
-	//	FVector4* DisplacementBufferData = static_cast<FVector4*>(RHILockTexture2D(DisplacementBuffer, 0, EResourceLockMode::RLM_ReadOnly, Stride, false));
-	//	DisplacementBufferData += Stride / sizeof(FVector4);
-
-	//	int32 Sign;
-	//	static float Signs[2] = { 1.f,-1.f };
-	//	float Lambda = -1.f;
-	//	for (int32 m = 0; m < WaveSize; ++m)
-	//	{
-	//		for (int32 n = 0; n < WaveSize; ++n)
-	//		{
-	//			int32 Index = m * WaveSize + n;
-	//			int32 Index1 = m * (WaveSize + 1) + n;
-
-	//			Sign = (int32)Signs[(n + m) & 1];
-
-	//			// Get height
-	//			WaveVertices[Index1].Z = HeightBufferData[Index].X * Sign;
-
-	//			// Get displacement
-	//			WaveVertices[Index1].X = WavePosition[Index1].X + DisplacementBufferData[Index].Z * Lambda * Sign;
-	//			WaveVertices[Index1].Y = WavePosition[Index1].Y + DisplacementBufferData[Index].X * Lambda * Sign;
-	//			
-	//			// Get normal
-	//			FVector Normal(-SlopeBufferData[Index].Z *Sign, -SlopeBufferData[Index].X *Sign, 1.f);
-	//			Normal.Normalize();
-
-	//			WaveNormals[Index1].X = Normal.X;
-	//			WaveNormals[Index1].Y = Normal.Y;
-	//			WaveNormals[Index1].Z = Normal.Z;
-
-	//			int32 TileIndex;
-	//			//Handle tiling
-	//			if (n == 0 && m == 0)
-	//			{
-	//				TileIndex = Index1 + WaveSize + (WaveSize + 1)*WaveSize;
-	//			}
-	//			else if (n == 0)
-	//			{
-	//				TileIndex = Index1 + WaveSize;
-	//			}
-	//			else if (m == 0)
-	//			{
-	//				TileIndex = Index1 + (WaveSize + 1) * WaveSize;
-	//			}
-	//			else
-	//				continue;
-
-	//			WaveVertices[TileIndex].Z = HeightBufferData[Index].X * Sign;
-	//			WaveVertices[TileIndex].X = WavePosition[TileIndex].X + DisplacementBufferData[Index].Z * Lambda * Sign;
-	//			WaveVertices[TileIndex].Y = WavePosition[TileIndex].Y + DisplacementBufferData[Index].X * Lambda * Sign;
-	//			
-	//			WaveNormals[TileIndex].X = Normal.X;
-	//			WaveNormals[TileIndex].Y = Normal.Y;
-	//			WaveNormals[TileIndex].Z = Normal.Z;
-	//		}
-	//	}
-
-	//	// Unlock the buffers
-	//	RHIUnlockTexture2D(HeightBuffer, 0, false);
-	//	RHIUnlockTexture2D(SlopeBuffer, 0, false);
-	//	RHIUnlockTexture2D(DisplacementBuffer, 0, false);
-	//}
+	UWorld* World = GetWorld();
+	if (!World || World->ViewLocationsRenderedLastFrame.Num() == 0)
+		return false;
+
+	// Snapped to twice the spacing of the last level, so the vertices of every level stay at the same place of the wave
+	const float SnapSize = PatchLength * (1 << FMath::Clamp(ClipmapLevels, 1, 8));
+	const FVector LocalViewLocation = GetActorTransform().InverseTransformPosition(World->ViewLocationsRenderedLastFrame[0]);
+	OutCenter = FVector2D(FMath::GridSnap(LocalViewLocation.X, SnapSize), FMath::GridSnap(LocalViewLocation.Y, SnapSize));
+	return true;
+}
+
+void AFFTWaveSimulator::BuildClipmapVertices()
+{
+	// Same uv as the grid of CreateWaveGridMesh, a uv unit is one patch of WaveSize cells
+	const float TileLength = PatchLength * WaveSize;
+	const FVector Center(ClipmapCenter, 0.f);
+	WavePosition.SetNum(WaveVertices.Num());
+	UVs.SetNum(WaveVertices.Num());
+	for (int32 i = 0; i < WaveVertices.Num(); ++i)
+	{
+		WavePosition[i] = WaveVertices[i] + Center;
+		UVs[i] = FVector2D(WavePosition[i]) / TileLength;
+	}
+}
+
+void AFFTWaveSimulator::UpdateClipmap()
+{
+	UProceduralMeshComponent* ProcMesh = Cast<UProceduralMeshComponent>(WaveMesh);
+	FVector2D NewCenter;
+	if (!ProcMesh || !GetClipmapCenter(NewCenter) || NewCenter == ClipmapCenter)
+		return;
+
+	// Only rebuilt when the view moves to the next snap, the vertex count is the same wherever the view is
+	ClipmapCenter = NewCenter;
+	BuildClipmapVertices();
+
+	TArray<FColor> Colors;
+	TArray<FProcMeshTangent> Tangents;
+	ProcMesh->UpdateMeshSection(0, WavePosition, WaveNormals, UVs, Colors, Tangents);
+}
+
+bool AFFTWaveSimulator::ShouldSimulateOnCPU() const
+{
+	return bSimulateOnCPU || DrawNormal;
+}
+
+FWaveSignificance AFFTWaveSimulator::ComputeSignificance() const
+{
+	FWaveSignificance Significance;
+	UWorld* World = GetWorld();
+	if (!bUseSignificance || DrawNormal || !World || !WaveMesh)
+		return Significance;
+
+	if (!WaveMesh->WasRecentlyRendered(HiddenDelay))
+		return FWaveSignificance::Hidden();
+
+	// Distance to the nearest view, every view of split screen or editor viewports counts
+	float MinDistanceSquared = BIG_NUMBER;
+	const FBox Bounds = WaveMesh->Bounds.GetBox();
+	for (const FVector& ViewLocation : World->ViewLocationsRenderedLastFrame)
+	{
+		MinDistanceSquared = FMath::Min(MinDistanceSquared, Bounds.ComputeSquaredDistanceToPoint(ViewLocation));
+	}
+	if (World->ViewLocationsRenderedLastFrame.Num() > 0 && MinDistanceSquared > FMath::Square(DistantSimulationDistance))
+	{
+		Significance.UpdateInterval = 1.f / FMath::Max(DistantUpdateRate, 1.f);
+		Significance.bLongWavesOnly = true;
+	}
+	return Significance;
 }
 
 FVector2D AFFTWaveSimulator::GetWaveDimension() const
@@ -493,11 +555,110 @@ FVector2D AFFTWaveSimulator::GetWaveDimension() const
 	const bool bCanUseStaticMesh = bUseStaticMesh && WaveStaticMesh;
 	if (bCanUseStaticMesh)
 		return FVector2D(WaveStaticMeshGridSize * WaveSize, WaveStaticMeshGridSize * WaveSize);
+	else if (IsUsingClipmap())
+		return FVector2D(GetClipmapExtent(), GetClipmapExtent()) * 2.f * (MeshGridLength / PatchLength);
 	else
 		return FVector2D(HorizontalTileCount * MeshGridLength * WaveSize, VerticalTileCount * MeshGridLength * WaveSize);
 }
 
+bool AFFTWaveSimulator::WorldToWaveTexel(const FVector& WorldPosition, FVector2D& OutTexelCoord) const
+{
+	// The root is scaled by CreateWaveGrid, so local space has the spacing of the mesh grid, and the grid is centered at the actor
+	const bool bCanUseStaticMesh = bUseStaticMesh && WaveStaticMesh;
+	const float GridSpacing = bCanUseStaticMesh ? WaveStaticMeshGridSize : PatchLength;
+	const FVector2D Extent = bCanUseStaticMesh ? FVector2D(WaveSize, WaveSize) * GridSpacing / 2 : FVector2D(WaveSize * HorizontalTileCount, WaveSize * VerticalTileCount) * GridSpacing / 2;
+	const FVector LocalPosition = GetActorTransform().InverseTransformPosition(WorldPosition);
+	if (IsUsingClipmap())
+	{
+		// The clipmap follows the view, and its uv is from the local position
+		const FVector2D FromCenter = FVector2D(LocalPosition) - ClipmapCenter;
+		if (FMath::Abs(FromCenter.X) > GetClipmapExtent() || FMath::Abs(FromCenter.Y) > GetClipmapExtent())
+			return false;
+
+		OutTexelCoord = FVector2D(LocalPosition) / PatchLength;
+		return true;
+	}
+	if (FMath::Abs(LocalPosition.X) > Extent.X || FMath::Abs(LocalPosition.Y) > Extent.Y)
+		return false;
+
+	OutTexelCoord = (FVector2D(LocalPosition) + Extent) / GridSpacing;
+	return true;
+}
+
+bool AFFTWaveSimulator::QueryWave(const FWaveSurfaceCascadeMirrors& Mirror, const FVector& WorldPosition, FWaveQueryResult& OutResult) const
+{
+	FVector2D TexelCoord;
+	if (!WorldToWaveTexel(WorldPosition, TexelCoord))
+		return false;
+
+	// Same scale as WaveDisplacementScale of the material
+	const float DisplacementScale = MeshGridLength / PatchLength;
+	const FQuat ActorQuat = GetActorQuat();
+	FVector PosOffset, Normal;
+	Mirror.Sample(TexelCoord, PosOffset, Normal);
+
+	// The grid is also moved horizontally, step back by the offset once to get the grid point which ends up near the position
+	const FVector HorizontalOffset = ActorQuat.RotateVector(FVector(PosOffset.X, PosOffset.Y, 0.f) * DisplacementScale);
+	if (WorldToWaveTexel(WorldPosition - HorizontalOffset, TexelCoord))
+		Mirror.Sample(TexelCoord, PosOffset, Normal);
+
+	OutResult.Displacement = ActorQuat.RotateVector(PosOffset * DisplacementScale);
+	OutResult.Normal = ActorQuat.RotateVector(Normal);
+	OutResult.Height = GetActorLocation().Z + OutResult.Displacement.Z;
+	OutResult.bValid = true;
+	return true;
+}
+
+void AFFTWaveSimulator::QueryWaves(const UWorld* World, TArrayView<const FVector> Positions, TArray<FWaveQueryResult>& OutResults)
+{
+	OutResults.Reset(Positions.Num());
+	OutResults.AddDefaulted(Positions.Num());
+	if (!World)
+		return;
+
+	// Take the mirror of every simulation once, so the whole batch sees the same time
+	TMap<FWaveSimulation*, TSharedPtr<const FWaveSurfaceCascadeMirrors, ESPMode::ThreadSafe>> Mirrors;
+	TArray<TPair<const AFFTWaveSimulator*, TSharedPtr<const FWaveSurfaceCascadeMirrors, ESPMode::ThreadSafe>>> Simulators;
+	for (auto& Pair : GlobalRunningFFTWave)
+	{
+		for (AFFTWaveSimulator* Simulator : Pair.Value)
+		{
+			if (!IsValid(Simulator) || Simulator->GetWorld() != World || !Simulator->Simulation.IsValid())
+				continue;
+
+			FWaveSimulation* WaveSimulation = Simulator->Simulation.Get();
+			TSharedPtr<const FWaveSurfaceCascadeMirrors, ESPMode::ThreadSafe>* Mirror = Mirrors.Find(WaveSimulation);
+			if (!Mirror)
+			{
+				WaveSimulation->MarkQueried();
+				Mirror = &Mirrors.Add(WaveSimulation, WaveSimulation->GetSurfaceMirror());
+			}
+			if (Mirror->IsValid())
+				Simulators.Emplace(Simulator, *Mirror);
+		}
+	}
+
+	for (int32 i = 0; i < Positions.Num(); ++i)
+	{
+		for (const auto& Simulator : Simulators)
+		{
+			if (Simulator.Key->QueryWave(*Simulator.Value, Positions[i], OutResults[i]))
+				break;
+		}
+	}
+}
+
+FWaveQueryResult AFFTWaveSimulator::QueryWave(const UWorld* World, const FVector& Position)
+{
+	TArray<FWaveQueryResult> Results;
+	QueryWaves(World, MakeArrayView(&Position, 1), Results);
+	return Results[0];
+}
+
 static FName Name_UseStaticMesh = GET_MEMBER_NAME_CHECKED(AFFTWaveSimulator, bUseStaticMesh);
+static FName Name_UseClipmap = GET_MEMBER_NAME_CHECKED(AFFTWaveSimulator, bUseClipmap);
+static FName Name_ClipmapLevels = GET_MEMBER_NAME_CHECKED(AFFTWaveSimulator, ClipmapLevels);
+static FName Name_ClipmapGridCount = GET_MEMBER_NAME_CHECKED(AFFTWaveSimulator, ClipmapGridCount);
 static FName Name_HorizontalTileCount = GET_MEMBER_NAME_CHECKED(AFFTWaveSimulator, HorizontalTileCount);
 static FName Name_VerticalTileCount = GET_MEMBER_NAME_CHECKED(AFFTWaveSimulator, VerticalTileCount);
 static FName Name_MeshGridLength = GET_MEMBER_NAME_CHECKED(AFFTWaveSimulator, MeshGridLength);
@@ -505,6 +666,10 @@ static FName Name_WaveSize = GET_MEMBER_NAME_CHECKED(AFFTWaveSimulator, WaveSize
 static FName Name_PatchLength = GET_MEMBER_NAME_CHECKED(AFFTWaveSimulator, PatchLength);
 static FName Name_WaveAmplitude = GET_MEMBER_NAME_CHECKED(AFFTWaveSimulator, WaveAmplitude);
 static FName Name_WindSpeed = GET_MEMBER_NAME_CHECKED(AFFTWaveSimulator, WindSpeed);
+static FName Name_WaveSeed = GET_MEMBER_NAME_CHECKED(AFFTWaveSimulator, WaveSeed);
+static FName Name_ExtraCascades = GET_MEMBER_NAME_CHECKED(AFFTWaveSimulator, ExtraCascades);
+static FName Name_PlayAnimationCache = GET_MEMBER_NAME_CHECKED(AFFTWaveSimulator, bPlayAnimationCache);
+static FName Name_AnimationCacheFrames = GET_MEMBER_NAME_CHECKED(AFFTWaveSimulator, AnimationCacheFrames);
 
 static int32 MacroNum = (void(0), 1);
 
@@ -515,13 +680,20 @@ void AFFTWaveSimulator::PostEditChangeProperty(FPropertyChangedEvent& PropertyCh
 	const FName MemberPropertyName = MemberPropertyThatChanged != NULL ? MemberPropertyThatChanged->GetFName() : NAME_None;
 
 	bool bWaveProperyChanged = MemberPropertyName == Name_UseStaticMesh ||
+							   MemberPropertyName == Name_UseClipmap ||
+							   MemberPropertyName == Name_ClipmapLevels ||
+							   MemberPropertyName == Name_ClipmapGridCount ||
 							   MemberPropertyName == Name_HorizontalTileCount ||
 							   MemberPropertyName == Name_VerticalTileCount ||
 							   MemberPropertyName == Name_MeshGridLength ||
 							   MemberPropertyName == Name_WaveSize ||
 							   MemberPropertyName == Name_PatchLength ||
 							   MemberPropertyName == Name_WaveAmplitude ||
-							   MemberPropertyName == Name_WindSpeed;
+							   MemberPropertyName == Name_WindSpeed ||
+							   MemberPropertyName == Name_WaveSeed ||
+							   MemberPropertyName == Name_ExtraCascades ||
+							   MemberPropertyName == Name_PlayAnimationCache ||
+							   MemberPropertyName == Name_AnimationCacheFrames;
 	if (bWaveProperyChanged)
 	{
 		bHasInit = false;
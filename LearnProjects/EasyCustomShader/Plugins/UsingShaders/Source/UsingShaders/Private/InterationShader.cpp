@@ -13,36 +13,11 @@
 #include "Engine/World.h"
 #include "SceneInterface.h"
 #include "BlurComputeShader.h"
+#include "RenderTargetPool.h"
+#include "Common.h"
 #include "RHICommandList.h"
 
 
-struct FVertexInput
-{
-	FVector4 Position;
-	FVector2D UV;
-};
-
-class FInterationDeclaration : public FRenderResource
-{
-public:
-	FVertexDeclarationRHIRef VertexDeclarationRHI;
-
-	virtual void InitRHI()override
-	{
-		//ö벼
-		FVertexDeclarationElementList Elements;
-		uint32 Stride = sizeof(FVertexInput);   //
-		Elements.Add(FVertexElement(0, STRUCT_OFFSET(FVertexInput, Position), EVertexElementType::VET_Float4, 0, Stride));  //һStreamӦInstanceʹ
-		Elements.Add(FVertexElement(0, STRUCT_OFFSET(FVertexInput, UV), EVertexElementType::VET_Float2, 1, Stride));
-		VertexDeclarationRHI = RHICreateVertexDeclaration(Elements);
-	}
-
-	virtual void ReleaseRHI()override
-	{
-		VertexDeclarationRHI.SafeRelease();
-	}
-};
-
 class FInterationShader : public FGlobalShader
 {
 public:
@@ -127,38 +102,6 @@ IMPLEMENT_SHADER_TYPE(, FInterationShaderVS, TEXT("/Plugins/Shaders/Private/Inte
 IMPLEMENT_SHADER_TYPE(, FInterationShaderPS, TEXT("/Plugins/Shaders/Private/InterationShader.usf"),TEXT("MainPS"), SF_Pixel)
 
 
-static void DrawIndexedPrimitiveUP_cpy2(
-	FRHICommandList& RHICmdList,
-	uint32 PrimitiveType,
-	uint32 MinVertexIndex,
-	uint32 NumVertices,
-	uint32 NumPrimitives,
-	const void* IndexData,
-	uint32 IndexDataStride,
-	const void* VertexData,
-	uint32 VertexDataStride)
-{
-	const uint32 NumIndices = GetVertexCountForPrimitiveCount(NumPrimitives, PrimitiveType);
-
-	FRHIResourceCreateInfo CreateInfo;
-	FVertexBufferRHIRef VertexBufferRHI = RHICreateVertexBuffer(VertexDataStride * NumVertices, BUF_Volatile, CreateInfo);        //BufǸĶͣû֡д룬ΪBUF_Volatile
-	void* VoidPtr = RHILockVertexBuffer(VertexBufferRHI, 0, VertexDataStride * NumVertices, RLM_WriteOnly);        //lock㻺bufferֻд
-	FPlatformMemory::Memcpy(VoidPtr, VertexData, VertexDataStride * NumVertices);       //붥
-	RHIUnlockVertexBuffer(VertexBufferRHI);    //unlock㻺
-
-	//ͬϴһ
-	FIndexBufferRHIRef IndexBufferRHI = RHICreateIndexBuffer(IndexDataStride, IndexDataStride * NumIndices, BUF_Volatile, CreateInfo);
-	void* VoidPtr2 = RHILockIndexBuffer(IndexBufferRHI, 0, IndexDataStride * NumIndices, RLM_WriteOnly);
-	FPlatformMemory::Memcpy(VoidPtr2, IndexData, IndexDataStride * NumIndices);
-	RHIUnlockIndexBuffer(IndexBufferRHI);
-
-	RHICmdList.SetStreamSource(0, VertexBufferRHI, 0);     //Բͬͼνӿö㻺
-	RHICmdList.DrawIndexedPrimitive(IndexBufferRHI, MinVertexIndex, 0, NumVertices, 0, NumPrimitives, 1);        //ͼԪ
-
-	IndexBufferRHI.SafeRelease();
-	VertexBufferRHI.SafeRelease();
-}
-
 static void DrawInterationShaderRenderTarget_RenderThread(
 	FRHICommandListImmediate& RHICmdList,
 	FTextureRenderTargetResource* OutputRenderTargetResource,
@@ -194,38 +137,20 @@ static void DrawInterationShaderRenderTarget_RenderThread(
 	TShaderMapRef<FInterationShaderVS> VertexShader(GlobalShaderMap);
 	TShaderMapRef<FInterationShaderPS> PixelShader(GlobalShaderMap);        //ȡԶShader
 
-	FInterationDeclaration VertexDeclaration;   
-	VertexDeclaration.InitRHI(); //벼
-
 	FGraphicsPipelineStateInitializer GraphicPSPoint;
 	RHICmdList.ApplyCachedRenderTargets(GraphicPSPoint);
 	GraphicPSPoint.DepthStencilState = TStaticDepthStencilState<false, CF_Always>::GetRHI();
 	GraphicPSPoint.BlendState = TStaticBlendState<>::GetRHI();
 	GraphicPSPoint.RasterizerState = TStaticRasterizerState<>::GetRHI();
 	GraphicPSPoint.PrimitiveType = PT_TriangleList;        //ƵͼԪ
-	GraphicPSPoint.BoundShaderState.VertexDeclarationRHI = VertexDeclaration.VertexDeclarationRHI;
+	GraphicPSPoint.BoundShaderState.VertexDeclarationRHI = GCommonVertexDeclaration.VertexDeclarationRHI;
 	GraphicPSPoint.BoundShaderState.VertexShaderRHI = GETSAFERHISHADER_VERTEX(*VertexShader);
 	GraphicPSPoint.BoundShaderState.PixelShaderRHI = GETSAFERHISHADER_PIXEL(*PixelShader);
 	SetGraphicsPipelineState(RHICmdList, GraphicPSPoint);
 
 	PixelShader->SetParameters(RHICmdList, MyColor, MyTexture);    //Shaderһɫһ
 
-	FVertexInput Vertices[4];
-	Vertices[0].Position.Set(-1.0f, 1.0f, 0, 1.0f);
-	Vertices[1].Position.Set(1.0f, 1.0f, 0, 1.0f);
-	Vertices[2].Position.Set(-1.0f, -1.0f, 0, 1.0f);
-	Vertices[3].Position.Set(1.0f, -1.0f, 0, 1.0f);
-	Vertices[0].UV = FVector2D(0.0f, 1.0f);
-	Vertices[1].UV = FVector2D(1.0f, 1.0f);
-	Vertices[2].UV = FVector2D(0.0f, 0.0f);
-	Vertices[3].UV = FVector2D(1.0f, 0.0f);
-    static const uint16 Indices[6] =  
-    {  
-        0, 1, 2,  
-        2, 1, 3  
-    };  
-
-	DrawIndexedPrimitiveUP_cpy2(RHICmdList, PT_TriangleList, 0, ARRAY_COUNT(Vertices), 2, Indices, sizeof(Indices[0]), Vertices, sizeof(Vertices[0]));
+	DrawCommonQuad(RHICmdList);
 	//RHICmdList.CopyToResolveTarget(OutputRenderTargetResource->GetRenderTargetTexture(), OutputRenderTargetResource->TextureRHI, FResolveParams());
 
 	RHICmdList.EndRenderPass();
@@ -259,30 +184,18 @@ void UInterationShaderBlueprintLibrary::DrawInterationShaderRenderTarget_Blur(cl
 {
 	check(IsInGameThread());
 
-	if (!OutputRenderTarget)return;
+	if (!OutputRenderTarget || !MyTexture || !MyTexture->Resource)return;
 
 	FTextureRenderTargetResource* TextureRenderTargetResource = OutputRenderTarget->GameThread_GetRenderTargetResource();
-	FRHITexture* MyTextureRHI = MyTexture->TextureReference.TextureReferenceRHI;
+	FTextureResource* MyTextureResource = MyTexture->Resource;
 	UWorld* World = Ac->GetWorld();
 	ERHIFeatureLevel::Type FeatureLevel = World->Scene->GetFeatureLevel();
 	FName TextureRenderTargetName = OutputRenderTarget->GetFName();
-	
-	//UAVͼ
-	FRHIResourceCreateInfo RHIResourceCreateInfo;
-	
-	Texture = RHICreateTexture2D(MyTextureRHI->GetSizeXYZ().X, MyTextureRHI->GetSizeXYZ().Y, PF_A32B32G32R32F, 1, 1, TexCreate_ShaderResource | TexCreate_UAV, RHIResourceCreateInfo);
-	TextureUAV = RHICreateUnorderedAccessView(Texture);
-
-	//ģͼ
-	DrawBlurComputeShaderRenderTarget(Ac, BlurCounts, MyTextureRHI, Texture, TextureUAV);
-
-	//ģͼȾ뵽Ⱦ߳
-	ENQUEUE_RENDER_COMMAND(CaptureCommand)([TextureRenderTargetResource, FeatureLevel, MyColor, TextureRenderTargetName](FRHICommandListImmediate& RHICmdList)
+
+	// The blurred texture comes from the render target pool and goes back after the draw, the shader only reads rgb
+	ENQUEUE_RENDER_COMMAND(CaptureCommand)([TextureRenderTargetResource, FeatureLevel, MyColor, TextureRenderTargetName, MyTextureResource, BlurCounts](FRHICommandListImmediate& RHICmdList)
 	{
-		DrawInterationShaderRenderTarget_RenderThread(RHICmdList, TextureRenderTargetResource, FeatureLevel, TextureRenderTargetName, MyColor, Texture);
+		TRefCountPtr<IPooledRenderTarget> BlurredTexture = BlurTexture_RenderThread(RHICmdList, FeatureLevel, MyTextureResource->TextureRHI, BlurCounts, EBlurTextureFormat::FloatR11G11B10);
+		DrawInterationShaderRenderTarget_RenderThread(RHICmdList, TextureRenderTargetResource, FeatureLevel, TextureRenderTargetName, MyColor, BlurredTexture->GetRenderTargetItem().ShaderResourceTexture);
 	});
 }
-
-FTextureRHIRef UInterationShaderBlueprintLibrary::Texture = FTextureRHIRef();
-FUnorderedAccessViewRHIRef UInterationShaderBlueprintLibrary::TextureUAV = FUnorderedAccessViewRHIRef();
-
@@ -13,40 +13,24 @@
 #include "Engine/World.h"
 #include "SceneInterface.h"
 #include "Button.h"
+#include "Common.h"
 
 BEGIN_GLOBAL_SHADER_PARAMETER_STRUCT(FRayMarchingShaderData, )
 SHADER_PARAMETER(FVector2D, ViewResolution)
 SHADER_PARAMETER(float, TimeSeconds)
 SHADER_PARAMETER(FVector2D, MousePos)
+SHADER_PARAMETER(int32, MarchSteps)
+SHADER_PARAMETER(FIntPoint, OutputResolution)
+SHADER_PARAMETER(FIntPoint, TraceResolution)
+SHADER_PARAMETER(FIntPoint, TraceScale)
+SHADER_PARAMETER(FIntPoint, TraceOffset)
+SHADER_PARAMETER(uint32, bCheckerboard)
+SHADER_PARAMETER(uint32, FrameIndex)
+SHADER_PARAMETER(uint32, bHistoryValid)
+SHADER_PARAMETER(float, PrevTimeSeconds)
+SHADER_PARAMETER(FVector2D, PrevMousePos)
 END_GLOBAL_SHADER_PARAMETER_STRUCT()
 
-struct FSVertexInput
-{
-	FVector4 Position;
-	FVector2D UV;
-};
-
-class FRayMarchingVertexDeclaration : public FRenderResource
-{
-public:
-	FVertexDeclarationRHIRef VertexDeclarationRHI;
-
-	virtual void InitRHI()override
-	{
-		//ö벼
-		FVertexDeclarationElementList Elements;
-		uint32 Stride = sizeof(FSVertexInput);   //
-		Elements.Add(FVertexElement(0, STRUCT_OFFSET(FSVertexInput, Position), EVertexElementType::VET_Float4, 0, Stride));  //һStreamӦInstanceʹ
-		Elements.Add(FVertexElement(0, STRUCT_OFFSET(FSVertexInput, UV), EVertexElementType::VET_Float2, 1, Stride));
-		VertexDeclarationRHI = RHICreateVertexDeclaration(Elements);
-	}
-
-	virtual void ReleaseRHI()override
-	{
-		VertexDeclarationRHI.SafeRelease();
-	}
-};
-
 class FRayMarchingShader : public FGlobalShader
 {
 public:
@@ -74,13 +58,8 @@ public:
 		OutEnvironment.SetDefine(TEXT("RayMarching_MICRO"), 1);
 	}
 
-	void SetParameters(FRHICommandListImmediate& RHICmdList, FRayMarchingBufferData& MyData)
+	void SetParameters(FRHICommandListImmediate& RHICmdList, const FRayMarchingShaderData& SShaderData)
 	{
-		FRayMarchingShaderData SShaderData;
-		SShaderData.ViewResolution = MyData.ViewResolution;
-		SShaderData.TimeSeconds = MyData.TimeSeconds;
-		SShaderData.MousePos = MyData.MousePos;
-
 		SetUniformBufferParameter(RHICmdList, GetPixelShader(), GetUniformBufferParameter<FRayMarchingShaderData>(), FRayMarchingShaderData::CreateUniformBuffer(SShaderData, EUniformBufferUsage::UniformBuffer_SingleDraw));
 	}
 
@@ -121,6 +100,67 @@ public:
 	}
 };
 
+/** Marches the pixels of this frame into the trace target of a reduced resolution */
+template<int32 Index>
+class FRayMarchingTracePS :public FRayMarchingShader
+{
+	DECLARE_SHADER_TYPE(FRayMarchingTracePS, Global);
+
+public:
+	FRayMarchingTracePS() {}
+
+	FRayMarchingTracePS(const ShaderMetaType::CompiledShaderInitializerType& Initializer):
+		FRayMarchingShader(Initializer)
+	{
+	}
+};
+
+/** Combines the trace target with the reprojected history into the full resolution output */
+class FRayMarchingResolveShader : public FRayMarchingShader
+{
+public:
+	FRayMarchingResolveShader() {}
+
+	FRayMarchingResolveShader(const ShaderMetaType::CompiledShaderInitializerType& Initializer) :
+		FRayMarchingShader(Initializer)
+	{
+		TraceTextureVal.Bind(Initializer.ParameterMap, TEXT("TraceTexture"));
+		HistoryTextureVal.Bind(Initializer.ParameterMap, TEXT("HistoryTexture"));
+	}
+
+	void SetTextures(FRHICommandListImmediate& RHICmdList, FRHITexture* TraceTexture, FRHITexture* HistoryTexture)
+	{
+		SetTextureParameter(RHICmdList, GetPixelShader(), TraceTextureVal, TraceTexture);
+		SetTextureParameter(RHICmdList, GetPixelShader(), HistoryTextureVal, HistoryTexture);
+	}
+
+	virtual bool Serialize(FArchive& Ar) override
+	{
+		bool bShaderHasOutdatedParameters = FRayMarchingShader::Serialize(Ar);
+		Ar << TraceTextureVal << HistoryTextureVal;
+		return bShaderHasOutdatedParameters;
+	}
+
+private:
+	FShaderResourceParameter TraceTextureVal;
+
+	FShaderResourceParameter HistoryTextureVal;
+};
+
+template<int32 Index>
+class FRayMarchingResolvePS :public FRayMarchingResolveShader
+{
+	DECLARE_SHADER_TYPE(FRayMarchingResolvePS, Global);
+
+public:
+	FRayMarchingResolvePS() {}
+
+	FRayMarchingResolvePS(const ShaderMetaType::CompiledShaderInitializerType& Initializer):
+		FRayMarchingResolveShader(Initializer)
+	{
+	}
+};
+
  //ΪShaderUniformBufferҪShaderЩд뵽Common.ushshaderļУShaderļҪCommonļ
 IMPLEMENT_GLOBAL_SHADER_PARAMETER_STRUCT(FRayMarchingShaderData, "FRayMarchingData");    
 
@@ -131,39 +171,218 @@ IMPLEMENT_SHADER_TYPE(, FRayMarchingShaderPS<1>, TEXT("/Plugins/Shaders/Private/
 IMPLEMENT_SHADER_TYPE(, FRayMarchingShaderVS<2>, TEXT("/Plugins/Shaders/Private/ProteanCloud.usf"), TEXT("MainVS"), SF_Vertex)
 IMPLEMENT_SHADER_TYPE(, FRayMarchingShaderPS<2>, TEXT("/Plugins/Shaders/Private/ProteanCloud.usf"), TEXT("MainPS"), SF_Pixel)
 
+IMPLEMENT_SHADER_TYPE(, FRayMarchingTracePS<1>, TEXT("/Plugins/Shaders/Private/SeascapeShader.usf"), TEXT("TracePS"), SF_Pixel)
+IMPLEMENT_SHADER_TYPE(, FRayMarchingResolvePS<1>, TEXT("/Plugins/Shaders/Private/SeascapeShader.usf"), TEXT("ResolvePS"), SF_Pixel)
+
+IMPLEMENT_SHADER_TYPE(, FRayMarchingTracePS<2>, TEXT("/Plugins/Shaders/Private/ProteanCloud.usf"), TEXT("TracePS"), SF_Pixel)
+IMPLEMENT_SHADER_TYPE(, FRayMarchingResolvePS<2>, TEXT("/Plugins/Shaders/Private/ProteanCloud.usf"), TEXT("ResolvePS"), SF_Pixel)
 
-static void DrawIndexedPrimitiveUP_cpy4(
-	FRHICommandList& RHICmdList,
-	uint32 PrimitiveType,
-	uint32 MinVertexIndex,
-	uint32 NumVertices,
-	uint32 NumPrimitives,
-	const void* IndexData,
-	uint32 IndexDataStride,
-	const void* VertexData,
-	uint32 VertexDataStride)
+// A history older than this is not reprojected, and a target not drawn for this many frames releases its textures
+static const float RayMarchingMaxHistoryDeltaSeconds = 0.5f;
+static const uint32 RayMarchingHistoryLifetimeFrames = 300;
+
+/** Textures of a target drawn below full resolution, kept across frames for the reprojection, render thread only */
+struct FRayMarchingHistory
 {
-	const uint32 NumIndices = GetVertexCountForPrimitiveCount(NumPrimitives, PrimitiveType);
+	FTexture2DRHIRef TraceTexture;
+
+	/** Color and distance of the hit, written in turn by the resolve pass */
+	FTexture2DRHIRef HistoryTextures[2];
 
-	FRHIResourceCreateInfo CreateInfo;
-	FVertexBufferRHIRef VertexBufferRHI = RHICreateVertexBuffer(VertexDataStride * NumVertices, BUF_Volatile, CreateInfo);        //BufǸĶͣû֡д룬ΪBUF_Volatile
-	void* VoidPtr = RHILockVertexBuffer(VertexBufferRHI, 0, VertexDataStride * NumVertices, RLM_WriteOnly);        //lock㻺bufferֻд
-	FPlatformMemory::Memcpy(VoidPtr, VertexData, VertexDataStride * NumVertices);       //붥
-	RHIUnlockVertexBuffer(VertexBufferRHI);    //unlock㻺
+	FIntPoint OutputSize = FIntPoint::ZeroValue;
 
-	//ͬϴһ
-	FIndexBufferRHIRef IndexBufferRHI = RHICreateIndexBuffer(IndexDataStride, IndexDataStride * NumIndices, BUF_Volatile, CreateInfo);
-	void* VoidPtr2 = RHILockIndexBuffer(IndexBufferRHI, 0, IndexDataStride * NumIndices, RLM_WriteOnly);
-	FPlatformMemory::Memcpy(VoidPtr2, IndexData, IndexDataStride * NumIndices);
-	RHIUnlockIndexBuffer(IndexBufferRHI);
+	ERayMarchingShader ShaderType = ERayMarchingShader::None;
 
-	RHICmdList.SetStreamSource(0, VertexBufferRHI, 0);     //Բͬͼνӿö㻺
-	RHICmdList.DrawIndexedPrimitive(IndexBufferRHI, MinVertexIndex, 0, NumVertices, 0, NumPrimitives, 1);        //ͼԪ
+	ERayMarchingResolution Resolution = ERayMarchingResolution::Full;
 
-	IndexBufferRHI.SafeRelease();
-	VertexBufferRHI.SafeRelease();
+	uint32 FrameIndex = 0;
+
+	uint32 LastDrawnFrame = 0;
+
+	float PrevTimeSeconds = 0.f;
+
+	FVector2D PrevMousePos = FVector2D::ZeroVector;
+
+	bool bHistoryValid = false;
+};
+
+class FRayMarchingHistories : public FRenderResource
+{
+public:
+	TMap<const FTextureRenderTargetResource*, FRayMarchingHistory> Histories;
+
+	virtual void ReleaseRHI()override
+	{
+		Histories.Empty();
+	}
+};
+
+static TGlobalResource<FRayMarchingHistories> GRayMarchingHistories;
+
+/** Same as NUM_STEPS of SeascapeShader.usf and the steps of render() in ProteanCloud.usf */
+static int32 GetDefaultMarchSteps(ERayMarchingShader ShaderType)
+{
+	return ShaderType == ERayMarchingShader::ProteanCloud ? 130 : 8;
+}
+
+static float GetTracedPixelFraction(ERayMarchingResolution Resolution)
+{
+	switch (Resolution)
+	{
+	case ERayMarchingResolution::Checkerboard: return 1.f / 2.f;
+	case ERayMarchingResolution::Half: return 1.f / 4.f;
+	case ERayMarchingResolution::Quarter: return 1.f / 16.f;
+	default: return 1.f;
+	}
+}
+
+/** Lower the resolution and then the steps until a draw of OutputSize marches at most SampleBudget million steps */
+static void FitSampleBudget(FIntPoint OutputSize, float SampleBudget, ERayMarchingResolution& InOutResolution, int32& InOutSteps)
+{
+	if (SampleBudget <= 0.f)
+		return;
+
+	const double MaxSamples = SampleBudget * 1000000.0;
+	const double NumPixels = (double)OutputSize.X * OutputSize.Y;
+	while (InOutResolution != ERayMarchingResolution::Quarter && NumPixels * GetTracedPixelFraction(InOutResolution) * InOutSteps > MaxSamples)
+	{
+		InOutResolution = (ERayMarchingResolution)((uint8)InOutResolution + 1);
+	}
+	const double NumTracedPixels = FMath::Max(NumPixels * GetTracedPixelFraction(InOutResolution), 1.0);
+	InOutSteps = FMath::Clamp((int32)(MaxSamples / NumTracedPixels), 1, InOutSteps);
+}
+
+/** Pixel of a Scale x Scale block marched this frame, the blocks are visited in Bayer order so every frame lands far from the last one */
+static FIntPoint GetTraceOffset(int32 Scale, uint32 FrameIndex)
+{
+	static const FIntPoint Bayer2x2[4] = { FIntPoint(0, 0), FIntPoint(1, 1), FIntPoint(1, 0), FIntPoint(0, 1) };
+	FIntPoint Offset = FIntPoint::ZeroValue;
+	uint32 Index = FrameIndex % (Scale * Scale);
+	for (int32 Step = Scale / 2; Step > 0; Step /= 2)
+	{
+		Offset += Bayer2x2[Index & 3] * Step;
+		Index >>= 2;
+	}
+	return Offset;
+}
+
+static FRayMarchingShaderData MakeShaderData(const FRayMarchingBufferData& MyData, FIntPoint OutputSize, int32 MarchSteps)
+{
+	FRayMarchingShaderData SShaderData;
+	FMemory::Memzero(SShaderData);
+	SShaderData.ViewResolution = MyData.ViewResolution;
+	SShaderData.TimeSeconds = MyData.TimeSeconds;
+	SShaderData.MousePos = MyData.MousePos;
+	SShaderData.MarchSteps = MarchSteps;
+	SShaderData.OutputResolution = OutputSize;
+	SShaderData.TraceResolution = OutputSize;
+	SShaderData.TraceScale = FIntPoint(1, 1);
+	return SShaderData;
+}
+
+/** March a part of the pixels into the trace target, then resolve it with the history of the target into the output */
+static void DrawRayMarchingReduced_RenderThread(
+	FRHICommandListImmediate& RHICmdList,
+	ERayMarchingShader ShaderType,
+	ERayMarchingResolution Resolution,
+	int32 MarchSteps,
+	FTextureRenderTargetResource* OutputRenderTargetResource,
+	FRayMarchingShader* VertexShader,
+	FRayMarchingShader* TracePixelShader,
+	FRayMarchingResolveShader* ResolvePixelShader,
+	const FRayMarchingBufferData& MyData
+)
+{
+	const uint32 FrameNumber = GFrameNumberRenderThread;
+	for (auto It = GRayMarchingHistories.Histories.CreateIterator(); It; ++It)
+	{
+		if (It.Key() != OutputRenderTargetResource && FrameNumber - It.Value().LastDrawnFrame > RayMarchingHistoryLifetimeFrames)
+			It.RemoveCurrent();
+	}
+
+	const FIntPoint OutputSize = OutputRenderTargetResource->GetSizeXY();
+	const FIntPoint TraceScale = Resolution == ERayMarchingResolution::Checkerboard ? FIntPoint(2, 1) : Resolution == ERayMarchingResolution::Half ? FIntPoint(2, 2) : FIntPoint(4, 4);
+	const FIntPoint TraceSize = FIntPoint::DivideAndRoundUp(OutputSize, TraceScale);
+
+	FRayMarchingHistory& History = GRayMarchingHistories.Histories.FindOrAdd(OutputRenderTargetResource);
+	if (!History.TraceTexture.IsValid() || History.OutputSize != OutputSize || History.Resolution != Resolution)
+	{
+		FRHIResourceCreateInfo CreateInfo;
+		History.TraceTexture = RHICreateTexture2D(TraceSize.X, TraceSize.Y, PF_FloatRGBA, 1, 1, TexCreate_RenderTargetable | TexCreate_ShaderResource, CreateInfo);
+		for (FTexture2DRHIRef& HistoryTexture : History.HistoryTextures)
+		{
+			HistoryTexture = RHICreateTexture2D(OutputSize.X, OutputSize.Y, PF_FloatRGBA, 1, 1, TexCreate_RenderTargetable | TexCreate_ShaderResource, CreateInfo);
+		}
+		History.OutputSize = OutputSize;
+		History.Resolution = Resolution;
+		History.bHistoryValid = false;
+	}
+	History.bHistoryValid &= History.ShaderType == ShaderType && FMath::Abs(MyData.TimeSeconds - History.PrevTimeSeconds) < RayMarchingMaxHistoryDeltaSeconds;
+	History.ShaderType = ShaderType;
+
+	FRayMarchingShaderData SShaderData = MakeShaderData(MyData, OutputSize, MarchSteps);
+	SShaderData.TraceResolution = TraceSize;
+	SShaderData.TraceScale = TraceScale;
+	SShaderData.TraceOffset = Resolution == ERayMarchingResolution::Checkerboard ? FIntPoint::ZeroValue : GetTraceOffset(TraceScale.X, History.FrameIndex);
+	SShaderData.bCheckerboard = Resolution == ERayMarchingResolution::Checkerboard;
+	SShaderData.FrameIndex = History.FrameIndex;
+	SShaderData.bHistoryValid = History.bHistoryValid;
+	SShaderData.PrevTimeSeconds = History.PrevTimeSeconds;
+	SShaderData.PrevMousePos = History.PrevMousePos;
+
+	FGraphicsPipelineStateInitializer GraphicPSPoint;
+	GraphicPSPoint.DepthStencilState = TStaticDepthStencilState<false, CF_Always>::GetRHI();
+	GraphicPSPoint.BlendState = TStaticBlendState<>::GetRHI();
+	GraphicPSPoint.RasterizerState = TStaticRasterizerState<>::GetRHI();
+	GraphicPSPoint.PrimitiveType = PT_TriangleList;
+	GraphicPSPoint.BoundShaderState.VertexDeclarationRHI = GCommonVertexDeclaration.VertexDeclarationRHI;
+	GraphicPSPoint.BoundShaderState.VertexShaderRHI = GETSAFERHISHADER_VERTEX(VertexShader);
+
+	{
+		RHICmdList.TransitionResource(EResourceTransitionAccess::EWritable, History.TraceTexture);
+		RHICmdList.SetViewport(0, 0, 0.0f, TraceSize.X, TraceSize.Y, 1.0f);
+		FRHIRenderPassInfo RPInfo(History.TraceTexture, ERenderTargetActions::DontLoad_Store);
+		RHICmdList.BeginRenderPass(RPInfo, TEXT("RayMarchingTrace"));
+
+		RHICmdList.ApplyCachedRenderTargets(GraphicPSPoint);
+		GraphicPSPoint.BoundShaderState.PixelShaderRHI = GETSAFERHISHADER_PIXEL(TracePixelShader);
+		SetGraphicsPipelineState(RHICmdList, GraphicPSPoint);
+		TracePixelShader->SetParameters(RHICmdList, SShaderData);
+		DrawCommonQuad(RHICmdList);
+
+		RHICmdList.EndRenderPass();
+		RHICmdList.TransitionResource(EResourceTransitionAccess::EReadable, History.TraceTexture);
+	}
+
+	{
+		FRHITexture* ReadHistory = History.HistoryTextures[History.FrameIndex & 1];
+		FRHITexture* WriteHistory = History.HistoryTextures[(History.FrameIndex + 1) & 1];
+		RHICmdList.TransitionResource(EResourceTransitionAccess::EWritable, WriteHistory);
+		RHICmdList.SetViewport(0, 0, 0.0f, OutputSize.X, OutputSize.Y, 1.0f);
+		FRHITexture* ColorRTs[2] = { OutputRenderTargetResource->GetRenderTargetTexture(), WriteHistory };
+		FRHIRenderPassInfo RPInfo(2, ColorRTs, ERenderTargetActions::DontLoad_Store);
+		RHICmdList.BeginRenderPass(RPInfo, TEXT("RayMarchingResolve"));
+
+		RHICmdList.ApplyCachedRenderTargets(GraphicPSPoint);
+		GraphicPSPoint.BoundShaderState.PixelShaderRHI = GETSAFERHISHADER_PIXEL(ResolvePixelShader);
+		SetGraphicsPipelineState(RHICmdList, GraphicPSPoint);
+		ResolvePixelShader->SetParameters(RHICmdList, SShaderData);
+		ResolvePixelShader->SetTextures(RHICmdList, History.TraceTexture, ReadHistory);
+		DrawCommonQuad(RHICmdList);
+
+		RHICmdList.EndRenderPass();
+		RHICmdList.TransitionResource(EResourceTransitionAccess::EReadable, WriteHistory);
+		RHICmdList.CopyToResolveTarget(OutputRenderTargetResource->GetRenderTargetTexture(), OutputRenderTargetResource->TextureRHI, FResolveParams());
+	}
+
+	++History.FrameIndex;
+	History.LastDrawnFrame = FrameNumber;
+	History.PrevTimeSeconds = MyData.TimeSeconds;
+	History.PrevMousePos = MyData.MousePos;
+	History.bHistoryValid = true;
 }
 
+
 static void DrawUniformBufferShaderRenderTarget_RenderThread(
 	FRHICommandListImmediate& RHICmdList,
 	ERayMarchingShader ShaderType,
@@ -189,6 +408,8 @@ static void DrawUniformBufferShaderRenderTarget_RenderThread(
 
 	FRayMarchingShader* VertexShader = nullptr;
 	FRayMarchingShader* PixelShader = nullptr;
+	FRayMarchingShader* TracePixelShader = nullptr;
+	FRayMarchingResolveShader* ResolvePixelShader = nullptr;
 
 	switch (ShaderType)
 	{
@@ -199,51 +420,46 @@ static void DrawUniformBufferShaderRenderTarget_RenderThread(
 	case ERayMarchingShader::Seascape:
 		VertexShader = *TShaderMapRef<FRayMarchingShaderVS<1>>(GlobalShaderMap);
 		PixelShader = *TShaderMapRef<FRayMarchingShaderPS<1>>(GlobalShaderMap);
+		TracePixelShader = *TShaderMapRef<FRayMarchingTracePS<1>>(GlobalShaderMap);
+		ResolvePixelShader = *TShaderMapRef<FRayMarchingResolvePS<1>>(GlobalShaderMap);
 		break;
 	case ERayMarchingShader::ProteanCloud:
 		VertexShader = *TShaderMapRef<FRayMarchingShaderVS<2>>(GlobalShaderMap);
 		PixelShader = *TShaderMapRef<FRayMarchingShaderPS<2>>(GlobalShaderMap);
+		TracePixelShader = *TShaderMapRef<FRayMarchingTracePS<2>>(GlobalShaderMap);
+		ResolvePixelShader = *TShaderMapRef<FRayMarchingResolvePS<2>>(GlobalShaderMap);
 		break;
 	}
 
 	FIntPoint DrawTargetResolution(OutputRenderTargetResource->GetSizeX(), OutputRenderTargetResource->GetSizeY());  
+	ERayMarchingResolution Resolution = MyData.Resolution;
+	int32 MarchSteps = MyData.MarchSteps > 0 ? MyData.MarchSteps : GetDefaultMarchSteps(ShaderType);
+	FitSampleBudget(DrawTargetResolution, MyData.SampleBudget, Resolution, MarchSteps);
+	if (Resolution != ERayMarchingResolution::Full)
+	{
+		DrawRayMarchingReduced_RenderThread(RHICmdList, ShaderType, Resolution, MarchSteps, OutputRenderTargetResource, VertexShader, TracePixelShader, ResolvePixelShader, MyData);
+		return;
+	}
+
     RHICmdList.SetViewport(0, 0, 0.0f, DrawTargetResolution.X, DrawTargetResolution.Y, 1.0f);    //ӿڴС
 
 	FRHIRenderPassInfo RPInfo(OutputRenderTargetResource->GetRenderTargetTexture(), ERenderTargetActions::Load_Store, OutputRenderTargetResource->TextureRHI);
 	RHICmdList.BeginRenderPass(RPInfo, TEXT("RayMarchingShader"));
 
-	FRayMarchingVertexDeclaration VertexDeclaration;   
-	VertexDeclaration.InitRHI(); //벼
-
 	FGraphicsPipelineStateInitializer GraphicPSPoint;
 	RHICmdList.ApplyCachedRenderTargets(GraphicPSPoint);
 	GraphicPSPoint.DepthStencilState = TStaticDepthStencilState<false, CF_Always>::GetRHI();
 	GraphicPSPoint.BlendState = TStaticBlendState<>::GetRHI();
 	GraphicPSPoint.RasterizerState = TStaticRasterizerState<>::GetRHI();
 	GraphicPSPoint.PrimitiveType = PT_TriangleList;        //ƵͼԪ
-	GraphicPSPoint.BoundShaderState.VertexDeclarationRHI = VertexDeclaration.VertexDeclarationRHI;
+	GraphicPSPoint.BoundShaderState.VertexDeclarationRHI = GCommonVertexDeclaration.VertexDeclarationRHI;
 	GraphicPSPoint.BoundShaderState.VertexShaderRHI = GETSAFERHISHADER_VERTEX(VertexShader);
 	GraphicPSPoint.BoundShaderState.PixelShaderRHI = GETSAFERHISHADER_PIXEL(PixelShader);
 	SetGraphicsPipelineState(RHICmdList, GraphicPSPoint);
 
-	PixelShader->SetParameters(RHICmdList, MyData);    //Shaderһɫһ
-
-	FSVertexInput Vertices[4];
-	Vertices[0].Position.Set(-1.0f, 1.0f, 0, 1.0f);
-	Vertices[1].Position.Set(1.0f, 1.0f, 0, 1.0f);
-	Vertices[2].Position.Set(-1.0f, -1.0f, 0, 1.0f);
-	Vertices[3].Position.Set(1.0f, -1.0f, 0, 1.0f);
-	Vertices[0].UV = FVector2D(0.0f, 1.0f);
-	Vertices[1].UV = FVector2D(1.0f, 1.0f);
-	Vertices[2].UV = FVector2D(0.0f, 0.0f);
-	Vertices[3].UV = FVector2D(1.0f, 0.0f);
-    static const uint16 Indices[6] =  
-    {  
-        0, 1, 2,  
-        2, 1, 3  
-    };  
-
-	DrawIndexedPrimitiveUP_cpy4(RHICmdList, PT_TriangleList, 0, ARRAY_COUNT(Vertices), 2, Indices, sizeof(Indices[0]), Vertices, sizeof(Vertices[0]));
+	PixelShader->SetParameters(RHICmdList, MakeShaderData(MyData, DrawTargetResolution, MarchSteps));    //Shaderһɫһ
+
+	DrawCommonQuad(RHICmdList);
 	RHICmdList.CopyToResolveTarget(OutputRenderTargetResource->GetRenderTargetTexture(), OutputRenderTargetResource->TextureRHI, FResolveParams());
 
 	RHICmdList.EndRenderPass();
@@ -14,6 +14,7 @@
 #include "Engine/World.h"
 #include "Engine/Texture.h"
 #include "Shader.h"
+#include "Common.h"
 
 
 UTestShaderBlueprintLibrary::UTestShaderBlueprintLibrary(const FObjectInitializer& ObjectInitializer)
@@ -95,38 +96,6 @@ IMPLEMENT_SHADER_TYPE(, FHelloShaderVS, TEXT("/Plugins/Shaders/Private/CustomSha
 IMPLEMENT_SHADER_TYPE(, FHelloShaderPS, TEXT("/Plugins/Shaders/Private/CustomShader.usf"), TEXT("MainPS"), SF_Pixel)
 
 
-static void DrawIndexedPrimitiveUP_cpy1(
-	FRHICommandList& RHICmdList,
-	uint32 PrimitiveType,
-	uint32 MinVertexIndex,
-	uint32 NumVertices,
-	uint32 NumPrimitives,
-	const void* IndexData,
-	uint32 IndexDataStride,
-	const void* VertexData,
-	uint32 VertexDataStride)
-{
-	const uint32 NumIndices = GetVertexCountForPrimitiveCount(NumPrimitives, PrimitiveType);
-
-	FRHIResourceCreateInfo CreateInfo;
-	FVertexBufferRHIRef VertexBufferRHI = RHICreateVertexBuffer(VertexDataStride * NumVertices, BUF_Volatile, CreateInfo);        //Buf类型是改动类型，没帧写入，所以声明为BUF_Volatile
-	void* VoidPtr = RHILockVertexBuffer(VertexBufferRHI, 0, VertexDataStride * NumVertices, RLM_WriteOnly);        //lock顶点缓冲buffer，并且只能写入
-	FPlatformMemory::Memcpy(VoidPtr, VertexData, VertexDataStride * NumVertices);       //传入顶点数据
-	RHIUnlockVertexBuffer(VertexBufferRHI);    //unlock顶点缓冲
-
-	//同上创建一个索引缓冲
-	FIndexBufferRHIRef IndexBufferRHI = RHICreateIndexBuffer(IndexDataStride, IndexDataStride * NumIndices, BUF_Volatile, CreateInfo);
-	void* VoidPtr2 = RHILockIndexBuffer(IndexBufferRHI, 0, IndexDataStride * NumIndices, RLM_WriteOnly);
-	FPlatformMemory::Memcpy(VoidPtr2, IndexData, IndexDataStride * NumIndices);
-	RHIUnlockIndexBuffer(IndexBufferRHI);
-
-	RHICmdList.SetStreamSource(0, VertexBufferRHI, 0);     //针对不同的图形接口设置顶点缓冲
-	RHICmdList.DrawIndexedPrimitive(IndexBufferRHI, MinVertexIndex, 0, NumVertices, 0, NumPrimitives, 1);        //绘制图元
-
-	IndexBufferRHI.SafeRelease();
-	VertexBufferRHI.SafeRelease();
-}
-
 //渲染线程全局函数
 static void DrawHelloShaderRenderTarget_RenderThread(
 	FRHICommandListImmediate& RHICmdList,
@@ -168,26 +137,15 @@ static void DrawHelloShaderRenderTarget_RenderThread(
 	GraphicPSPoint.BlendState = TStaticBlendState<>::GetRHI();
 	GraphicPSPoint.RasterizerState = TStaticRasterizerState<>::GetRHI();
 	GraphicPSPoint.PrimitiveType = PT_TriangleList;        //绘制的图元类型
-	GraphicPSPoint.BoundShaderState.VertexDeclarationRHI = GetVertexDeclarationFVector4();    //顶点类型
+	GraphicPSPoint.BoundShaderState.VertexDeclarationRHI = GCommonVertexDeclaration.VertexDeclarationRHI;    //顶点类型
 	GraphicPSPoint.BoundShaderState.VertexShaderRHI = GETSAFERHISHADER_VERTEX(*VertexShader);
 	GraphicPSPoint.BoundShaderState.PixelShaderRHI = GETSAFERHISHADER_PIXEL(*PixelShader);
 	SetGraphicsPipelineState(RHICmdList, GraphicPSPoint);
 
 	PixelShader->SetParameters(RHICmdList, MyColor);    //设置Shader参数，这里只有一个颜色参数
 
-	FVector4 Vertices[4];  
-    Vertices[0].Set(-1.0f, 1.0f, 0, 1.0f);  
-    Vertices[1].Set(1.0f, 1.0f, 0, 1.0f);  
-    Vertices[2].Set(-1.0f, -1.0f, 0, 1.0f);  
-    Vertices[3].Set(1.0f, -1.0f, 0, 1.0f);  
-    static const uint16 Indices[6] =  
-    {  
-        0, 1, 2,  
-        2, 1, 3  
-    };  
-
 	//现在开始绘制，按照顶点缓冲和索引缓冲来绘制
-	DrawIndexedPrimitiveUP_cpy1(RHICmdList, PT_TriangleList, 0, ARRAY_COUNT(Vertices), 2, Indices, sizeof(Indices[0]), Vertices, sizeof(Vertices[0]));
+	DrawCommonQuad(RHICmdList);
 	
 	// RHICmdList.SetStreamSource(0, GScreenSpaceVertexBuffer.VertexBufferRHI, 0);
 	//RHICmdList.DrawIndexedPrimitive(GTwoTrianglesIndexBuffer.IndexBufferRHI, 0, 0, 4, 0, 2, 1);
@@ -120,38 +120,6 @@ IMPLEMENT_SHADER_TYPE(, FUniformBufferShaderVS, TEXT("/Plugins/Shaders/Private/U
 IMPLEMENT_SHADER_TYPE(, FUniformBufferShaderPS, TEXT("/Plugins/Shaders/Private/UniformBufferShader.usf"),TEXT("MainPS"), SF_Pixel)
 
 
-static void DrawIndexedPrimitiveUP_cpy3(
-	FRHICommandList& RHICmdList,
-	uint32 PrimitiveType,
-	uint32 MinVertexIndex,
-	uint32 NumVertices,
-	uint32 NumPrimitives,
-	const void* IndexData,
-	uint32 IndexDataStride,
-	const void* VertexData,
-	uint32 VertexDataStride)
-{
-	const uint32 NumIndices = GetVertexCountForPrimitiveCount(NumPrimitives, PrimitiveType);
-
-	FRHIResourceCreateInfo CreateInfo;
-	FVertexBufferRHIRef VertexBufferRHI = RHICreateVertexBuffer(VertexDataStride * NumVertices, BUF_Volatile, CreateInfo);        //BufǸĶͣû֡д룬ΪBUF_Volatile
-	void* VoidPtr = RHILockVertexBuffer(VertexBufferRHI, 0, VertexDataStride * NumVertices, RLM_WriteOnly);        //lock㻺bufferֻд
-	FPlatformMemory::Memcpy(VoidPtr, VertexData, VertexDataStride * NumVertices);       //붥
-	RHIUnlockVertexBuffer(VertexBufferRHI);    //unlock㻺
-
-	//ͬϴһ
-	FIndexBufferRHIRef IndexBufferRHI = RHICreateIndexBuffer(IndexDataStride, IndexDataStride * NumIndices, BUF_Volatile, CreateInfo);
-	void* VoidPtr2 = RHILockIndexBuffer(IndexBufferRHI, 0, IndexDataStride * NumIndices, RLM_WriteOnly);
-	FPlatformMemory::Memcpy(VoidPtr2, IndexData, IndexDataStride * NumIndices);
-	RHIUnlockIndexBuffer(IndexBufferRHI);
-
-	RHICmdList.SetStreamSource(0, VertexBufferRHI, 0);     //Բͬͼνӿö㻺
-	RHICmdList.DrawIndexedPrimitive(IndexBufferRHI, MinVertexIndex, 0, NumVertices, 0, NumPrimitives, 1);        //ͼԪ
-
-	IndexBufferRHI.SafeRelease();
-	VertexBufferRHI.SafeRelease();
-}
-
 static void DrawUniformBufferShaderRenderTarget_RenderThread(
 	FRHICommandListImmediate& RHICmdList,
 	FTextureRenderTargetResource* OutputRenderTargetResource,
@@ -188,38 +156,20 @@ static void DrawUniformBufferShaderRenderTarget_RenderThread(
 	TShaderMapRef<FUniformBufferShaderVS> VertexShader(GlobalShaderMap);
 	TShaderMapRef<FUniformBufferShaderPS> PixelShader(GlobalShaderMap);        //ȡԶShader
 
-	FCommonVertexDeclaration VertexDeclaration;   
-	VertexDeclaration.InitRHI(); //벼
-
 	FGraphicsPipelineStateInitializer GraphicPSPoint;
 	RHICmdList.ApplyCachedRenderTargets(GraphicPSPoint);
 	GraphicPSPoint.DepthStencilState = TStaticDepthStencilState<false, CF_Always>::GetRHI();
 	GraphicPSPoint.BlendState = TStaticBlendState<>::GetRHI();
 	GraphicPSPoint.RasterizerState = TStaticRasterizerState<>::GetRHI();
 	GraphicPSPoint.PrimitiveType = PT_TriangleList;        //ƵͼԪ
-	GraphicPSPoint.BoundShaderState.VertexDeclarationRHI = VertexDeclaration.VertexDeclarationRHI;
+	GraphicPSPoint.BoundShaderState.VertexDeclarationRHI = GCommonVertexDeclaration.VertexDeclarationRHI;
 	GraphicPSPoint.BoundShaderState.VertexShaderRHI = GETSAFERHISHADER_VERTEX(*VertexShader);
 	GraphicPSPoint.BoundShaderState.PixelShaderRHI = GETSAFERHISHADER_PIXEL(*PixelShader);
 	SetGraphicsPipelineState(RHICmdList, GraphicPSPoint);
 
 	PixelShader->SetParameters(RHICmdList, MyColor, MyTexture, MyData);    //Shaderһɫһ
 
-	FUVertexInput Vertices[4];
-	Vertices[0].Position.Set(-1.0f, 1.0f, 0, 1.0f);
-	Vertices[1].Position.Set(1.0f, 1.0f, 0, 1.0f);
-	Vertices[2].Position.Set(-1.0f, -1.0f, 0, 1.0f);
-	Vertices[3].Position.Set(1.0f, -1.0f, 0, 1.0f);
-	Vertices[0].UV = FVector2D(0.0f, 1.0f);
-	Vertices[1].UV = FVector2D(1.0f, 1.0f);
-	Vertices[2].UV = FVector2D(0.0f, 0.0f);
-	Vertices[3].UV = FVector2D(1.0f, 0.0f);
-    static const uint16 Indices[6] =  
-    {  
-        0, 1, 2,  
-        2, 1, 3  
-    };  
-
-	DrawIndexedPrimitiveUP_cpy3(RHICmdList, PT_TriangleList, 0, ARRAY_COUNT(Vertices), 2, Indices, sizeof(Indices[0]), Vertices, sizeof(Vertices[0]));
+	DrawCommonQuad(RHICmdList);
 	//RHICmdList.CopyToResolveTarget(OutputRenderTargetResource->GetRenderTargetTexture(), OutputRenderTargetResource->TextureRHI, FResolveParams());
 
 	RHICmdList.EndRenderPass();
@@ -0,0 +1,231 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "WaveAnimationCache.h"
+#include "HAL/PlatformFilemanager.h"
+#include "Async/MappedFileHandle.h"
+#include "Async/ParallelFor.h"
+#include "Misc/Compression.h"
+#include "Misc/FileHelper.h"
+#include "Serialization/BufferReader.h"
+#include "Serialization/MemoryWriter.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogWaveAnimationCache, Log, All);
+
+// Same W_0 as FWaveSimulation::Dispersion
+const float FWaveAnimationCache::Period = 2.f * PI / 1.f;
+
+static const uint32 WaveAnimationCacheMagic = 0x43564157;	// "WAVC"
+static const uint32 WaveAnimationCacheVersion = 1;
+
+// Height.x, Slope.x, Slope.z, Displacement.x, Displacement.z, the only ones GetPosOffsetAndNormal reads
+static const int32 WaveAnimationCacheChannels = 5;
+
+TSharedPtr<FWaveAnimationCache, ESPMode::ThreadSafe> FWaveAnimationCache::LoadOrBake(const FString& Path, uint32 WavesHash, int32 NumFrames, TArrayView<FWaveFFTCPU* const> Waves)
+{
+	TSharedPtr<FWaveAnimationCache, ESPMode::ThreadSafe> Cache = MakeShareable(new FWaveAnimationCache());
+	if (Cache->Load(Path, WavesHash) && Cache->GetNumCascades() == Waves.Num())
+		return Cache;
+
+	// Unmap the stale file before it is written again
+	Cache.Reset();
+	Cache = MakeShareable(new FWaveAnimationCache());
+	if (Cache->Bake(Path, WavesHash, NumFrames, Waves))
+		return Cache;
+
+	return nullptr;
+}
+
+FWaveAnimationCache::~FWaveAnimationCache()
+{
+	delete MappedRegion;
+	delete MappedFile;
+}
+
+const uint8* FWaveAnimationCache::GetFileData() const
+{
+	return MappedRegion ? MappedRegion->GetMappedPtr() : FileData.GetData();
+}
+
+bool FWaveAnimationCache::Load(const FString& Path, uint32 WavesHash)
+{
+	const uint8* Data = nullptr;
+	int64 DataSize = 0;
+	MappedFile = FPlatformFileManager::Get().GetPlatformFile().OpenMapped(*Path);
+	if (MappedFile)
+	{
+		MappedRegion = MappedFile->MapRegion();
+		if (MappedRegion)
+		{
+			Data = MappedRegion->GetMappedPtr();
+			DataSize = MappedRegion->GetMappedSize();
+		}
+	}
+	else if (FFileHelper::LoadFileToArray(FileData, *Path, FILEREAD_Silent))
+	{
+		Data = FileData.GetData();
+		DataSize = FileData.Num();
+	}
+	if (!Data)
+		return false;
+
+	FBufferReader Reader(const_cast<uint8*>(Data), DataSize, false);
+	uint32 Magic = 0, Version = 0, FileWavesHash = 0;
+	int32 NumCascades = 0;
+	Reader << Magic << Version << FileWavesHash << NumFrames << NumCascades;
+	if (Magic != WaveAnimationCacheMagic || Version != WaveAnimationCacheVersion || FileWavesHash != WavesHash || NumFrames <= 0 || (NumFrames & 1) || NumCascades <= 0)
+		return false;
+
+	CascadeWaveSizes.SetNum(NumCascades);
+	for (int32& WaveSize : CascadeWaveSizes)
+	{
+		Reader << WaveSize;
+	}
+
+	Frames.SetNum(NumFrames * NumCascades);
+	for (FFrameEntry& Frame : Frames)
+	{
+		Reader << Frame.Offset << Frame.CompressedSize;
+		if (Reader.IsError() || Frame.Offset + Frame.CompressedSize > DataSize)
+			return false;
+	}
+
+	DecodedFrames.SetNum(NumCascades * 2);
+	return !Reader.IsError();
+}
+
+bool FWaveAnimationCache::Bake(const FString& Path, uint32 WavesHash, int32 InNumFrames, TArrayView<FWaveFFTCPU* const> Waves)
+{
+	// Even, so the two frames blended are never in the same decoded slot
+	NumFrames = FMath::Max(2, Align(InNumFrames, 2));
+	const int32 NumCascades = Waves.Num();
+	CascadeWaveSizes.SetNum(NumCascades);
+	for (int32 CascadeIndex = 0; CascadeIndex < NumCascades; ++CascadeIndex)
+	{
+		if (!Waves[CascadeIndex]->IsInitialized())
+			return false;
+		CascadeWaveSizes[CascadeIndex] = Waves[CascadeIndex]->GetWaveSize();
+	}
+
+	const double StartTime = FPlatformTime::Seconds();
+	TArray<uint8> CompressedFrames;
+	Frames.SetNum(NumFrames * NumCascades);
+	TArray<FFloat16> Channels;
+	TArray<uint8> CompressedFrame;
+	for (int32 FrameIndex = 0; FrameIndex < NumFrames; ++FrameIndex)
+	{
+		const float TimeSeconds = Period * FrameIndex / NumFrames;
+		for (int32 CascadeIndex = 0; CascadeIndex < NumCascades; ++CascadeIndex)
+		{
+			FWaveFFTCPU& Wave = *Waves[CascadeIndex];
+			Wave.Evaluate(TimeSeconds);
+
+			const FWaveFFTGrid& Grid = Wave.GetResult();
+			const int32 NumTexels = Grid.WaveSize * Grid.WaveSize;
+			Channels.SetNumUninitialized(NumTexels * WaveAnimationCacheChannels);
+			for (int32 Index = 0; Index < NumTexels; ++Index)
+			{
+				FFloat16* Texel = &Channels[Index * WaveAnimationCacheChannels];
+				Texel[0] = Grid.Height[Index].X;
+				Texel[1] = Grid.Slope[Index].X;
+				Texel[2] = Grid.Slope[Index].Z;
+				Texel[3] = Grid.Displacement[Index].X;
+				Texel[4] = Grid.Displacement[Index].Z;
+			}
+
+			const int32 UncompressedSize = Channels.Num() * sizeof(FFloat16);
+			int32 CompressedSize = FCompression::CompressMemoryBound(NAME_Zlib, UncompressedSize);
+			CompressedFrame.SetNumUninitialized(CompressedSize);
+			if (!FCompression::CompressMemory(NAME_Zlib, CompressedFrame.GetData(), CompressedSize, Channels.GetData(), UncompressedSize))
+				return false;
+
+			FFrameEntry& Frame = Frames[FrameIndex * NumCascades + CascadeIndex];
+			Frame.Offset = CompressedFrames.Num();
+			Frame.CompressedSize = CompressedSize;
+			CompressedFrames.Append(CompressedFrame.GetData(), CompressedSize);
+		}
+	}
+
+	// Offsets are from the start of the file
+	TArray<uint8> FileImage;
+	FMemoryWriter Writer(FileImage);
+	uint32 Magic = WaveAnimationCacheMagic, Version = WaveAnimationCacheVersion;
+	int32 NumFramesToSave = NumFrames, NumCascadesToSave = NumCascades;
+	Writer << Magic << Version << WavesHash << NumFramesToSave << NumCascadesToSave;
+	for (int32& WaveSize : CascadeWaveSizes)
+	{
+		Writer << WaveSize;
+	}
+	const int64 HeaderSize = Writer.Tell() + Frames.Num() * (sizeof(int64) + sizeof(int32));
+	for (FFrameEntry& Frame : Frames)
+	{
+		Frame.Offset += HeaderSize;
+		Writer << Frame.Offset << Frame.CompressedSize;
+	}
+	check(Writer.Tell() == HeaderSize);
+	FileImage.Append(CompressedFrames);
+
+	DecodedFrames.SetNum(NumCascades * 2);
+	UE_LOG(LogWaveAnimationCache, Log, TEXT("Baked %d frames of %d cascades in %.2fs, %lld bytes"), NumFrames, NumCascades, FPlatformTime::Seconds() - StartTime, (int64)FileImage.Num());
+
+	// Still played from memory when the file can not be written
+	if (!FFileHelper::SaveArrayToFile(FileImage, *Path))
+		UE_LOG(LogWaveAnimationCache, Warning, TEXT("Failed to save %s"), *Path);
+	FileData = MoveTemp(FileImage);
+	return true;
+}
+
+const TArray<FFloat16>& FWaveAnimationCache::DecodeFrame(int32 CascadeIndex, int32 FrameIndex)
+{
+	FDecodedFrame& Decoded = DecodedFrames[CascadeIndex * 2 + (FrameIndex & 1)];
+	if (Decoded.FrameIndex != FrameIndex)
+	{
+		const int32 WaveSize = CascadeWaveSizes[CascadeIndex];
+		const FFrameEntry& Frame = Frames[FrameIndex * CascadeWaveSizes.Num() + CascadeIndex];
+		Decoded.Channels.SetNumUninitialized(WaveSize * WaveSize * WaveAnimationCacheChannels);
+		const bool bUncompressed = FCompression::UncompressMemory(NAME_Zlib, Decoded.Channels.GetData(), Decoded.Channels.Num() * sizeof(FFloat16), GetFileData() + Frame.Offset, Frame.CompressedSize);
+		if (!bUncompressed)
+			FMemory::Memzero(Decoded.Channels.GetData(), Decoded.Channels.Num() * sizeof(FFloat16));
+		Decoded.FrameIndex = FrameIndex;
+	}
+	return Decoded.Channels;
+}
+
+void FWaveAnimationCache::Sample(int32 CascadeIndex, float TimeSeconds, FWaveFFTGrid& OutGrid)
+{
+	check(IsInGameThread());
+
+	const int32 WaveSize = CascadeWaveSizes[CascadeIndex];
+	if (OutGrid.WaveSize != WaveSize)
+		OutGrid.Init(WaveSize);
+
+	float Phase = FMath::Fmod(TimeSeconds, Period);
+	if (Phase < 0.f)
+		Phase += Period;
+	const float FrameTime = Phase / Period * NumFrames;
+	const int32 Frame0 = FMath::Min((int32)FrameTime, NumFrames - 1);
+	const int32 Frame1 = (Frame0 + 1) % NumFrames;
+	const float Alpha = FrameTime - Frame0;
+
+	const TArray<FFloat16>& Channels0 = DecodeFrame(CascadeIndex, Frame0);
+	const TArray<FFloat16>& Channels1 = DecodeFrame(CascadeIndex, Frame1);
+
+	// The spatial domain is linear in h(k,t), so blending the frames is blending the spectrum between them
+	ParallelFor(WaveSize, [&](int32 Row)
+	{
+		for (int32 Index = Row * WaveSize; Index < (Row + 1) * WaveSize; ++Index)
+		{
+			float Texel[WaveAnimationCacheChannels];
+			for (int32 Channel = 0; Channel < WaveAnimationCacheChannels; ++Channel)
+			{
+				const int32 ChannelIndex = Index * WaveAnimationCacheChannels + Channel;
+				Texel[Channel] = FMath::Lerp(Channels0[ChannelIndex].GetFloat(), Channels1[ChannelIndex].GetFloat(), Alpha);
+			}
+			OutGrid.Height[Index].X = Texel[0];
+			OutGrid.Slope[Index].X = Texel[1];
+			OutGrid.Slope[Index].Z = Texel[2];
+			OutGrid.Displacement[Index].X = Texel[3];
+			OutGrid.Displacement[Index].Z = Texel[4];
+		}
+	});
+}
@@ -0,0 +1,187 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "WaveBenchmark.h"
+
+// A stage has to be slower by this much too, the small ones are mostly noise
+static const double WaveBenchmarkNoiseMilliseconds = 0.05;
+
+FWaveSimulationKey FWaveBenchmark::MakeKey(const FWaveBenchmarkConfig& Config)
+{
+	// Same spectrum as the default AFFTWaveSimulator
+	FWaveSimulationKey Key;
+	Key.WaveAmplitude = 0.05f;
+	Key.WindSpeed = FVector(10.f, 10.f, 0.f);
+	Key.bUseSharedMemoryFFT = Config.bUseSharedMemoryFFT;
+	for (int32 CascadeIndex = 0; CascadeIndex < FMath::Clamp(Config.NumCascades, 1, MAX_WAVE_CASCADES); ++CascadeIndex)
+	{
+		FWaveCascadeKey& Cascade = Key.Cascades.AddDefaulted_GetRef();
+		Cascade.WaveSize = Config.WaveSize;
+		Cascade.PatchLength = FMath::Pow(4.f, CascadeIndex);
+	}
+	Key.LimitCascadeBands();
+	return Key;
+}
+
+const TCHAR* FWaveBenchmark::GetStageName(EWaveBenchmarkStage::Type Stage)
+{
+	switch (Stage)
+	{
+	case EWaveBenchmarkStage::Tables: return TEXT("Tables");
+	case EWaveBenchmarkStage::Upload: return TEXT("Upload");
+	case EWaveBenchmarkStage::PhillipsSpectrum: return TEXT("PhillipsSpectrum");
+	case EWaveBenchmarkStage::PrepareFFT: return TEXT("PrepareFFT");
+	case EWaveBenchmarkStage::FFT: return TEXT("FFT");
+	case EWaveBenchmarkStage::PosAndNormal: return TEXT("PosAndNormal");
+	default: return TEXT("Unknown");
+	}
+}
+
+bool FWaveBenchmark::RunCPU(const FWaveBenchmarkConfig& Config, FWaveBenchmarkResult& OutResult)
+{
+	if (!FMath::IsPowerOfTwo(Config.WaveSize) || Config.WaveSize < 2)
+		return false;
+
+	const FWaveSimulationKey Key = MakeKey(Config);
+	const int32 NumCascades = Key.Cascades.Num();
+	OutResult = FWaveBenchmarkResult();
+	OutResult.Config = Config;
+	OutResult.Backend = TEXT("CPU");
+	OutResult.Stages.SetNum(EWaveBenchmarkStage::Num);
+	for (int32 StageIndex = 0; StageIndex < EWaveBenchmarkStage::Num; ++StageIndex)
+	{
+		OutResult.Stages[StageIndex].Name = GetStageName((EWaveBenchmarkStage::Type)StageIndex);
+	}
+
+	TArray<TArray<FVector2D>> RandomTables;
+	TArray<TArray<float>> ButterflyLookupTables;
+	TArray<TArray<float>> DispersionTables;
+	RandomTables.SetNum(NumCascades);
+	ButterflyLookupTables.SetNum(NumCascades);
+	DispersionTables.SetNum(NumCascades);
+	double StartTime = FPlatformTime::Seconds();
+	for (int32 CascadeIndex = 0; CascadeIndex < NumCascades; ++CascadeIndex)
+	{
+		FWaveSimulation::CreateCascadeTables(Key.Cascades[CascadeIndex], Key.GetCascadeSeed(CascadeIndex), RandomTables[CascadeIndex], ButterflyLookupTables[CascadeIndex], DispersionTables[CascadeIndex]);
+	}
+	OutResult.Stages[EWaveBenchmarkStage::Tables].CPUMilliseconds = (FPlatformTime::Seconds() - StartTime) * 1000.0;
+
+	// Init computes h0(k) and its conjugate, as PhillipsSpectrumCS
+	TArray<FWaveFFTCPU> Waves;
+	Waves.SetNum(NumCascades);
+	StartTime = FPlatformTime::Seconds();
+	for (int32 CascadeIndex = 0; CascadeIndex < NumCascades; ++CascadeIndex)
+	{
+		const FWaveCascadeKey& Cascade = Key.Cascades[CascadeIndex];
+		Waves[CascadeIndex].Init(Cascade.WaveSize, Cascade.PatchLength, Key.WaveAmplitude, Key.WindSpeed, RandomTables[CascadeIndex], DispersionTables[CascadeIndex], ButterflyLookupTables[CascadeIndex], Cascade.SpectrumKMin, Cascade.SpectrumKMax);
+	}
+	OutResult.Stages[EWaveBenchmarkStage::PhillipsSpectrum].CPUMilliseconds = (FPlatformTime::Seconds() - StartTime) * 1000.0;
+
+	TArray<FWaveSurfaceMirror> Mirrors;
+	Mirrors.SetNum(NumCascades);
+	const int32 NumFrames = FMath::Max(Config.NumFrames, 1);
+	for (int32 Frame = 0; Frame < NumFrames; ++Frame)
+	{
+		const float TimeSeconds = Frame / 60.f;
+		StartTime = FPlatformTime::Seconds();
+		for (FWaveFFTCPU& Wave : Waves)
+		{
+			Wave.PrepareForFFT(TimeSeconds);
+		}
+		const double PreparedTime = FPlatformTime::Seconds();
+		for (FWaveFFTCPU& Wave : Waves)
+		{
+			Wave.EvaluateFFT();
+		}
+		const double EvaluatedTime = FPlatformTime::Seconds();
+		for (int32 CascadeIndex = 0; CascadeIndex < NumCascades; ++CascadeIndex)
+		{
+			Mirrors[CascadeIndex].Build(Waves[CascadeIndex], TimeSeconds);
+		}
+		const double MirroredTime = FPlatformTime::Seconds();
+
+		OutResult.Stages[EWaveBenchmarkStage::PrepareFFT].CPUMilliseconds += (PreparedTime - StartTime) * 1000.0 / NumFrames;
+		OutResult.Stages[EWaveBenchmarkStage::FFT].CPUMilliseconds += (EvaluatedTime - PreparedTime) * 1000.0 / NumFrames;
+		OutResult.Stages[EWaveBenchmarkStage::PosAndNormal].CPUMilliseconds += (MirroredTime - EvaluatedTime) * 1000.0 / NumFrames;
+	}
+
+	for (int32 CascadeIndex = 0; CascadeIndex < NumCascades; ++CascadeIndex)
+	{
+		OutResult.MemoryBytes += RandomTables[CascadeIndex].GetAllocatedSize() + ButterflyLookupTables[CascadeIndex].GetAllocatedSize() + DispersionTables[CascadeIndex].GetAllocatedSize();
+		OutResult.MemoryBytes += Waves[CascadeIndex].GetAllocatedSize();
+		OutResult.MemoryBytes += Mirrors[CascadeIndex].PosOffset.GetAllocatedSize() + Mirrors[CascadeIndex].Normal.GetAllocatedSize();
+	}
+	return true;
+}
+
+FString FWaveBenchmark::ToCSV(const TArray<FWaveBenchmarkResult>& Results)
+{
+	FString CSV = TEXT("WaveSize,Cascades,Frames,Backend,Stage,CPUms,GPUms,MemoryBytes\n");
+	for (const FWaveBenchmarkResult& Result : Results)
+	{
+		for (const FWaveBenchmarkStage& Stage : Result.Stages)
+		{
+			CSV += FString::Printf(TEXT("%d,%d,%d,%s,%s,%.4f,%.4f,%lld\n"), Result.Config.WaveSize, Result.Config.NumCascades, Result.Config.NumFrames,
+				*Result.Backend, *Stage.Name, Stage.CPUMilliseconds, Stage.GPUMilliseconds, Result.MemoryBytes);
+		}
+	}
+	return CSV;
+}
+
+FString FWaveBenchmark::ToJson(const TArray<FWaveBenchmarkResult>& Results)
+{
+	FString Json = TEXT("[\n");
+	for (int32 ResultIndex = 0; ResultIndex < Results.Num(); ++ResultIndex)
+	{
+		const FWaveBenchmarkResult& Result = Results[ResultIndex];
+		Json += FString::Printf(TEXT("\t{ \"WaveSize\": %d, \"Cascades\": %d, \"Frames\": %d, \"Backend\": \"%s\", \"MemoryBytes\": %lld, \"Stages\": ["),
+			Result.Config.WaveSize, Result.Config.NumCascades, Result.Config.NumFrames, *Result.Backend, Result.MemoryBytes);
+		for (int32 StageIndex = 0; StageIndex < Result.Stages.Num(); ++StageIndex)
+		{
+			const FWaveBenchmarkStage& Stage = Result.Stages[StageIndex];
+			Json += FString::Printf(TEXT("%s{ \"Name\": \"%s\", \"CPUms\": %.4f, \"GPUms\": %.4f }"), StageIndex > 0 ? TEXT(", ") : TEXT(""), *Stage.Name, Stage.CPUMilliseconds, Stage.GPUMilliseconds);
+		}
+		Json += ResultIndex + 1 < Results.Num() ? TEXT("] },\n") : TEXT("] }\n");
+	}
+	Json += TEXT("]\n");
+	return Json;
+}
+
+int32 FWaveBenchmark::CompareToBaseline(const TArray<FWaveBenchmarkResult>& Results, const FString& BaselineCSV, float Tolerance, TArray<FString>& OutRegressions)
+{
+	// WaveSize,Cascades,Backend,Stage to CPUms and GPUms
+	TMap<FString, TPair<double, double>> Baseline;
+	TArray<FString> Lines;
+	BaselineCSV.ParseIntoArrayLines(Lines);
+	for (int32 LineIndex = 1; LineIndex < Lines.Num(); ++LineIndex)
+	{
+		TArray<FString> Columns;
+		if (Lines[LineIndex].ParseIntoArray(Columns, TEXT(","), false) < 7)
+			continue;
+
+		const FString StageKey = FString::Printf(TEXT("%s,%s,%s,%s"), *Columns[0], *Columns[1], *Columns[3], *Columns[4]);
+		Baseline.Add(StageKey, TPair<double, double>(FCString::Atod(*Columns[5]), FCString::Atod(*Columns[6])));
+	}
+
+	auto IsRegression = [Tolerance](double Current, double Base)
+	{
+		return Base >= 0.0 && Current > Base * (1.0 + Tolerance) && Current - Base > WaveBenchmarkNoiseMilliseconds;
+	};
+
+	for (const FWaveBenchmarkResult& Result : Results)
+	{
+		for (const FWaveBenchmarkStage& Stage : Result.Stages)
+		{
+			const FString StageKey = FString::Printf(TEXT("%d,%d,%s,%s"), Result.Config.WaveSize, Result.Config.NumCascades, *Result.Backend, *Stage.Name);
+			const TPair<double, double>* Base = Baseline.Find(StageKey);
+			if (!Base)
+				continue;
+
+			if (IsRegression(Stage.CPUMilliseconds, Base->Key))
+				OutRegressions.Add(FString::Printf(TEXT("%s cpu %.4fms, baseline %.4fms"), *StageKey, Stage.CPUMilliseconds, Base->Key));
+			if (Stage.GPUMilliseconds >= 0.0 && IsRegression(Stage.GPUMilliseconds, Base->Value))
+				OutRegressions.Add(FString::Printf(TEXT("%s gpu %.4fms, baseline %.4fms"), *StageKey, Stage.GPUMilliseconds, Base->Value));
+		}
+	}
+	return OutRegressions.Num();
+}
@@ -0,0 +1,126 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "WaveBenchmarkCommandlet.h"
+#include "WaveBenchmark.h"
+#include "Misc/App.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogWaveBenchmarkCommandlet, Log, All);
+
+static TArray<int32> ParseIntList(const FString& Params, const TCHAR* Name, const TArray<int32>& Default)
+{
+	FString Value;
+	if (!FParse::Value(*Params, Name, Value, false))
+		return Default;
+
+	TArray<FString> Items;
+	Value.ParseIntoArray(Items, TEXT(","));
+	TArray<int32> Result;
+	for (const FString& Item : Items)
+	{
+		Result.Add(FCString::Atoi(*Item));
+	}
+	return Result;
+}
+
+UWaveBenchmarkCommandlet::UWaveBenchmarkCommandlet()
+{
+	IsClient = false;
+	IsEditor = true;
+	IsServer = false;
+	LogToConsole = true;
+}
+
+int32 UWaveBenchmarkCommandlet::Main(const FString& Params)
+{
+	const TArray<int32> WaveSizes = ParseIntList(Params, TEXT("Sizes="), { 64, 128, 256, 512, 1024 });
+	const TArray<int32> CascadeCounts = ParseIntList(Params, TEXT("Cascades="), { 1, 2, 4 });
+	int32 NumFrames = 32;
+	FParse::Value(*Params, TEXT("Frames="), NumFrames);
+	FString OutputPath = FPaths::ProjectSavedDir() / TEXT("WaveBenchmark") / TEXT("WaveBenchmark.csv");
+	FParse::Value(*Params, TEXT("Output="), OutputPath);
+	const bool bMeasureGPU = !FParse::Param(*Params, TEXT("CPU")) && FApp::CanEverRender();
+	if (!FParse::Param(*Params, TEXT("CPU")) && !FApp::CanEverRender())
+	{
+		UE_LOG(LogWaveBenchmarkCommandlet, Warning, TEXT("No RHI, gpu is not measured. Run with -AllowCommandletRendering to measure it, or -CPU to silence this"));
+	}
+
+	UE_LOG(LogWaveBenchmarkCommandlet, Display, TEXT("Measuring %d sizes x %d cascade counts, %d frames, gpu %s"), WaveSizes.Num(), CascadeCounts.Num(), NumFrames, bMeasureGPU ? TEXT("on") : TEXT("off"));
+
+	TArray<FWaveBenchmarkResult> Results;
+	int32 FailedCount = 0;
+	for (int32 WaveSize : WaveSizes)
+	{
+		for (int32 NumCascades : CascadeCounts)
+		{
+			FWaveBenchmarkConfig Config;
+			Config.WaveSize = WaveSize;
+			Config.NumCascades = FMath::Clamp(NumCascades, 1, MAX_WAVE_CASCADES);
+			Config.NumFrames = FMath::Max(NumFrames, 1);
+			Config.bUseSharedMemoryFFT = !FParse::Param(*Params, TEXT("NoSharedFFT"));
+
+			FWaveBenchmarkResult Result;
+			if (FWaveBenchmark::RunCPU(Config, Result))
+				Results.Add(Result);
+			else
+				++FailedCount;
+
+			if (bMeasureGPU)
+			{
+				if (FWaveBenchmark::RunGPU(Config, Result))
+					Results.Add(Result);
+				else
+					++FailedCount;
+			}
+		}
+	}
+
+	for (const FWaveBenchmarkResult& Result : Results)
+	{
+		FString Line = FString::Printf(TEXT("%s size %d cascades %d, %.1f KB:"), *Result.Backend, Result.Config.WaveSize, Result.Config.NumCascades, Result.MemoryBytes / 1024.0);
+		for (const FWaveBenchmarkStage& Stage : Result.Stages)
+		{
+			Line += Stage.GPUMilliseconds >= 0.0 ? FString::Printf(TEXT(" %s %.3f/%.3fms"), *Stage.Name, Stage.CPUMilliseconds, Stage.GPUMilliseconds) : FString::Printf(TEXT(" %s %.3fms"), *Stage.Name, Stage.CPUMilliseconds);
+		}
+		UE_LOG(LogWaveBenchmarkCommandlet, Display, TEXT("%s"), *Line);
+	}
+
+	if (!FFileHelper::SaveStringToFile(FWaveBenchmark::ToCSV(Results), *OutputPath))
+	{
+		UE_LOG(LogWaveBenchmarkCommandlet, Warning, TEXT("Failed to write %s"), *OutputPath);
+		++FailedCount;
+	}
+	if (FParse::Param(*Params, TEXT("Json")) && !FFileHelper::SaveStringToFile(FWaveBenchmark::ToJson(Results), *FPaths::ChangeExtension(OutputPath, TEXT("json"))))
+	{
+		UE_LOG(LogWaveBenchmarkCommandlet, Warning, TEXT("Failed to write %s"), *FPaths::ChangeExtension(OutputPath, TEXT("json")));
+		++FailedCount;
+	}
+
+	int32 RegressionCount = 0;
+	FString BaselinePath;
+	if (FParse::Value(*Params, TEXT("Baseline="), BaselinePath))
+	{
+		FString BaselineCSV;
+		float Tolerance = 0.2f;
+		FParse::Value(*Params, TEXT("Tolerance="), Tolerance);
+		if (FFileHelper::LoadFileToString(BaselineCSV, *BaselinePath))
+		{
+			TArray<FString> Regressions;
+			RegressionCount = FWaveBenchmark::CompareToBaseline(Results, BaselineCSV, Tolerance, Regressions);
+			for (const FString& Regression : Regressions)
+			{
+				UE_LOG(LogWaveBenchmarkCommandlet, Warning, TEXT("Regression: %s"), *Regression);
+			}
+		}
+		else
+		{
+			UE_LOG(LogWaveBenchmarkCommandlet, Warning, TEXT("Failed to read baseline %s"), *BaselinePath);
+			++FailedCount;
+		}
+	}
+
+	UE_LOG(LogWaveBenchmarkCommandlet, Display, TEXT("Measured %d, failed %d, regressions %d, written to %s"), Results.Num(), FailedCount, RegressionCount, *OutputPath);
+	return FailedCount == 0 && RegressionCount == 0 ? 0 : 1;
+}
@@ -0,0 +1,395 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "WaveSimulation.h"
+#include "Engine/World.h"
+#include "Misc/App.h"
+#include "RenderingThread.h"
+#include "Misc/Paths.h"
+
+#define GRAVITY 9.8f
+
+extern void ComputeRandomTable(int32 Size, uint32 Seed, TArray<FVector2D>& OutTable);
+extern void ComputeButterflyLookuptable(int32 Size, int32 Passes, TArray<float>& OutTable);
+
+// The cpu simulation keeps running for this long after the last query
+static const float WaveQueryKeepAliveSeconds = 1.f;
+
+// A smaller cascade starts at this harmonic of its patch, its longest waves repeat too often to be seen
+static const float WaveCascadeFirstHarmonic = 6.f;
+
+static TMap<FWaveSimulationKey, TWeakPtr<FWaveSimulation, ESPMode::ThreadSafe>> GRunningWaveSimulations;
+
+void FWaveSimulationKey::LimitCascadeBands()
+{
+	TArray<FWaveCascadeKey*, TInlineAllocator<MAX_WAVE_CASCADES>> SortedCascades;
+	for (FWaveCascadeKey& Cascade : Cascades)
+	{
+		Cascade.SpectrumKMin = 0.f;
+		Cascade.SpectrumKMax = BIG_NUMBER;
+		SortedCascades.Add(&Cascade);
+	}
+	SortedCascades.Sort([](const FWaveCascadeKey& A, const FWaveCascadeKey& B) { return A.PatchLength > B.PatchLength; });
+
+	for (int32 i = 0; i + 1 < SortedCascades.Num(); ++i)
+	{
+		FWaveCascadeKey& Larger = *SortedCascades[i];
+		FWaveCascadeKey& Smaller = *SortedCascades[i + 1];
+		// The larger patch can not go beyond its highest wave number PI * N / L
+		const float Boundary = FMath::Min(PI * Larger.WaveSize / Larger.PatchLength, 2.f * PI * WaveCascadeFirstHarmonic / Smaller.PatchLength);
+		Larger.SpectrumKMax = FMath::Max(Boundary, Larger.SpectrumKMin);
+		Smaller.SpectrumKMin = Larger.SpectrumKMax;
+	}
+}
+
+uint32 FWaveSimulationKey::GetWavesHash() const
+{
+	uint32 Hash = GetTypeHash(Seed);
+	Hash = HashCombine(Hash, GetTypeHash(WaveAmplitude));
+	Hash = HashCombine(Hash, GetTypeHash(WindSpeed));
+	Hash = HashCombine(Hash, GetTypeHash(AnimationCacheFrames));
+	for (const FWaveCascadeKey& Cascade : Cascades)
+	{
+		Hash = HashCombine(Hash, GetTypeHash(Cascade.WaveSize));
+		Hash = HashCombine(Hash, GetTypeHash(Cascade.PatchLength));
+		Hash = HashCombine(Hash, GetTypeHash(Cascade.SpectrumKMin));
+		Hash = HashCombine(Hash, GetTypeHash(Cascade.SpectrumKMax));
+	}
+	return Hash;
+}
+
+TSharedRef<FWaveSimulation, ESPMode::ThreadSafe> FWaveSimulation::FindOrCreate(const FWaveSimulationKey& InKey)
+{
+	check(IsInGameThread());
+
+	if (TWeakPtr<FWaveSimulation, ESPMode::ThreadSafe>* Found = GRunningWaveSimulations.Find(InKey))
+	{
+		if (TSharedPtr<FWaveSimulation, ESPMode::ThreadSafe> Simulation = Found->Pin())
+			return Simulation.ToSharedRef();
+	}
+
+	TSharedRef<FWaveSimulation, ESPMode::ThreadSafe> Simulation = MakeShareable(new FWaveSimulation(InKey));
+	GRunningWaveSimulations.Add(InKey, Simulation);
+	return Simulation;
+}
+
+TSharedRef<FWaveSimulation, ESPMode::ThreadSafe> FWaveSimulation::FindOrUpdate(const TSharedPtr<FWaveSimulation, ESPMode::ThreadSafe>& Current, const FWaveSimulationKey& InKey)
+{
+	check(IsInGameThread());
+
+	if (Current.IsValid() && Current->Key == InKey)
+		return Current.ToSharedRef();
+
+	// Join another tile which already runs the new key
+	if (TWeakPtr<FWaveSimulation, ESPMode::ThreadSafe>* Found = GRunningWaveSimulations.Find(InKey))
+	{
+		if (TSharedPtr<FWaveSimulation, ESPMode::ThreadSafe> Simulation = Found->Pin())
+			return Simulation.ToSharedRef();
+	}
+
+	// Other tiles still want the old spectrum from a shared one
+	if (Current.IsValid() && Current.IsUnique() && Current->CanUpdateSpectrum(InKey))
+	{
+		GRunningWaveSimulations.Remove(Current->Key);
+		Current->UpdateSpectrum(InKey);
+		GRunningWaveSimulations.Add(InKey, Current);
+		return Current.ToSharedRef();
+	}
+
+	return FindOrCreate(InKey);
+}
+
+FWaveSimulation::FWaveSimulation(const FWaveSimulationKey& InKey) :
+	Key(InKey),
+	LastQueryTime(-BIG_NUMBER),
+	LastEvaluatedFrame(0),
+	LastCPUEvaluatedFrame(0),
+	LastEvaluatedTime(-BIG_NUMBER),
+	FrameSignificance(FWaveSignificance::Hidden()),
+	LastFrameSignificance(FWaveSignificance::Hidden()),
+	SignificanceFrame(0)
+{
+	CreateLookupTables();
+
+	if (Key.AnimationCacheFrames > 0)
+		CreateAnimationCache();
+
+	UWorld* World = Key.World.Get();
+	if (FApp::CanEverRender() && World && World->Scene)
+		CreateRenderData();
+}
+
+FWaveSimulation::~FWaveSimulation()
+{
+	check(IsInGameThread());
+
+	// A new simulation may already use the key, only remove the stale one
+	TWeakPtr<FWaveSimulation, ESPMode::ThreadSafe>* Found = GRunningWaveSimulations.Find(Key);
+	if (Found && !Found->IsValid())
+		GRunningWaveSimulations.Remove(Key);
+
+	// Commands already enqueued still hold it, so it goes away after them on render thread
+	if (RenderData.IsValid())
+	{
+		ENQUEUE_RENDER_COMMAND(FReleaseWaveSimulation)([RenderData = MoveTemp(RenderData)](FRHICommandListImmediate& RHICmdList) mutable
+		{
+			RenderData.Reset();
+		});
+	}
+}
+
+float FWaveSimulation::Dispersion(int32 WaveSize, float PatchLength, int32 n, int32 m)
+{
+	//float W_0 = 2.0f * PI / 200.f;  // Use this value, time will be slow, so that the wave will be slow too
+	float W_0 = 1.f;
+	float KX = PI * (2 * n - WaveSize) / PatchLength; //k=2*PI*n/L
+	float KY = PI * (2 * m - WaveSize) / PatchLength;
+	// w=sqrt(g*|k|)
+	return FMath::FloorToFloat(FMath::Sqrt(GRAVITY * FMath::Sqrt(KX * KX + KY * KY) / W_0)) * W_0;
+}
+
+void FWaveSimulation::CreateCascadeTables(const FWaveCascadeKey& CascadeKey, uint32 Seed, TArray<FVector2D>& OutRandomTable, TArray<float>& OutButterflyLookupTable, TArray<float>& OutDispersionTable)
+{
+	const int32 WaveSize = CascadeKey.WaveSize;
+	ComputeRandomTable(WaveSize + 1, Seed, OutRandomTable);
+	ComputeButterflyLookuptable(WaveSize, (int32)FMath::Log2(WaveSize), OutButterflyLookupTable);
+	CreateDispersionTable(WaveSize, CascadeKey.PatchLength, OutDispersionTable);
+}
+
+void FWaveSimulation::CreateDispersionTable(int32 WaveSize, float PatchLength, TArray<float>& OutDispersionTable)
+{
+	OutDispersionTable.SetNum((WaveSize + 1) * (WaveSize + 1));
+	for (int32 i = 0; i < WaveSize + 1; ++i)
+	{
+		for (int32 j = 0; j < WaveSize + 1; ++j)
+		{
+			int32 Index = i * (WaveSize + 1) + j;
+			OutDispersionTable[Index] = Dispersion(WaveSize, PatchLength, j, i);
+		}
+	}
+}
+
+void FWaveSimulation::CreateLookupTables()
+{
+	Cascades.SetNum(Key.Cascades.Num());
+	for (int32 CascadeIndex = 0; CascadeIndex < Cascades.Num(); ++CascadeIndex)
+	{
+		FCascade& Cascade = Cascades[CascadeIndex];
+		CreateCascadeTables(Key.Cascades[CascadeIndex], Key.GetCascadeSeed(CascadeIndex), Cascade.RandomTable, Cascade.ButterflyLookupTable, Cascade.DispersionTable);
+	}
+}
+
+bool FWaveSimulation::CanUpdateSpectrum(const FWaveSimulationKey& InKey) const
+{
+	if (Key.AnimationCacheFrames > 0 || InKey.AnimationCacheFrames > 0)
+		return false;
+
+	if (Key.World != InKey.World || Key.Seed != InKey.Seed || Key.TimeRate != InKey.TimeRate || Key.bUseSharedMemoryFFT != InKey.bUseSharedMemoryFFT || Key.Cascades.Num() != InKey.Cascades.Num())
+		return false;
+
+	// The random and butterfly tables and the buffers only depend on these
+	for (int32 CascadeIndex = 0; CascadeIndex < Key.Cascades.Num(); ++CascadeIndex)
+	{
+		const FWaveCascadeKey& Cascade = Key.Cascades[CascadeIndex];
+		const FWaveCascadeKey& NewCascade = InKey.Cascades[CascadeIndex];
+		if (Cascade.WaveSize != NewCascade.WaveSize || Cascade.HeightMapRenderTarget != NewCascade.HeightMapRenderTarget || Cascade.NormalRenderTarget != NewCascade.NormalRenderTarget)
+			return false;
+	}
+	return true;
+}
+
+void FWaveSimulation::UpdateSpectrum(const FWaveSimulationKey& InKey)
+{
+	check(CanUpdateSpectrum(InKey));
+
+	TArray<bool, TInlineAllocator<MAX_WAVE_CASCADES>> DispersionChanged;
+	for (int32 CascadeIndex = 0; CascadeIndex < Cascades.Num(); ++CascadeIndex)
+	{
+		const FWaveCascadeKey& NewCascade = InKey.Cascades[CascadeIndex];
+		DispersionChanged.Add(Key.Cascades[CascadeIndex].PatchLength != NewCascade.PatchLength);
+		if (DispersionChanged.Last())
+			CreateDispersionTable(NewCascade.WaveSize, NewCascade.PatchLength, Cascades[CascadeIndex].DispersionTable);
+	}
+	Key = InKey;
+
+	// Only the cpu waves already running are computed again, the others are made when they are first needed
+	for (int32 CascadeIndex = 0; CascadeIndex < Cascades.Num(); ++CascadeIndex)
+	{
+		const FWaveCascadeKey& CascadeKey = Key.Cascades[CascadeIndex];
+		FCascade& Cascade = Cascades[CascadeIndex];
+		if (Cascade.CPUWave.IsInitialized())
+			Cascade.CPUWave.Init(CascadeKey.WaveSize, CascadeKey.PatchLength, Key.WaveAmplitude, Key.WindSpeed, Cascade.RandomTable, Cascade.DispersionTable, Cascade.ButterflyLookupTable, CascadeKey.SpectrumKMin, CascadeKey.SpectrumKMax);
+	}
+
+	if (RenderData.IsValid())
+		UpdateRenderSpectrum(DispersionChanged);
+}
+
+void FWaveSimulation::Tick(bool bSimulateOnCPU, const FWaveSignificance& Significance)
+{
+	UWorld* World = Key.World.Get();
+	if (!World)
+		return;
+
+	// Tiles tick one after another, so the first one of a frame decides with what all tiles asked for in the last frame
+	if (SignificanceFrame != GFrameCounter)
+	{
+		SignificanceFrame = GFrameCounter;
+		LastFrameSignificance = FrameSignificance;
+		FrameSignificance = FWaveSignificance::Hidden();
+	}
+	FrameSignificance.Merge(Significance);
+	FWaveSignificance Needed = LastFrameSignificance;
+	Needed.Merge(Significance);
+	const bool bEvaluate = LastEvaluatedFrame != GFrameCounter && Needed.IsNeeded() && World->TimeSeconds - LastEvaluatedTime >= Needed.UpdateInterval;
+
+	// Same time as EvaluateWavesFFT_RenderThread
+	const float TimeSeconds = World->TimeSeconds * Key.TimeRate;
+	if (AnimationCache.IsValid())
+	{
+		// The baked loop is sampled once a frame for both gpu and cpu, no FFT runs.
+		// Only the upload depends on significance, hidden tiles must not freeze the wave of buoyancy
+		const bool bEvaluateCPU = (bSimulateOnCPU || ShouldSimulateOnCPU()) && LastCPUEvaluatedFrame != GFrameCounter;
+		const bool bSampledThisFrame = LastEvaluatedFrame == GFrameCounter || LastCPUEvaluatedFrame == GFrameCounter;
+		if ((bEvaluate || bEvaluateCPU) && !bSampledThisFrame)
+			SampleAnimationCache(TimeSeconds);
+
+		if (bEvaluate)
+		{
+			LastEvaluatedFrame = GFrameCounter;
+			LastEvaluatedTime = World->TimeSeconds;
+			if (RenderData.IsValid())
+				UploadAnimationFrame();
+		}
+		if (bEvaluateCPU)
+		{
+			LastCPUEvaluatedFrame = GFrameCounter;
+			PublishSurfaceMirror(TimeSeconds);
+		}
+		return;
+	}
+
+	if (bEvaluate)
+	{
+		LastEvaluatedFrame = GFrameCounter;
+		LastEvaluatedTime = World->TimeSeconds;
+		if (RenderData.IsValid())
+			EvaluateWavesFFT(TimeSeconds, Needed.bLongWavesOnly);
+	}
+
+	// Another tile may ask for the cpu one later in the same frame
+	if ((bSimulateOnCPU || ShouldSimulateOnCPU()) && LastCPUEvaluatedFrame != GFrameCounter)
+	{
+		LastCPUEvaluatedFrame = GFrameCounter;
+		EvaluateWavesFFT_CPU(TimeSeconds);
+	}
+}
+
+bool FWaveSimulation::ShouldSimulateOnCPU() const
+{
+	UWorld* World = Key.World.Get();
+	const bool bQueried = World && World->TimeSeconds - LastQueryTime < WaveQueryKeepAliveSeconds;
+	return bQueried || !FApp::CanEverRender();
+}
+
+void FWaveSimulation::MarkQueried()
+{
+	if (UWorld* World = Key.World.Get())
+		LastQueryTime = World->TimeSeconds;
+}
+
+FVector2D FWaveSimulation::InitSpectrum(float TimeSeconds, int32 n, int32 m, int32 CascadeIndex) const
+{
+	if (Cascades.IsValidIndex(CascadeIndex) && Cascades[CascadeIndex].CPUWave.IsInitialized())
+		return Cascades[CascadeIndex].CPUWave.InitSpectrum(TimeSeconds, n, m);
+
+	return FVector2D::ZeroVector;
+}
+
+const FWaveFFTGrid* FWaveSimulation::GetWaveResult(int32 CascadeIndex) const
+{
+	if (!Cascades.IsValidIndex(CascadeIndex))
+		return nullptr;
+
+	const FCascade& Cascade = Cascades[CascadeIndex];
+	if (AnimationCache.IsValid())
+		return Cascade.CachedGrid.WaveSize > 0 ? &Cascade.CachedGrid : nullptr;
+	return Cascade.CPUWave.IsInitialized() ? &Cascade.CPUWave.GetResult() : nullptr;
+}
+
+void FWaveSimulation::CreateAnimationCache()
+{
+	TArray<FWaveFFTCPU*, TInlineAllocator<MAX_WAVE_CASCADES>> Waves;
+	for (int32 CascadeIndex = 0; CascadeIndex < Cascades.Num(); ++CascadeIndex)
+	{
+		const FWaveCascadeKey& CascadeKey = Key.Cascades[CascadeIndex];
+		FCascade& Cascade = Cascades[CascadeIndex];
+		if (!FMath::IsPowerOfTwo(CascadeKey.WaveSize) || CascadeKey.WaveSize < 2)
+			return;
+
+		if (!Cascade.CPUWave.IsInitialized())
+			Cascade.CPUWave.Init(CascadeKey.WaveSize, CascadeKey.PatchLength, Key.WaveAmplitude, Key.WindSpeed, Cascade.RandomTable, Cascade.DispersionTable, Cascade.ButterflyLookupTable, CascadeKey.SpectrumKMin, CascadeKey.SpectrumKMax);
+		Waves.Add(&Cascade.CPUWave);
+	}
+
+	const uint32 WavesHash = Key.GetWavesHash();
+	const FString Path = FPaths::ProjectSavedDir() / TEXT("WaveAnimationCache") / FString::Printf(TEXT("%08x.wavecache"), WavesHash);
+	AnimationCache = FWaveAnimationCache::LoadOrBake(Path, WavesHash, Key.AnimationCacheFrames, Waves);
+}
+
+void FWaveSimulation::SampleAnimationCache(float TimeSeconds)
+{
+	for (int32 CascadeIndex = 0; CascadeIndex < Cascades.Num(); ++CascadeIndex)
+	{
+		AnimationCache->Sample(CascadeIndex, TimeSeconds, Cascades[CascadeIndex].CachedGrid);
+	}
+}
+
+void FWaveSimulation::EvaluateWavesFFT_CPU(float TimeSeconds)
+{
+	for (int32 CascadeIndex = 0; CascadeIndex < Cascades.Num(); ++CascadeIndex)
+	{
+		const FWaveCascadeKey& CascadeKey = Key.Cascades[CascadeIndex];
+		FCascade& Cascade = Cascades[CascadeIndex];
+		if (!FMath::IsPowerOfTwo(CascadeKey.WaveSize) || CascadeKey.WaveSize < 2)
+			return;
+
+		if (!Cascade.CPUWave.IsInitialized())
+			Cascade.CPUWave.Init(CascadeKey.WaveSize, CascadeKey.PatchLength, Key.WaveAmplitude, Key.WindSpeed, Cascade.RandomTable, Cascade.DispersionTable, Cascade.ButterflyLookupTable, CascadeKey.SpectrumKMin, CascadeKey.SpectrumKMax);
+
+		Cascade.CPUWave.Evaluate(TimeSeconds);
+	}
+	PublishSurfaceMirror(TimeSeconds);
+}
+
+void FWaveSimulation::PublishSurfaceMirror(float TimeSeconds)
+{
+	// Build into the back one, it is only reused when no query holds it any more
+	if (!BackSurfaceMirror.IsValid() || !BackSurfaceMirror.IsUnique())
+		BackSurfaceMirror = MakeShared<FWaveSurfaceCascadeMirrors, ESPMode::ThreadSafe>();
+
+	const FWaveCascadeKey& FirstCascade = Key.Cascades[0];
+	BackSurfaceMirror->Cascades.SetNum(Cascades.Num());
+	for (int32 CascadeIndex = 0; CascadeIndex < Cascades.Num(); ++CascadeIndex)
+	{
+		const FWaveCascadeKey& CascadeKey = Key.Cascades[CascadeIndex];
+		// Nothing sampled or evaluated yet, keep the mirror queries already have
+		const FWaveFFTGrid* WaveResult = GetWaveResult(CascadeIndex);
+		if (!WaveResult)
+			return;
+
+		FWaveSurfaceMirror& Mirror = BackSurfaceMirror->Cascades[CascadeIndex];
+		Mirror.Build(*WaveResult, TimeSeconds);
+		// Same world length of a patch unit in every cascade
+		Mirror.TexelScale = (float)CascadeKey.WaveSize / FirstCascade.WaveSize * FirstCascade.PatchLength / CascadeKey.PatchLength;
+	}
+
+	FScopeLock Lock(&SurfaceMirrorCS);
+	Swap(SurfaceMirror, BackSurfaceMirror);
+}
+
+TSharedPtr<const FWaveSurfaceCascadeMirrors, ESPMode::ThreadSafe> FWaveSimulation::GetSurfaceMirror() const
+{
+	FScopeLock Lock(&SurfaceMirrorCS);
+	return SurfaceMirror;
+}
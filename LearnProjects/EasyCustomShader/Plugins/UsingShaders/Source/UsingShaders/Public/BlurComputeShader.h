@@ -1,14 +1,22 @@
 #pragma once
 #include "CoreMinimal.h"
-#include "UObject/ObjectMacros.h"
-#include "Classes/Kismet/BlueprintFunctionLibrary.h"
 #include "RHIResources.h"
+#include "RenderGraphResources.h"
 
-/**
- * 
- */
-
-void DrawBlurComputeShaderRenderTarget(AActor* Ac, int32 BlurCounts,  FRHITexture* MyTexture,  FRHITexture* UAVSource,FRHIUnorderedAccessView* TextureUAV);
+class FRDGBuilder;
 
+/** Format of the blurred texture, R11G11B10 is half the size when the alpha is not needed */
+enum class EBlurTextureFormat : uint8
+{
+	FloatRGBA,
+	FloatR11G11B10
+};
 
+/**
+ * Blur as much as BlurCounts passes of the old 11 taps kernel, in one separable gaussian of the same sigma,
+ * so the cost does not grow with BlurCounts. Large sigmas are blurred at a lower resolution and upsampled.
+ */
+FRDGTextureRef AddBlurComputeShaderPasses(FRDGBuilder& GraphBuilder, ERHIFeatureLevel::Type FeatureLevel, FRDGTextureRef InputTexture, int32 BlurCounts, EBlurTextureFormat Format);
 
+/** Blur a texture into a target of the render target pool, the target goes back to the pool when the reference is released */
+TRefCountPtr<IPooledRenderTarget> BlurTexture_RenderThread(FRHICommandListImmediate& RHICmdList, ERHIFeatureLevel::Type FeatureLevel, FRHITexture* InputTexture, int32 BlurCounts, EBlurTextureFormat Format);
@@ -1,5 +1,6 @@
 #pragma once
 #include "RHI.h"
+#include "RenderResource.h"
 
 struct FUVertexInput
 {
@@ -28,34 +29,34 @@ public:
 	}
 };
 
-static void DrawIndexedPrimitiveUP_Custom(
-	FRHICommandList& RHICmdList,
-	uint32 PrimitiveType,
-	uint32 MinVertexIndex,
-	uint32 NumVertices,
-	uint32 NumPrimitives,
-	const void* IndexData,
-	uint32 IndexDataStride,
-	const void* VertexData,
-	uint32 VertexDataStride)
+/** Quad covering the whole viewport, uv (0,0) is at the bottom left, built once and shared by every fullscreen pass */
+class FCommonQuadBuffer : public FRenderResource
 {
-	const uint32 NumIndices = GetVertexCountForPrimitiveCount(NumPrimitives, PrimitiveType);
-
-	FRHIResourceCreateInfo CreateInfo;
-	FVertexBufferRHIRef VertexBufferRHI = RHICreateVertexBuffer(VertexDataStride * NumVertices, BUF_Volatile, CreateInfo);        //BufǸĶͣû֡д룬ΪBUF_Volatile
-	void* VoidPtr = RHILockVertexBuffer(VertexBufferRHI, 0, VertexDataStride * NumVertices, RLM_WriteOnly);        //lock㻺bufferֻд
-	FPlatformMemory::Memcpy(VoidPtr, VertexData, VertexDataStride * NumVertices);       //붥
-	RHIUnlockVertexBuffer(VertexBufferRHI);    //unlock㻺
-
-	//ͬϴһ
-	FIndexBufferRHIRef IndexBufferRHI = RHICreateIndexBuffer(IndexDataStride, IndexDataStride * NumIndices, BUF_Volatile, CreateInfo);
-	void* VoidPtr2 = RHILockIndexBuffer(IndexBufferRHI, 0, IndexDataStride * NumIndices, RLM_WriteOnly);
-	FPlatformMemory::Memcpy(VoidPtr2, IndexData, IndexDataStride * NumIndices);
-	RHIUnlockIndexBuffer(IndexBufferRHI);
-
-	RHICmdList.SetStreamSource(0, VertexBufferRHI, 0);     //Բͬͼνӿö㻺
-	RHICmdList.DrawIndexedPrimitive(IndexBufferRHI, MinVertexIndex, 0, NumVertices, 0, NumPrimitives, 1);        //ͼԪ
-
-	IndexBufferRHI.SafeRelease();
-	VertexBufferRHI.SafeRelease();
-}
\ No newline at end of file
+public:
+	FVertexBufferRHIRef VertexBuffer;
+
+	FIndexBufferRHIRef IndexBuffer;
+
+	static const uint32 NumVertices = 4;
+
+	static const uint32 NumPrimitives = 2;
+
+	virtual void InitRHI()override;
+
+	virtual void ReleaseRHI()override
+	{
+		VertexBuffer.SafeRelease();
+		IndexBuffer.SafeRelease();
+	}
+};
+
+extern TGlobalResource<FCommonVertexDeclaration> GCommonVertexDeclaration;
+
+extern TGlobalResource<FCommonQuadBuffer> GCommonQuadBuffer;
+
+/** Draw GCommonQuadBuffer, the bound pipeline state has to use GCommonVertexDeclaration */
+inline void DrawCommonQuad(FRHICommandList& RHICmdList)
+{
+	RHICmdList.SetStreamSource(0, GCommonQuadBuffer.VertexBuffer, 0);
+	RHICmdList.DrawIndexedPrimitive(GCommonQuadBuffer.IndexBuffer, 0, 0, FCommonQuadBuffer::NumVertices, 0, FCommonQuadBuffer::NumPrimitives, 1);
+}
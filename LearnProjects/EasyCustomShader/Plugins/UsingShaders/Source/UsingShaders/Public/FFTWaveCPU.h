@@ -0,0 +1,135 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/** Height, slope and displacement of the wave, the same data as one half of HeightBuffer, SlopeBuffer and DisplacementBuffer, row major (row is y of the texture) */
+struct USINGSHADERS_API FWaveFFTGrid
+{
+	int32 WaveSize = 0;
+
+	TArray<FVector2D> Height;
+	TArray<FVector4> Slope;
+	TArray<FVector4> Displacement;
+
+	void Init(int32 InWaveSize)
+	{
+		WaveSize = InWaveSize;
+		Height.SetNumZeroed(WaveSize * WaveSize);
+		Slope.SetNumZeroed(WaveSize * WaveSize);
+		Displacement.SetNumZeroed(WaveSize * WaveSize);
+	}
+
+	/** Same as GetPosOffsetAndNormal of FFTWave.usf, the offset is in patch space and wraps at WaveSize */
+	void GetPosOffsetAndNormal(int32 X, int32 Y, FVector& OutPosOffset, FVector& OutNormal) const;
+};
+
+/**
+ * Cpu backend of FFTWave.usf, PhillipsSpectrumCS, PrepareForFFT and the FFT passes of PerformFFTCS_Horizontal/Vertical are done
+ * with the same tables and math, so servers and other nodes without gpu get the same wave as the rendered one.
+ * The butterflies are radix-2 as ButterflyLookupTable, two complex numbers are processed in one vector register, and rows are spread over worker threads.
+ */
+class USINGSHADERS_API FWaveFFTCPU
+{
+public:
+	/**
+	 * Tables are the same as the ones uploaded to gpu in FWaveSimulation::CreateRenderData.
+	 * Only wave numbers |k| in [InSpectrumKMin, InSpectrumKMax) are kept, so cascades do not add the same waves twice.
+	 */
+	void Init(int32 InWaveSize, float InPatchLength, float InWaveAmplitude, const FVector& InWindSpeed, const TArray<FVector2D>& RandomTable, const TArray<float>& InDispersionTable, const TArray<float>& InButterflyLookupTable, float InSpectrumKMin = 0.f, float InSpectrumKMax = BIG_NUMBER);
+
+	void Release();
+
+	bool IsInitialized() const { return WaveSize > 0; }
+
+	/** h(k,t) of PrepareForFFT, TimeSeconds is already scaled by the time rate */
+	FVector2D InitSpectrum(float TimeSeconds, int32 n, int32 m) const;
+
+	/** Fill the frequency domain of the time, the gpu does the same in its first horizontal FFT pass */
+	void PrepareForFFT(float TimeSeconds, bool bForceSingleThread = false);
+
+	/** Transform the prepared data to spatial domain, same as all horizontal and then vertical passes of EvaluateWavesFFT_RenderThread */
+	void EvaluateFFT(bool bForceSingleThread = false);
+
+	/** PrepareForFFT and EvaluateFFT */
+	void Evaluate(float TimeSeconds, bool bForceSingleThread = false);
+
+	/** Result of the last EvaluateFFT */
+	const FWaveFFTGrid& GetResult() const { return Grids[ResultIndex]; }
+
+	int32 GetWaveSize() const { return WaveSize; }
+
+	/** Memory of the spectrum, tables and grids */
+	SIZE_T GetAllocatedSize() const;
+
+	/** Same as GetPosOffsetAndNormal of FFTWave.usf, the offset is in patch space and wraps at WaveSize */
+	void GetPosOffsetAndNormal(int32 X, int32 Y, FVector& OutPosOffset, FVector& OutNormal) const
+	{
+		check(IsInitialized());
+		GetResult().GetPosOffsetAndNormal(X, Y, OutPosOffset, OutNormal);
+	}
+
+private:
+	float PhillipsSpectrum(int32 n, int32 m) const;
+
+	FVector2D GetSpectrum(const TArray<FVector2D>& RandomTable, int32 n, int32 m) const;
+
+	void PerformFFTPass(bool bHorizontal, int32 Pass, const FWaveFFTGrid& Source, FWaveFFTGrid& Dest, bool bForceSingleThread) const;
+
+private:
+	int32 WaveSize = 0;
+	int32 Passes = 0;
+	float PatchLength = 1.f;
+	float WaveAmplitude = 0.f;
+	FVector WindSpeed = FVector::ZeroVector;
+	float SpectrumKMin = 0.f;
+	float SpectrumKMax = BIG_NUMBER;
+
+	/** h_0(k) in XY and conj of h_0(-k) in ZW, packed as the Spectrum buffer of the gpu */
+	TArray<FVector4> Spectrum;
+	TArray<float> DispersionTable;
+	TArray<float> ButterflyLookupTable;
+
+	/** Ping pong of the passes, like the two halves of the gpu textures */
+	FWaveFFTGrid Grids[2];
+	int32 ResultIndex = 0;
+};
+
+/**
+ * Offset and normal of every texel of a FWaveFFTCPU result, as GetPosOffsetAndNormal returns them.
+ * Built aside and never changed after published, so queries can keep reading an old one while the next one is built.
+ */
+struct USINGSHADERS_API FWaveSurfaceMirror
+{
+	int32 WaveSize = 0;
+
+	/** Time of the wave which is mirrored, already scaled by the time rate */
+	float TimeSeconds = 0.f;
+
+	/** Texels of this one in a texel of the first cascade */
+	float TexelScale = 1.f;
+
+	/** xyz is the offset in patch space, w is unused so a texel is one register, row major (row is y of the grid) */
+	TArray<FVector4> PosOffset;
+
+	/** Normalized, w is unused */
+	TArray<FVector4> Normal;
+
+	void Build(const FWaveFFTCPU& Wave, float InTimeSeconds, bool bForceSingleThread = false);
+
+	/** Build from a grid which is not simulated, as the frames of FWaveAnimationCache */
+	void Build(const FWaveFFTGrid& Grid, float InTimeSeconds, bool bForceSingleThread = false);
+
+	/** Bilinear sample at texel coordinate, wraps at WaveSize like the texture of the wave */
+	void Sample(const FVector2D& TexelCoord, FVector& OutPosOffset, FVector& OutNormal) const;
+};
+
+/** Mirrors of all cascades of a simulation, sampled together */
+struct USINGSHADERS_API FWaveSurfaceCascadeMirrors
+{
+	TArray<FWaveSurfaceMirror> Cascades;
+
+	/** TexelCoord is in texel of the first cascade, offsets are added up and normals are combined by their slopes */
+	void Sample(const FVector2D& TexelCoord, FVector& OutPosOffset, FVector& OutNormal) const;
+};
@@ -4,14 +4,57 @@
 
 #include "CoreMinimal.h"
 #include "GameFramework/Actor.h"
-#include "RHIResources.h"
-#include "RHIUtilities.h"
-#include "FFTWave.h"
+#include "WaveSimulation.h"
 #include "FFTWaveSimulator.generated.h"
 
+/** Wave surface at a queried world position, all in world space */
+struct FWaveQueryResult
+{
+	/** Z of the surface */
+	float Height = 0.f;
+
+	/** Offset of the surface from the flat grid */
+	FVector Displacement = FVector::ZeroVector;
+
+	FVector Normal = FVector::UpVector;
+
+	/** False when no simulated wave covers the position, other members are not filled then */
+	bool bValid = false;
+};
+
+/** A cascade on top of the wave of the tile, with its own patch and resolution */
+USTRUCT(BlueprintType)
+struct FWaveCascade
+{
+	GENERATED_USTRUCT_BODY()
+
+	/** Smaller than PatchLength of the tile for the short waves, larger for the long swell */
+	UPROPERTY(EditAnywhere, Category = WaveCascade)
+	float PatchLength = 100.f;
+
+	UPROPERTY(EditAnywhere, Category = WaveCascade)
+	int32 WaveSize = 64;
+
+	UPROPERTY(EditAnywhere, Category = WaveCascade)
+	class UTextureRenderTarget* WaveHeightMapRenderTarget = nullptr;
+
+	UPROPERTY(EditAnywhere, Category = WaveCascade)
+	class UTextureRenderTarget* WaveNormalRenderTarget = nullptr;
+
+	/** Texture parameters of GridMaterial which read this cascade */
+	UPROPERTY(EditAnywhere, Category = WaveCascade)
+	FName HeightMapParameter;
+
+	UPROPERTY(EditAnywhere, Category = WaveCascade)
+	FName NormalMapParameter;
+
+	/** Scalar parameter of GridMaterial, uv of the tile is multiplied by it to read this cascade */
+	UPROPERTY(EditAnywhere, Category = WaveCascade)
+	FName UVScaleParameter;
+};
 
 UCLASS()
-class AFFTWaveSimulator : public AActor
+class USINGSHADERS_API AFFTWaveSimulator : public AActor
 {
 	GENERATED_BODY()
 	
@@ -42,27 +85,56 @@ public:
 
 	void InitWaveResource();
 
-	// Run on cpu, don't use it
-	void PrepareForFFT(float TimeSeconds);
+	void CreateWaveGrid();
 
-	void EvaluateWavesFFT(float TimeSeconds);
+	// Run on cpu, fill WavePosition and WaveNormals from the cpu wave
+	void ComputePositionAndNormal();
 
-	// Run on cpu, don't use it
-	FVector2D InitSpectrum(float TimeSeconds, int32 n, int32 m);
+	// This tile asks for the cpu simulation, for debug normals or when asked
+	bool ShouldSimulateOnCPU()const;
 
-	// Compute w(k),uesd in h(k,t), (Phillips spectrum) 
-	float Dispersion(int32 n, int32 m);
+	// How often this tile needs the gpu simulation, from whether it was rendered and how far it is from the views
+	FWaveSignificance ComputeSignificance()const;
 
-	void ComputeSpectrum();
+	// Key of the simulation which is shared by the tiles with the same spectrum
+	FWaveSimulationKey MakeSimulationKey()const;
 
-	void CreateWaveGrid();
+	const FWaveSimulation* GetSimulation()const { return Simulation.Get(); }
 
-	void CreateResources();
+	FVector2D GetWaveDimension()const;
 
-	// Run on cpu, don't use it
-	void ComputePositionAndNormal();
+	/**
+	 * Query the wave surface at world positions (only xy is used), each position is served by the simulator whose grid covers it.
+	 * Reads the mirror published by the cpu simulation and never waits for the render thread, the cpu simulation of the wave
+	 * is kept running as long as it is queried. Call on game thread.
+	 */
+	static void QueryWaves(const UWorld* World, TArrayView<const FVector> Positions, TArray<FWaveQueryResult>& OutResults);
 
-	FVector2D GetWaveDimension()const;
+	/** Same as QueryWaves for one position */
+	static FWaveQueryResult QueryWave(const UWorld* World, const FVector& Position);
+
+	/** Procedural mesh is built as a clipmap around the view */
+	bool IsUsingClipmap()const;
+
+	/** Half size of the clipmap in local space */
+	float GetClipmapExtent()const;
+
+	/** Position in texel of the wave grid, false if outside of the grid */
+	bool WorldToWaveTexel(const FVector& WorldPosition, FVector2D& OutTexelCoord)const;
+
+private:
+	// Local position of the view snapped to the last level, false if nothing is rendered yet
+	bool GetClipmapCenter(FVector2D& OutCenter)const;
+
+	// Move the clipmap vertices to ClipmapCenter into WavePosition, and the uv of them
+	void BuildClipmapVertices();
+
+	// Follow the view, the mesh section is only updated when the snapped center moves
+	void UpdateClipmap();
+
+	bool QueryWave(const FWaveSurfaceCascadeMirrors& Mirror, const FVector& WorldPosition, FWaveQueryResult& OutResult)const;
+
+public:
 
 #if WITH_EDITOR
 	virtual void PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent)override;
@@ -86,6 +158,20 @@ public:
 	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = WaveRenderResource, meta = (editcondition = "bUseStaticMesh"))
 	float WaveStaticMeshGridSize;
 
+	/**
+	 * Build the procedural mesh as nested rings around the view instead of HorizontalTileCount x VerticalTileCount full grids,
+	 * every ring has twice the spacing of the one inside, so the vertex count does not grow with the ocean.
+	 */
+	UPROPERTY(EditAnywhere, Category = WaveRenderResource, meta = (editcondition = "!bUseStaticMesh"))
+	bool bUseClipmap;
+
+	UPROPERTY(EditAnywhere, Category = WaveRenderResource, meta = (editcondition = "bUseClipmap", ClampMin = "1", ClampMax = "8"))
+	int32 ClipmapLevels;
+
+	/** Cells across every level, multiple of 4 */
+	UPROPERTY(EditAnywhere, Category = WaveRenderResource, meta = (editcondition = "bUseClipmap", ClampMin = "4"))
+	int32 ClipmapGridCount;
+
 	UPROPERTY(EditAnywhere, Category = WaveProperty)
 	int32 VerticalTileCount;
 
@@ -101,6 +187,25 @@ public:
 	UPROPERTY(EditAnywhere, Category = WaveProperty)
 	int32 WaveSize;
 
+	/** Do the whole row and column FFT in one dispatch each with groupshared memory, only for WaveSize 32 to 512, other sizes use the passes of ButterflyLookupTable */
+	UPROPERTY(EditAnywhere, Category = WaveProperty)
+	bool bUseSharedMemoryFFT;
+
+	/** Also simulate the wave on cpu, so the height, slope and displacement can be used by game thread */
+	UPROPERTY(EditAnywhere, Category = WaveProperty)
+	bool bSimulateOnCPU;
+
+	/**
+	 * Play a baked loop of the wave instead of simulating it every frame, for low end devices and background oceans.
+	 * The loop is baked on cpu the first time and saved under Saved/WaveAnimationCache.
+	 */
+	UPROPERTY(EditAnywhere, Category = WaveProperty)
+	bool bPlayAnimationCache;
+
+	/** Frames baked for the loop, more frames follow the sharp crests better */
+	UPROPERTY(EditAnywhere, Category = WaveProperty, meta = (editcondition = "bPlayAnimationCache", ClampMin = "2"))
+	int32 AnimationCacheFrames;
+
 	/**not mean the wave mesh grid length, only use in shader*/
 	UPROPERTY(EditAnywhere, Category = SpectrumProperty)
 	float PatchLength;
@@ -108,8 +213,19 @@ public:
 	UPROPERTY(EditAnywhere, Category = SpectrumProperty)
 	FVector WindSpeed;
 
+	/** Seed of the random table, the same seed and spectrum properties give the same wave on server and every client */
+	UPROPERTY(EditAnywhere, Category = SpectrumProperty)
+	int32 WaveSeed;
+
 	UPROPERTY(EditAnywhere, Category = SpectrumProperty)
 	float WaveAmplitude;
+
+	/**
+	 * More cascades simulated with the wave of the tile, each keeps its own band of the spectrum so waves are not added twice.
+	 * Only the first MAX_WAVE_CASCADES - 1 are used.
+	 */
+	UPROPERTY(EditAnywhere, Category = SpectrumProperty)
+	TArray<FWaveCascade> ExtraCascades;
 	
 	UPROPERTY(EditAnywhere, Category = WaveRenderResource)
 	class UMaterialInterface* GridMaterial;
@@ -129,36 +245,41 @@ public:
 	UPROPERTY(EditAnywhere, Category = WaveMaterialParams)
 	FName WaveGradientZ;
 
-	UPROPERTY(EditAnywhere, Category = Debug)
-	bool DrawNormal;
+	/** Lower the update rate of distant tiles and freeze hidden ones, a shared simulation runs as often as its most significant tile needs */
+	UPROPERTY(EditAnywhere, Category = WaveSignificance)
+	bool bUseSignificance;
 
-	TArray<FVector2D> RandomTable;
+	/** Tiles farther than this from every view are updated at DistantUpdateRate, and only with the cascades of the long waves */
+	UPROPERTY(EditAnywhere, Category = WaveSignificance, meta = (editcondition = "bUseSignificance", ClampMin = "0"))
+	float DistantSimulationDistance;
 
-	TArray<float> ButterflyLookupTable;
+	/** Evaluations per second of a distant tile */
+	UPROPERTY(EditAnywhere, Category = WaveSignificance, meta = (editcondition = "bUseSignificance", ClampMin = "1"))
+	float DistantUpdateRate;
 
-	FVertexBufferRHIRef RandomTableVB;
-	FShaderResourceViewRHIRef RandomTableSRV;
+	/** A tile not rendered for this long is hidden, its wave is frozen unless the cpu wave is queried */
+	UPROPERTY(EditAnywhere, Category = WaveSignificance, meta = (editcondition = "bUseSignificance", ClampMin = "0"))
+	float HiddenDelay;
 
-	FVertexBufferRHIRef ButterflyLookupTableVB;
-	FShaderResourceViewRHIRef ButterflyLookupTableSRV;
+	/** A hidden tile only ticks this often, to notice when it is seen again */
+	UPROPERTY(EditAnywhere, Category = WaveSignificance, meta = (editcondition = "bUseSignificance", ClampMin = "0"))
+	float HiddenTickInterval;
+
+	UPROPERTY(EditAnywhere, Category = Debug)
+	bool DrawNormal;
 
-	FVertexBufferRHIRef DispersionTableVB;
-	FShaderResourceViewRHIRef DispersionTableSRV;
 public:
 	TArray<FVector> WavePosition;
 	TArray<FVector> WaveVertices;
 	TArray<FVector> WaveNormals;
 	TArray<FVector2D> UVs;
 
-	TArray<float> DispersionTable;
-
-	// Render resources
-	FRWBuffer* Spectrum;
-	FRWBuffer* SpectrumConj;
+	bool bHasInit;
 
-	FTextureRWBuffer2D* HeightBuffer;
-	FTextureRWBuffer2D* SlopeBuffer;
-	FTextureRWBuffer2D* DisplacementBuffer;
+	/** Center of the clipmap in local space */
+	FVector2D ClipmapCenter;
 
-	bool bHasInit;
+private:
+	/** Spectrum, FFT buffers and cpu wave, shared with the other tiles of the same spectrum */
+	TSharedPtr<FWaveSimulation, ESPMode::ThreadSafe> Simulation;
 };
@@ -19,10 +19,6 @@ public:
 
 	UFUNCTION(BlueprintCallable, Category = "UsingShaderPlugin", meta = (WorldContext = "WorldContext"))
 	static void DrawInterationShaderRenderTarget_Blur(class UTextureRenderTarget* OutputRenderTarget, AActor* Ac, FLinearColor MyColor, class UTexture* MyTexture, int32 BlurCounts = 1);
-
-	static FTextureRHIRef Texture;
-
-	static FUnorderedAccessViewRHIRef TextureUAV;
 };
 
 
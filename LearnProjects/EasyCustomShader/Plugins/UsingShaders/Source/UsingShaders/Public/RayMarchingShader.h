@@ -13,6 +13,19 @@ enum ERayMarchingShader
 	ProteanCloud
 };
 
+/** Pixels marched every frame, below Full the other pixels are reprojected from the last frames or upsampled */
+UENUM(BlueprintType)
+enum class ERayMarchingResolution : uint8
+{
+	Full,
+	/** Half of the pixels in a checkerboard that flips every frame */
+	Checkerboard,
+	/** Half width and height, a quarter of the pixels */
+	Half,
+	/** Quarter width and height, one in 16 pixels */
+	Quarter
+};
+
 USTRUCT(BlueprintType)
 struct FRayMarchingBufferData
 {
@@ -26,6 +39,17 @@ struct FRayMarchingBufferData
 
 	UPROPERTY(BlueprintReadWrite, VisibleAnywhere, Category = SeascapeBufferData)
 	FVector2D MousePos;
+
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = SeascapeBufferData)
+	ERayMarchingResolution Resolution = ERayMarchingResolution::Full;
+
+	/** Steps of each ray, 0 is the default of the shader */
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = SeascapeBufferData)
+	int32 MarchSteps = 0;
+
+	/** Max million steps marched by one draw, the resolution and then the steps are lowered until the draw fits, 0 is no limit */
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = SeascapeBufferData)
+	float SampleBudget = 0.f;
 };
 
 UCLASS(MinimalAPI, meta = (ScriptName = "UniformBufferShaderLibrary"))
@@ -0,0 +1,77 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "FFTWaveCPU.h"
+
+class IMappedFileHandle;
+class IMappedFileRegion;
+
+/**
+ * Frames of one period of a wave, baked from FWaveFFTCPU and saved as a file under Saved/WaveAnimationCache.
+ * Dispersion floors w(k) to whole multiples of W_0, so the wave repeats every 2 * PI / W_0 seconds, and the frames loop.
+ * Only the channels read by GetPosOffsetAndNormal are kept as half floats, each frame of each cascade is compressed on its own,
+ * and the file is memory mapped, so only the two frames around the played time are decompressed.
+ */
+class USINGSHADERS_API FWaveAnimationCache
+{
+public:
+	/** Length of the loop in wave time (world time multiplied by the time rate) */
+	static const float Period;
+
+	/**
+	 * Load the cache of the waves from Path, or bake and save it when the file is missing or baked from other waves.
+	 * Waves must be initialized, one for each cascade, and are evaluated for every frame while baking.
+	 */
+	static TSharedPtr<FWaveAnimationCache, ESPMode::ThreadSafe> LoadOrBake(const FString& Path, uint32 WavesHash, int32 NumFrames, TArrayView<FWaveFFTCPU* const> Waves);
+
+	~FWaveAnimationCache();
+
+	int32 GetNumFrames() const { return NumFrames; }
+
+	int32 GetNumCascades() const { return CascadeWaveSizes.Num(); }
+
+	/** Spatial domain of the cascade at the time, the two frames around are blended, only call on game thread */
+	void Sample(int32 CascadeIndex, float TimeSeconds, FWaveFFTGrid& OutGrid);
+
+private:
+	FWaveAnimationCache() = default;
+
+	bool Load(const FString& Path, uint32 WavesHash);
+
+	bool Bake(const FString& Path, uint32 WavesHash, int32 InNumFrames, TArrayView<FWaveFFTCPU* const> Waves);
+
+	/** Decompress a frame into the decoded slot of the cascade, the slot is kept until another frame needs it */
+	const TArray<FFloat16>& DecodeFrame(int32 CascadeIndex, int32 FrameIndex);
+
+	const uint8* GetFileData() const;
+
+private:
+	struct FFrameEntry
+	{
+		int64 Offset;
+		int32 CompressedSize;
+	};
+
+	struct FDecodedFrame
+	{
+		int32 FrameIndex = INDEX_NONE;
+		TArray<FFloat16> Channels;
+	};
+
+	int32 NumFrames = 0;
+	TArray<int32> CascadeWaveSizes;
+
+	/** Frame major, cascade minor */
+	TArray<FFrameEntry> Frames;
+
+	/** Two decoded frames of every cascade, the ones blended by the last sample */
+	TArray<FDecodedFrame> DecodedFrames;
+
+	IMappedFileHandle* MappedFile = nullptr;
+	IMappedFileRegion* MappedRegion = nullptr;
+
+	/** Used when the platform can not map the file */
+	TArray<uint8> FileData;
+};
@@ -0,0 +1,86 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "WaveSimulation.h"
+
+namespace EWaveBenchmarkStage
+{
+	enum Type
+	{
+		/** Random, butterfly and dispersion tables on cpu */
+		Tables,
+		/** Buffers and table upload, gpu only */
+		Upload,
+		PhillipsSpectrum,
+		// The stages below run every frame, their time is for one frame
+		/** Cpu only, the gpu evolves the spectrum in the first FFT pass */
+		PrepareFFT,
+		FFT,
+		PosAndNormal,
+		Num
+	};
+}
+
+/** One configuration of the sweep, all cascades have the same WaveSize */
+struct FWaveBenchmarkConfig
+{
+	int32 WaveSize = 256;
+	int32 NumCascades = 1;
+	int32 NumFrames = 32;
+	bool bUseSharedMemoryFFT = true;
+};
+
+struct FWaveBenchmarkStage
+{
+	FString Name;
+
+	double CPUMilliseconds = 0.0;
+
+	/** Negative when the stage has no gpu work or the gpu is not measured */
+	double GPUMilliseconds = -1.0;
+};
+
+struct FWaveBenchmarkResult
+{
+	FWaveBenchmarkConfig Config;
+
+	/** "CPU" for FWaveFFTCPU, "GPU" for the passes of FFTWave.usf */
+	FString Backend;
+
+	/** Indexed by EWaveBenchmarkStage */
+	TArray<FWaveBenchmarkStage> Stages;
+
+	/** Tables, spectrum and the buffers of the passes */
+	int64 MemoryBytes = 0;
+};
+
+/**
+ * Run the wave simulation stages of a configuration alone and time them, the cpu backend runs without a gpu (-nullrhi),
+ * the gpu backend waits for the gpu after every stage so it is only for measuring, not for a running game.
+ */
+class USINGSHADERS_API FWaveBenchmark
+{
+public:
+	/** Key of the configuration, cascades are 4 times larger one after another */
+	static FWaveSimulationKey MakeKey(const FWaveBenchmarkConfig& Config);
+
+	static const TCHAR* GetStageName(EWaveBenchmarkStage::Type Stage);
+
+	static bool RunCPU(const FWaveBenchmarkConfig& Config, FWaveBenchmarkResult& OutResult);
+
+	/** Needs a real RHI, call on game thread */
+	static bool RunGPU(const FWaveBenchmarkConfig& Config, FWaveBenchmarkResult& OutResult);
+
+	/** One row for each stage of each result */
+	static FString ToCSV(const TArray<FWaveBenchmarkResult>& Results);
+
+	static FString ToJson(const TArray<FWaveBenchmarkResult>& Results);
+
+	/**
+	 * Compare with the CSV written by ToCSV before, a stage slower than its baseline by more than Tolerance (0.2 is 20%)
+	 * and by more than the noise of a small stage is a regression. Returns the number of regressions.
+	 */
+	static int32 CompareToBaseline(const TArray<FWaveBenchmarkResult>& Results, const FString& BaselineCSV, float Tolerance, TArray<FString>& OutRegressions);
+};
@@ -0,0 +1,26 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "WaveBenchmarkCommandlet.generated.h"
+
+/**
+ * Time every stage of the FFT wave for a sweep of configurations, e.g.
+ * UE4Editor-Cmd.exe Project.uproject -run=WaveBenchmark -AllowCommandletRendering -Sizes=64,128,256,512,1024 -Cascades=1,2,4 -Frames=32 [-CPU] [-NoSharedFFT] [-Output=Path.csv] [-Json] [-Baseline=Path.csv] [-Tolerance=0.2]
+ * The cpu backend is always measured, the gpu backend too unless -CPU is given or there is no RHI.
+ * Commandlets have no RHI without -AllowCommandletRendering, leave it out (or pass -nullrhi) on agents without gpu.
+ * Results are written as CSV to Output (Saved/WaveBenchmark/WaveBenchmark.csv by default), and as JSON next to it with -Json.
+ * Returns 1 if a configuration fails or, with -Baseline, if any stage is slower than the baseline by more than Tolerance.
+ */
+UCLASS()
+class UWaveBenchmarkCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	UWaveBenchmarkCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+};
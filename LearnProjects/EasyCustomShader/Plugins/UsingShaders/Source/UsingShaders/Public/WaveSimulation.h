@@ -0,0 +1,265 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/WeakObjectPtr.h"
+#include "FFTWaveCPU.h"
+#include "WaveAnimationCache.h"
+
+class UWorld;
+class UTextureRenderTarget;
+struct FWaveSimulationRenderData;
+
+// First cascade is the one of the tile, at most 3 more
+#define MAX_WAVE_CASCADES 4
+
+/** One cascade of a simulation, every cascade has its own patch and resolution */
+struct FWaveCascadeKey
+{
+	int32 WaveSize = 0;
+	float PatchLength = 1.f;
+
+	/** Band of |k| kept by the cascade, set by FWaveSimulationKey::LimitCascadeBands */
+	float SpectrumKMin = 0.f;
+	float SpectrumKMax = BIG_NUMBER;
+
+	/** Output of the gpu simulation, the material of every tile reads them */
+	TWeakObjectPtr<UTextureRenderTarget> HeightMapRenderTarget;
+	TWeakObjectPtr<UTextureRenderTarget> NormalRenderTarget;
+
+	bool operator==(const FWaveCascadeKey& Other) const
+	{
+		return WaveSize == Other.WaveSize &&
+			PatchLength == Other.PatchLength &&
+			SpectrumKMin == Other.SpectrumKMin &&
+			SpectrumKMax == Other.SpectrumKMax &&
+			HeightMapRenderTarget == Other.HeightMapRenderTarget &&
+			NormalRenderTarget == Other.NormalRenderTarget;
+	}
+
+	friend uint32 GetTypeHash(const FWaveCascadeKey& Key)
+	{
+		uint32 Hash = GetTypeHash(Key.WaveSize);
+		Hash = HashCombine(Hash, GetTypeHash(Key.PatchLength));
+		Hash = HashCombine(Hash, GetTypeHash(Key.HeightMapRenderTarget));
+		return HashCombine(Hash, GetTypeHash(Key.NormalRenderTarget));
+	}
+};
+
+/** Everything which decides the result of a wave simulation, simulators with the same key share one FWaveSimulation */
+struct FWaveSimulationKey
+{
+	TWeakObjectPtr<UWorld> World;
+
+	/** With the spectrum parameters and cascades it decides the whole wave, so every process makes the same wave from it */
+	uint32 Seed = 0;
+
+	float WaveAmplitude = 0.f;
+	FVector WindSpeed = FVector::ZeroVector;
+	int32 TimeRate = 1;
+	bool bUseSharedMemoryFFT = true;
+
+	/** Frames of the baked loop played instead of the simulation, 0 simulates every frame */
+	int32 AnimationCacheFrames = 0;
+
+	/** The first one is the cascade of the tile mesh, queries are in its texel */
+	TArray<FWaveCascadeKey, TInlineAllocator<MAX_WAVE_CASCADES>> Cascades;
+
+	/** Split |k| between the cascades, larger patches keep the long waves and smaller ones the short waves */
+	void LimitCascadeBands();
+
+	/** Hash of what decides the baked frames, unlike GetTypeHash it is the same in every run */
+	uint32 GetWavesHash() const;
+
+	/** Seed of the random table of a cascade, cascades have different tables so they do not repeat each other */
+	uint32 GetCascadeSeed(int32 CascadeIndex) const { return HashCombine(Seed, CascadeIndex); }
+
+	bool operator==(const FWaveSimulationKey& Other) const
+	{
+		return World == Other.World &&
+			Seed == Other.Seed &&
+			WaveAmplitude == Other.WaveAmplitude &&
+			WindSpeed == Other.WindSpeed &&
+			TimeRate == Other.TimeRate &&
+			bUseSharedMemoryFFT == Other.bUseSharedMemoryFFT &&
+			AnimationCacheFrames == Other.AnimationCacheFrames &&
+			Cascades == Other.Cascades;
+	}
+
+	friend uint32 GetTypeHash(const FWaveSimulationKey& Key)
+	{
+		uint32 Hash = GetTypeHash(Key.World);
+		Hash = HashCombine(Hash, GetTypeHash(Key.Seed));
+		Hash = HashCombine(Hash, GetTypeHash(Key.WaveAmplitude));
+		Hash = HashCombine(Hash, GetTypeHash(Key.WindSpeed));
+		Hash = HashCombine(Hash, GetTypeHash(Key.TimeRate));
+		Hash = HashCombine(Hash, GetTypeHash(Key.AnimationCacheFrames));
+		for (const FWaveCascadeKey& Cascade : Key.Cascades)
+		{
+			Hash = HashCombine(Hash, GetTypeHash(Cascade));
+		}
+		return Hash;
+	}
+};
+
+/** What a tile needs from the gpu simulation, the simulation serves the most demanding of its tiles */
+struct FWaveSignificance
+{
+	/** Seconds between two evaluations, 0 is every frame, negative when no view sees the tile and the wave can be frozen */
+	float UpdateInterval = 0.f;
+
+	/** Only the cascades with patches at least as large as the first one, the short waves are not seen from far away */
+	bool bLongWavesOnly = false;
+
+	static FWaveSignificance Hidden()
+	{
+		FWaveSignificance Significance;
+		Significance.UpdateInterval = -1.f;
+		Significance.bLongWavesOnly = true;
+		return Significance;
+	}
+
+	bool IsNeeded() const { return UpdateInterval >= 0.f; }
+
+	void Merge(const FWaveSignificance& Other)
+	{
+		if (!Other.IsNeeded())
+			return;
+		UpdateInterval = IsNeeded() ? FMath::Min(UpdateInterval, Other.UpdateInterval) : Other.UpdateInterval;
+		bLongWavesOnly = bLongWavesOnly && Other.bLongWavesOnly;
+	}
+};
+
+/**
+ * Lookup tables, spectrum, gpu FFT buffers and the cpu wave of one simulation, for every cascade.
+ * The spectrum is only computed when the spectrum parameters change, every frame the cascades go through the FFT passes,
+ * which evolve the spectrum in their first pass, one after another in one render command.
+ * Every AFFTWaveSimulator tile with the same FWaveSimulationKey holds the same one, so the tiles only own their mesh,
+ * and the simulation is evaluated once a frame by the first tile which ticks.
+ */
+class USINGSHADERS_API FWaveSimulation
+{
+public:
+	/** The running simulation of the key, created if there is none */
+	static TSharedRef<FWaveSimulation, ESPMode::ThreadSafe> FindOrCreate(const FWaveSimulationKey& InKey);
+
+	/**
+	 * Same as FindOrCreate, but when the caller holds the only reference to Current and only amplitude, wind or patch lengths
+	 * are changed, Current keeps its buffers and tables and only its spectrum is computed again.
+	 */
+	static TSharedRef<FWaveSimulation, ESPMode::ThreadSafe> FindOrUpdate(const TSharedPtr<FWaveSimulation, ESPMode::ThreadSafe>& Current, const FWaveSimulationKey& InKey);
+
+	~FWaveSimulation();
+
+	const FWaveSimulationKey& GetKey() const { return Key; }
+
+	/**
+	 * Called by every tile every frame, only the first call of a frame evaluates, bSimulateOnCPU asks for the cpu simulation too.
+	 * The gpu simulation runs as often as the most significant tile of the last frame or this tile needs, and not at all when none is seen,
+	 * the cpu simulation only follows bSimulateOnCPU and the queries.
+	 */
+	void Tick(bool bSimulateOnCPU, const FWaveSignificance& Significance = FWaveSignificance());
+
+	/** Cpu simulation is kept running while queried, and used when there is no gpu (dedicated server, -nullrhi) */
+	bool ShouldSimulateOnCPU() const;
+
+	/** Keep the cpu simulation running for a while */
+	void MarkQueried();
+
+	int32 GetNumCascades() const { return Cascades.Num(); }
+
+	const FWaveFFTCPU& GetCPUWave(int32 CascadeIndex = 0) const { return Cascades[CascadeIndex].CPUWave; }
+
+	/** Spatial domain of the cascade on cpu, from the cpu wave or the animation cache, null if neither has run */
+	const FWaveFFTGrid* GetWaveResult(int32 CascadeIndex = 0) const;
+
+	bool IsPlayingAnimationCache() const { return AnimationCache.IsValid(); }
+
+	/** The latest mirror of the cpu waves, null before the first cpu simulation */
+	TSharedPtr<const FWaveSurfaceCascadeMirrors, ESPMode::ThreadSafe> GetSurfaceMirror() const;
+
+	/** h(k,t) of the cpu wave */
+	FVector2D InitSpectrum(float TimeSeconds, int32 n, int32 m, int32 CascadeIndex = 0) const;
+
+	/** Random, butterfly and dispersion tables of a cascade, the same ones a simulation uploads to gpu */
+	static void CreateCascadeTables(const FWaveCascadeKey& CascadeKey, uint32 Seed, TArray<FVector2D>& OutRandomTable, TArray<float>& OutButterflyLookupTable, TArray<float>& OutDispersionTable);
+
+private:
+	explicit FWaveSimulation(const FWaveSimulationKey& InKey);
+
+	// Compute w(k),uesd in h(k,t), (Phillips spectrum)
+	static float Dispersion(int32 WaveSize, float PatchLength, int32 n, int32 m);
+
+	static void CreateDispersionTable(int32 WaveSize, float PatchLength, TArray<float>& OutDispersionTable);
+
+	// RandomTable, ButterflyLookupTable and DispersionTable are shared by gpu and cpu simulation
+	void CreateLookupTables();
+
+	// The key only differs in the spectrum parameters, and there is no baked loop of the old spectrum
+	bool CanUpdateSpectrum(const FWaveSimulationKey& InKey) const;
+
+	// Take the spectrum parameters of the key, and compute the spectrum again on cpu and gpu
+	void UpdateSpectrum(const FWaveSimulationKey& InKey);
+
+	// Upload the changed dispersion tables and run PhillipsSpectrumCS again into the buffers already created
+	void UpdateRenderSpectrum(const TArray<bool, TInlineAllocator<MAX_WAVE_CASCADES>>& DispersionChanged);
+
+	// Create the gpu buffers and compute the spectrum on render thread
+	void CreateRenderData();
+
+	void EvaluateWavesFFT(float TimeSeconds, bool bLongWavesOnly);
+
+	void EvaluateWavesFFT_CPU(float TimeSeconds);
+
+	// Load the baked loop of the key, bake it first if there is no file
+	void CreateAnimationCache();
+
+	// Sample the baked loop on game thread into the cached grids, UploadAnimationFrame puts it in place of the FFT result
+	void SampleAnimationCache(float TimeSeconds);
+
+	void UploadAnimationFrame();
+
+	void PublishSurfaceMirror(float TimeSeconds);
+
+private:
+	struct FCascade
+	{
+		TArray<FVector2D> RandomTable;
+		TArray<float> ButterflyLookupTable;
+		TArray<float> DispersionTable;
+
+		FWaveFFTCPU CPUWave;
+
+		/** Frame sampled from AnimationCache */
+		FWaveFFTGrid CachedGrid;
+	};
+
+	FWaveSimulationKey Key;
+
+	TArray<FCascade, TInlineAllocator<MAX_WAVE_CASCADES>> Cascades;
+
+	TSharedPtr<FWaveAnimationCache, ESPMode::ThreadSafe> AnimationCache;
+
+	/** Only touched on render thread after created, released there too */
+	TSharedPtr<FWaveSimulationRenderData, ESPMode::ThreadSafe> RenderData;
+
+	/** Swapped with BackSurfaceMirror when a new one is built, queries hold a reference so the old one is not reused until they finish */
+	TSharedPtr<FWaveSurfaceCascadeMirrors, ESPMode::ThreadSafe> SurfaceMirror;
+	TSharedPtr<FWaveSurfaceCascadeMirrors, ESPMode::ThreadSafe> BackSurfaceMirror;
+	mutable FCriticalSection SurfaceMirrorCS;
+
+	/** World time of the last query */
+	float LastQueryTime;
+
+	uint64 LastEvaluatedFrame;
+	uint64 LastCPUEvaluatedFrame;
+
+	/** World time of the last gpu evaluation or cache sample */
+	float LastEvaluatedTime;
+
+	/** Merged from the tiles which ticked in SignificanceFrame, and the merged one of the frame before */
+	FWaveSignificance FrameSignificance;
+	FWaveSignificance LastFrameSignificance;
+	uint64 SignificanceFrame;
+};
@@ -8,7 +8,7 @@ public class HaiaimiShaders : ModuleRules
 	{
 		PCHUsage = PCHUsageMode.UseExplicitOrSharedPCHs;
 	
-		PublicDependencyModuleNames.AddRange(new string[] { "Core", "CoreUObject", "Engine", "InputCore"});
+		PublicDependencyModuleNames.AddRange(new string[] { "Core", "CoreUObject", "Engine", "InputCore", "UsingShaders"});
 
 		PrivateDependencyModuleNames.AddRange(new string[] {  });
 
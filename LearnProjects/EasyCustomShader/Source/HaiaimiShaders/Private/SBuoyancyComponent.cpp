@@ -4,6 +4,7 @@
 #include "SBuoyancyComponent.h"
 #include "Components/SphereComponent.h"
 #include "Kismet/KismetSystemLibrary.h"
+#include "FFTWaveSimulator.h"
 
 // Sets default values for this component's properties
 USBuoyancyComponent::USBuoyancyComponent()
@@ -13,6 +14,9 @@ USBuoyancyComponent::USBuoyancyComponent()
 	PrimaryComponentTick.bCanEverTick = true;
 
 	SphereRadius = 10.f;
+	DefaultWaterSurfaceHeight = 20.f;
+	WaterSurfaceHeight = DefaultWaterSurfaceHeight;
+	WaterSurfaceHeightFrame = 0;
 
 	CustomPhysics.BindUObject(this, &USBuoyancyComponent::UpdatePhysics);
 }
@@ -30,7 +34,7 @@ void USBuoyancyComponent::UpdatePhysics(float DeltaTime, FBodyInstance* BodyInst
 	//UKismetSystemLibrary::PrintString(this, TEXT("Update Physics"));
 	if (GetOwnerRole() < ENetRole::ROLE_Authority)return;
 	const FVector ForcePoint = GetComponentLocation();
-	const float Height = GetWaterSurfaceHeight(ForcePoint);
+	const float Height = WaterSurfaceHeight;
 	const float Radius = GetUnscaledSphereRadius();
 
 	float BuoyancyScale = FMath::Clamp((ForcePoint.Z - Height) / Radius, -1.f, 1.f);
@@ -41,7 +45,14 @@ void USBuoyancyComponent::UpdatePhysics(float DeltaTime, FBodyInstance* BodyInst
 
 float USBuoyancyComponent::GetWaterSurfaceHeight(FVector DetectPos /*= FVector::ZeroVector*/)
 {
-	return 20.f;
+	const FWaveQueryResult Result = AFFTWaveSimulator::QueryWave(GetWorld(), DetectPos);
+	return Result.bValid ? Result.Height : DefaultWaterSurfaceHeight;
+}
+
+void USBuoyancyComponent::SetWaterSurfaceHeight(float Height)
+{
+	WaterSurfaceHeight = Height;
+	WaterSurfaceHeightFrame = GFrameCounter;
 }
 
 void USBuoyancyComponent::SetUpdatedComponent(class UPrimitiveComponent* PrimComp)
@@ -54,6 +65,9 @@ void USBuoyancyComponent::TickComponent(float DeltaTime, ELevelTick TickType, FA
 {
 	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
 
+	if (WaterSurfaceHeightFrame != GFrameCounter)
+		SetWaterSurfaceHeight(GetWaterSurfaceHeight(GetComponentLocation()));
+
 	if (UpdatedComponent)
 		UpdatedComponent->GetBodyInstance()->AddCustomPhysics(CustomPhysics);
 }
@@ -6,6 +6,7 @@
 #include "Components/StaticMeshComponent.h"
 #include "Kismet/KismetSystemLibrary.h"
 #include "Public/SBuoyancyComponent.h"
+#include "FFTWaveSimulator.h"
 
 // Sets default values
 ASVehicleWatercraft::ASVehicleWatercraft()
@@ -22,18 +23,20 @@ void ASVehicleWatercraft::BeginPlay()
 {
 	Super::BeginPlay();
 
-	TArray<USBuoyancyComponent*> AllBuoyancy;
-	GetComponents<USBuoyancyComponent, FDefaultAllocator>(AllBuoyancy);
+	GetComponents<USBuoyancyComponent, FDefaultAllocator>(BuoyancyComponents);
 
-	for (auto Iter : AllBuoyancy)
+	for (auto Iter : BuoyancyComponents)
 	{
 		Iter->SetUpdatedComponent(WatercraftMesh);
+		// Heights are queried by the watercraft before the components use them
+		Iter->PrimaryComponentTick.AddPrerequisite(this, PrimaryActorTick);
 	}
 }
 
 float ASVehicleWatercraft::GetWaterSurfaceHeight(FVector DetectPos /*= FVector::ZeroVector*/)
 {
-	return 20.f;
+	const FWaveQueryResult Result = AFFTWaveSimulator::QueryWave(GetWorld(), DetectPos);
+	return Result.bValid ? Result.Height : 20.f;
 }
 
 void ASVehicleWatercraft::UpdatePhysics(float Force, FBodyInstance* BodyInstance)
@@ -72,4 +75,20 @@ void ASVehicleWatercraft::Tick(float DeltaTime)
 {
 	Super::Tick(DeltaTime);
 
+	if (BuoyancyComponents.Num() > 0)
+	{
+		TArray<FVector> Positions;
+		Positions.Reserve(BuoyancyComponents.Num());
+		for (auto Iter : BuoyancyComponents)
+		{
+			Positions.Add(Iter->GetComponentLocation());
+		}
+
+		TArray<FWaveQueryResult> Results;
+		AFFTWaveSimulator::QueryWaves(GetWorld(), Positions, Results);
+		for (int32 i = 0; i < BuoyancyComponents.Num(); ++i)
+		{
+			BuoyancyComponents[i]->SetWaterSurfaceHeight(Results[i].bValid ? Results[i].Height : BuoyancyComponents[i]->DefaultWaterSurfaceHeight);
+		}
+	}
 }
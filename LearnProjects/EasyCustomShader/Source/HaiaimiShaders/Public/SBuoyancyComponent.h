@@ -30,9 +30,22 @@ public:
 		
 	void SetUpdatedComponent(class UPrimitiveComponent* PrimComp);
 
+	/** Height queried by owner in batch for this frame, so the component does not query it again */
+	void SetWaterSurfaceHeight(float Height);
+
+public:
+	/** Used when there is no wave at the position */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Buoyancy)
+	float DefaultWaterSurfaceHeight;
+
 private:
 	FCalculateCustomPhysics CustomPhysics;
 
 	UPROPERTY()
 	class UPrimitiveComponent* UpdatedComponent;
+
+	/** Queried on game thread every frame, physics substeps use it */
+	float WaterSurfaceHeight;
+
+	uint64 WaterSurfaceHeightFrame;
 };
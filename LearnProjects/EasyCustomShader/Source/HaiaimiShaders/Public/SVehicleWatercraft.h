@@ -36,4 +36,8 @@ public:
 private:
 	UPROPERTY(BlueprintReadOnly, VisibleAnywhere, meta = (AllowPrivateAccess = "true"))
 	class UStaticMeshComponent* WatercraftMesh;
+
+	/** All buoyancy points, their water heights are queried in one batch */
+	UPROPERTY()
+	TArray<class USBuoyancyComponent*> BuoyancyComponents;
 };
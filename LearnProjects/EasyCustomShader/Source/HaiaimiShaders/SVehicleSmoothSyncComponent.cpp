@@ -6,12 +6,284 @@
 #include "Components/SkinnedMeshComponent.h"
 #include "DrawDebugHelpers.h"
 #include "Components/StaticMeshComponent.h"
+#include "HAL/IConsoleManager.h"
+#include "Net/UnrealNetwork.h"
+
+static TAutoConsoleVariable<int32> CVarVehicleSmoothSyncDrawDebug(
+	TEXT("net.VehicleSmoothSync.DrawDebug"),
+	0,
+	TEXT("Draw the received snapshots and the interpolation targets of USVehicleSmoothSyncComponent."),
+	ECVF_Cheat);
+
+/** The other three components of a normalized quaternion are within +-1/sqrt(2) of the largest one */
+static const float SmallestThreeRange = 0.70710678f;
+
+static const int32 SmallestThreeBits = 10;
+
+static void SerializeZigZagInt(FArchive& Ar, int32& Value)
+{
+	// Small negative values take as few bytes as small positive ones
+	uint32 Packed = ((uint32)Value << 1) ^ (uint32)(Value >> 31);
+	Ar.SerializeIntPacked(Packed);
+	if (Ar.IsLoading())
+	{
+		Value = (int32)(Packed >> 1) ^ -(int32)(Packed & 1);
+	}
+}
+
+static void SerializeZigZagVector(FArchive& Ar, FIntVector& Value)
+{
+	SerializeZigZagInt(Ar, Value.X);
+	SerializeZigZagInt(Ar, Value.Y);
+	SerializeZigZagInt(Ar, Value.Z);
+}
+
+static FIntVector QuantizeVector(const FVector& Value, float Precision)
+{
+	return FIntVector(FMath::RoundToInt(Value.X / Precision), FMath::RoundToInt(Value.Y / Precision), FMath::RoundToInt(Value.Z / Precision));
+}
+
+static FVector DequantizeVector(const FIntVector& Value, float Precision)
+{
+	return FVector(Value) * Precision;
+}
+
+static uint32 QuantizeRotation(const FQuat& Rotation)
+{
+	const FQuat NormalizedRotation = Rotation.GetNormalized();
+	const float Components[4] = { NormalizedRotation.X, NormalizedRotation.Y, NormalizedRotation.Z, NormalizedRotation.W };
+	int32 Largest = 0;
+	for (int32 i = 1; i < 4; ++i)
+	{
+		if (FMath::Abs(Components[i]) > FMath::Abs(Components[Largest]))
+			Largest = i;
+	}
+
+	// q and -q are the same rotation, flip it so the dropped component is positive
+	const float Sign = Components[Largest] < 0.f ? -1.f : 1.f;
+	const int32 MaxStep = (1 << SmallestThreeBits) - 1;
+	uint32 Packed = (uint32)Largest << (3 * SmallestThreeBits);
+	int32 Shift = 2 * SmallestThreeBits;
+	for (int32 i = 0; i < 4; ++i)
+	{
+		if (i == Largest)
+			continue;
+		const float Alpha = Components[i] * Sign / SmallestThreeRange * 0.5f + 0.5f;
+		Packed |= (uint32)FMath::Clamp(FMath::RoundToInt(Alpha * MaxStep), 0, MaxStep) << Shift;
+		Shift -= SmallestThreeBits;
+	}
+	return Packed;
+}
+
+static FQuat DequantizeRotation(uint32 Packed)
+{
+	const int32 Largest = Packed >> (3 * SmallestThreeBits);
+	const int32 MaxStep = (1 << SmallestThreeBits) - 1;
+	float Components[4];
+	float SquaredSum = 0.f;
+	int32 Shift = 2 * SmallestThreeBits;
+	for (int32 i = 0; i < 4; ++i)
+	{
+		if (i == Largest)
+			continue;
+		const int32 Step = (Packed >> Shift) & MaxStep;
+		Components[i] = ((float)Step / MaxStep * 2.f - 1.f) * SmallestThreeRange;
+		SquaredSum += Components[i] * Components[i];
+		Shift -= SmallestThreeBits;
+	}
+	Components[Largest] = FMath::Sqrt(FMath::Max(0.f, 1.f - SquaredSum));
+	return FQuat(Components[0], Components[1], Components[2], Components[3]).GetNormalized();
+}
+
+bool FVehicleStateQuantized::IsSameMotion(const FVehicleStateQuantized& Other) const
+{
+	return Cell == Other.Cell && Position == Other.Position && Rotation == Other.Rotation &&
+		LinearVelocity == Other.LinearVelocity && AngularVelocity == Other.AngularVelocity;
+}
+
+FVehicleStateQuantized FVehicleStateQuantized::MakeDelta(const FVehicleStateQuantized& Base) const
+{
+	FVehicleStateQuantized Delta;
+	Delta.Cell = Cell - Base.Cell;
+	Delta.Position = Position - Base.Position;
+	Delta.Rotation = Rotation ^ Base.Rotation;
+	Delta.LinearVelocity = LinearVelocity - Base.LinearVelocity;
+	Delta.AngularVelocity = AngularVelocity - Base.AngularVelocity;
+	Delta.OwnerTime = OwnerTime - Base.OwnerTime;
+	return Delta;
+}
+
+FVehicleStateQuantized FVehicleStateQuantized::ApplyDelta(const FVehicleStateQuantized& Base) const
+{
+	FVehicleStateQuantized State;
+	State.Cell = Base.Cell + Cell;
+	State.Position = Base.Position + Position;
+	State.Rotation = Base.Rotation ^ Rotation;
+	State.LinearVelocity = Base.LinearVelocity + LinearVelocity;
+	State.AngularVelocity = Base.AngularVelocity + AngularVelocity;
+	State.OwnerTime = Base.OwnerTime + OwnerTime;
+	return State;
+}
+
+void FVehicleStateQuantized::Serialize(FArchive& Ar, bool bDelta)
+{
+	enum
+	{
+		ChangedCell = 1 << 0,
+		ChangedPosition = 1 << 1,
+		ChangedRotation = 1 << 2,
+		ChangedLinearVelocity = 1 << 3,
+		ChangedAngularVelocity = 1 << 4,
+		NumChangedBits = 5
+	};
+
+	if (Ar.IsLoading())
+	{
+		*this = FVehicleStateQuantized();
+	}
+
+	uint8 ChangedMask = (1 << NumChangedBits) - 1;
+	if (bDelta)
+	{
+		if (Ar.IsSaving())
+		{
+			ChangedMask = (Cell != FIntVector::ZeroValue ? ChangedCell : 0) |
+				(Position != FIntVector::ZeroValue ? ChangedPosition : 0) |
+				(Rotation != 0 ? ChangedRotation : 0) |
+				(LinearVelocity != FIntVector::ZeroValue ? ChangedLinearVelocity : 0) |
+				(AngularVelocity != FIntVector::ZeroValue ? ChangedAngularVelocity : 0);
+		}
+		Ar.SerializeBits(&ChangedMask, NumChangedBits);
+	}
+
+	if (ChangedMask & ChangedCell)
+		SerializeZigZagVector(Ar, Cell);
+	if (ChangedMask & ChangedPosition)
+		SerializeZigZagVector(Ar, Position);
+	if (ChangedMask & ChangedRotation)
+	{
+		// A changed rotation xor-ed with its base is as random as a full one
+		Ar << Rotation;
+	}
+	if (ChangedMask & ChangedLinearVelocity)
+		SerializeZigZagVector(Ar, LinearVelocity);
+	if (ChangedMask & ChangedAngularVelocity)
+		SerializeZigZagVector(Ar, AngularVelocity);
+
+	if (bDelta)
+		Ar.SerializeIntPacked(OwnerTime);
+	else
+		Ar << OwnerTime;
+}
+
+FVehicleStateHistory::FVehicleStateHistory()
+{
+	FMemory::Memzero(Sequences);
+	FMemory::Memzero(bValid);
+}
+
+void FVehicleStateHistory::Add(uint8 Sequence, const FVehicleStateQuantized& State)
+{
+	const int32 Slot = Sequence % Size;
+	States[Slot] = State;
+	Sequences[Slot] = Sequence;
+	bValid[Slot] = true;
+}
+
+const FVehicleStateQuantized* FVehicleStateHistory::Find(uint8 Sequence) const
+{
+	const int32 Slot = Sequence % Size;
+	return bValid[Slot] && Sequences[Slot] == Sequence ? &States[Slot] : nullptr;
+}
+
+bool FVehicleStatePacket::NetSerialize(FArchive& Ar, class UPackageMap* Map, bool& bOutSuccess)
+{
+	Ar << Sequence;
+
+	uint8 bDeltaBit = bDelta;
+	Ar.SerializeBits(&bDeltaBit, 1);
+	bDelta = bDeltaBit != 0;
+
+	if (bDelta)
+		Ar << BaseSequence;
+
+	Values.Serialize(Ar, bDelta);
+
+	bOutSuccess = !Ar.IsError();
+	return true;
+}
+
+/** The state last sent to a connection, the next delta to it is taken against it */
+class FVehicleStateNetBaseState : public INetDeltaBaseState
+{
+public:
+	FVehicleStateNetBaseState(uint8 InSequence, const FVehicleStateQuantized& InState) :
+		Sequence(InSequence),
+		State(InState)
+	{}
+
+	virtual bool IsStateEqual(INetDeltaBaseState* OtherState) override
+	{
+		const FVehicleStateNetBaseState* Other = static_cast<FVehicleStateNetBaseState*>(OtherState);
+		return Sequence == Other->Sequence && State.OwnerTime == Other->State.OwnerTime;
+	}
+
+	uint8 Sequence;
+
+	FVehicleStateQuantized State;
+};
+
+bool FVehicleStateNetPack::NetDeltaSerialize(FNetDeltaSerializeInfo& DeltaParms)
+{
+	if (DeltaParms.Writer)
+	{
+		FVehicleStateNetBaseState* OldState = static_cast<FVehicleStateNetBaseState*>(DeltaParms.OldState);
+
+		// Nothing newer than what the connection has, the vehicle is idle
+		if (OldState && OldState->Sequence == Sequence && OldState->State.OwnerTime == State.OwnerTime)
+			return false;
+
+		FVehicleStatePacket Packet;
+		Packet.Sequence = Sequence;
+		// The connection may have lost the base, a full state now and then lets it resync
+		Packet.bDelta = OldState && FVehicleStateHistory::IsInWindow(OldState->Sequence, Sequence) && Sequence % FullStateInterval != 0;
+		Packet.BaseSequence = Packet.bDelta ? OldState->Sequence : 0;
+		Packet.Values = Packet.bDelta ? State.MakeDelta(OldState->State) : State;
+
+		bool bSuccess = true;
+		Packet.NetSerialize(*DeltaParms.Writer, DeltaParms.Map, bSuccess);
+
+		*DeltaParms.NewState = MakeShareable(new FVehicleStateNetBaseState(Sequence, State));
+	}
+	else if (DeltaParms.Reader)
+	{
+		FVehicleStatePacket Packet;
+		bool bSuccess = true;
+		Packet.NetSerialize(*DeltaParms.Reader, DeltaParms.Map, bSuccess);
+
+		// The base is missing when the packet carrying it was lost, then deltas are dropped until the next full state
+		const FVehicleStateQuantized* Base = Packet.bDelta ? History.Find(Packet.BaseSequence) : nullptr;
+		if (bSuccess && (!Packet.bDelta || Base))
+		{
+			State = Base ? Packet.Values.ApplyDelta(*Base) : Packet.Values;
+			Sequence = Packet.Sequence;
+			History.Add(Sequence, State);
+		}
+	}
+
+	return true;
+}
 
 // Sets default values for this component's properties
 USVehicleSmoothSyncComponent::USVehicleSmoothSyncComponent() :
 	MaxSnapshots(30),
 	SendStateRate(30),
 	PingLimit(100.f),
+	PositionCellSize(8192.f),
+	PositionPrecision(0.5f),
+	VelocityPrecision(1.f),
+	AngularVelocityPrecision(0.5f),
+	IdleResendInterval(1.f),
 	PositionLerp(0.3f),
 	AngleLerp(0.5f),
 	LinearVelocityLerp(0.3f),
@@ -25,9 +297,15 @@ USVehicleSmoothSyncComponent::USVehicleSmoothSyncComponent() :
 	InterVelCoefficient(100.f),
 	InterAngCoefficient(100.f),
 	ExtrapolationCoefficient(30.f),
+	NewestSnapshot(0),
+	NumSnapshots(0),
 	CurSimulationTime(0.f),
 	LastSendStateTime(0.f),
 	LastReceiveStateTime(0.f),
+	LastSentPacketTime(0.f),
+	SendSequence(0),
+	AckedSequence(0),
+	bHasAckedState(false),
 	UpdatedComponent(nullptr),
 	bForceVehicleRotation(false),
 	bShouldAccelerate(false)
@@ -50,9 +328,20 @@ void USVehicleSmoothSyncComponent::BeginPlay()
 	if (GetOwner())
 	{
 		UpdatedComponent = Cast<USkinnedMeshComponent>(GetOwner()->GetComponentByClass(USkinnedMeshComponent::StaticClass()));	
+
+		// ReplicatedState goes out at the net update rate of the vehicle
+		if (GetOwner()->HasAuthority())
+			GetOwner()->NetUpdateFrequency = FMath::Max(GetOwner()->NetUpdateFrequency, (float)SendStateRate);
 	}
 }
 
+void USVehicleSmoothSyncComponent::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const
+{
+	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
+
+	DOREPLIFETIME_CONDITION(USVehicleSmoothSyncComponent, ReplicatedState, COND_SkipOwner);
+}
+
 
 void USVehicleSmoothSyncComponent::EndPlay(const EEndPlayReason::Type EndPlayReason)
 {
@@ -117,32 +406,73 @@ void USVehicleSmoothSyncComponent::SendState()
 		NewState.OwnerTime = UGameplayStatics::GetRealTimeSeconds(this);
 		LastSendStateTime = UGameplayStatics::GetRealTimeSeconds(this);
 
-		Server_SendStateToServer(NewState);
+		const FVehicleStateQuantized Quantized = QuantizeState(NewState);
+		if (Quantized.IsSameMotion(LastSentState) && LastSendStateTime - LastSentPacketTime < IdleResendInterval)
+			return;
+
+		// Delta against the newest state the server acknowledged, while it is still in the history
+		FVehicleStatePacket Packet;
+		Packet.Sequence = ++SendSequence;
+		const FVehicleStateQuantized* Base = bHasAckedState && FVehicleStateHistory::IsInWindow(AckedSequence, Packet.Sequence) ? SentStates.Find(AckedSequence) : nullptr;
+		Packet.bDelta = Base != nullptr;
+		Packet.BaseSequence = Base ? AckedSequence : 0;
+		Packet.Values = Base ? Quantized.MakeDelta(*Base) : Quantized;
+
+		SentStates.Add(Packet.Sequence, Quantized);
+		LastSentState = Quantized;
+		LastSentPacketTime = LastSendStateTime;
+
+		Server_SendStateToServer(Packet);
 	}
 }
 
-void USVehicleSmoothSyncComponent::AddState(FVehicleState NewState)
+void USVehicleSmoothSyncComponent::AddState(const FVehicleState& NewState)
 {
-	StateSnapshotList.AddHead(NewState);
-
-	for (auto& Iter : StateSnapshotList)
+	if (StateSnapshots.Num() != MaxSnapshots)
 	{
-		DrawDebugPoint(GetWorld(), Iter.Position, 10.f, FColor::Red, false, 100.f);
+		StateSnapshots.SetNum(MaxSnapshots);
+		NewestSnapshot = 0;
+		NumSnapshots = 0;
 	}
 
-	if (StateSnapshotList.Num() == 1 && CurSimulationTime == 0.f)
+	// Unreliable packets can come out of order, the ring has to stay sorted for FindSnapshotBefore
+	if (NumSnapshots > 0 && NewState.OwnerTime <= GetSnapshot(0).OwnerTime)
+		return;
+
+	NewestSnapshot = (NewestSnapshot + 1) % StateSnapshots.Num();
+	StateSnapshots[NewestSnapshot] = NewState;      //Overwrite the oldest snapshot when the ring is full
+	NumSnapshots = FMath::Min(NumSnapshots + 1, StateSnapshots.Num());
+
+	if (CVarVehicleSmoothSyncDrawDebug.GetValueOnGameThread())
 	{
-		CurSimulationTime = NewState.OwnerTime - GetWorld()->DeltaTimeSeconds;
+		// Lives as long as the snapshot stays in the ring
+		DrawDebugPoint(GetWorld(), NewState.Position, 10.f, FColor::Red, false, (float)MaxSnapshots / SendStateRate);
 	}
 
-	while (StateSnapshotList.Num() > MaxSnapshots)
+	if (NumSnapshots == 1 && CurSimulationTime == 0.f)
 	{
-		StateSnapshotList.RemoveNode(StateSnapshotList.GetTail());   //Remove extern snapshot
+		CurSimulationTime = NewState.OwnerTime - GetWorld()->DeltaTimeSeconds;
 	}
 
 	LastReceiveStateTime = UGameplayStatics::GetRealTimeSeconds(GetWorld());
 }
 
+int32 USVehicleSmoothSyncComponent::FindSnapshotBefore(float Time)
+{
+	// OwnerTime decreases with the index
+	int32 First = 0;
+	int32 Last = NumSnapshots;
+	while (First < Last)
+	{
+		const int32 Mid = (First + Last) / 2;
+		if (GetSnapshot(Mid).OwnerTime > Time)
+			First = Mid + 1;
+		else
+			Last = Mid;
+	}
+	return First;
+}
+
 void USVehicleSmoothSyncComponent::AdjustOrientation(class UStaticMeshComponent* LMesh, class UStaticMeshComponent* RMesh)
 {
 	FVehicleState InState, CurState;
@@ -183,9 +513,9 @@ void USVehicleSmoothSyncComponent::AdjustOrientation(class UStaticMeshComponent*
 
 void USVehicleSmoothSyncComponent::SmoothVehicleMovement(float DeltaTime)
 {
-	auto TargetState = StateSnapshotList.GetHead();
+	if (NumSnapshots == 0 || NumSnapshots < MaxSnapshots)return;
 
-	if (!TargetState || StateSnapshotList.Num() < MaxSnapshots)return;
+	FVehicleState& NewestState = GetSnapshot(0);
 
 	FRigidBodyState BodyState;
 	UpdatedComponent->GetRigidBodyState(BodyState);
@@ -197,7 +527,7 @@ void USVehicleSmoothSyncComponent::SmoothVehicleMovement(float DeltaTime)
 
 	if (bShouldAccelerate)
 	{
-		CurSimulationTime = FMath::Min(TargetState->GetValue().OwnerTime - 0.01f, CurSimulationTime + DeltaTime * AccTimeCoefficient);
+		CurSimulationTime = FMath::Min(NewestState.OwnerTime - 0.01f, CurSimulationTime + DeltaTime * AccTimeCoefficient);
 		//PrintDebug(TEXT("In acceleration"));
 	}
 	else
@@ -208,32 +538,27 @@ void USVehicleSmoothSyncComponent::SmoothVehicleMovement(float DeltaTime)
 
 	if (GetOwnerRole() == ROLE_SimulatedProxy)
 	{
-		//UKismetSystemLibrary::PrintString(this, TEXT("Time Diff") + FString::SanitizeFloat(CurSimulationTime - TargetState->GetValue().OwnerTime));
+		//UKismetSystemLibrary::PrintString(this, TEXT("Time Diff") + FString::SanitizeFloat(CurSimulationTime - NewestState.OwnerTime));
 	}
 
-	if (TargetState->GetValue().OwnerTime < CurSimulationTime)
+	if (NewestState.OwnerTime < CurSimulationTime)
 	{
-		//Extrapolate(CurSimulationTime, &TargetState->GetValue());
+		//Extrapolate(CurSimulationTime, &NewestState);
 		//PrintDebug(TEXT("Extrapolate"));
 	}
 	else
 	{
 		//PrintDebug(TEXT("Interpolate"));
-		int32 Index = 0;
-		while (TargetState && TargetState->GetValue().OwnerTime > CurSimulationTime)
-		{
-			TargetState = TargetState->GetNextNode();
-			Index++;
-		}
+		const int32 Index = FindSnapshotBefore(CurSimulationTime);
 		bShouldAccelerate = Index >= 4;
 			
-		if (TargetState && TargetState->GetPrevNode())
+		if (Index > 0 && Index < NumSnapshots)
 		{
-			Interpolate(CurSimulationTime, &TargetState->GetValue(), &TargetState->GetPrevNode()->GetValue());
+			Interpolate(CurSimulationTime, &GetSnapshot(Index), &GetSnapshot(Index - 1));
 		}
-		else if(TargetState == StateSnapshotList.GetTail())
+		else if(Index == NumSnapshots - 1)
 		{
-			FVehicleState& EndState = StateSnapshotList.GetTail()->GetValue();
+			FVehicleState& EndState = GetSnapshot(NumSnapshots - 1);
 
 			TargetVehicleState.Position = EndState.Position;
 			TargetVehicleState.Rotation = EndState.Rotation;
@@ -242,7 +567,7 @@ void USVehicleSmoothSyncComponent::SmoothVehicleMovement(float DeltaTime)
 
 			if (UpdatedComponent)
 			{
-				FVector DiffVec = TargetState->GetValue().Position - BodyState.Position;
+				FVector DiffVec = EndState.Position - BodyState.Position;
 				//UpdatedComponent->SetPhysicsLinearVelocity(BodyState.LinVel + DiffVec * GetWorld()->GetDeltaSeconds() * InterVelCoefficient);
 				FQuat DeltaQuat = BodyState.Quaternion.Inverse() * EndState.Rotation;
 				FVector AngDiffAxis;
@@ -270,7 +595,8 @@ void USVehicleSmoothSyncComponent::SmoothVehicleMovement(float DeltaTime)
 					//UpdatedComponent->SetWorldRotation(DeltaQuat * FQuat(AngDiffAxis, FMath::DegreesToRadians(AngDiff / FMath::Abs(AngDiff) * 60.f)), false, nullptr, ETeleportType::TeleportPhysics);
 
 				FVector NewPosition = FMath::Lerp(FVector(BodyState.Position), TargetVehicleState.Position, PositionLerp);
-				DrawDebugPoint(GetWorld(), TargetVehicleState.Position + FVector::UpVector * 50.f, 20.f, FColor::Blue);
+				if (CVarVehicleSmoothSyncDrawDebug.GetValueOnGameThread())
+					DrawDebugPoint(GetWorld(), TargetVehicleState.Position + FVector::UpVector * 50.f, 20.f, FColor::Blue);
 				FQuat NewRotation = FQuat::Slerp(BodyState.Quaternion, TargetVehicleState.Rotation, AngleLerp);
 			}
 		}
@@ -312,7 +638,8 @@ void USVehicleSmoothSyncComponent::Interpolate(float DestTime, FVehicleState* St
 			float AngDiff;
 			DeltaQuat.ToAxisAndAngle(AngDiffAxis, AngDiff);
 			AngDiff = FMath::RadiansToDegrees(FMath::UnwindRadians(AngDiff));
-			DrawDebugDirectionalArrow(GetWorld(), BodyState.Position, BodyState.Position + AngDiffAxis * AngDiff*10.f, 100.f, FColor::Green, false, -1, 0, 3.f);
+			if (CVarVehicleSmoothSyncDrawDebug.GetValueOnGameThread())
+				DrawDebugDirectionalArrow(GetWorld(), BodyState.Position, BodyState.Position + AngDiffAxis * AngDiff*10.f, 100.f, FColor::Green, false, -1, 0, 3.f);
 			FQuat OutDiff;
 			//bool bTeleportRotation = AdjustVehicleOrientation(TargetVehicleState, OutDiff);
 			/*if (AngDiff < 3.f)return;
@@ -342,18 +669,19 @@ void USVehicleSmoothSyncComponent::Interpolate(float DestTime, FVehicleState* St
 			}
 				//BodyInstance->SetBodyTransform(FTransform(FQuat::Slerp(BodyState.Quaternion, TargetVehicleState.Rotation, 0.2f), FMath::Lerp(FVector(BodyState.Position), TargetVehicleState.Position, 0.3f)), ETeleportType::TeleportPhysics);
 			
-			DrawDebugPoint(GetWorld(), TargetVehicleState.Position, 20.f, FColor::Blue);
+			if (CVarVehicleSmoothSyncDrawDebug.GetValueOnGameThread())
+				DrawDebugPoint(GetWorld(), TargetVehicleState.Position, 20.f, FColor::Blue);
 		}
 	}
 }
 
 void USVehicleSmoothSyncComponent::Extrapolate(float DestTime, FVehicleState* LastState)
 {
-	if (UpdatedComponent)
+	if (UpdatedComponent && NumSnapshots >= 2)
 	{
 		FBodyInstance* BodyInstance = UpdatedComponent->GetBodyInstance();
-		FVehicleState& LastState = StateSnapshotList.GetHead()->GetValue();
-		FVehicleState& PreLastState = StateSnapshotList.GetHead()->GetNextNode()->GetValue();
+		FVehicleState& LastState = GetSnapshot(0);
+		FVehicleState& PreLastState = GetSnapshot(1);
 		FVector LinearAcceleration = (LastState.LinearVelocity - PreLastState.LinearVelocity) / (LastState.OwnerTime - PreLastState.OwnerTime);
 		FVector AngularAcceleration = (LastState.AngularVelocity - PreLastState.AngularVelocity) / (LastState.OwnerTime - PreLastState.OwnerTime);
 		FVector NewLinearVel = LastState.LinearVelocity + LinearAcceleration * GetWorld()->GetDeltaSeconds();
@@ -412,35 +740,36 @@ void USVehicleSmoothSyncComponent::Extrapolate(float DestTime, FVehicleState* La
 
 FVehicleState* USVehicleSmoothSyncComponent::GetNearestStateSnapshot(const FVehicleState& InState, float& OutTime)
 {
-	auto HeadState = StateSnapshotList.GetHead();
-	if (!HeadState)return nullptr;
+	if (NumSnapshots == 0)return nullptr;
 
-	int32 i = 0;
-	while (HeadState && HeadState->GetNextNode())
+	// Searched by position, not by time, so it walks the snapshots from the newest
+	for (int32 i = 0; i + 1 < NumSnapshots; ++i)
 	{
-		i++;
-		const FVector FromForward = HeadState->GetValue().Position - InState.Position;
-		const FVector FromBackward = HeadState->GetNextNode()->GetValue().Position - InState.Position;
-		if (FVector::DotProduct(FromForward, FromBackward) < 0.f && FVector::DotProduct(InState.LinearVelocity, HeadState->GetValue().LinearVelocity) >= 0.f)
+		const FVehicleState& NewerState = GetSnapshot(i);
+		const FVehicleState& OlderState = GetSnapshot(i + 1);
+		const FVector FromForward = NewerState.Position - InState.Position;
+		const FVector FromBackward = OlderState.Position - InState.Position;
+		if (FVector::DotProduct(FromForward, FromBackward) < 0.f && FVector::DotProduct(InState.LinearVelocity, NewerState.LinearVelocity) >= 0.f)
 		{
-			const FVector SnapshotInterval = HeadState->GetValue().Position - HeadState->GetNextNode()->GetValue().Position;
-			const float Mid = FVector::DotProduct(InState.Position - HeadState->GetNextNode()->GetValue().Position, SnapshotInterval) / (FMath::Pow(SnapshotInterval.Size(), 2));
-			OutTime = FMath::Lerp(HeadState->GetNextNode()->GetValue().OwnerTime, HeadState->GetValue().OwnerTime, Mid);
+			const FVector SnapshotInterval = NewerState.Position - OlderState.Position;
+			const float Mid = FVector::DotProduct(InState.Position - OlderState.Position, SnapshotInterval) / (FMath::Pow(SnapshotInterval.Size(), 2));
+			OutTime = FMath::Lerp(OlderState.OwnerTime, NewerState.OwnerTime, Mid);
 			
-			return &HeadState->GetNextNode()->GetValue();
+			return &GetSnapshot(i + 1);
 		}
-		HeadState = HeadState->GetNextNode();
 	}
 	
-	if ((InState.Position - StateSnapshotList.GetHead()->GetValue().Position).Size() > (InState.Position - StateSnapshotList.GetTail()->GetValue().Position).Size())
+	FVehicleState& NewestState = GetSnapshot(0);
+	FVehicleState& OldestState = GetSnapshot(NumSnapshots - 1);
+	if ((InState.Position - NewestState.Position).Size() > (InState.Position - OldestState.Position).Size())
 	{
-		OutTime = StateSnapshotList.GetTail()->GetValue().OwnerTime - 0.01f;
-		return &StateSnapshotList.GetTail()->GetValue();
+		OutTime = OldestState.OwnerTime - 0.01f;
+		return &OldestState;
 	}
 	else
 	{
-		OutTime = StateSnapshotList.GetHead()->GetValue().OwnerTime - 0.01f;
-		return &StateSnapshotList.GetHead()->GetValue();
+		OutTime = NewestState.OwnerTime - 0.01f;
+		return &NewestState;
 	}
 }
 
@@ -584,6 +913,29 @@ bool USVehicleSmoothSyncComponent::IsPointInCone(const FPlane& ComparedPlane, co
 	return Distance <= 0.f;
 }
 
+FVehicleStateQuantized USVehicleSmoothSyncComponent::QuantizeState(const FVehicleState& InState) const
+{
+	FVehicleStateQuantized Quantized;
+	Quantized.Cell = FIntVector(FMath::FloorToInt(InState.Position.X / PositionCellSize), FMath::FloorToInt(InState.Position.Y / PositionCellSize), FMath::FloorToInt(InState.Position.Z / PositionCellSize));
+	Quantized.Position = QuantizeVector(InState.Position - FVector(Quantized.Cell) * PositionCellSize, PositionPrecision);
+	Quantized.Rotation = QuantizeRotation(InState.Rotation);
+	Quantized.LinearVelocity = QuantizeVector(InState.LinearVelocity, VelocityPrecision);
+	Quantized.AngularVelocity = QuantizeVector(InState.AngularVelocity, AngularVelocityPrecision);
+	Quantized.OwnerTime = (uint32)FMath::RoundToInt(InState.OwnerTime * 1000.f);
+	return Quantized;
+}
+
+FVehicleState USVehicleSmoothSyncComponent::DequantizeState(const FVehicleStateQuantized& InState) const
+{
+	FVehicleState State;
+	State.Position = FVector(InState.Cell) * PositionCellSize + DequantizeVector(InState.Position, PositionPrecision);
+	State.Rotation = DequantizeRotation(InState.Rotation);
+	State.LinearVelocity = DequantizeVector(InState.LinearVelocity, VelocityPrecision);
+	State.AngularVelocity = DequantizeVector(InState.AngularVelocity, AngularVelocityPrecision);
+	State.OwnerTime = InState.OwnerTime / 1000.f;
+	return State;
+}
+
 FVehicleState USVehicleSmoothSyncComponent::CurveMovement(float DestTime, FVehicleState* PreState, FVehicleState* StartState, FVehicleState* EndState /*= nullptr*/)
 {
 	FVehicleState VehicleState;
@@ -604,19 +956,52 @@ void USVehicleSmoothSyncComponent::PrintDebug(FString&& InString)
 	}
 }
 
-void USVehicleSmoothSyncComponent::MultiCast_SendStateToAllClient_Implementation(FVehicleState NewState)
+void USVehicleSmoothSyncComponent::Server_SendStateToServer_Implementation(const FVehicleStatePacket& Packet)
 {
-	if (GetOwnerRole() != ROLE_AutonomousProxy)
-		AddState(NewState);
+	// Acknowledged states stay in the history for a while, a base can only be missing for a very late packet,
+	// the client then sends absolute states until it gets a new ack
+	const FVehicleStateQuantized* Base = Packet.bDelta ? ReceivedStates.Find(Packet.BaseSequence) : nullptr;
+	if (Packet.bDelta && !Base)
+	{
+		Client_ResetAckedState();
+		return;
+	}
+
+	const FVehicleStateQuantized State = Base ? Packet.Values.ApplyDelta(*Base) : Packet.Values;
+	ReceivedStates.Add(Packet.Sequence, State);
+	Client_AckState(Packet.Sequence);
+
+	// Out of order states are only kept as bases, the receivers interpolate forward
+	if (State.OwnerTime <= ReplicatedState.State.OwnerTime)
+		return;
+
+	ReplicatedState.Sequence++;
+	ReplicatedState.State = State;
+
+	AddState(DequantizeState(State));
 }
 
-void USVehicleSmoothSyncComponent::Server_SendStateToServer_Implementation(FVehicleState NewState)
+bool USVehicleSmoothSyncComponent::Server_SendStateToServer_Validate(const FVehicleStatePacket& Packet)
 {
-	MultiCast_SendStateToAllClient(NewState);
+	return true;
 }
 
-bool USVehicleSmoothSyncComponent::Server_SendStateToServer_Validate(FVehicleState NewState)
+void USVehicleSmoothSyncComponent::Client_AckState_Implementation(uint8 Sequence)
 {
-	return true;
+	if (!bHasAckedState || (int8)(Sequence - AckedSequence) > 0)
+	{
+		AckedSequence = Sequence;
+		bHasAckedState = true;
+	}
+}
+
+void USVehicleSmoothSyncComponent::Client_ResetAckedState_Implementation()
+{
+	bHasAckedState = false;
 }
 
+void USVehicleSmoothSyncComponent::OnRep_ReplicatedState()
+{
+	if (GetOwnerRole() != ROLE_AutonomousProxy)
+		AddState(DequantizeState(ReplicatedState.State));
+}
@@ -4,6 +4,7 @@
 
 #include "CoreMinimal.h"
 #include "Components/ActorComponent.h"
+#include "Engine/NetSerialization.h"
 #include "SVehicleSmoothSyncComponent.generated.h"
 
 USTRUCT()
@@ -43,6 +44,141 @@ struct FVehicleState
 	}
 };
 
+/** FVehicleState in the steps sent over the network, see USVehicleSmoothSyncComponent::QuantizeState */
+struct FVehicleStateQuantized
+{
+	/** Cell of the position, cells are PositionCellSize wide */
+	FIntVector Cell;
+
+	/** Position from the corner of the cell in steps of PositionPrecision */
+	FIntVector Position;
+
+	/** Smallest three, index of the largest component in the top 2 bits then the others in 10 bits each */
+	uint32 Rotation;
+
+	/** Steps of VelocityPrecision and AngularVelocityPrecision */
+	FIntVector LinearVelocity;
+
+	FIntVector AngularVelocity;
+
+	/** OwnerTime in milliseconds */
+	uint32 OwnerTime;
+
+	FVehicleStateQuantized() :
+		Cell(ForceInitToZero),
+		Position(ForceInitToZero),
+		Rotation(0),
+		LinearVelocity(ForceInitToZero),
+		AngularVelocity(ForceInitToZero),
+		OwnerTime(0)
+	{}
+
+	/** Same state apart from the time, the vehicle did not move */
+	bool IsSameMotion(const FVehicleStateQuantized& Other) const;
+
+	/** Difference to Base, the rotation is xor-ed so an unchanged rotation is 0 */
+	FVehicleStateQuantized MakeDelta(const FVehicleStateQuantized& Base) const;
+
+	FVehicleStateQuantized ApplyDelta(const FVehicleStateQuantized& Base) const;
+
+	/** A delta only writes the fields which changed */
+	void Serialize(FArchive& Ar, bool bDelta);
+};
+
+/** Quantized states by sequence, a delta is only taken against a state the receiver still has here */
+struct FVehicleStateHistory
+{
+	static const int32 Size = 32;
+
+	FVehicleStateHistory();
+
+	void Add(uint8 Sequence, const FVehicleStateQuantized& State);
+
+	const FVehicleStateQuantized* Find(uint8 Sequence) const;
+
+	/** Whether a state of Sequence can still be a base of a state of NewSequence */
+	static bool IsInWindow(uint8 Sequence, uint8 NewSequence)
+	{
+		return (uint8)(NewSequence - Sequence) < Size;
+	}
+
+private:
+	FVehicleStateQuantized States[Size];
+
+	uint8 Sequences[Size];
+
+	bool bValid[Size];
+};
+
+/** State sent by the owning client, absolute or a delta against the last state the server acknowledged */
+USTRUCT()
+struct FVehicleStatePacket
+{
+	GENERATED_BODY()
+
+	uint8 Sequence;
+
+	uint8 BaseSequence;
+
+	bool bDelta;
+
+	/** Delta against the state of BaseSequence when bDelta, resolved by the component which keeps the history */
+	FVehicleStateQuantized Values;
+
+	FVehicleStatePacket() :
+		Sequence(0),
+		BaseSequence(0),
+		bDelta(false)
+	{}
+
+	bool NetSerialize(FArchive& Ar, class UPackageMap* Map, bool& bOutSuccess);
+};
+
+template<>
+struct TStructOpsTypeTraits<FVehicleStatePacket> : public TStructOpsTypeTraitsBase2<FVehicleStatePacket>
+{
+	enum
+	{
+		WithNetSerializer = true,
+	};
+};
+
+/**
+ * Newest state of the vehicle replicated to the other clients. The delta of every connection is taken against
+ * the state last sent to it, which may have been lost, so every FullStateInterval sequences a full state is sent
+ * and a client missing a base resyncs there. Nothing is sent while the server has no new state.
+ */
+USTRUCT()
+struct FVehicleStateNetPack
+{
+	GENERATED_BODY()
+
+	/** Simulated proxies can not call server RPCs to ask for a full state, so the server sends one this often */
+	static const uint8 FullStateInterval = 16;
+
+	uint8 Sequence;
+
+	FVehicleStateQuantized State;
+
+	/** States received by a client, the bases of the deltas */
+	FVehicleStateHistory History;
+
+	FVehicleStateNetPack() :
+		Sequence(0)
+	{}
+
+	bool NetDeltaSerialize(FNetDeltaSerializeInfo& DeltaParms);
+};
+
+template<>
+struct TStructOpsTypeTraits<FVehicleStateNetPack> : public TStructOpsTypeTraitsBase2<FVehicleStateNetPack>
+{
+	enum
+	{
+		WithNetDeltaSerializer = true,
+	};
+};
+
 UCLASS( ClassGroup=(Custom), meta=(BlueprintSpawnableComponent) )
 class USVehicleSmoothSyncComponent : public UActorComponent
 {
@@ -62,15 +198,24 @@ public:
 	// Called every frame
 	virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
 
+	virtual void GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const override;
+
 	UFUNCTION(Server, Unreliable, WithValidation)
-	void Server_SendStateToServer(FVehicleState NewState);
+	void Server_SendStateToServer(const FVehicleStatePacket& Packet);
+
+	UFUNCTION(Client, Unreliable)
+	void Client_AckState(uint8 Sequence);
+
+	/** The server dropped a delta whose base it does not have, the next state is sent absolute */
+	UFUNCTION(Client, Unreliable)
+	void Client_ResetAckedState();
 
-	UFUNCTION(NetMulticast, Unreliable)
-	void MultiCast_SendStateToAllClient(FVehicleState NewState);
+	UFUNCTION()
+	void OnRep_ReplicatedState();
 
 	void SendState();
 
-	void AddState(FVehicleState NewState);
+	void AddState(const FVehicleState& NewState);
 
 	UFUNCTION(BlueprintCallable)
 	static void AdjustOrientation(class UStaticMeshComponent* LMesh, class UStaticMeshComponent* RMesh);
@@ -84,12 +229,25 @@ private:
 
 	FVehicleState* GetNearestStateSnapshot(const FVehicleState& InState, float& OutTime);
 
+	/** Snapshot Index back from the newest one, 0 is the newest */
+	FORCEINLINE FVehicleState& GetSnapshot(int32 Index)
+	{
+		return StateSnapshots[(NewestSnapshot - Index + StateSnapshots.Num()) % StateSnapshots.Num()];
+	}
+
+	/** Index of the newest snapshot not later than Time, NumSnapshots when all of them are later */
+	int32 FindSnapshotBefore(float Time);
+
 	void SmoothPhysics(float DeltaTime, FBodyInstance* BodyInstance);
 
 	bool AdjustVehicleOrientation(const FVehicleState& InState, FQuat& OutDiffQuat);
 
 	bool IsPointInCone(const FPlane& ComparedPlane, const FVector& StartPoint, const FVector& EndPoint);
 
+	FVehicleStateQuantized QuantizeState(const FVehicleState& InState) const;
+
+	FVehicleState DequantizeState(const FVehicleStateQuantized& InState) const;
+
 	FVehicleState CurveMovement(float DestTime, FVehicleState* PreState, FVehicleState* StartState, FVehicleState* EndState = nullptr);
 
 	void PrintDebug(FString&& InString);
@@ -104,6 +262,26 @@ private:
 	UPROPERTY(EditDefaultsOnly, meta = (ClampMin = 0.0f), Category = BaseConfig)
 	float PingLimit;
 
+	/** Positions are sent from the corner of a cell this wide, so they fit in a few bits in the cell */
+	UPROPERTY(EditDefaultsOnly, meta = (ClampMin = 100.0f), Category = Replication)
+	float PositionCellSize;
+
+	/** Centimeters of a step of the sent position */
+	UPROPERTY(EditDefaultsOnly, meta = (ClampMin = 0.01f), Category = Replication)
+	float PositionPrecision;
+
+	/** Centimeters per second of a step of the sent linear velocity */
+	UPROPERTY(EditDefaultsOnly, meta = (ClampMin = 0.01f), Category = Replication)
+	float VelocityPrecision;
+
+	/** Degrees per second of a step of the sent angular velocity */
+	UPROPERTY(EditDefaultsOnly, meta = (ClampMin = 0.01f), Category = Replication)
+	float AngularVelocityPrecision;
+
+	/** A vehicle which did not move only sends a state this often, so the receivers know it is still there */
+	UPROPERTY(EditDefaultsOnly, meta = (ClampMin = 0.0f), Category = Replication)
+	float IdleResendInterval;
+
 	UPROPERTY(EditDefaultsOnly, meta = (ClampMin = 0.0f, ClampMax = 1.0f), Category = Interpolation)
 	float PositionLerp;
 
@@ -143,7 +321,13 @@ private:
 	UPROPERTY(EditDefaultsOnly, meta = (ClampMin = 1.0f), Category = Extrapolation)
 	float ExtrapolationCoefficient;
 
-	TDoubleLinkedList<FVehicleState> StateSnapshotList;
+	/** Received snapshots, a ring of MaxSnapshots allocated once, ordered by OwnerTime */
+	TArray<FVehicleState> StateSnapshots;
+
+	/** Slot of the newest snapshot in StateSnapshots */
+	int32 NewestSnapshot;
+
+	int32 NumSnapshots;
 
 	float CurSimulationTime;
 
@@ -151,6 +335,25 @@ private:
 
 	float LastReceiveStateTime;
 
+	/** Owning client, the sent states and the newest one the server acknowledged */
+	FVehicleStateHistory SentStates;
+
+	FVehicleStateQuantized LastSentState;
+
+	float LastSentPacketTime;
+
+	uint8 SendSequence;
+
+	uint8 AckedSequence;
+
+	bool bHasAckedState;
+
+	/** Server, the states received from the owning client */
+	FVehicleStateHistory ReceivedStates;
+
+	UPROPERTY(ReplicatedUsing = OnRep_ReplicatedState)
+	FVehicleStateNetPack ReplicatedState;
+
 	FVehicleState TargetVehicleState;
 
 	UPROPERTY()
@@ -26,6 +26,21 @@ DECLARE_STATS_GROUP(TEXT("Foliage"), STATGROUP_Foliage, STATCAT_Advanced);
 
 #define MAX_CUSTOM_INSTANCEDATA_NUM 4
 
+//#Change by wh, 2020/6/12 
+/** Storage of the per instance custom data slots */
+UENUM()
+enum class ECustomInstanceDataFormat : uint8
+{
+	Float,
+	/** Halves the instance buffer and the fetch of it */
+	Half,
+	/** Values are clamped to [0,1], fits flags and normalized angles */
+	UNorm16,
+	/** Values are clamped to [0,1], a quarter of the float size */
+	UNorm8,
+};
+//end
+
 class FStaticLightingTextureMapping_InstancedStaticMesh;
 class FInstancedLightMap2D;
 class FInstancedShadowMap2D;
@@ -275,6 +290,33 @@ public:
 	//#Change by wh, 2020/6/12 
 	UPROPERTY(EditAnywhere, Category = CustomInstance, meta = (ClampMin = "0"))
 	int32 CustomInstanceDataNum;
+
+	/**
+	 * Number of leading custom data slots which are the same for all instances, they are read from CustomInstanceSharedData
+	 * instead of the instance buffer. Only works with manual vertex fetch, otherwise all slots are stored per instance.
+	 */
+	UPROPERTY(EditAnywhere, Category = CustomInstance, meta = (ClampMin = "0"))
+	int32 CustomInstanceSharedDataNum;
+
+	/** Values of the shared custom data slots */
+	UPROPERTY(EditAnywhere, Category = CustomInstance)
+	TArray<FVector4> CustomInstanceSharedData;
+
+	/** Storage of the per instance custom data, falls back to Float when the vertex format is not supported */
+	UPROPERTY(EditAnywhere, Category = CustomInstance)
+	ECustomInstanceDataFormat CustomInstanceDataFormat;
+
+	/** Shared slots which are really used on this platform */
+	int32 GetCustomInstanceSharedDataNum() const;
+
+	/**
+	 * Set a custom data slot for all instances. A shared slot only recreates the proxy, when the platform stores it per instance
+	 * every instance is written and the instance buffer is rebuilt.
+	 */
+	void SetCustomInstanceSharedData(int32 Slot, const FVector4& Value);
+
+	/** Create the render instance data with the stored slot count and format of this component */
+	FStaticMeshInstanceData* CreateInstanceBufferData() const;
 	//end
 public:
 	/** Render data will be initialized on PostLoad or on demand. Released on the rendering thread. */
@@ -245,7 +245,7 @@ void FStaticMeshInstanceBuffer::InitFromPreallocatedData(FStaticMeshInstanceData
 	}
 
 	//InstanceData = MakeShared<FStaticMeshInstanceData, ESPMode::ThreadSafe>();
-	FMemory::Memswap(Other, InstanceData.Get(), Other->GetNumCustomData() ? sizeof(FStaticMeshInstanceData) : sizeof(FStaticMeshInstanceData_CustomData<1>));
+	FMemory::Memswap(Other, InstanceData.Get(), Other->GetNumCustomData() ? sizeof(FStaticMeshInstanceData_CustomData<1>) : sizeof(FStaticMeshInstanceData));
 	InstanceData->SetAllowCPUAccess(RequireCPUAccess);
 }
 //end
@@ -334,7 +334,10 @@ void FStaticMeshInstanceBuffer::InitRHI()
 		CreateVertexBuffer(InstanceData->GetLightMapResourceArray(), AccessFlags | BUF_ShaderResource, 8, PF_R16G16B16A16_SNORM, InstanceLightmapBuffer.VertexBufferRHI, InstanceLightmapSRV);
 		//#Change by wh, 2019/6/10 
 		if (InstanceData->GetNumCustomData() > 0)
-			CreateVertexBuffer(InstanceData->GetShadowFakeryResourceArray(), AccessFlags | BUF_ShaderResource, InstanceData->GetNumCustomData() * 16, PF_A32B32G32R32F, InstanceShadowFakeryBuffer.VertexBufferRHI, InstanceShadowFakerySRV);
+		{
+			const EInstanceCustomDataFormat CustomDataFormat = InstanceData->GetCustomDataFormat();
+			CreateVertexBuffer(InstanceData->GetShadowFakeryResourceArray(), AccessFlags | BUF_ShaderResource, GetInstanceCustomDataSlotStride(CustomDataFormat), GetInstanceCustomDataPixelFormat(CustomDataFormat), InstanceShadowFakeryBuffer.VertexBufferRHI, InstanceShadowFakerySRV);
+		}
 		//end
 	}
 }
@@ -434,11 +437,12 @@ void FStaticMeshInstanceBuffer::BindInstanceVertexBuffer(const class FVertexFact
 		//#Change by wh, 2019/6/10 
 		if (InstanceData->GetNumCustomData() > 0)
 		{
+			const EInstanceCustomDataFormat CustomDataFormat = InstanceData->GetCustomDataFormat();
 			InstancedStaticMeshData.InstanceShadowFakeryComponent = FVertexStreamComponent(
 				&InstanceShadowFakeryBuffer,
 				0,
-				16 * InstanceData->GetNumCustomData(),
-				VET_Float4,
+				GetInstanceCustomDataSlotStride(CustomDataFormat) * InstanceData->GetNumCustomData(),
+				GetInstanceCustomDataElementType(CustomDataFormat),
 				EVertexStreamUsage::ManualFetch | EVertexStreamUsage::Instancing
 			);
 		}
@@ -829,7 +833,7 @@ void FPerInstanceRenderData::UpdateFromPreallocatedData(FStaticMeshInstanceData*
 		}
 	}
 	//InstanceBuffer_GameThread = MakeShared<FStaticMeshInstanceData, ESPMode::ThreadSafe>();
-	FMemory::Memswap(InOther, InstanceBuffer_GameThread.Get(), InOther->GetNumCustomData() ? sizeof(FStaticMeshInstanceData) : sizeof(FStaticMeshInstanceData_CustomData<1>));
+	FMemory::Memswap(InOther, InstanceBuffer_GameThread.Get(), InOther->GetNumCustomData() ? sizeof(FStaticMeshInstanceData_CustomData<1>) : sizeof(FStaticMeshInstanceData));
 
 	typedef TSharedPtr<FStaticMeshInstanceData, ESPMode::ThreadSafe> FStaticMeshInstanceDataPtr;
 
@@ -1018,6 +1022,14 @@ void FInstancedStaticMeshSceneProxy::SetupProxy(UInstancedStaticMeshComponent* I
 
 	UserData_AllInstances.AverageInstancesScale = MinScale + (MaxScale - MinScale) / 2.0f;
 
+	//#Change by wh, 2020/6/12 
+	UserData_AllInstances.CustomDataSharedNum = InComponent->GetCustomInstanceSharedDataNum();
+	for (int32 i = 0; i < UserData_AllInstances.CustomDataSharedNum; ++i)
+	{
+		UserData_AllInstances.CustomDataShared[i] = InComponent->CustomInstanceSharedData[i];
+	}
+	//end
+
 	// selected only
 	UserData_SelectedInstances = UserData_AllInstances;
 	UserData_SelectedInstances.bRenderUnselected = false;
@@ -1504,19 +1516,7 @@ FPrimitiveSceneProxy* UInstancedStaticMeshComponent::CreateSceneProxy()
 		{
 			InstanceUpdateCmdBuffer.Reset();
 
-			FStaticMeshInstanceData* RenderInstanceData = nullptr;
-			if(CustomInstanceDataNum == 0)
-				RenderInstanceData = new FStaticMeshInstanceData(GVertexElementTypeSupport.IsSupported(VET_Half2));
-			else
-			{
-				switch (CustomInstanceDataNum)
-				{
-				case 1: RenderInstanceData = new FStaticMeshInstanceData_CustomData<1>(GVertexElementTypeSupport.IsSupported(VET_Half2));break;
-				case 2: RenderInstanceData = new FStaticMeshInstanceData_CustomData<2>(GVertexElementTypeSupport.IsSupported(VET_Half2));break;
-				case 3: RenderInstanceData = new FStaticMeshInstanceData_CustomData<3>(GVertexElementTypeSupport.IsSupported(VET_Half2));break;
-				case 4: RenderInstanceData = new FStaticMeshInstanceData_CustomData<4>(GVertexElementTypeSupport.IsSupported(VET_Half2));break;
-				}
-			}
+			FStaticMeshInstanceData* RenderInstanceData = CreateInstanceBufferData();
 			BuildRenderData(RenderInstanceData, PerInstanceRenderData->HitProxies);
 			PerInstanceRenderData->UpdateFromPreallocatedData(RenderInstanceData);
 			delete RenderInstanceData;
@@ -1596,7 +1596,7 @@ void UInstancedStaticMeshComponent::BuildRenderData(FStaticMeshInstanceData* Out
 		}
 		
 		//#Change by wh, 2020/6/12 
-		if (CustomInstanceDataNum == 0)
+		if (OutData->GetNumCustomData() == 0)
 			OutData->SetInstance(RenderIndex, InstanceData.Transform, RandomStream.GetFraction(), LightmapUVBias, ShadowmapUVBias);
 		else
 			OutData->SetInstance(RenderIndex, InstanceData.Transform, TArray<FVector4>(InstanceData.ShadowFakeryParam, CustomInstanceDataNum), RandomStream.GetFraction(), LightmapUVBias, ShadowmapUVBias);
@@ -2103,19 +2103,7 @@ void UInstancedStaticMeshComponent::SerializeRenderData(FArchive& Ar)
 
 					//#Change by wh, 2020/6/12 
 					//FStaticMeshInstanceData RenderInstanceData = FStaticMeshInstanceData(GVertexElementTypeSupport.IsSupported(VET_Half2));
-					FStaticMeshInstanceData* RenderInstanceData = nullptr;
-					if (CustomInstanceDataNum == 0)
-						RenderInstanceData = new FStaticMeshInstanceData(GVertexElementTypeSupport.IsSupported(VET_Half2));
-					else
-					{
-						switch (CustomInstanceDataNum)
-						{
-						case 1: RenderInstanceData = new FStaticMeshInstanceData_CustomData<1>(GVertexElementTypeSupport.IsSupported(VET_Half2)); break;
-						case 2: RenderInstanceData = new FStaticMeshInstanceData_CustomData<2>(GVertexElementTypeSupport.IsSupported(VET_Half2)); break;
-						case 3: RenderInstanceData = new FStaticMeshInstanceData_CustomData<3>(GVertexElementTypeSupport.IsSupported(VET_Half2)); break;
-						case 4: RenderInstanceData = new FStaticMeshInstanceData_CustomData<4>(GVertexElementTypeSupport.IsSupported(VET_Half2)); break;
-						}
-					}
+					FStaticMeshInstanceData* RenderInstanceData = CreateInstanceBufferData();
 					BuildRenderData(RenderInstanceData, PerInstanceRenderData->HitProxies);
 					PerInstanceRenderData->UpdateFromPreallocatedData(RenderInstanceData);
 					//end
@@ -2848,6 +2836,77 @@ void UInstancedStaticMeshComponent::GetInstancesMinMaxScale(FVector& MinScale, F
 	}
 }
 
+//#Change by wh, 2020/6/12 
+int32 UInstancedStaticMeshComponent::GetCustomInstanceSharedDataNum() const
+{
+	// The shared slots are picked in the manual fetch path of LocalVertexFactory, the vertex stream path reads all slots from the instance buffer
+	if (!RHISupportsManualVertexFetch(GMaxRHIShaderPlatform))
+		return 0;
+
+	return FMath::Clamp(CustomInstanceSharedDataNum, 0, FMath::Min(CustomInstanceDataNum, CustomInstanceSharedData.Num()));
+}
+
+FStaticMeshInstanceData* UInstancedStaticMeshComponent::CreateInstanceBufferData() const
+{
+	const bool bUseHalfFloat = GVertexElementTypeSupport.IsSupported(VET_Half2);
+
+	EInstanceCustomDataFormat DataFormat = EInstanceCustomDataFormat::Float;
+	switch (CustomInstanceDataFormat)
+	{
+	case ECustomInstanceDataFormat::Half:		DataFormat = EInstanceCustomDataFormat::Half; break;
+	case ECustomInstanceDataFormat::UNorm16:	DataFormat = EInstanceCustomDataFormat::UNorm16; break;
+	case ECustomInstanceDataFormat::UNorm8:		DataFormat = EInstanceCustomDataFormat::UNorm8; break;
+	default: break;
+	}
+	if (!GVertexElementTypeSupport.IsSupported(GetInstanceCustomDataElementType(DataFormat)))
+	{
+		DataFormat = EInstanceCustomDataFormat::Float;
+	}
+
+	switch (CustomInstanceDataNum - GetCustomInstanceSharedDataNum())
+	{
+	case 1: return new FStaticMeshInstanceData_CustomData<1>(bUseHalfFloat, DataFormat);
+	case 2: return new FStaticMeshInstanceData_CustomData<2>(bUseHalfFloat, DataFormat);
+	case 3: return new FStaticMeshInstanceData_CustomData<3>(bUseHalfFloat, DataFormat);
+	case 4: return new FStaticMeshInstanceData_CustomData<4>(bUseHalfFloat, DataFormat);
+	default: return new FStaticMeshInstanceData(bUseHalfFloat);
+	}
+}
+
+void UInstancedStaticMeshComponent::SetCustomInstanceSharedData(int32 Slot, const FVector4& Value)
+{
+	if (Slot < 0 || Slot >= CustomInstanceDataNum)
+	{
+		return;
+	}
+
+	if (Slot < GetCustomInstanceSharedDataNum())
+	{
+		if (CustomInstanceSharedData[Slot] == Value)
+		{
+			return;
+		}
+
+		// Only the proxy copies the shared values into its shader bindings, the instance buffer is reused as is
+		CustomInstanceSharedData[Slot] = Value;
+		MarkRenderStateDirty();
+		return;
+	}
+
+	// The slot is stored per instance on this platform, write it to every instance
+	if (CustomInstanceSharedData.IsValidIndex(Slot))
+	{
+		CustomInstanceSharedData[Slot] = Value;
+	}
+	for (FInstancedStaticMeshInstanceData& InstanceData : PerInstanceSMData)
+	{
+		InstanceData.ShadowFakeryParam[Slot] = Value;
+	}
+	InstanceUpdateCmdBuffer.Edit();
+	MarkRenderStateDirty();
+}
+//end
+
 void UInstancedStaticMeshComponent::InitPerInstanceRenderData(bool InitializeFromCurrentData, FStaticMeshInstanceData* InSharedInstanceBufferData, bool InRequireCPUAccess)
 {
 	if (PerInstanceRenderData.IsValid())
@@ -2878,19 +2937,7 @@ void UInstancedStaticMeshComponent::InitPerInstanceRenderData(bool InitializeFro
 	{
 		TArray<TRefCountPtr<HHitProxy>> HitProxies;
 		//#Change by wh, 2020/6/12 
-		FStaticMeshInstanceData* InstanceBufferData = nullptr;
-		if (CustomInstanceDataNum == 0)
-			InstanceBufferData = new FStaticMeshInstanceData(GVertexElementTypeSupport.IsSupported(VET_Half2));
-		else
-		{
-			switch (CustomInstanceDataNum)
-			{
-			case 1: InstanceBufferData = new FStaticMeshInstanceData_CustomData<1>(GVertexElementTypeSupport.IsSupported(VET_Half2)); break;
-			case 2: InstanceBufferData = new FStaticMeshInstanceData_CustomData<2>(GVertexElementTypeSupport.IsSupported(VET_Half2)); break;
-			case 3: InstanceBufferData = new FStaticMeshInstanceData_CustomData<3>(GVertexElementTypeSupport.IsSupported(VET_Half2)); break;
-			case 4: InstanceBufferData = new FStaticMeshInstanceData_CustomData<4>(GVertexElementTypeSupport.IsSupported(VET_Half2)); break;
-			}
-		}
+		FStaticMeshInstanceData* InstanceBufferData = CreateInstanceBufferData();
 		
 		if (InitializeFromCurrentData)
 		{
@@ -3433,7 +3480,21 @@ void FInstancedStaticMeshVertexFactoryShaderParameters_CustomData<CustomDataNum>
 		{
 			if (InstancedVertexFactory->GetNumInstances() > 0)
 			{
-				ShaderBindings.Add(VertexFetch_InstanceShadowFakeryBufferParameter, InstancedVertexFactory->GetInstanceShadowFakerySRV());
+				// All slots may be shared, then there is no instance buffer but the shader still declares it
+				FRHIShaderResourceView* ShadowFakerySRV = InstancedVertexFactory->GetInstanceShadowFakerySRV();
+				ShaderBindings.Add(VertexFetch_InstanceShadowFakeryBufferParameter, ShadowFakerySRV ? ShadowFakerySRV : GNullColorVertexBuffer.VertexBufferSRV.GetReference());
+
+				const FInstancingUserData* InstancingUserData = (const FInstancingUserData*)BatchElement.UserData;
+				FVector4 SharedValues[CustomDataNum];
+				uint32 SharedNum = 0;
+				if (InstancingUserData)
+				{
+					SharedNum = FMath::Min<uint32>(InstancingUserData->CustomDataSharedNum, CustomDataNum);
+					for (uint32 i = 0; i < SharedNum; ++i)
+						SharedValues[i] = InstancingUserData->CustomDataShared[i];
+				}
+				ShaderBindings.Add(InstanceShadowFakeryShared, SharedValues);
+				ShaderBindings.Add(InstanceShadowFakerySharedNum, SharedNum);
 			}
 			else
 			{
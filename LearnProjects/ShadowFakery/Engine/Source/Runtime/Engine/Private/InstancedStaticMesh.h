@@ -164,6 +164,12 @@ struct FInstancingUserData
 	bool bRenderSelected;
 	bool bRenderUnselected;
 	FVector AverageInstancesScale;
+
+	//#Change by wh, 2020/6/12 
+	/** Leading custom data slots which are the same for all instances, set as shader parameter instead of stored in instance buffer */
+	FVector4 CustomDataShared[MAX_CUSTOM_INSTANCEDATA_NUM];
+	int32 CustomDataSharedNum = 0;
+	//end
 };
 
 struct FInstancedStaticMeshDataType
@@ -456,7 +462,11 @@ public:
 		FInstancedStaticMeshVertexFactoryShaderParameters::Bind(ParameterMap);
 		
 		if (CustomDataNum > 0)
+		{
 			VertexFetch_InstanceShadowFakeryBufferParameter.Bind(ParameterMap, TEXT("VertexFetch_InstanceShadowFakeryBuffer"));
+			InstanceShadowFakeryShared.Bind(ParameterMap, TEXT("InstanceShadowFakeryShared"));
+			InstanceShadowFakerySharedNum.Bind(ParameterMap, TEXT("InstanceShadowFakerySharedNum"));
+		}
 	}
 
 	virtual void GetElementShaderBindings(
@@ -475,10 +485,16 @@ public:
 	{
 		FInstancedStaticMeshVertexFactoryShaderParameters::Serialize(Ar);
 		if (CustomDataNum > 0)
+		{
 			Ar << VertexFetch_InstanceShadowFakeryBufferParameter;
+			Ar << InstanceShadowFakeryShared;
+			Ar << InstanceShadowFakerySharedNum;
+		}
 	}
 	//#Change by wh, 2019/6/10 
 	FShaderResourceParameter VertexFetch_InstanceShadowFakeryBufferParameter;
+	FShaderParameter InstanceShadowFakeryShared;
+	FShaderParameter InstanceShadowFakerySharedNum;
 	//end
 };
 
@@ -1054,6 +1054,51 @@ private:
 	FStaticMeshInstanceData
 -----------------------------------------------------------------------------*/
 
+/** Storage of the per instance custom data, the shader always reads float4 through the typed SRV */
+enum class EInstanceCustomDataFormat : uint8
+{
+	Float,
+	Half,
+	/** [0,1] values only, quantized to 16 bit */
+	UNorm16,
+	/** [0,1] values only, quantized to 8 bit */
+	UNorm8,
+};
+
+/** Bytes of one float4 custom data slot in the instance buffer */
+FORCEINLINE uint32 GetInstanceCustomDataSlotStride(EInstanceCustomDataFormat Format)
+{
+	switch (Format)
+	{
+	case EInstanceCustomDataFormat::Half:		return 8;
+	case EInstanceCustomDataFormat::UNorm16:	return 8;
+	case EInstanceCustomDataFormat::UNorm8:		return 4;
+	default:									return 16;
+	}
+}
+
+FORCEINLINE EPixelFormat GetInstanceCustomDataPixelFormat(EInstanceCustomDataFormat Format)
+{
+	switch (Format)
+	{
+	case EInstanceCustomDataFormat::Half:		return PF_FloatRGBA;
+	case EInstanceCustomDataFormat::UNorm16:	return PF_R16G16B16A16_UNORM;
+	case EInstanceCustomDataFormat::UNorm8:		return PF_R8G8B8A8;
+	default:									return PF_A32B32G32R32F;
+	}
+}
+
+FORCEINLINE EVertexElementType GetInstanceCustomDataElementType(EInstanceCustomDataFormat Format)
+{
+	switch (Format)
+	{
+	case EInstanceCustomDataFormat::Half:		return VET_Half4;
+	case EInstanceCustomDataFormat::UNorm16:	return VET_UShort4N;
+	case EInstanceCustomDataFormat::UNorm8:		return VET_UByte4N;
+	default:									return VET_Float4;
+	}
+}
+
 /** The implementation of the static mesh instance data storage type. */
 class FStaticMeshInstanceData
 {
@@ -1430,6 +1475,14 @@ public:
 		return NumCustomData;
 	}
 
+	//#Change by wh, 2020/6/12 
+	/** Storage of the custom data slots in the instance buffer */
+	FORCEINLINE_DEBUGGABLE EInstanceCustomDataFormat GetCustomDataFormat() const
+	{
+		return CustomDataFormat;
+	}
+	//end
+
 
 	FORCEINLINE_DEBUGGABLE void SetAllowCPUAccess(bool InNeedsCPUAccess)
 	{
@@ -1633,6 +1686,7 @@ private:
 	bool bUseHalfFloat = false;
 protected:
 	int32 NumCustomData = 0;
+	EInstanceCustomDataFormat CustomDataFormat = EInstanceCustomDataFormat::Float;
 };
 
 template<uint32 PerInstanceDataNum = 1>
@@ -1651,14 +1705,44 @@ public:
 		}
 	};
 
+	/** Same layout as FDataType with every component in half, the SRV is PF_FloatRGBA so the shader still reads float4 */
+	struct FPackedDataType
+	{
+		FFloat16 Data[(PerInstanceDataNum > 0 ? PerInstanceDataNum : 1) * 4];
+
+		friend FArchive& operator<<(FArchive& Ar, FPackedDataType& Elem)
+		{
+			for (int32 i = 0; i < UE_ARRAY_COUNT(Data); ++i)
+				Ar << Elem.Data[i];
+			return Ar;
+		}
+	};
+
+	/** Normalized storage for [0,1] values such as flags and wrapped angles, the SRV is PF_R16G16B16A16_UNORM / PF_R8G8B8A8 */
+	template<typename ComponentType>
+	struct TUNormDataType
+	{
+		ComponentType Data[(PerInstanceDataNum > 0 ? PerInstanceDataNum : 1) * 4];
+
+		friend FArchive& operator<<(FArchive& Ar, TUNormDataType& Elem)
+		{
+			for (int32 i = 0; i < UE_ARRAY_COUNT(Data); ++i)
+				Ar << Elem.Data[i];
+			return Ar;
+		}
+	};
+	typedef TUNormDataType<uint16> FUNorm16DataType;
+	typedef TUNormDataType<uint8> FUNorm8DataType;
+
 	FStaticMeshInstanceData_CustomData()
 	{
 		NumCustomData = PerInstanceDataNum;
 	}
 	
-	FStaticMeshInstanceData_CustomData(bool bInUseHalfFloat)
+	FStaticMeshInstanceData_CustomData(bool bInUseHalfFloat, EInstanceCustomDataFormat InCustomDataFormat = EInstanceCustomDataFormat::Float)
 	:	FStaticMeshInstanceData(bInUseHalfFloat)
 	{
+		CustomDataFormat = InCustomDataFormat;
 		AllocateBuffers(0);
 		NumCustomData = PerInstanceDataNum;
 	}
@@ -1680,17 +1764,63 @@ public:
 	FORCEINLINE_DEBUGGABLE void SetInstanceShadowFakeryInternal(int32 InstanceIndex, const TArray<FVector4>& ShadowFakery) const
 	{
 		if (PerInstanceDataNum == 0)return;
-		FVector4* ElementData = reinterpret_cast<FVector4*>(InstanceShadowFakeryDataPtr);
-		uint32 CurrentSize = InstanceShadowFakeryData->Num() * InstanceShadowFakeryData->GetStride();
-		check((void*)((&ElementData[InstanceIndex * PerInstanceDataNum]) + 1) <= (void*)(InstanceShadowFakeryDataPtr + CurrentSize));
-		check((void*)((&ElementData[InstanceIndex * PerInstanceDataNum]) + 0) >= (void*)(InstanceShadowFakeryDataPtr));
 		check(ShadowFakery.Num() >= PerInstanceDataNum);
 
+		switch (CustomDataFormat)
+		{
+		case EInstanceCustomDataFormat::Half:
+			SetInstanceShadowFakeryInternal<FPackedDataType>(InstanceIndex, ShadowFakery);
+			break;
+		case EInstanceCustomDataFormat::UNorm16:
+			SetInstanceShadowFakeryInternal<FUNorm16DataType>(InstanceIndex, ShadowFakery);
+			break;
+		case EInstanceCustomDataFormat::UNorm8:
+			SetInstanceShadowFakeryInternal<FUNorm8DataType>(InstanceIndex, ShadowFakery);
+			break;
+		default:
+			SetInstanceShadowFakeryInternal<FDataType>(InstanceIndex, ShadowFakery);
+			break;
+		}
+	}
+
+	template<typename T>
+	FORCEINLINE_DEBUGGABLE void SetInstanceShadowFakeryInternal(int32 InstanceIndex, const TArray<FVector4>& ShadowFakery) const
+	{
+		T* ElementData = reinterpret_cast<T*>(InstanceShadowFakeryDataPtr);
+		uint32 CurrentSize = InstanceShadowFakeryData->Num() * InstanceShadowFakeryData->GetStride();
+		check((void*)((&ElementData[InstanceIndex]) + 1) <= (void*)(InstanceShadowFakeryDataPtr + CurrentSize));
+		check((void*)((&ElementData[InstanceIndex]) + 0) >= (void*)(InstanceShadowFakeryDataPtr));
+
+		// ShadowFakery may have more slots than stored here, the leading ones are shared by all instances and not in the stream
+		const int32 FirstSlot = ShadowFakery.Num() - PerInstanceDataNum;
 		for (int32 i = 0; i < PerInstanceDataNum; ++i)
 		{
-			ElementData[InstanceIndex++] = ShadowFakery[i];
+			for (int32 Component = 0; Component < 4; ++Component)
+			{
+				SetShadowFakeryComponent(ElementData[InstanceIndex], i * 4 + Component, ShadowFakery[FirstSlot + i][Component]);
+			}
 		}
 	}
+
+	static FORCEINLINE void SetShadowFakeryComponent(FDataType& Elem, int32 Index, float Value)
+	{
+		Elem.Data[Index / 4][Index % 4] = Value;
+	}
+
+	static FORCEINLINE void SetShadowFakeryComponent(FPackedDataType& Elem, int32 Index, float Value)
+	{
+		Elem.Data[Index] = Value;
+	}
+
+	static FORCEINLINE void SetShadowFakeryComponent(FUNorm16DataType& Elem, int32 Index, float Value)
+	{
+		Elem.Data[Index] = (uint16)FMath::RoundToInt(FMath::Clamp(Value, 0.0f, 1.0f) * 65535.0f);
+	}
+
+	static FORCEINLINE void SetShadowFakeryComponent(FUNorm8DataType& Elem, int32 Index, float Value)
+	{
+		Elem.Data[Index] = (uint8)FMath::RoundToInt(FMath::Clamp(Value, 0.0f, 1.0f) * 255.0f);
+	}
 	void AllocateInstances(int32 InNumInstances, EResizeBufferFlags BufferFlags, bool DestroyExistingInstances)override
 	{
 		FStaticMeshInstanceData::AllocateInstances(InNumInstances, BufferFlags, DestroyExistingInstances);
@@ -1710,7 +1840,21 @@ public:
 		delete InstanceShadowFakeryData;
 		InstanceShadowFakeryData = nullptr;
 		
-		InstanceShadowFakeryData = new TStaticMeshVertexData<FDataType>();
+		switch (CustomDataFormat)
+		{
+		case EInstanceCustomDataFormat::Half:
+			InstanceShadowFakeryData = new TStaticMeshVertexData<FPackedDataType>();
+			break;
+		case EInstanceCustomDataFormat::UNorm16:
+			InstanceShadowFakeryData = new TStaticMeshVertexData<FUNorm16DataType>();
+			break;
+		case EInstanceCustomDataFormat::UNorm8:
+			InstanceShadowFakeryData = new TStaticMeshVertexData<FUNorm8DataType>();
+			break;
+		default:
+			InstanceShadowFakeryData = new TStaticMeshVertexData<FDataType>();
+			break;
+		}
 		
 		InstanceShadowFakeryData->ResizeBuffer(InNumInstances, BufferFlags);
 	}
@@ -1755,7 +1899,7 @@ public:
 	FORCEINLINE_DEBUGGABLE SIZE_T GetResourceSize() const override
 	{
 		return	FStaticMeshInstanceData::GetResourceSize() +
-			InstanceShadowFakeryData ? InstanceShadowFakeryData->GetResourceSize() : 0;
+			(InstanceShadowFakeryData ? InstanceShadowFakeryData->GetResourceSize() : 0);
 	}
 
 	FStaticMeshVertexDataInterface* InstanceShadowFakeryData = nullptr;
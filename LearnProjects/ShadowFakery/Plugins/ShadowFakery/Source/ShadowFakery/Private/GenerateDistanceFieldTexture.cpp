@@ -7,6 +7,8 @@
 #include "Engine/StaticMesh.h"
 #include "Engine/Texture2D.h"
 #include "GenerateDistanceFieldTexture_GPU.h"
+#include "ShadowFakeryDistanceTransform.h"
+#include "ShadowFakeryJumpFlood.h"
 
 #if GENERATE_TEXTURE_DF
 #include <embree2/rtcore.h>
@@ -19,8 +21,34 @@
 
 #include "Engine/TextureRenderTarget.h"
 #include "RenderingThread.h"
+#include "UObject/MetaData.h"
+#include "Async/ParallelFor.h"
+#include "Misc/ScopedSlowTask.h"
+#include "Containers/Ticker.h"
+#include "UObject/StrongObjectPtr.h"
+
+static TAutoConsoleVariable<int32> CVarShadowFakeryCPUBakeTileSize(
+	TEXT("r.ShadowFakery.CPUBakeTileSize"),
+	64,
+	TEXT("Size in texels of the tiles the CPU bake is split into."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarShadowFakeryParallelCPUBake(
+	TEXT("r.ShadowFakery.ParallelCPUBake"),
+	1,
+	TEXT("0: CPU bake runs on game thread only, 1: CPU bake tiles run on worker threads."),
+	ECVF_Default);
+
+FShadowFakeryCPUBakeOptions FShadowFakeryCPUBakeOptions::FromConsoleVariables()
+{
+	check(IsInGameThread());
+	FShadowFakeryCPUBakeOptions Options;
+	Options.TileSize = CVarShadowFakeryCPUBakeTileSize.GetValueOnGameThread();
+	Options.bForceSingleThread = CVarShadowFakeryParallelCPUBake.GetValueOnGameThread() == 0;
+	return Options;
+}
 
-extern void GenerateMeshMaskTexture(FRHICommandListImmediate& RHICmdList, ERHIFeatureLevel::Type FeatureLevel, class UStaticMesh* StaticMesh, FRHITexture*& MergedDistanceFieldRT, class UTextureRenderTarget* OutputRenderTarget,  uint32 TileIndex, float StartDegree, uint32 TextureSize);
+extern void GenerateMeshMaskAtlas(FRHICommandListImmediate& RHICmdList, ERHIFeatureLevel::Type FeatureLevel, class UStaticMesh* StaticMesh, FRHITexture*& MergedDistanceFieldTexture, class UTextureRenderTarget* OutputRenderTarget, float StartDegree, float StepDegree, uint32 TextureSize);
 
 static void GenerateHemisphereSamples(int32 NumThetaSteps, int32 NumPhiSteps, FRandomStream& RandomStream, TArray<FVector4>& Samples)
 {
@@ -89,126 +117,113 @@ void EmbreeFilterFunc(void* UserPtr, RTCRay& InRay)
 
 	EmbreeRay.ElementIndex = Desc.ElementIndex;
 }
-#endif
 
-FDelegateHandle GShadowFakeryDelegateHandle;
+// Rays count of one embree packet, 4 only need SSE so it is always supported
+#define SHADOWFAKERY_RAY_PACKET_SIZE 4
 
-void UGenerateDistanceFieldTexture::GenerateDistanceFieldTexture(const UObject* WorldContextObject, UStaticMesh* GenerateStaticMesh, class UTextureRenderTarget* OutputRenderTarget, int32 DistanceFieldSize, float StartDegree, float MakeDFRadius, bool bUseGPU)
+/** The view of one pitch direction, it is baked into one channel of the texture */
+struct FShadowFakeryBakeView
 {
-	if (!GenerateStaticMesh)return;
-	
-	float SizeExpo = FMath::Log2(DistanceFieldSize);
-	if (FMath::Frac(SizeExpo) != 0.f)
-		DistanceFieldSize = FMath::RoundToInt(FMath::Exp2(FMath::RoundToFloat(SizeExpo + 0.5f)));
+	FVector LookDir;
+	FVector LookLeft;
+	FVector LookUp;
+	FVector Min;
+};
 
-#if GENERATE_TEXTURE_DF
-	if (bUseGPU)
+/**
+ * Traces the occlusion of all texels in the tile for one channel, rays are packed and intersected with rtcIntersect4.
+ * Tiles never share texel of the same channel, so it is safe to call it from different threads.
+ */
+static void TraceShadowFakeryTile(RTCScene EmbreeScene, const FShadowFakeryBakeView& View, int32 Channel, const FIntRect& TileRect, int32 DistanceFieldSize, const FVector& DistanceFieldVoxelSize, float DistanceFieldVolumeMaxDistance, FVector4* DistanceFieldData)
+{
+	const FVector RayDirection = -View.LookDir * DistanceFieldVolumeMaxDistance;
+
+	RTCORE_ALIGN(16) int32 ValidMask[SHADOWFAKERY_RAY_PACKET_SIZE];
+	RTCRay4 RayPacket;
+	int32 PacketTexels[SHADOWFAKERY_RAY_PACKET_SIZE];
+	int32 PacketCount = 0;
+
+	auto FlushPacket = [&]()
 	{
-		FRHITexture* MergedDistanceFieldRT = nullptr;
-		ENQUEUE_RENDER_COMMAND(CaptureCommand)([GenerateStaticMesh, StartDegree, DistanceFieldSize, &MergedDistanceFieldRT, OutputRenderTarget](FRHICommandListImmediate& RHICmdList)
+		for (int32 Lane = 0; Lane < SHADOWFAKERY_RAY_PACKET_SIZE; ++Lane)
 		{
-			//TODO
-			for (uint32 i = 0; i < 16; ++i)
-			{
-				GenerateMeshMaskTexture(RHICmdList, ERHIFeatureLevel::SM5, GenerateStaticMesh, MergedDistanceFieldRT, OutputRenderTarget, i, StartDegree + 10.f * i, DistanceFieldSize);
-			}	
-		});
-		/*GEngine->PreRenderDelegate.Remove(GShadowFakeryDelegateHandle);
-		GShadowFakeryDelegateHandle = GEngine->PreRenderDelegate.AddLambda([GenerateStaticMesh, StartDegree, DistanceFieldSize, &MergedDistanceFieldRT, OutputRenderTarget]() {
-			FRHICommandListImmediate& RHICmdList = GetImmediateCommandList_ForRenderCommand();
-			GenerateMeshMaskTexture(RHICmdList, ERHIFeatureLevel::SM5, GenerateStaticMesh, MergedDistanceFieldRT, OutputRenderTarget, StartDegree, DistanceFieldSize);
-		});
-		return;*/
-		// We need to run all renderthread command to save texture
-		FlushRenderingCommands();
-		int32 AtlasSize = MergedDistanceFieldRT->GetSizeXYZ().X;
-		FString TextureName = TEXT("Tex_ShadowFakery_2");
-		FString PackageName = TEXT("/Game/ShadowFakeryTextures/");
-		PackageName += TextureName;
-		UPackage* Package = CreatePackage(NULL, *PackageName);
-		Package->FullyLoad();
-
-		UTexture2D* TargetTex = NewObject<UTexture2D>(Package, *TextureName, RF_Public | RF_Standalone | RF_MarkAsRootSet);
-		TargetTex->AddToRoot();				// This line prevents garbage collection of the texture
-		TargetTex->PlatformData = new FTexturePlatformData();	// Then we initialize the PlatformData
-		TargetTex->PlatformData->SizeX = AtlasSize;
-		TargetTex->PlatformData->SizeY = AtlasSize;
-		TargetTex->PlatformData->SetNumSlices(1);
-		TargetTex->PlatformData->PixelFormat = EPixelFormat::PF_B8G8R8A8;
-		TargetTex->AddressX = TextureAddress::TA_Clamp;
-		TargetTex->AddressY = TextureAddress::TA_Clamp;
-		TargetTex->CompressionQuality = ETextureCompressionQuality::TCQ_Medium;
-		TargetTex->CompressionSettings = TC_VectorDisplacementmap;
-
-		int32 Index = TargetTex->PlatformData->Mips.Add(new FTexture2DMipMap());
-		FTexture2DMipMap* Mip = &TargetTex->PlatformData->Mips[Index];
-		Mip->SizeX = AtlasSize;
-		Mip->SizeY = AtlasSize;
+			ValidMask[Lane] = Lane < PacketCount ? -1 : 0;
+		}
 
-		uint32 DestStride = 0;
-		FRHITexture2D* MergedTexture2D = static_cast<FRHITexture2D*>(MergedDistanceFieldRT);
-		TArray<uint8> PixelData;
-		uint32 RowDataSize = AtlasSize * 4 * sizeof(uint8);
-		//PixelData.Reserve(DistanceFieldSize * RowDataSize);
-		PixelData.SetNumZeroed(AtlasSize * RowDataSize);
-		uint8* Texture2DData = (uint8*)RHILockTexture2D(MergedTexture2D, 0, RLM_ReadOnly, DestStride, false);
+		rtcIntersect4(ValidMask, EmbreeScene, RayPacket);
 
-		if (DestStride == RowDataSize)
+		for (int32 Lane = 0; Lane < PacketCount; ++Lane)
 		{
-			FMemory::Memcpy(PixelData.GetData(), Texture2DData, PixelData.Num());
+			float FinalVolumeSpaceDistance = 1.f;
+			if (RayPacket.geomID[Lane] != RTC_INVALID_GEOMETRY_ID && RayPacket.primID[Lane] != RTC_INVALID_GEOMETRY_ID)
+			{
+				FinalVolumeSpaceDistance = 0.f;
+			}
+			float* Data = reinterpret_cast<float*>(DistanceFieldData + PacketTexels[Lane]);
+			*(Data + Channel) = FinalVolumeSpaceDistance;
 		}
-		else
+		PacketCount = 0;
+	};
+
+	for (int32 YIndex = TileRect.Min.Y; YIndex < TileRect.Max.Y; YIndex++)
+	{
+		for (int32 XIndex = TileRect.Min.X; XIndex < TileRect.Max.X; XIndex++)
 		{
-			uint8* TempData = PixelData.GetData();
-			for (int32 i = 0; i < AtlasSize; ++i)
+			const FVector VoxelPosition = -View.LookLeft * XIndex * DistanceFieldVoxelSize.X + View.LookUp * (DistanceFieldSize - YIndex) * DistanceFieldVoxelSize.Y + View.Min;
+
+			const int32 Lane = PacketCount;
+			RayPacket.orgx[Lane] = VoxelPosition.X;
+			RayPacket.orgy[Lane] = VoxelPosition.Y;
+			RayPacket.orgz[Lane] = VoxelPosition.Z;
+			RayPacket.dirx[Lane] = RayDirection.X;
+			RayPacket.diry[Lane] = RayDirection.Y;
+			RayPacket.dirz[Lane] = RayDirection.Z;
+			RayPacket.tnear[Lane] = 0.f;
+			RayPacket.tfar[Lane] = 1.f;
+			RayPacket.time[Lane] = 0.f;
+			RayPacket.mask[Lane] = 0xFFFFFFFF;
+			RayPacket.u[Lane] = RayPacket.v[Lane] = 0.f;
+			RayPacket.geomID[Lane] = RTC_INVALID_GEOMETRY_ID;
+			RayPacket.primID[Lane] = RTC_INVALID_GEOMETRY_ID;
+			RayPacket.instID[Lane] = RTC_INVALID_GEOMETRY_ID;
+			PacketTexels[Lane] = YIndex * DistanceFieldSize + XIndex;
+
+			if (++PacketCount == SHADOWFAKERY_RAY_PACKET_SIZE)
 			{
-				FMemory::Memcpy(TempData, Texture2DData, RowDataSize);
-				TempData += RowDataSize;
-				Texture2DData += DestStride;
+				FlushPacket();
 			}
 		}
+	}
 
-		RHIUnlockTexture2D(MergedTexture2D, 0, false);
-
-		// Lock the texture so it can be modified
-		Mip->BulkData.Lock(LOCK_READ_WRITE);
-		uint8* TextureData = (uint8*)Mip->BulkData.Realloc(AtlasSize * AtlasSize * 4 * sizeof(uint8));
-		FMemory::Memcpy(TextureData, PixelData.GetData(), PixelData.Num());
-		Mip->BulkData.Unlock();
+	if (PacketCount > 0)
+	{
+		FlushPacket();
+	}
+}
 
-		TargetTex->Source.Init(AtlasSize, AtlasSize, 1, 1, ETextureSourceFormat::TSF_BGRA8, PixelData.GetData());
-		TargetTex->UpdateResource();
-		Package->MarkPackageDirty();
-		FAssetRegistryModule::AssetCreated(TargetTex);
+/** Embree scene of the opaque triangles of LOD0, the device and scene are released with it */
+struct FShadowFakeryEmbreeScene
+{
+	RTCDevice EmbreeDevice = NULL;
+	RTCScene EmbreeScene = NULL;
+	FEmbreeGeometry Geometry;
 
-		FString PackageFileName = FPackageName::LongPackageNameToFilename(PackageName, FPackageName::GetAssetPackageExtension());
-		bool bSaved = UPackage::SavePackage(Package, TargetTex, EObjectFlags::RF_Public | EObjectFlags::RF_Standalone, *PackageFileName, GError, nullptr, true, true, SAVE_NoError);
-		return;
+	~FShadowFakeryEmbreeScene()
+	{
+		if (EmbreeScene)
+			rtcDeleteScene(EmbreeScene);
+		if (EmbreeDevice)
+			rtcDeleteDevice(EmbreeDevice);
 	}
 
-	//Following Code Was For CPU
+	bool Init(UStaticMesh* GenerateStaticMesh);
+};
+
+bool FShadowFakeryEmbreeScene::Init(UStaticMesh* GenerateStaticMesh)
+{
 	const FStaticMeshLODResources& LODModel = GenerateStaticMesh->RenderData->LODResources[0];
-	const FBoxSphereBounds& Bounds = GenerateStaticMesh->RenderData->Bounds;
 	const FPositionVertexBuffer& PositionVertexBuffer = LODModel.VertexBuffers.PositionVertexBuffer;
 	FIndexArrayView Indices = LODModel.IndexBuffer.GetArrayView();
-	
-
-	const int32 NumVoxelDistanceSamples = 1200;
-	TArray<FVector4> SampleDirections;
-	const int32 NumThetaSteps = FMath::TruncToInt(FMath::Sqrt(NumVoxelDistanceSamples / (2.0f * (float)PI)));
-	const int32 NumPhiSteps = FMath::TruncToInt(NumThetaSteps * (float)PI);
-	SampleDirections.Reserve(2 * NumThetaSteps * NumPhiSteps);
-	FRandomStream RandomStream(0);
-	// Compute the upper samples
-	GenerateHemisphereSamples(NumThetaSteps, NumPhiSteps, RandomStream, SampleDirections);
-	// Compute under samples
-	TArray<FVector4> DownSampleDirections;
-	GenerateHemisphereSamples(NumThetaSteps, NumPhiSteps, RandomStream, DownSampleDirections);
-	for (auto& Iter : DownSampleDirections)
-	{
-		Iter.Z *= -1.f;
-		SampleDirections.Add(Iter);
-	}
 
 	// Get blend mode of each material in static mesh
 	TArray<EBlendMode> MaterialBlendModes;
@@ -225,22 +240,19 @@ void UGenerateDistanceFieldTexture::GenerateDistanceFieldTexture(const UObject*
 	}
 
 	//Generate embree data
-	RTCDevice EmbreeDevice = NULL;
-	RTCScene EmbreeScene = NULL;
 	EmbreeDevice = rtcNewDevice(NULL);
 	RTCError ReturnErrorNewDevice = rtcDeviceGetError(EmbreeDevice);
 	if (ReturnErrorNewDevice != RTC_NO_ERROR)
 	{
-		return;
+		return false;
 	}
 
-	EmbreeScene = rtcDeviceNewScene(EmbreeDevice, RTC_SCENE_STATIC, RTC_INTERSECT1);
+	EmbreeScene = rtcDeviceNewScene(EmbreeDevice, RTC_SCENE_STATIC, RTC_INTERSECT1 | RTC_INTERSECT4);
 
 	RTCError ReturnErrorNewScene = rtcDeviceGetError(EmbreeDevice);
 	if (ReturnErrorNewScene != RTC_NO_ERROR)
 	{
-		rtcDeleteDevice(EmbreeDevice);
-		return;
+		return false;
 	}
 
 	TArray<int32> FilteredTriangles;
@@ -284,7 +296,6 @@ void UGenerateDistanceFieldTexture::GenerateDistanceFieldTexture(const UObject*
 	FVector4* EmbreeVertices = NULL;
 	int32* EmbreeIndices = NULL;
 	uint32 GeomID = 0;
-	FEmbreeGeometry Geometry;
 
 	GeomID = rtcNewTriangleMesh(EmbreeScene, RTC_GEOMETRY_STATIC, FilteredTriangles.Num(), PositionVertexBuffer.GetNumVertices());
 	rtcSetIntersectionFilterFunction(EmbreeScene, GeomID, EmbreeFilterFunc);
@@ -329,15 +340,16 @@ void UGenerateDistanceFieldTexture::GenerateDistanceFieldTexture(const UObject*
 	RTCError ReturnError = rtcDeviceGetError(EmbreeDevice);
 	if (ReturnError != RTC_NO_ERROR)
 	{
-		rtcDeleteScene(EmbreeScene);
-		rtcDeleteDevice(EmbreeDevice);
-		return;
+		return false;
 	}
-	// Now we start create distance field
-	// We only need build 4 direction of mesh
+	return true;
+}
 
+/** Trace the occupancy of the 4 pitch directions at yaw StartDegree, every direction is one channel and 0 is occluded */
+static void TraceDistanceFieldOccupancy(RTCScene EmbreeScene, const FBoxSphereBounds& Bounds, int32 DistanceFieldSize, float StartDegree, const FShadowFakeryCPUBakeOptions& Options, TArray<FVector4>& DistanceFieldData)
+{
 	// Distance Field volume always larger than bounding box
-	TArray<FVector4> DistanceFieldData;
+	DistanceFieldData.Reset();
 	DistanceFieldData.AddZeroed(DistanceFieldSize * DistanceFieldSize);
 	const float VolumeScale = 1.05f;
 
@@ -365,196 +377,459 @@ void UGenerateDistanceFieldTexture::GenerateDistanceFieldTexture(const UObject*
 	FVector LookDir = FVector(FMath::Cos(FMath::DegreesToRadians(StartPitchDegree)) * FMath::Cos(StartRadian), FMath::Cos(FMath::DegreesToRadians(StartPitchDegree)) * FMath::Sin(StartRadian), FMath::Sin(FMath::DegreesToRadians(StartPitchDegree))).GetSafeNormal();
 	const FVector LookLeft = FVector::CrossProduct(FVector::UpVector, LookDir).GetSafeNormal();
 
+	// Every pitch direction is one channel of the texture, precompute them so the tiles only read
+	FShadowFakeryBakeView BakeViews[4];
 	for (int32 i = 0; i < 4; ++i)
 	{
 		LookDir = FVector(FMath::Cos(FMath::DegreesToRadians(StartPitchDegree)) * FMath::Cos(StartRadian), FMath::Cos(FMath::DegreesToRadians(StartPitchDegree)) * FMath::Sin(StartRadian), FMath::Sin(FMath::DegreesToRadians(StartPitchDegree))).GetSafeNormal();
 		const FVector LookUp = FVector::CrossProduct(LookDir, LookLeft).GetSafeNormal();
-		
-		const FVector Min = DistanceFieldVolumeBox.GetCenter() + LookDir * DFVoulmeWidth + LookLeft * DFVoulmeWidth - LookUp * DFVoulmeWidth;
+
+		BakeViews[i].LookDir = LookDir;
+		BakeViews[i].LookLeft = LookLeft;
+		BakeViews[i].LookUp = LookUp;
+		BakeViews[i].Min = DistanceFieldVolumeBox.GetCenter() + LookDir * DFVoulmeWidth + LookLeft * DFVoulmeWidth - LookUp * DFVoulmeWidth;
 		StartPitchDegree += PitchStepDegree;
-		
-		for (int32 YIndex = 0; YIndex < DistanceFieldSize; YIndex++)
+	}
+
+	// Split the 4 channels into tiles, the tiles are traced on worker threads and each texel casts exactly the same ray as before
+	const int32 TileSize = FMath::Clamp(Options.TileSize, 4, DistanceFieldSize);
+	const bool bForceSingleThread = Options.bForceSingleThread;
+	const int32 TileCountPerSide = FMath::DivideAndRoundUp(DistanceFieldSize, TileSize);
+	const int32 TileCountPerChannel = TileCountPerSide * TileCountPerSide;
+	const int32 TileCount = UE_ARRAY_COUNT(BakeViews) * TileCountPerChannel;
+	// Tiles are scheduled in batches, so we can report progress on game thread between them
+	const int32 TilesPerBatch = bForceSingleThread ? 1 : FMath::Max(FTaskGraphInterface::Get().GetNumWorkerThreads(), 1) * 2;
+
+	// Slow task is game thread only, the batch baker traces several meshes on worker threads
+	const bool bReportProgress = IsInGameThread();
+	FScopedSlowTask SlowTask(TileCount, NSLOCTEXT("ShadowFakery", "BakeShadowFakeryTiles", "Baking ShadowFakery Tiles"), bReportProgress);
+	if (bReportProgress)
+	{
+		SlowTask.MakeDialog();
+	}
+
+	for (int32 BatchStart = 0; BatchStart < TileCount; BatchStart += TilesPerBatch)
+	{
+		const int32 BatchCount = FMath::Min(TilesPerBatch, TileCount - BatchStart);
+		ParallelFor(BatchCount, [&](int32 BatchIndex)
 		{
-			for (int32 XIndex = 0; XIndex < DistanceFieldSize; XIndex++)
-			{
-				const FVector VoxelPosition = -LookLeft * XIndex * DistanceFieldVoxelSize.X + LookUp * (DistanceFieldSize - YIndex) * DistanceFieldVoxelSize.Y + Min;
+			const int32 TileIndex = BatchStart + BatchIndex;
+			const int32 Channel = TileIndex / TileCountPerChannel;
+			const int32 TileX = (TileIndex % TileCountPerChannel) % TileCountPerSide;
+			const int32 TileY = (TileIndex % TileCountPerChannel) / TileCountPerSide;
+			const FIntRect TileRect(TileX * TileSize, TileY * TileSize, FMath::Min((TileX + 1) * TileSize, DistanceFieldSize), FMath::Min((TileY + 1) * TileSize, DistanceFieldSize));
 
-				float MinDistance = DistanceFieldVolumeMaxDistance;
-				int32 Hit = 0;
-				int32 HitBack = 0;
+			TraceShadowFakeryTile(EmbreeScene, BakeViews[Channel], Channel, TileRect, DistanceFieldSize, DistanceFieldVoxelSize, DistanceFieldVolumeMaxDistance, DistanceFieldData.GetData());
+		}, bForceSingleThread);
+
+		SlowTask.EnterProgressFrame(BatchCount);
+	}
+}
+#endif
 
-				/*if (i == 0)
-					DrawDebugLine(WorldContextObject->GetWorld(), VoxelPosition, VoxelPosition + LookDir * -DistanceFieldVolumeMaxDistance, FColor::Red, true, 100.f);*/
+FDelegateHandle GShadowFakeryDelegateHandle;
 
-				// Begin detect
-				//for (int32 SampleIndex = 0; SampleIndex < SampleDirections.Num(); ++SampleIndex)
-				
-					//const FVector UnitRayDir = SampleDirections[SampleIndex];
-					const FVector UnitRayDir = -LookDir;
-					const FVector EndPosition = VoxelPosition + UnitRayDir * DistanceFieldVolumeMaxDistance;
+/** The bake only supports power of two size, round it up */
+static int32 GetPowerOfTwoDistanceFieldSize(int32 DistanceFieldSize)
+{
+	float SizeExpo = FMath::Log2(DistanceFieldSize);
+	if (FMath::Frac(SizeExpo) != 0.f)
+		DistanceFieldSize = FMath::RoundToInt(FMath::Exp2(FMath::RoundToFloat(SizeExpo + 0.5f)));
+	return DistanceFieldSize;
+}
 
-					float FinalVolumeSpaceDistance = 1.f;
-					// If cur ray don't intersect with volume, skip
-					//if (FMath::LineBoxIntersection(DistanceFieldVolumeBox, VoxelPosition, EndPosition, UnitRayDir))
-					{
-						FEmbreeRay EmbreeRay;
-
-						FVector RayDirection = EndPosition - VoxelPosition;
-						EmbreeRay.org[0] = VoxelPosition.X;
-						EmbreeRay.org[1] = VoxelPosition.Y;
-						EmbreeRay.org[2] = VoxelPosition.Z;
-						EmbreeRay.dir[0] = RayDirection.X;
-						EmbreeRay.dir[1] = RayDirection.Y;
-						EmbreeRay.dir[2] = RayDirection.Z;
-						EmbreeRay.tnear = 0;
-						EmbreeRay.tfar = 1.0f;
-
-						rtcIntersect(EmbreeScene, EmbreeRay);
-
-						
-						if (EmbreeRay.geomID != -1 && EmbreeRay.primID != -1)
-						{
-							FinalVolumeSpaceDistance = 0.f;
-							//Hit++;
-							//const FVector GeoNormal = FVector(EmbreeRay.Ng[0], EmbreeRay.Ng[1], EmbreeRay.Ng[2]).GetSafeNormal();
-
-							//if (FVector::DotProduct(UnitRayDir, GeoNormal) > 0  // check weather the ray is in backface
-							//	&& EmbreeRay.ElementIndex == 0)
-							//{
-							//	HitBack++;
-							//}
-
-							//const float CurrentDistance = DistanceFieldVolumeMaxDistance * EmbreeRay.tfar;
-							//if (CurrentDistance < MinDistance)
-							//{
-							//	MinDistance = CurrentDistance;
-							//}
-						}
-					}
-				
-				//const float UnsignedDistance = MinDistance;
-				//// If more than 50% ray is in backface, the distance should < 0
-				//MinDistance *= (Hit == 0 || HitBack < SampleDirections.Num() * 0.5f) ? 1 : -1;
-
-				//if (FMath::Square(UnsignedDistance) < VoxelDiameterSqr && HitBack > .95f * Hit)
-				//{
-				//	MinDistance = -UnsignedDistance;
-				//}
-
-				//const float FinalVolumeSpaceDistance = FMath::Min(MinDistance, DistanceFieldVolumeMaxDistance) / DistanceFieldVolumeBox.GetExtent().GetMax();
-				const int32 CurIndex = YIndex * DistanceFieldSize + XIndex;
-				float* Data = nullptr;
-				{
-					Data = reinterpret_cast<float*>(DistanceFieldData.GetData() + CurIndex);
-				}
-				*(Data + i) = FinalVolumeSpaceDistance;
-			}
-		}
+void UGenerateDistanceFieldTexture::GenerateDistanceFieldTexture(const UObject* WorldContextObject, UStaticMesh* GenerateStaticMesh, class UTextureRenderTarget* OutputRenderTarget, int32 DistanceFieldSize, float StartDegree, float MakeDFRadius, bool bUseGPU)
+{
+	TArray<FColor> Pixels;
+	int32 TextureSize = 0;
+	if (BakeDistanceFieldPixels(GenerateStaticMesh, OutputRenderTarget, DistanceFieldSize, StartDegree, MakeDFRadius, bUseGPU, FShadowFakeryCPUBakeOptions::FromConsoleVariables(), Pixels, TextureSize))
+	{
+		FString PackageName = TEXT("/Game/ShadowFakeryTextures/");
+		PackageName += bUseGPU ? TEXT("Tex_ShadowFakery_2") : TEXT("Tex_ShadowFakery_1");
+		SaveDistanceFieldTexture(PackageName, TextureSize, Pixels);
 	}
-	TArray<FVector4> FinalData;
-	FinalData.Reserve(DistanceFieldSize * DistanceFieldSize);
-	const float MaxRadius = MakeDFRadius;
-	const FVector4 VecMaxRadius(MakeDFRadius, MakeDFRadius, MakeDFRadius, MakeDFRadius);
-	for (int32 YIndex = 0; YIndex < DistanceFieldSize; ++YIndex)
+}
+
+bool UGenerateDistanceFieldTexture::BakeDistanceFieldPixels(UStaticMesh* GenerateStaticMesh, UTextureRenderTarget* OutputRenderTarget, int32 DistanceFieldSize, float StartDegree, float MakeDFRadius, bool bUseGPU, const FShadowFakeryCPUBakeOptions& CPUBakeOptions, TArray<FColor>& OutPixels, int32& OutTextureSize)
+{
+	if (!GenerateStaticMesh)return false;
+	
+	DistanceFieldSize = GetPowerOfTwoDistanceFieldSize(DistanceFieldSize);
+
+#if GENERATE_TEXTURE_DF
+	if (bUseGPU)
 	{
-		for (int32 XIndex = 0; XIndex < DistanceFieldSize; ++XIndex)
+		check(IsInGameThread());
+		FRHITexture* MergedDistanceFieldRT = nullptr;
+		ENQUEUE_RENDER_COMMAND(CaptureCommand)([GenerateStaticMesh, StartDegree, DistanceFieldSize, &MergedDistanceFieldRT, OutputRenderTarget](FRHICommandListImmediate& RHICmdList)
 		{
-			int32 StartIndex = YIndex * DistanceFieldSize + XIndex;
-			FVector4 MinDist(MaxRadius, MaxRadius, MaxRadius, MaxRadius);
-			FVector4 StartSample = DistanceFieldData[StartIndex];
-			float* StartSamplePtr = reinterpret_cast<float*>(&StartSample);
-			float* MinDistPtr = reinterpret_cast<float*>(&MinDist);
-			for (int32 i = -MaxRadius; i < MaxRadius; ++i)
-			{
-				for (int32 j = -MaxRadius; j < MaxRadius; ++j)
-				{
-					float CurLength = FMath::Sqrt(i * i + j * j);
-					if ((i + XIndex) < 0 || (i + XIndex) >= DistanceFieldSize)
-						continue;
-					if ((j + YIndex) < 0 || (j + YIndex) >= DistanceFieldSize)
-						continue;
-
-					int32 CurIndex = (YIndex + j) * DistanceFieldSize + (XIndex + i);
-					FVector4 CurSample = DistanceFieldData[CurIndex];
-					float* CurSamplePtr = reinterpret_cast<float*>(&CurSample);
-					
-					for (int32 Field = 0; Field < 4; ++Field)
-					{
-						if (*(StartSamplePtr + Field) != *(CurSamplePtr + Field))
-						{
-							*(MinDistPtr + Field) = FMath::Min(*(MinDistPtr + Field), CurLength);
-						}
-					}
-				}
-			}
-			MinDist /= VecMaxRadius;
-			for (int32 Field = 0; Field < 4; ++Field)
+			GenerateMeshMaskAtlas(RHICmdList, ERHIFeatureLevel::SM5, GenerateStaticMesh, MergedDistanceFieldRT, OutputRenderTarget, StartDegree, 10.f, DistanceFieldSize);
+		});
+		// We need to run all renderthread command to read back texture
+		FlushRenderingCommands();
+		if (!MergedDistanceFieldRT)return false;
+
+		int32 AtlasSize = MergedDistanceFieldRT->GetSizeXYZ().X;
+		uint32 DestStride = 0;
+		FRHITexture2D* MergedTexture2D = static_cast<FRHITexture2D*>(MergedDistanceFieldRT);
+		uint32 RowDataSize = AtlasSize * sizeof(FColor);
+		OutPixels.SetNumZeroed(AtlasSize * AtlasSize);
+		uint8* Texture2DData = (uint8*)RHILockTexture2D(MergedTexture2D, 0, RLM_ReadOnly, DestStride, false);
+
+		if (DestStride == RowDataSize)
+		{
+			FMemory::Memcpy(OutPixels.GetData(), Texture2DData, OutPixels.Num() * sizeof(FColor));
+		}
+		else
+		{
+			uint8* TempData = (uint8*)OutPixels.GetData();
+			for (int32 i = 0; i < AtlasSize; ++i)
 			{
-				*(MinDistPtr + Field) *= (*(StartSamplePtr + Field) == 0.f) ? -1.f : 1.f;
+				FMemory::Memcpy(TempData, Texture2DData, RowDataSize);
+				TempData += RowDataSize;
+				Texture2DData += DestStride;
 			}
-			FinalData.Add(FVector4(1.f, 1.f, 1.f, 1.f) - (MinDist + FVector4(1.f, 1.f, 1.f, 1.f)) * 0.5f);
 		}
+
+		RHIUnlockTexture2D(MergedTexture2D, 0, false);
+		OutTextureSize = AtlasSize;
+		return true;
+	}
+
+	const FBoxSphereBounds& Bounds = GenerateStaticMesh->RenderData->Bounds;
+
+	const int32 NumVoxelDistanceSamples = 1200;
+	TArray<FVector4> SampleDirections;
+	const int32 NumThetaSteps = FMath::TruncToInt(FMath::Sqrt(NumVoxelDistanceSamples / (2.0f * (float)PI)));
+	const int32 NumPhiSteps = FMath::TruncToInt(NumThetaSteps * (float)PI);
+	SampleDirections.Reserve(2 * NumThetaSteps * NumPhiSteps);
+	FRandomStream RandomStream(0);
+	// Compute the upper samples
+	GenerateHemisphereSamples(NumThetaSteps, NumPhiSteps, RandomStream, SampleDirections);
+	// Compute under samples
+	TArray<FVector4> DownSampleDirections;
+	GenerateHemisphereSamples(NumThetaSteps, NumPhiSteps, RandomStream, DownSampleDirections);
+	for (auto& Iter : DownSampleDirections)
+	{
+		Iter.Z *= -1.f;
+		SampleDirections.Add(Iter);
+	}
+
+	FShadowFakeryEmbreeScene EmbreeScene;
+	if (!EmbreeScene.Init(GenerateStaticMesh))
+	{
+		return false;
+	}
+
+	TArray<FVector4> DistanceFieldData;
+	TraceDistanceFieldOccupancy(EmbreeScene.EmbreeScene, Bounds, DistanceFieldSize, StartDegree, CPUBakeOptions, DistanceFieldData);
+
+	// Exact distance to the nearest texel with different occupancy, the cost does not depend on MakeDFRadius
+	TArray<FVector4> SignedDistanceData;
+	FShadowFakeryDistanceTransform::ComputeSignedDistance(DistanceFieldSize, DistanceFieldSize, DistanceFieldData, MakeDFRadius, SignedDistanceData, CPUBakeOptions.bForceSingleThread);
+	FShadowFakeryDistanceTransform::QuantizeToBGRA8(SignedDistanceData, OutPixels);
+
+	OutTextureSize = DistanceFieldSize;
+	return true;
+#else
+	return false;
+#endif
+}
+
+bool UGenerateDistanceFieldTexture::BakeDistanceFieldAtlasCPU(UStaticMesh* GenerateStaticMesh, int32 DistanceFieldSize, float StartDegree, const FShadowFakeryCPUBakeOptions& CPUBakeOptions, TArray<FColor>& OutPixels, int32& OutTextureSize)
+{
+	if (!GenerateStaticMesh || !GenerateStaticMesh->RenderData)return false;
+
+#if GENERATE_TEXTURE_DF
+	DistanceFieldSize = GetPowerOfTwoDistanceFieldSize(DistanceFieldSize);
+	const bool bForceSingleThread = CPUBakeOptions.bForceSingleThread;
+
+	FShadowFakeryEmbreeScene EmbreeScene;
+	if (!EmbreeScene.Init(GenerateStaticMesh))
+	{
+		return false;
+	}
+
+	// Same layout as GenerateMeshMaskAtlas, tile i is the yaw StartDegree + 10 * i
+	const int32 TileCount = SHADOWFAKERY_ATLAS_TILE_COUNT * SHADOWFAKERY_ATLAS_TILE_COUNT;
+	const int32 AtlasSize = DistanceFieldSize * SHADOWFAKERY_ATLAS_TILE_COUNT;
+	OutPixels.SetNumZeroed(AtlasSize * AtlasSize);
+
+	TArray<FVector4> DistanceFieldData;
+	TArray<FColor> TileColors;
+	for (int32 TileIndex = 0; TileIndex < TileCount; ++TileIndex)
+	{
+		TraceDistanceFieldOccupancy(EmbreeScene.EmbreeScene, GenerateStaticMesh->RenderData->Bounds, DistanceFieldSize, StartDegree + 10.f * TileIndex, CPUBakeOptions, DistanceFieldData);
+		FShadowFakeryJumpFlood::BakeTile(DistanceFieldSize, DistanceFieldData, TileColors, bForceSingleThread);
+		FShadowFakeryJumpFlood::CopyTileToAtlas(DistanceFieldSize, TileIndex, TileColors, AtlasSize, OutPixels);
+	}
+
+	OutTextureSize = AtlasSize;
+	return true;
+#else
+	return false;
+#endif
+}
+
+bool UGenerateDistanceFieldTexture::CompareJumpFloodToDistanceTransform(UStaticMesh* GenerateStaticMesh, int32 DistanceFieldSize, float StartDegree, int32 Tolerance, const FShadowFakeryCPUBakeOptions& CPUBakeOptions, FShadowFakeryCompareReport& OutReport)
+{
+	if (!GenerateStaticMesh || !GenerateStaticMesh->RenderData)return false;
+
+#if GENERATE_TEXTURE_DF
+	DistanceFieldSize = GetPowerOfTwoDistanceFieldSize(DistanceFieldSize);
+	const bool bForceSingleThread = CPUBakeOptions.bForceSingleThread;
+
+	FShadowFakeryEmbreeScene EmbreeScene;
+	if (!EmbreeScene.Init(GenerateStaticMesh))
+	{
+		return false;
 	}
 
-	rtcDeleteScene(EmbreeScene);
-	rtcDeleteDevice(EmbreeDevice);
+	TArray<FVector4> DistanceFieldData;
+	TraceDistanceFieldOccupancy(EmbreeScene.EmbreeScene, GenerateStaticMesh->RenderData->Bounds, DistanceFieldSize, StartDegree, CPUBakeOptions, DistanceFieldData);
 
-	FString TextureName = TEXT("Tex_ShadowFakery_1");
-	FString PackageName = TEXT("/Game/ShadowFakeryTextures/");
-	PackageName += TextureName;
+	TArray<FColor> JumpFloodColors;
+	FShadowFakeryJumpFlood::BakeTile(DistanceFieldSize, DistanceFieldData, JumpFloodColors, bForceSingleThread);
+
+	// The exact distance transform is clamped at the same distance as jump flood, so both use the same encoding
+	TArray<FVector4> SignedDistanceData;
+	TArray<FColor> ExactColors;
+	FShadowFakeryDistanceTransform::ComputeSignedDistance(DistanceFieldSize, DistanceFieldSize, DistanceFieldData, FShadowFakeryJumpFlood::MaxDistance * DistanceFieldSize, SignedDistanceData, bForceSingleThread);
+	FShadowFakeryDistanceTransform::QuantizeToBGRA8(SignedDistanceData, ExactColors);
+
+	OutReport = FShadowFakeryJumpFlood::Compare(DistanceFieldSize, JumpFloodColors, ExactColors, Tolerance);
+	return true;
+#else
+	return false;
+#endif
+}
+
+static const FName ShadowFakeryBakeHashKey(TEXT("ShadowFakeryBakeHash"));
+
+/** Create the texture object with one B8G8R8A8 mip, the mip data is allocated but not filled */
+static UTexture2D* CreateDistanceFieldTextureObject(const FString& PackageName, int32 TextureSize)
+{
+	const FString TextureName = FPackageName::GetLongPackageAssetName(PackageName);
 	UPackage* Package = CreatePackage(NULL, *PackageName);
 	Package->FullyLoad();
 
 	UTexture2D* TargetTex = NewObject<UTexture2D>(Package, *TextureName, RF_Public | RF_Standalone | RF_MarkAsRootSet);
 	TargetTex->AddToRoot();				// This line prevents garbage collection of the texture
 	TargetTex->PlatformData = new FTexturePlatformData();	// Then we initialize the PlatformData
-	TargetTex->PlatformData->SizeX = DistanceFieldSize;
-	TargetTex->PlatformData->SizeY = DistanceFieldSize;
+	TargetTex->PlatformData->SizeX = TextureSize;
+	TargetTex->PlatformData->SizeY = TextureSize;
 	TargetTex->PlatformData->SetNumSlices(1);
 	TargetTex->PlatformData->PixelFormat = EPixelFormat::PF_B8G8R8A8;
 	TargetTex->AddressX = TextureAddress::TA_Clamp;
 	TargetTex->AddressY = TextureAddress::TA_Clamp;
-
-	int32 SizeX = TargetTex->GetSizeX();
-	int32 SizeY = TargetTex->GetSizeY();
-	/*if (DistanceFieldDimension.X <= SizeX && DistanceFieldDimension.Y <= SizeY)
-	{
-		FUpdateTextureRegion2D UpdateRegion(0, 0, 0, 0, DistanceFieldDimension.X, DistanceFieldDimension.Y);
-		TargetTex->UpdateTextureRegions(0, 1, &UpdateRegion, DistanceFieldDimension.X * sizeof(FVector4), sizeof(FVector4), (uint8*)DistanceFieldData.GetData());
-	}*/
-
-	/*TArray<float> DistanceFieldDataHalf;
-	DistanceFieldDataHalf.Reserve(DistanceFieldDimension.X* DistanceFieldDimension.Y * 4);
-	for (int32 j = 0; j < DistanceFieldDimension.Y; ++j)
-		for (int32 i = 0; i < DistanceFieldDimension.X; ++i)
-		{
-			DistanceFieldDataHalf.Add(1.f);
-			DistanceFieldDataHalf.Add(0);
-			DistanceFieldDataHalf.Add(0);
-			DistanceFieldDataHalf.Add(1.f);
-		}
-
-	for (auto& Iter : DistanceFieldData)
-		Iter = FVector4(1.f, 1.f, 1.f, 1.f);*/
+	TargetTex->CompressionQuality = ETextureCompressionQuality::TCQ_Medium;
+	TargetTex->CompressionSettings = TC_VectorDisplacementmap;
 
 	int32 Index = TargetTex->PlatformData->Mips.Add(new FTexture2DMipMap());
 	FTexture2DMipMap* Mip = &TargetTex->PlatformData->Mips[Index];
-	Mip->SizeX = DistanceFieldSize;
-	Mip->SizeY = DistanceFieldSize;
+	Mip->SizeX = TextureSize;
+	Mip->SizeY = TextureSize;
 
-	// Lock the texture so it can be modified
 	Mip->BulkData.Lock(LOCK_READ_WRITE);
-	uint8* TextureData = (uint8*)Mip->BulkData.Realloc(DistanceFieldSize * DistanceFieldSize * 4 * sizeof(float));
-	FMemory::Memcpy(TextureData, FinalData.GetData(), sizeof(float) * DistanceFieldSize * DistanceFieldSize * 4);
+	Mip->BulkData.Realloc(TextureSize * TextureSize * sizeof(FColor));
 	Mip->BulkData.Unlock();
 
-	TargetTex->Source.Init(DistanceFieldSize, DistanceFieldSize, 1, 1, ETextureSourceFormat::TSF_RGBA8);
+	return TargetTex;
+}
+
+/** Texture source and mip must have been filled, update the resource and save the package */
+static UTexture2D* FinishDistanceFieldTexture(UTexture2D* TargetTex, const FString& BakeHash)
+{
+	UPackage* Package = TargetTex->GetOutermost();
 	TargetTex->UpdateResource();
+#if WITH_EDITORONLY_DATA
+	if (!BakeHash.IsEmpty())
+	{
+		Package->GetMetaData()->SetValue(TargetTex, ShadowFakeryBakeHashKey, *BakeHash);
+	}
+#endif
 	Package->MarkPackageDirty();
 	FAssetRegistryModule::AssetCreated(TargetTex);
 
-	FString PackageFileName = FPackageName::LongPackageNameToFilename(PackageName, FPackageName::GetAssetPackageExtension());
+	FString PackageFileName = FPackageName::LongPackageNameToFilename(Package->GetName(), FPackageName::GetAssetPackageExtension());
 	bool bSaved = UPackage::SavePackage(Package, TargetTex, EObjectFlags::RF_Public | EObjectFlags::RF_Standalone, *PackageFileName, GError, nullptr, true, true, SAVE_NoError);
+	return bSaved ? TargetTex : nullptr;
+}
+
+UTexture2D* UGenerateDistanceFieldTexture::SaveDistanceFieldTexture(const FString& PackageName, int32 TextureSize, const TArray<FColor>& Pixels, const FString& BakeHash)
+{
+	check(Pixels.Num() == TextureSize * TextureSize);
+
+	UTexture2D* TargetTex = CreateDistanceFieldTextureObject(PackageName, TextureSize);
+	FTexture2DMipMap* Mip = &TargetTex->PlatformData->Mips[0];
+
+	// Lock the texture so it can be modified
+	uint8* TextureData = (uint8*)Mip->BulkData.Lock(LOCK_READ_WRITE);
+	FMemory::Memcpy(TextureData, Pixels.GetData(), TextureSize * TextureSize * sizeof(FColor));
+	Mip->BulkData.Unlock();
+
+	TargetTex->Source.Init(TextureSize, TextureSize, 1, 1, ETextureSourceFormat::TSF_BGRA8, (const uint8*)Pixels.GetData());
+	return FinishDistanceFieldTexture(TargetTex, BakeHash);
+}
+
+/** Drop a texture from CreateDistanceFieldTextureObject which never got its pixels, so it is neither saved nor kept alive */
+static void DiscardDistanceFieldTexture(UTexture2D* TargetTex)
+{
+	TargetTex->RemoveFromRoot();
+	TargetTex->ClearFlags(RF_Public | RF_Standalone);
+	TargetTex->MarkPendingKill();
+}
+
+#if GENERATE_TEXTURE_DF
+/** State of one async GPU bake, it is shared by game thread and render thread */
+struct FShadowFakeryAsyncBake
+{
+	FString PackageName;
+	FString BakeHash;
+	int32 TextureSize = 0;
+	// Render thread draws the mesh, it must not be collected before the bake is done. Only created and reset on game thread
+	TStrongObjectPtr<UStaticMesh> StaticMesh;
+	// Created on game thread with its mip locked, render thread copies the staging surface straight into MipData.
+	// It is only passed out by OnCompleted once it has pixels and is saved
+	UTexture2D* Texture = nullptr;
+	uint8* MipData = nullptr;
+	FTexture2DRHIRef StagingTexture;
+	FGPUFenceRHIRef ReadbackFence;
+	FThreadSafeBool bPollQueued;
+	FThreadSafeBool bCompleted;
+	FThreadSafeBool bFailed;
+	FOnShadowFakeryBakeCompleted OnCompleted;
+};
+
+typedef TSharedRef<FShadowFakeryAsyncBake, ESPMode::ThreadSafe> FShadowFakeryAsyncBakeRef;
+
+/** Ticked on game thread until the readback is done, returns false when the bake is finished */
+static bool TickAsyncBake(const FShadowFakeryAsyncBakeRef& Bake)
+{
+	if (!Bake->bCompleted)
+	{
+		// Only one poll command in flight, the fence is checked on render thread
+		if (!Bake->bPollQueued)
+		{
+			Bake->bPollQueued = true;
+			ENQUEUE_RENDER_COMMAND(PollShadowFakeryReadback)([Bake](FRHICommandListImmediate& RHICmdList)
+			{
+				if (Bake->ReadbackFence.IsValid() && Bake->ReadbackFence->Poll())
+				{
+					void* StagingData = nullptr;
+					int32 RowPitchInPixels = 0;
+					int32 StagingHeight = 0;
+					RHICmdList.MapStagingSurface(Bake->StagingTexture, Bake->ReadbackFence, StagingData, RowPitchInPixels, StagingHeight);
+
+					const uint32 RowDataSize = Bake->TextureSize * sizeof(FColor);
+					const uint32 StagingStride = RowPitchInPixels * sizeof(FColor);
+					uint8* PixelData = Bake->MipData;
+					if (StagingStride == RowDataSize)
+					{
+						FMemory::Memcpy(PixelData, StagingData, RowDataSize * Bake->TextureSize);
+					}
+					else
+					{
+						const uint8* SrcData = (const uint8*)StagingData;
+						for (int32 i = 0; i < Bake->TextureSize; ++i)
+						{
+							FMemory::Memcpy(PixelData + i * RowDataSize, SrcData + i * StagingStride, RowDataSize);
+						}
+					}
+
+					RHICmdList.UnmapStagingSurface(Bake->StagingTexture);
+					Bake->StagingTexture.SafeRelease();
+					Bake->ReadbackFence.SafeRelease();
+					Bake->bCompleted = true;
+				}
+				Bake->bPollQueued = false;
+			});
+		}
+		return true;
+	}
+
+	// Render thread is done with the mesh, release it here as the last reference of the bake may be dropped on render thread
+	Bake->StaticMesh.Reset();
+
+	UTexture2D* Result = nullptr;
+	FTexture2DMipMap& Mip = Bake->Texture->PlatformData->Mips[0];
+	if (!Bake->bFailed)
+	{
+		Bake->Texture->Source.Init(Bake->TextureSize, Bake->TextureSize, 1, 1, ETextureSourceFormat::TSF_BGRA8, Bake->MipData);
+	}
+	Mip.BulkData.Unlock();
+	Bake->MipData = nullptr;
+
+	if (Bake->bFailed)
+	{
+		DiscardDistanceFieldTexture(Bake->Texture);
+	}
+	else
+	{
+		Result = FinishDistanceFieldTexture(Bake->Texture, Bake->BakeHash);
+	}
+	Bake->Texture = nullptr;
+	Bake->OnCompleted.ExecuteIfBound(Result);
+	return false;
+}
+#endif
+
+bool UGenerateDistanceFieldTexture::BakeDistanceFieldTextureAsync(UStaticMesh* GenerateStaticMesh, int32 DistanceFieldSize, float StartDegree, const FString& PackageName, const FString& BakeHash, FOnShadowFakeryBakeCompleted OnCompleted)
+{
+#if GENERATE_TEXTURE_DF
+	if (!GenerateStaticMesh)return false;
+
+	DistanceFieldSize = GetPowerOfTwoDistanceFieldSize(DistanceFieldSize);
+	const int32 AtlasSize = DistanceFieldSize * SHADOWFAKERY_ATLAS_TILE_COUNT;
+
+	FShadowFakeryAsyncBakeRef Bake = MakeShared<FShadowFakeryAsyncBake, ESPMode::ThreadSafe>();
+	Bake->PackageName = PackageName;
+	Bake->BakeHash = BakeHash;
+	Bake->TextureSize = AtlasSize;
+	Bake->StaticMesh.Reset(GenerateStaticMesh);
+	Bake->OnCompleted = OnCompleted;
+	// Mip stays locked until the readback is done, so no extra copy of the pixels is needed
+	Bake->Texture = CreateDistanceFieldTextureObject(PackageName, AtlasSize);
+	Bake->MipData = (uint8*)Bake->Texture->PlatformData->Mips[0].BulkData.Lock(LOCK_READ_WRITE);
+
+	ENQUEUE_RENDER_COMMAND(ShadowFakeryAsyncBake)([Bake, StartDegree, DistanceFieldSize](FRHICommandListImmediate& RHICmdList)
+	{
+		FRHITexture* MergedDistanceFieldRT = nullptr;
+		GenerateMeshMaskAtlas(RHICmdList, ERHIFeatureLevel::SM5, Bake->StaticMesh.Get(), MergedDistanceFieldRT, nullptr, StartDegree, 10.f, DistanceFieldSize);
+
+		if (!MergedDistanceFieldRT || MergedDistanceFieldRT->GetSizeXYZ().X != Bake->TextureSize)
+		{
+			Bake->bFailed = true;
+			Bake->bCompleted = true;
+			return;
+		}
+
+		// Copy to a staging texture, the fence tells us when it can be mapped without stall
+		FRHIResourceCreateInfo CreateInfo;
+		Bake->StagingTexture = RHICreateTexture2D(Bake->TextureSize, Bake->TextureSize, MergedDistanceFieldRT->GetFormat(), 1, 1, TexCreate_CPUReadback, CreateInfo);
+		RHICmdList.CopyTexture(MergedDistanceFieldRT, Bake->StagingTexture, FRHICopyTextureInfo());
+		Bake->ReadbackFence = RHICreateGPUFence(TEXT("ShadowFakeryReadback"));
+		RHICmdList.WriteGPUFence(Bake->ReadbackFence);
+	});
+
+	FTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateLambda([Bake](float DeltaTime)
+	{
+		return TickAsyncBake(Bake);
+	}));
+
+	return true;
+#else
+	return false;
 #endif
 }
 
+FString UGenerateDistanceFieldTexture::GetDistanceFieldTextureBakeHash(UTexture2D* Texture)
+{
+#if WITH_EDITORONLY_DATA
+	if (Texture)
+	{
+		return Texture->GetOutermost()->GetMetaData()->GetValue(Texture, ShadowFakeryBakeHashKey);
+	}
+#endif
+	return FString();
+}
@@ -20,6 +20,12 @@ static TAutoConsoleVariable<float> CVarMaskVolumeScale(
 	TEXT(""),
 	ECVF_Default);
 
+static TAutoConsoleVariable<int32> CVarShadowFakeryBatchedGPUBake(
+	TEXT("r.ShadowFakery.BatchedGPUBake"),
+	1,
+	TEXT("0: GPU bake draws and floods the atlas tiles one by one, 1: all tiles are drawn and flooded together in one atlas."),
+	ECVF_RenderThreadSafe);
+
 
 
 FGenerateDistanceFieldTexture_GPU::FGenerateDistanceFieldTexture_GPU()
@@ -35,11 +41,14 @@ void GenerateDistanceFieldTexture(FRHICommandList& RHICmdList, ERHIFeatureLevel:
 #if GENERATE_TEXTURE_DF
 struct FDrawMaskInstance
 {
-	FDrawMaskInstance(const FMatrix& InWorld):
-		World(InWorld)
+	FDrawMaskInstance(const FMatrix& InWorld, const FVector4& InAtlasScaleBias):
+		World(InWorld),
+		AtlasScaleBias(InAtlasScaleBias)
 	{}
 
 	FMatrix World;
+	// Scale and bias from clip space of the tile to clip space of atlas
+	FVector4 AtlasScaleBias;
 };
 
 class FOnlyPosVertexDeclaration : public FRenderResource
@@ -64,6 +73,9 @@ public:
 		Offset += sizeof(FVector4);
 		Elements.Add(FVertexElement(1, Offset, EVertexElementType::VET_Float4, 4, Stride, true));
 		Offset += sizeof(FVector4);
+		//For atlas scale bias
+		Elements.Add(FVertexElement(1, Offset, EVertexElementType::VET_Float4, 5, Stride, true));
+		Offset += sizeof(FVector4);
 		
 		VertexDeclarationRHI = RHICreateVertexDeclaration(Elements);
 	}
@@ -74,6 +86,8 @@ public:
 	}
 };
 
+static TGlobalResource<FOnlyPosVertexDeclaration> GOnlyPosVertexDeclaration;
+
 struct FVertexInput
 {
 	FVector4 Position;
@@ -100,36 +114,45 @@ public:
 	}
 };
 
-static void DrawIndexedPrimitiveUP_Custom(
-	FRHICommandList& RHICmdList,
-	uint32 PrimitiveType,
-	uint32 MinVertexIndex,
-	uint32 NumVertices,
-	uint32 NumPrimitives,
-	const void* IndexData,
-	uint32 IndexDataStride,
-	const void* VertexData,
-	uint32 VertexDataStride)
+static TGlobalResource<FCommonVertexDeclaration> GCommonVertexDeclaration;
+
+/** Fullscreen quad of DrawQuadWithPSParams, uv (0,0) is at the top left */
+class FCommonQuadBuffer : public FRenderResource
 {
-	const uint32 NumIndices = GetVertexCountForPrimitiveCount(NumPrimitives, PrimitiveType);
+public:
+	FVertexBufferRHIRef VertexBuffer;
 
-	FRHIResourceCreateInfo CreateInfo;
-	FVertexBufferRHIRef VertexBufferRHI = RHICreateVertexBuffer(VertexDataStride * NumVertices, BUF_Volatile, CreateInfo);
-	void* VoidPtr = RHILockVertexBuffer(VertexBufferRHI, 0, VertexDataStride * NumVertices, RLM_WriteOnly);
-	FPlatformMemory::Memcpy(VoidPtr, VertexData, VertexDataStride * NumVertices);
-	RHIUnlockVertexBuffer(VertexBufferRHI);
+	FIndexBufferRHIRef IndexBuffer;
 
-	FIndexBufferRHIRef IndexBufferRHI = RHICreateIndexBuffer(IndexDataStride, IndexDataStride * NumIndices, BUF_Volatile, CreateInfo);
-	void* VoidPtr2 = RHILockIndexBuffer(IndexBufferRHI, 0, IndexDataStride * NumIndices, RLM_WriteOnly);
-	FPlatformMemory::Memcpy(VoidPtr2, IndexData, IndexDataStride * NumIndices);
-	RHIUnlockIndexBuffer(IndexBufferRHI);
+	virtual void InitRHI()override
+	{
+		TResourceArray<FVertexInput, VERTEXBUFFER_ALIGNMENT> Vertices;
+		Vertices.SetNumUninitialized(4);
+		Vertices[0].Position.Set(-1.0f, 1.0f, 0, 1.0f);
+		Vertices[1].Position.Set(1.0f, 1.0f, 0, 1.0f);
+		Vertices[2].Position.Set(-1.0f, -1.0f, 0, 1.0f);
+		Vertices[3].Position.Set(1.0f, -1.0f, 0, 1.0f);
+		Vertices[0].UV = FVector2D(0.0f, 0.0f);
+		Vertices[1].UV = FVector2D(1.0f, 0.0f);
+		Vertices[2].UV = FVector2D(0.0f, 1.0f);
+		Vertices[3].UV = FVector2D(1.0f, 1.0f);
+		FRHIResourceCreateInfo VertexCreateInfo(&Vertices);
+		VertexBuffer = RHICreateVertexBuffer(Vertices.GetResourceDataSize(), BUF_Static, VertexCreateInfo);
+
+		TResourceArray<uint16, INDEXBUFFER_ALIGNMENT> Indices;
+		Indices.Append({ 0, 1, 2, 2, 1, 3 });
+		FRHIResourceCreateInfo IndexCreateInfo(&Indices);
+		IndexBuffer = RHICreateIndexBuffer(sizeof(uint16), Indices.GetResourceDataSize(), BUF_Static, IndexCreateInfo);
+	}
 
-	RHICmdList.SetStreamSource(0, VertexBufferRHI, 0);
-	RHICmdList.DrawIndexedPrimitive(IndexBufferRHI, MinVertexIndex, 0, NumVertices, 0, NumPrimitives, 1);
+	virtual void ReleaseRHI()override
+	{
+		VertexBuffer.SafeRelease();
+		IndexBuffer.SafeRelease();
+	}
+};
 
-	IndexBufferRHI.SafeRelease();
-	VertexBufferRHI.SafeRelease();
-}
+static TGlobalResource<FCommonQuadBuffer> GCommonQuadBuffer;
 
 template<class VertexShaderType, class PixelShaderType, typename... ArgsType>
 void DrawQuadWithPSParams(FRHICommandList& RHICmdList, ERHIFeatureLevel::Type FeatureLevel, const TCHAR* PassName, FIntPoint ViewportSize, uint32 RTCounts, FRHITexture* ResultRTs[], ArgsType&&... Args)
@@ -143,37 +166,20 @@ void DrawQuadWithPSParams(FRHICommandList& RHICmdList, ERHIFeatureLevel::Type Fe
 	TShaderMapRef<VertexShaderType> VertexShader(GlobalShaderMap);
 	TShaderMapRef<PixelShaderType> PixelShader(GlobalShaderMap);    
 
-	FCommonVertexDeclaration VertexDeclaration;
-	VertexDeclaration.InitRHI();
-
 	FGraphicsPipelineStateInitializer GraphicPSPoint;
 	RHICmdList.ApplyCachedRenderTargets(GraphicPSPoint);
 	GraphicPSPoint.DepthStencilState = TStaticDepthStencilState<false, CF_Always>::GetRHI();
 	GraphicPSPoint.BlendState = TStaticBlendState<>::GetRHI();
 	GraphicPSPoint.RasterizerState = TStaticRasterizerState<>::GetRHI();
 	GraphicPSPoint.PrimitiveType = PT_TriangleList;
-	GraphicPSPoint.BoundShaderState.VertexDeclarationRHI = VertexDeclaration.VertexDeclarationRHI;
+	GraphicPSPoint.BoundShaderState.VertexDeclarationRHI = GCommonVertexDeclaration.VertexDeclarationRHI;
 	GraphicPSPoint.BoundShaderState.VertexShaderRHI = VertexShader.GetVertexShader();
 	GraphicPSPoint.BoundShaderState.PixelShaderRHI = PixelShader.GetPixelShader();
 	SetGraphicsPipelineState(RHICmdList, GraphicPSPoint);
 
-	FVertexInput Vertices[4];
-	Vertices[0].Position.Set(-1.0f, 1.0f, 0, 1.0f);
-	Vertices[1].Position.Set(1.0f, 1.0f, 0, 1.0f);
-	Vertices[2].Position.Set(-1.0f, -1.0f, 0, 1.0f);
-	Vertices[3].Position.Set(1.0f, -1.0f, 0, 1.0f);
-	Vertices[0].UV = FVector2D(0.0f, 0.0f);
-	Vertices[1].UV = FVector2D(1.0f, 0.0f);
-	Vertices[2].UV = FVector2D(0.0f, 1.0f);
-	Vertices[3].UV = FVector2D(1.0f, 1.0f);
-	static const uint16 Indices[6] =
-	{
-		0, 1, 2,
-		2, 1, 3
-	};
-	
 	PixelShader->SetParameters(RHICmdList, Forward<ArgsType>(Args)...);
-	DrawIndexedPrimitiveUP_Custom(RHICmdList, PT_TriangleList, 0, UE_ARRAY_COUNT(Vertices), 2, Indices, sizeof(Indices[0]), Vertices, sizeof(Vertices[0]));
+	RHICmdList.SetStreamSource(0, GCommonQuadBuffer.VertexBuffer, 0);
+	RHICmdList.DrawIndexedPrimitive(GCommonQuadBuffer.IndexBuffer, 0, 0, 4, 0, 2, 1);
 
 	RHICmdList.EndRenderPass();
 }
@@ -330,6 +336,7 @@ public:
 	{
 		CurLevel.Bind(Initializer.ParameterMap, TEXT("CurLevel"));
 		DistanceFieldDimension.Bind(Initializer.ParameterMap, TEXT("DistanceFieldDimension"));
+		TileCount.Bind(Initializer.ParameterMap, TEXT("TileCount"));
 		MaskTexture0.Bind(Initializer.ParameterMap, TEXT("MaskTexture0"));
 		MaskTexture1.Bind(Initializer.ParameterMap, TEXT("MaskTexture1"));
 		TextureSampler.Bind(Initializer.ParameterMap, TEXT("TextureSampler"));
@@ -354,12 +361,14 @@ public:
 		FRHICommandList& RHICmdList,
 		uint32 InLevel,
 		const FVector2D& DFDimension,
+		float InTileCount,
 		FRHITexture* InMaskTexture0,
 		FRHITexture* InMaskTexture1
 	)
 	{
 		SetShaderValue(RHICmdList, RHICmdList.GetBoundPixelShader(), CurLevel, InLevel);
 		SetShaderValue(RHICmdList, RHICmdList.GetBoundPixelShader(), DistanceFieldDimension, DFDimension);
+		SetShaderValue(RHICmdList, RHICmdList.GetBoundPixelShader(), TileCount, InTileCount);
 		SetTextureParameter(RHICmdList, RHICmdList.GetBoundPixelShader(), MaskTexture0, TextureSampler, TStaticSamplerState<SF_Bilinear, AM_Clamp, AM_Clamp, AM_Clamp>::GetRHI(), InMaskTexture0);
 		SetTextureParameter(RHICmdList, RHICmdList.GetBoundPixelShader(), MaskTexture1, InMaskTexture1);
 	}
@@ -380,6 +389,7 @@ public:
 private:
 	LAYOUT_FIELD(FShaderParameter, CurLevel);
 	LAYOUT_FIELD(FShaderParameter, DistanceFieldDimension);
+	LAYOUT_FIELD(FShaderParameter, TileCount);
 	LAYOUT_FIELD(FShaderResourceParameter, MaskTexture0);
 	LAYOUT_FIELD(FShaderResourceParameter, MaskTexture1);
 	LAYOUT_FIELD(FShaderResourceParameter, TextureSampler);
@@ -398,6 +408,7 @@ public:
 	FRevertToDistanceFieldShaderPS(const ShaderMetaType::CompiledShaderInitializerType& Initializer) :
 		FGlobalShader(Initializer)
 	{
+		TileCount.Bind(Initializer.ParameterMap, TEXT("TileCount"));
 		MaskTexture0.Bind(Initializer.ParameterMap, TEXT("MaskTexture0"));
 		MaskTexture1.Bind(Initializer.ParameterMap, TEXT("MaskTexture1"));
 		TextureSampler.Bind(Initializer.ParameterMap, TEXT("TextureSampler"));
@@ -420,10 +431,12 @@ public:
 
 	void SetParameters(
 		FRHICommandList& RHICmdList,
+		float InTileCount,
 		FRHITexture* InTexture0, 
 		FRHITexture* InTexture1 
 	)
 	{
+		SetShaderValue(RHICmdList, RHICmdList.GetBoundPixelShader(), TileCount, InTileCount);
 		SetTextureParameter(RHICmdList, RHICmdList.GetBoundPixelShader(), MaskTexture0, TextureSampler, TStaticSamplerState<SF_Bilinear, AM_Clamp, AM_Clamp, AM_Clamp>::GetRHI(), InTexture0);
 		SetTextureParameter(RHICmdList, RHICmdList.GetBoundPixelShader(), MaskTexture1, InTexture1);
 	}
@@ -440,6 +453,7 @@ public:
 	}*/
 
 private:
+	LAYOUT_FIELD(FShaderParameter, TileCount);
 	LAYOUT_FIELD(FShaderResourceParameter, MaskTexture0);
 	LAYOUT_FIELD(FShaderResourceParameter, MaskTexture1);
 	LAYOUT_FIELD(FShaderResourceParameter, TextureSampler);
@@ -575,33 +589,47 @@ private:
 IMPLEMENT_SHADER_TYPE(, FMergeToAtlasCS, TEXT("/Plugins/Shaders/ProcessShadowFakery.usf"), TEXT("MergeToAtlasCS"), SF_Compute)
 #endif
 
-void GenerateMeshMaskTexture(FRHICommandListImmediate& RHICmdList, ERHIFeatureLevel::Type FeatureLevel, class UStaticMesh* StaticMesh, FRHITexture*& MergedDistanceFieldTexture, class UTextureRenderTarget* OutputRenderTarget, uint32 TileIndex, float StartDegree, uint32 TextureSize)
-{
-	check(IsInRenderingThread());
-	
 #if GENERATE_TEXTURE_DF
-	if (!StaticMesh)return;
+/** Mesh buffers of LOD0 uploaded for drawing the mask, the same buffers are used by all tiles */
+struct FMaskMeshBuffers
+{
+	FVertexBufferRHIRef VertexBuffer;
+	FIndexBufferRHIRef IndexBuffer;
+	uint32 NumIndices = 0;
+};
 
-	FStaticMeshLODResources& LODModel = StaticMesh->RenderData->LODResources[0];
-	FBoxSphereBounds& Bounds = StaticMesh->RenderData->Bounds;
+static void CreateMaskMeshBuffers(FStaticMeshLODResources& LODModel, FMaskMeshBuffers& OutBuffers)
+{
 	FPositionVertexBuffer& PositionVertexBuffer = LODModel.VertexBuffers.PositionVertexBuffer;
-	FRawStaticIndexBuffer& Indices = LODModel.IndexBuffer;
-	
-	FBox MeshBox(Bounds.GetBox());
-	const FVector MeshBoxExtent = MeshBox.GetExtent();
+	FRHIResourceCreateInfo CreateInfo;
+	//Create Index Buffer
+	TArray<uint32> AllIndices;
+	LODModel.IndexBuffer.GetCopy(AllIndices);
+	uint32 SizeInBytes = AllIndices.Num() * sizeof(uint32);
+	OutBuffers.IndexBuffer = RHICreateIndexBuffer(sizeof(uint32), SizeInBytes, BUF_Static | BUF_ShaderResource, CreateInfo);
+	void* MeshModelIndexData = RHILockIndexBuffer(OutBuffers.IndexBuffer, 0, SizeInBytes, RLM_WriteOnly);
+	FPlatformMemory::Memcpy(MeshModelIndexData, AllIndices.GetData(), SizeInBytes);
+	RHIUnlockIndexBuffer(OutBuffers.IndexBuffer);
+	OutBuffers.NumIndices = AllIndices.Num();
+	//Create vertex buffer 
+	SizeInBytes = PositionVertexBuffer.GetNumVertices() * sizeof(FPositionVertex);
+	OutBuffers.VertexBuffer = RHICreateVertexBuffer(SizeInBytes, BUF_Static | BUF_ShaderResource, CreateInfo);
+	void* Data = PositionVertexBuffer.GetVertexData();
+	void* MeshModelVertexData = RHILockVertexBuffer(OutBuffers.VertexBuffer, 0, SizeInBytes, RLM_WriteOnly);
+	FPlatformMemory::Memcpy(MeshModelVertexData, Data, SizeInBytes);
+	RHIUnlockVertexBuffer(OutBuffers.VertexBuffer);
+}
+
+/** Volume of the mesh used by mask, returns the orthographic view projection and the half width of volume */
+static FMatrix GetMaskViewProjMatrix(const FBoxSphereBounds& Bounds, FBox& OutMeshBox)
+{
+	OutMeshBox = FBox(Bounds.GetBox());
+	const FVector MeshBoxExtent = OutMeshBox.GetExtent();
 	const float DFVoulmeRadius = FMath::Max(MeshBoxExtent.GetMax() * 1.7f, MeshBoxExtent.Size()) * CVarMaskVolumeScale.GetValueOnRenderThread();
 
-	const FBox DistanceFieldVolumeBox = FBox(MeshBox.GetCenter() - FVector(DFVoulmeRadius * 1.7f / 3.f), MeshBox.GetCenter() + FVector(DFVoulmeRadius * 1.7f / 3.f));
+	const FBox DistanceFieldVolumeBox = FBox(OutMeshBox.GetCenter() - FVector(DFVoulmeRadius * 1.7f / 3.f), OutMeshBox.GetCenter() + FVector(DFVoulmeRadius * 1.7f / 3.f));
 	const float DFVoulmeWidth = DistanceFieldVolumeBox.GetSize().X / 2.f;
 
-	TArray<FDrawMaskInstance> ModelInstance;
-	const static FVector4 Colors[4] = { FVector4(1.f, 0.f, 0.f, 0.f), FVector4(0.f, 1.f, 0.f, 0.f), FVector4(0.f, 0.f, 1.f, 0.f), FVector4(0.f, 0.f, 0.f, 1.f) };
-	for (int32 i = 0; i < UE_ARRAY_COUNT(Colors); ++i)
-	{
-		const FMatrix ModelWorldMatrix = FTranslationMatrix(-MeshBox.GetCenter()) * FRotationMatrix(FRotator(0.f, -StartDegree, 0.f)) * FRotationMatrix(FRotator(i * 30.f, 0.f, 0.f));
-		ModelInstance.Emplace(ModelWorldMatrix);
-	}
-	
 	FOrthoMatrix OrthoProjMatrix(DFVoulmeWidth, DFVoulmeWidth, 0.f, 0.f);
 	FMatrix ViewRotationMatrix = FInverseRotationMatrix(FRotator(0.f, 180.f, 0.f));
 	ViewRotationMatrix = ViewRotationMatrix * FMatrix(
@@ -612,8 +640,22 @@ void GenerateMeshMaskTexture(FRHICommandListImmediate& RHICmdList, ERHIFeatureLe
 
 	FVector ViewOrigin(DFVoulmeWidth * 2.f, 0.f, 0.f);
 	const FMatrix ViewMatrix = FTranslationMatrix(-ViewOrigin) * ViewRotationMatrix;
-	const FMatrix ViewProjMatrix = ViewMatrix * OrthoProjMatrix;
+	return ViewMatrix * OrthoProjMatrix;
+}
 
+/** Add the 4 pitch instances of one tile, the tile is placed into atlas by AtlasScaleBias */
+static void AddTileInstances(TArray<FDrawMaskInstance>& ModelInstance, const FBox& MeshBox, float StartDegree, const FVector4& AtlasScaleBias)
+{
+	for (int32 i = 0; i < 4; ++i)
+	{
+		const FMatrix ModelWorldMatrix = FTranslationMatrix(-MeshBox.GetCenter()) * FRotationMatrix(FRotator(0.f, -StartDegree, 0.f)) * FRotationMatrix(FRotator(i * 30.f, 0.f, 0.f));
+		ModelInstance.Emplace(ModelWorldMatrix, AtlasScaleBias);
+	}
+}
+
+/** Draw all instances into the 2 mask targets in one draw call */
+static void DrawMeshMask(FRHICommandListImmediate& RHICmdList, ERHIFeatureLevel::Type FeatureLevel, const FMaskMeshBuffers& MeshBuffers, const TArray<FDrawMaskInstance>& ModelInstance, const FMatrix& ViewProjMatrix, uint32 TextureSize, FRHITexture* MaskRTs[2])
+{
 	FRHIResourceCreateInfo CreateInfo;
 	//Create instanced buffer
 	uint32 SizeInBytes = ModelInstance.Num() * sizeof(FDrawMaskInstance);
@@ -621,85 +663,59 @@ void GenerateMeshMaskTexture(FRHICommandListImmediate& RHICmdList, ERHIFeatureLe
 	void* MeshModelInstancedData = RHILockVertexBuffer(MeshModelInstancedVB, 0, SizeInBytes, RLM_WriteOnly);
 	FPlatformMemory::Memcpy(MeshModelInstancedData, ModelInstance.GetData(), SizeInBytes);
 	RHIUnlockVertexBuffer(MeshModelInstancedVB);
-	//Create Index Buffer
-	TArray<uint32> AllIndices;
-	LODModel.IndexBuffer.GetCopy(AllIndices);
-	SizeInBytes = AllIndices.Num() * sizeof(uint32);
-	FIndexBufferRHIRef IndexBuffer = RHICreateIndexBuffer(sizeof(uint32), SizeInBytes, BUF_Static | BUF_ShaderResource, CreateInfo);
-	void* MeshModelIndexData = RHILockIndexBuffer(IndexBuffer, 0, SizeInBytes, RLM_WriteOnly);
-	FPlatformMemory::Memcpy(MeshModelIndexData, AllIndices.GetData(), SizeInBytes);
-	RHIUnlockIndexBuffer(IndexBuffer);
-	//Create vertex buffer 
-	SizeInBytes = PositionVertexBuffer.GetNumVertices() * sizeof(FPositionVertex);
-	FVertexBufferRHIRef VertexBuffer = RHICreateVertexBuffer(SizeInBytes, BUF_Static | BUF_ShaderResource, CreateInfo);
-	void* Data = PositionVertexBuffer.GetVertexData();
-	void* MeshModelVertexData = RHILockVertexBuffer(VertexBuffer, 0, SizeInBytes, RLM_WriteOnly);
-	FPlatformMemory::Memcpy(MeshModelVertexData, Data, SizeInBytes);
-	RHIUnlockVertexBuffer(VertexBuffer);
-	
+
 	TShaderMapRef<FGenerateMeshMaskShaderVS> VertexShader(GetGlobalShaderMap(FeatureLevel));
 	TShaderMapRef<FGenerateMeshMaskShaderPS> PixelShader(GetGlobalShaderMap(FeatureLevel));
 
 	RHICmdList.SetViewport(0.f, 0.f, 0.f, TextureSize, TextureSize, 1.f);
-	
-	TRefCountPtr<IPooledRenderTarget> MaskRT0;
-	TRefCountPtr<IPooledRenderTarget> MaskRT1;
-	FPooledRenderTargetDesc Desc(FPooledRenderTargetDesc::Create2DDesc(FIntPoint(TextureSize, TextureSize), PF_A32B32G32R32F, FClearValueBinding::Transparent, TexCreate_GenerateMipCapable, TexCreate_RenderTargetable | TexCreate_ShaderResource, false));
-	//Desc.NumSamples = 4;  //can not open mipmap and multisample simultaneously
-	GRenderTargetPool.FindFreeElement(RHICmdList, Desc, MaskRT0, TEXT("MaskRT0"));
-	GRenderTargetPool.FindFreeElement(RHICmdList, Desc, MaskRT1, TEXT("MaskRT1"));
-	
-	FRHITexture* ColorRTs[2] = { MaskRT0->GetRenderTargetItem().TargetableTexture, MaskRT1->GetRenderTargetItem().TargetableTexture };
-	FRHIRenderPassInfo PassInfo(UE_ARRAY_COUNT(ColorRTs), ColorRTs, ERenderTargetActions::Clear_Store);
+
+	FRHIRenderPassInfo PassInfo(2, MaskRTs, ERenderTargetActions::Clear_Store);
 	RHICmdList.BeginRenderPass(PassInfo, TEXT("GenerateMeshMask"));
-	// #TODO
-	//DrawClearQuad(RHICmdList, FLinearColor::Transparent);
-	FOnlyPosVertexDeclaration VertexDeclaration;
-	VertexDeclaration.InitRHI();
 	FGraphicsPipelineStateInitializer GraphicPSPoint;
 	RHICmdList.ApplyCachedRenderTargets(GraphicPSPoint);
 	GraphicPSPoint.DepthStencilState = TStaticDepthStencilState<false, CF_Always>::GetRHI();
 	GraphicPSPoint.BlendState = TStaticBlendState<CW_RGBA, BO_Max, BF_One, BF_One, BO_Max, BF_One, BF_One, CW_RGBA, BO_Max, BF_One, BF_One, BO_Max, BF_One, BF_One>::GetRHI();
 	GraphicPSPoint.RasterizerState = TStaticRasterizerState<>::GetRHI();
 	GraphicPSPoint.PrimitiveType = PT_TriangleList;
-	GraphicPSPoint.BoundShaderState.VertexDeclarationRHI = VertexDeclaration.VertexDeclarationRHI;
+	GraphicPSPoint.BoundShaderState.VertexDeclarationRHI = GOnlyPosVertexDeclaration.VertexDeclarationRHI;
 	GraphicPSPoint.BoundShaderState.VertexShaderRHI = VertexShader.GetVertexShader();
 	GraphicPSPoint.BoundShaderState.PixelShaderRHI = PixelShader.GetPixelShader();
 	SetGraphicsPipelineState(RHICmdList, GraphicPSPoint);
 
 	VertexShader->SetParameters(RHICmdList, ViewProjMatrix);
 	PixelShader->SetParameters(RHICmdList, TextureSize);
-	RHICmdList.SetStreamSource(0, VertexBuffer, 0);
+	RHICmdList.SetStreamSource(0, MeshBuffers.VertexBuffer, 0);
 	RHICmdList.SetStreamSource(1, MeshModelInstancedVB, 0);
-	RHICmdList.DrawIndexedPrimitive(IndexBuffer, 0, 0, Indices.GetNumIndices(), 0, Indices.GetNumIndices() / 3, ModelInstance.Num());
-	//RHICmdList.CopyToResolveTarget(MaskRT->GetRenderTargetItem().TargetableTexture, MaskRT->GetRenderTargetItem().ShaderResourceTexture, FResolveRect(0, 0, TextureSize, TextureSize));
-	//MaskRT->GetRenderTargetItem().TargetableTexture;
-	//FGenerateMips::Execute(RHICmdList, MaskRT->GetRenderTargetItem().TargetableTexture);
-	//RHICmdList.GenerateMips(MaskRT->GetRenderTargetItem().TargetableTexture);
-
-	VertexBuffer.SafeRelease();
-	IndexBuffer.SafeRelease();
+	RHICmdList.DrawIndexedPrimitive(MeshBuffers.IndexBuffer, 0, 0, MeshBuffers.NumIndices, 0, MeshBuffers.NumIndices / 3, ModelInstance.Num());
+
 	MeshModelInstancedVB.SafeRelease();
 
 	RHICmdList.EndRenderPass();
+}
 
+/**
+ * Run the jump flood chain on the masks and merge the result into atlas, TileCount is the tile count per side of the masks,
+ * the flood never crosses tiles, so all tiles are processed by the same passes.
+ */
+static void GenerateDistanceFieldAtlas(FRHICommandListImmediate& RHICmdList, ERHIFeatureLevel::Type FeatureLevel, TRefCountPtr<IPooledRenderTarget> MaskRTs[2], uint32 TextureSize, uint32 TileCount, uint32 TileIndex, TRefCountPtr<IPooledRenderTarget>& MergedDistanceFieldRT, uint32 AtlasSize)
+{
+	const uint32 TileSize = TextureSize / TileCount;
 	FVector2D DFSize(16, 16);
 	TRefCountPtr<IPooledRenderTarget> TempMaskRT0;
 	TRefCountPtr<IPooledRenderTarget> TempMaskRT1;
 	FPooledRenderTargetDesc DFDesc(FPooledRenderTargetDesc::Create2DDesc(FIntPoint(TextureSize, TextureSize), PF_A32B32G32R32F, FClearValueBinding::Transparent, TexCreate_None, TexCreate_RenderTargetable, false));
 	GRenderTargetPool.FindFreeElement(RHICmdList, DFDesc, TempMaskRT0, TEXT("TempMaskRT0"));
 	GRenderTargetPool.FindFreeElement(RHICmdList, DFDesc, TempMaskRT1, TEXT("TempMaskRT1"));
-	uint32 MaxLevel = FMath::RoundToInt(FMath::Log2(TextureSize) + 0.5f);
+	// Steps only need to cover one tile
+	uint32 MaxLevel = FMath::RoundToInt(FMath::Log2(TileSize) + 0.5f);
 
 	FRHITexture* CurRenderTargets[2] = { TempMaskRT0->GetRenderTargetItem().TargetableTexture, TempMaskRT1->GetRenderTargetItem().TargetableTexture };
-	FRHITexture* CurMaskTextures[2] = { MaskRT0->GetRenderTargetItem().TargetableTexture, MaskRT1->GetRenderTargetItem().TargetableTexture };
-	//FRHICopyTextureInfo CopyInfo;
-	//RHICmdList.CopyTexture(CurMaskTexture, CurRenderTarget, CopyInfo);
+	FRHITexture* CurMaskTextures[2] = { MaskRTs[0]->GetRenderTargetItem().TargetableTexture, MaskRTs[1]->GetRenderTargetItem().TargetableTexture };
 
 	//Generate DistanceField Texture
 	for (uint32 i = 1; i <= MaxLevel; ++i)
 	{
-		DrawQuadWithPSParams<FGeneralShaderVS, FGenerateDistanceFieldShaderPS>(RHICmdList, FeatureLevel, TEXT("DistanceFieldTexturePass"), FIntPoint(TextureSize, TextureSize), 2, CurRenderTargets, i, DFSize, CurMaskTextures[0], CurMaskTextures[1]);
+		DrawQuadWithPSParams<FGeneralShaderVS, FGenerateDistanceFieldShaderPS>(RHICmdList, FeatureLevel, TEXT("DistanceFieldTexturePass"), FIntPoint(TextureSize, TextureSize), 2, CurRenderTargets, i, DFSize, (float)TileCount, CurMaskTextures[0], CurMaskTextures[1]);
 		Swap(CurRenderTargets, CurMaskTextures);
 	}
 
@@ -708,18 +724,18 @@ void GenerateMeshMaskTexture(FRHICommandListImmediate& RHICmdList, ERHIFeatureLe
 	{
 		GRenderTargetPool.FindFreeElement(RHICmdList, DFDesc, UnsignedDistanceFieldRT, TEXT("UnsignedDistanceFieldRT"));
 		FRHITexture* RTs[] = { UnsignedDistanceFieldRT->GetRenderTargetItem().TargetableTexture };
-		DrawQuadWithPSParams<FGeneralShaderVS, FRevertToDistanceFieldShaderPS>(RHICmdList, FeatureLevel, TEXT("RevertDistanceFieldPass"), FIntPoint(TextureSize, TextureSize), 1, RTs, CurMaskTextures[0], CurMaskTextures[1]);
+		DrawQuadWithPSParams<FGeneralShaderVS, FRevertToDistanceFieldShaderPS>(RHICmdList, FeatureLevel, TEXT("RevertDistanceFieldPass"), FIntPoint(TextureSize, TextureSize), 1, RTs, (float)TileCount, CurMaskTextures[0], CurMaskTextures[1]);
 	}
 	
 	//Prepare to draw reverse DistanceField Texture value is 0-1
 	{
-		DrawQuadWithPSParams<FGeneralShaderVS, FReconstructAndReverseDistanceFieldShaderPS>(RHICmdList, FeatureLevel, TEXT("ReconstructAndReverseDistanceFieldPass"), FIntPoint(TextureSize, TextureSize), 2, CurMaskTextures, 1.f / TextureSize * 8.f, UnsignedDistanceFieldRT->GetRenderTargetItem().TargetableTexture);
+		DrawQuadWithPSParams<FGeneralShaderVS, FReconstructAndReverseDistanceFieldShaderPS>(RHICmdList, FeatureLevel, TEXT("ReconstructAndReverseDistanceFieldPass"), FIntPoint(TextureSize, TextureSize), 2, CurMaskTextures, 1.f / TileSize * 8.f, UnsignedDistanceFieldRT->GetRenderTargetItem().TargetableTexture);
 	}
 
 	//Generate reversed DistanceField Texture
 	for (uint32 i = 1; i <= MaxLevel; ++i)
 	{
-		DrawQuadWithPSParams<FGeneralShaderVS, FGenerateDistanceFieldShaderPS>(RHICmdList, FeatureLevel, TEXT("DistanceFieldTexturePass"), FIntPoint(TextureSize, TextureSize), 2, CurRenderTargets, i, DFSize, CurMaskTextures[0], CurMaskTextures[1]);
+		DrawQuadWithPSParams<FGeneralShaderVS, FGenerateDistanceFieldShaderPS>(RHICmdList, FeatureLevel, TEXT("DistanceFieldTexturePass"), FIntPoint(TextureSize, TextureSize), 2, CurRenderTargets, i, DFSize, (float)TileCount, CurMaskTextures[0], CurMaskTextures[1]);
 		Swap(CurRenderTargets, CurMaskTextures);
 	}
 
@@ -728,36 +744,121 @@ void GenerateMeshMaskTexture(FRHICommandListImmediate& RHICmdList, ERHIFeatureLe
 	{
 		GRenderTargetPool.FindFreeElement(RHICmdList, DFDesc, SignedDistanceFieldRT, TEXT("SignedDistanceFieldRT"));
 		FRHITexture* RTs[] = { SignedDistanceFieldRT->GetRenderTargetItem().TargetableTexture };
-		DrawQuadWithPSParams<FGeneralShaderVS, FRevertToDistanceFieldShaderPS>(RHICmdList, FeatureLevel, TEXT("RevertDistanceFieldPass"), FIntPoint(TextureSize, TextureSize), 1, RTs, CurMaskTextures[0], CurMaskTextures[1]);
+		DrawQuadWithPSParams<FGeneralShaderVS, FRevertToDistanceFieldShaderPS>(RHICmdList, FeatureLevel, TEXT("RevertDistanceFieldPass"), FIntPoint(TextureSize, TextureSize), 1, RTs, (float)TileCount, CurMaskTextures[0], CurMaskTextures[1]);
 	}
 	
 	//Merge two distance field 
-	TRefCountPtr<IPooledRenderTarget> MergedDistanceFieldRT;
 	{
-		FPooledRenderTargetDesc MDesc(FPooledRenderTargetDesc::Create2DDesc(FIntPoint(TextureSize * 4, TextureSize * 4), /*PF_A32B32G32R32F*/ PF_R32_UINT, FClearValueBinding::Transparent, TexCreate_None, TexCreate_RenderTargetable | TexCreate_UAV, false));
+		FPooledRenderTargetDesc MDesc(FPooledRenderTargetDesc::Create2DDesc(FIntPoint(AtlasSize, AtlasSize), /*PF_A32B32G32R32F*/ PF_R32_UINT, FClearValueBinding::Transparent, TexCreate_None, TexCreate_RenderTargetable | TexCreate_UAV, false));
 		GRenderTargetPool.FindFreeElement(RHICmdList, MDesc, MergedDistanceFieldRT, TEXT("MergedDistanceFieldRT"));
-		//FRHITexture* FinalRenderTargets[] = { MergedDistanceFieldRT->GetRenderTargetItem().TargetableTexture };
 
 		RHICmdList.BeginComputePass(TEXT("MergeToAtlas"));
 		TShaderMapRef<FMergeToAtlasCS> MergeCS(GetGlobalShaderMap(FeatureLevel));
 		FRHIComputeShader* ShaderRHI = MergeCS.GetComputeShader();
 		RHICmdList.SetComputeShader(ShaderRHI);
 
-		//RHICmdList.TransitionResource(EResourceTransitionAccess::EReadable, EResourceTransitionPipeline::EComputeToCompute, SignedDistanceFieldRT->GetRenderTargetItem().TargetableTexture);
 		auto AtlasUAV = RHICreateUnorderedAccessView(MergedDistanceFieldRT->GetRenderTargetItem().TargetableTexture, 0);
 		MergeCS->SetParameters(RHICmdList, TileIndex, SignedDistanceFieldRT->GetRenderTargetItem().TargetableTexture, UnsignedDistanceFieldRT->GetRenderTargetItem().TargetableTexture, AtlasUAV);
 		DispatchComputeShader(RHICmdList, MergeCS, FMath::DivideAndRoundUp(TextureSize, THREADGROUP_SIZE), FMath::DivideAndRoundUp(TextureSize, THREADGROUP_SIZE), 1);
 		MergeCS->UnsetParameters(RHICmdList);
 		RHICmdList.EndComputePass();
-		//DrawQuadWithPSParams<FGeneralShaderVS, FMergeDistanceFieldShaderPS>(RHICmdList, FeatureLevel, TEXT("MergeDistanceFieldPass"), FIntPoint(TextureSize, TextureSize), 1, FinalRenderTargets, SignedDistanceFieldRT->GetRenderTargetItem().TargetableTexture, UnsignedDistanceFieldRT->GetRenderTargetItem().TargetableTexture);
-
-		MergedDistanceFieldTexture = MergedDistanceFieldRT->GetRenderTargetItem().TargetableTexture;
 	}
+}
+#endif
+
+void GenerateMeshMaskTexture(FRHICommandListImmediate& RHICmdList, ERHIFeatureLevel::Type FeatureLevel, class UStaticMesh* StaticMesh, FRHITexture*& MergedDistanceFieldTexture, class UTextureRenderTarget* OutputRenderTarget, uint32 TileIndex, float StartDegree, uint32 TextureSize)
+{
+	check(IsInRenderingThread());
+	
+#if GENERATE_TEXTURE_DF
+	if (!StaticMesh)return;
+
+	FStaticMeshLODResources& LODModel = StaticMesh->RenderData->LODResources[0];
+	FBox MeshBox;
+	const FMatrix ViewProjMatrix = GetMaskViewProjMatrix(StaticMesh->RenderData->Bounds, MeshBox);
+
+	TArray<FDrawMaskInstance> ModelInstance;
+	AddTileInstances(ModelInstance, MeshBox, StartDegree, FVector4(1.f, 1.f, 0.f, 0.f));
+
+	FMaskMeshBuffers MeshBuffers;
+	CreateMaskMeshBuffers(LODModel, MeshBuffers);
+	
+	TRefCountPtr<IPooledRenderTarget> MaskRTs[2];
+	FPooledRenderTargetDesc Desc(FPooledRenderTargetDesc::Create2DDesc(FIntPoint(TextureSize, TextureSize), PF_A32B32G32R32F, FClearValueBinding::Transparent, TexCreate_GenerateMipCapable, TexCreate_RenderTargetable | TexCreate_ShaderResource, false));
+	//Desc.NumSamples = 4;  //can not open mipmap and multisample simultaneously
+	GRenderTargetPool.FindFreeElement(RHICmdList, Desc, MaskRTs[0], TEXT("MaskRT0"));
+	GRenderTargetPool.FindFreeElement(RHICmdList, Desc, MaskRTs[1], TEXT("MaskRT1"));
 	
-	//
+	FRHITexture* ColorRTs[2] = { MaskRTs[0]->GetRenderTargetItem().TargetableTexture, MaskRTs[1]->GetRenderTargetItem().TargetableTexture };
+	DrawMeshMask(RHICmdList, FeatureLevel, MeshBuffers, ModelInstance, ViewProjMatrix, TextureSize, ColorRTs);
+	MeshBuffers.VertexBuffer.SafeRelease();
+	MeshBuffers.IndexBuffer.SafeRelease();
+
+	TRefCountPtr<IPooledRenderTarget> MergedDistanceFieldRT;
+	GenerateDistanceFieldAtlas(RHICmdList, FeatureLevel, MaskRTs, TextureSize, 1, TileIndex, MergedDistanceFieldRT, TextureSize * 4);
+	MergedDistanceFieldTexture = MergedDistanceFieldRT->GetRenderTargetItem().TargetableTexture;
 
 	FRHICopyTextureInfo CopyInfo;
 	if (OutputRenderTarget)
 		RHICmdList.CopyTexture(MergedDistanceFieldRT->GetRenderTargetItem().TargetableTexture, OutputRenderTarget->GetRenderTargetResource()->TextureRHI, CopyInfo);
 #endif
 }
+
+void GenerateMeshMaskAtlas(FRHICommandListImmediate& RHICmdList, ERHIFeatureLevel::Type FeatureLevel, class UStaticMesh* StaticMesh, FRHITexture*& MergedDistanceFieldTexture, class UTextureRenderTarget* OutputRenderTarget, float StartDegree, float StepDegree, uint32 TextureSize)
+{
+	check(IsInRenderingThread());
+
+#if GENERATE_TEXTURE_DF
+	if (!StaticMesh)return;
+
+	if (!CVarShadowFakeryBatchedGPUBake.GetValueOnRenderThread())
+	{
+		for (uint32 i = 0; i < SHADOWFAKERY_ATLAS_TILE_COUNT * SHADOWFAKERY_ATLAS_TILE_COUNT; ++i)
+		{
+			GenerateMeshMaskTexture(RHICmdList, FeatureLevel, StaticMesh, MergedDistanceFieldTexture, OutputRenderTarget, i, StartDegree + StepDegree * i, TextureSize);
+		}
+		return;
+	}
+
+	const uint32 TileCount = SHADOWFAKERY_ATLAS_TILE_COUNT;
+	const uint32 AtlasSize = TextureSize * TileCount;
+
+	FStaticMeshLODResources& LODModel = StaticMesh->RenderData->LODResources[0];
+	FBox MeshBox;
+	const FMatrix ViewProjMatrix = GetMaskViewProjMatrix(StaticMesh->RenderData->Bounds, MeshBox);
+
+	// Every tile is drawn as 4 instances into its own viewport of atlas, tile 0 is at top left like MergeToAtlasCS
+	TArray<FDrawMaskInstance> ModelInstance;
+	ModelInstance.Reserve(TileCount * TileCount * 4);
+	const float TileScale = 1.f / TileCount;
+	for (uint32 i = 0; i < TileCount * TileCount; ++i)
+	{
+		const float BiasX = -1.f + TileScale * (2 * (i % TileCount) + 1);
+		const float BiasY = 1.f - TileScale * (2 * (i / TileCount) + 1);
+		AddTileInstances(ModelInstance, MeshBox, StartDegree + StepDegree * i, FVector4(TileScale, TileScale, BiasX, BiasY));
+	}
+
+	// Mesh buffers are uploaded only once for all tiles
+	FMaskMeshBuffers MeshBuffers;
+	CreateMaskMeshBuffers(LODModel, MeshBuffers);
+
+	TRefCountPtr<IPooledRenderTarget> MaskRTs[2];
+	FPooledRenderTargetDesc Desc(FPooledRenderTargetDesc::Create2DDesc(FIntPoint(AtlasSize, AtlasSize), PF_A32B32G32R32F, FClearValueBinding::Transparent, TexCreate_None, TexCreate_RenderTargetable | TexCreate_ShaderResource, false));
+	GRenderTargetPool.FindFreeElement(RHICmdList, Desc, MaskRTs[0], TEXT("MaskAtlasRT0"));
+	GRenderTargetPool.FindFreeElement(RHICmdList, Desc, MaskRTs[1], TEXT("MaskAtlasRT1"));
+
+	FRHITexture* ColorRTs[2] = { MaskRTs[0]->GetRenderTargetItem().TargetableTexture, MaskRTs[1]->GetRenderTargetItem().TargetableTexture };
+	DrawMeshMask(RHICmdList, FeatureLevel, MeshBuffers, ModelInstance, ViewProjMatrix, AtlasSize, ColorRTs);
+	MeshBuffers.VertexBuffer.SafeRelease();
+	MeshBuffers.IndexBuffer.SafeRelease();
+
+	// The masks are already laid out as atlas, so it is merged as a single tile
+	TRefCountPtr<IPooledRenderTarget> MergedDistanceFieldRT;
+	GenerateDistanceFieldAtlas(RHICmdList, FeatureLevel, MaskRTs, AtlasSize, TileCount, 0, MergedDistanceFieldRT, AtlasSize);
+	MergedDistanceFieldTexture = MergedDistanceFieldRT->GetRenderTargetItem().TargetableTexture;
+
+	FRHICopyTextureInfo CopyInfo;
+	if (OutputRenderTarget)
+		RHICmdList.CopyTexture(MergedDistanceFieldRT->GetRenderTargetItem().TargetableTexture, OutputRenderTarget->GetRenderTargetResource()->TextureRHI, CopyInfo);
+#endif
+}
\ No newline at end of file
@@ -0,0 +1,215 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ShadowFakeryBatchBaker.h"
+#include "GenerateDistanceFieldTexture.h"
+#include "StaticMeshResources.h"
+#include "Engine/StaticMesh.h"
+#include "Engine/Texture2D.h"
+#include "Materials/MaterialInterface.h"
+#include "FoliageType_InstancedStaticMesh.h"
+#include "Misc/SecureHash.h"
+#include "Misc/Crc.h"
+#include "Misc/PackageName.h"
+#include "Misc/ScopedSlowTask.h"
+#include "Async/ParallelFor.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogShadowFakeryBake, Log, All);
+
+// Increase it when bake algorithm changes, so all cached textures are baked again
+static const uint32 ShadowFakeryBakeVersion = 1;
+
+struct FShadowFakeryBakeJob
+{
+	UStaticMesh* StaticMesh = nullptr;
+	FString PackageName;
+	FString BakeHash;
+	TArray<FColor> Pixels;
+	int32 TextureSize = 0;
+	bool bSucceeded = false;
+};
+
+FString UShadowFakeryBatchBaker::ComputeBakeHash(UStaticMesh* StaticMesh, const FShadowFakeryBakeSettings& Settings)
+{
+	if (!StaticMesh || !StaticMesh->RenderData || StaticMesh->RenderData->LODResources.Num() == 0)
+		return FString();
+
+	const FStaticMeshLODResources& LODModel = StaticMesh->RenderData->LODResources[0];
+	const FPositionVertexBuffer& PositionVertexBuffer = LODModel.VertexBuffers.PositionVertexBuffer;
+	TArray<uint32> Indices;
+	LODModel.IndexBuffer.GetCopy(Indices);
+
+	FSHA1 HashState;
+	HashState.Update((const uint8*)&ShadowFakeryBakeVersion, sizeof(ShadowFakeryBakeVersion));
+	for (uint32 i = 0; i < PositionVertexBuffer.GetNumVertices(); ++i)
+	{
+		const FVector& Position = PositionVertexBuffer.VertexPosition(i);
+		HashState.Update((const uint8*)&Position, sizeof(FVector));
+	}
+	HashState.Update((const uint8*)Indices.GetData(), Indices.Num() * sizeof(uint32));
+
+	// Blend mode of materials decides which triangles are traced
+	for (const FStaticMaterial& StaticMaterial : StaticMesh->StaticMaterials)
+	{
+		const uint8 BlendMode = StaticMaterial.MaterialInterface ? (uint8)StaticMaterial.MaterialInterface->GetBlendMode() : (uint8)BLEND_Opaque;
+		HashState.Update(&BlendMode, sizeof(BlendMode));
+	}
+
+	const uint8 bUseGPU = Settings.bUseGPU ? 1 : 0;
+	const uint8 bCPUReferenceAtlas = !Settings.bUseGPU && Settings.bCPUReferenceAtlas ? 1 : 0;
+	HashState.Update((const uint8*)&Settings.DistanceFieldSize, sizeof(Settings.DistanceFieldSize));
+	HashState.Update((const uint8*)&Settings.StartDegree, sizeof(Settings.StartDegree));
+	HashState.Update((const uint8*)&Settings.MakeDFRadius, sizeof(Settings.MakeDFRadius));
+	HashState.Update(&bUseGPU, sizeof(bUseGPU));
+	HashState.Update(&bCPUReferenceAtlas, sizeof(bCPUReferenceAtlas));
+	HashState.Final();
+
+	FSHAHash Hash;
+	HashState.GetHash(Hash.Hash);
+	return Hash.ToString();
+}
+
+FString UShadowFakeryBatchBaker::GetTexturePackageName(UStaticMesh* StaticMesh, const FShadowFakeryBakeSettings& Settings)
+{
+	FString OutputPath = Settings.OutputPath;
+	OutputPath.RemoveFromEnd(TEXT("/"));
+	// Meshes in different folders can have the same name, the crc of the full path keeps their textures apart
+	const uint32 PathCrc = FCrc::StrCrc32(*StaticMesh->GetPathName());
+	return OutputPath / FString::Printf(TEXT("Tex_ShadowFakery_%s_%08X"), *StaticMesh->GetName(), PathCrc);
+}
+
+int32 UShadowFakeryBatchBaker::BakeStaticMeshes(const TArray<UStaticMesh*>& StaticMeshes, const FShadowFakeryBakeSettings& Settings, TArray<UTexture2D*>& OutTextures)
+{
+	TArray<FShadowFakeryBakeJob> Jobs;
+	// Several entries can share one mesh (foliage types), they are baked once
+	TMap<UStaticMesh*, UTexture2D*> MeshTextures;
+
+	for (UStaticMesh* StaticMesh : StaticMeshes)
+	{
+		if (!StaticMesh || !StaticMesh->RenderData)
+			continue;
+
+		if (MeshTextures.Contains(StaticMesh))
+			continue;
+		MeshTextures.Add(StaticMesh, nullptr);
+
+		const FString PackageName = GetTexturePackageName(StaticMesh, Settings);
+		const FString BakeHash = ComputeBakeHash(StaticMesh, Settings);
+
+		if (!Settings.bForceRebake && FPackageName::DoesPackageExist(PackageName))
+		{
+			const FString ObjectPath = PackageName + TEXT(".") + FPackageName::GetLongPackageAssetName(PackageName);
+			UTexture2D* CachedTexture = LoadObject<UTexture2D>(nullptr, *ObjectPath, nullptr, LOAD_NoWarn | LOAD_Quiet);
+			if (CachedTexture && UGenerateDistanceFieldTexture::GetDistanceFieldTextureBakeHash(CachedTexture) == BakeHash)
+			{
+				UE_LOG(LogShadowFakeryBake, Verbose, TEXT("%s is up to date, skip it"), *StaticMesh->GetName());
+				MeshTextures[StaticMesh] = CachedTexture;
+				continue;
+			}
+		}
+
+		FShadowFakeryBakeJob& Job = Jobs.AddDefaulted_GetRef();
+		Job.StaticMesh = StaticMesh;
+		Job.PackageName = PackageName;
+		Job.BakeHash = BakeHash;
+	}
+
+	UE_LOG(LogShadowFakeryBake, Log, TEXT("Baking %d of %d ShadowFakery textures"), Jobs.Num(), StaticMeshes.Num());
+
+	int32 BakedCount = 0;
+	if (Settings.bUseGPU && Settings.bAsyncReadback)
+	{
+		// Every readback has its own staging texture, so all meshes can be queued at once
+		for (FShadowFakeryBakeJob& Job : Jobs)
+		{
+			const FString MeshName = Job.StaticMesh->GetName();
+			const bool bQueued = UGenerateDistanceFieldTexture::BakeDistanceFieldTextureAsync(Job.StaticMesh, Settings.DistanceFieldSize, Settings.StartDegree, Job.PackageName, Job.BakeHash, FOnShadowFakeryBakeCompleted::CreateLambda([MeshName](UTexture2D* Texture)
+			{
+				if (!Texture)
+				{
+					UE_LOG(LogShadowFakeryBake, Warning, TEXT("Failed to bake ShadowFakery texture of %s"), *MeshName);
+				}
+			}));
+			if (!bQueued)
+			{
+				UE_LOG(LogShadowFakeryBake, Warning, TEXT("Failed to start ShadowFakery bake of %s"), *MeshName);
+			}
+			BakedCount += bQueued ? 1 : 0;
+		}
+		Jobs.Empty();
+	}
+
+	FScopedSlowTask SlowTask(Jobs.Num() * 2, NSLOCTEXT("ShadowFakery", "BatchBakeShadowFakery", "Baking ShadowFakery Textures"));
+	SlowTask.MakeDialog();
+
+	// CPU jobs run on worker threads, console variables can only be read here
+	const FShadowFakeryCPUBakeOptions CPUBakeOptions = FShadowFakeryCPUBakeOptions::FromConsoleVariables();
+
+	auto BakeJob = [&Jobs, &Settings, &CPUBakeOptions](int32 JobIndex)
+	{
+		FShadowFakeryBakeJob& Job = Jobs[JobIndex];
+		if (!Settings.bUseGPU && Settings.bCPUReferenceAtlas)
+		{
+			Job.bSucceeded = UGenerateDistanceFieldTexture::BakeDistanceFieldAtlasCPU(Job.StaticMesh, Settings.DistanceFieldSize, Settings.StartDegree, CPUBakeOptions, Job.Pixels, Job.TextureSize);
+			return;
+		}
+		Job.bSucceeded = UGenerateDistanceFieldTexture::BakeDistanceFieldPixels(Job.StaticMesh, nullptr, Settings.DistanceFieldSize, Settings.StartDegree, Settings.MakeDFRadius, Settings.bUseGPU, CPUBakeOptions, Job.Pixels, Job.TextureSize);
+	};
+
+	if (Settings.bUseGPU)
+	{
+		for (int32 JobIndex = 0; JobIndex < Jobs.Num(); ++JobIndex)
+		{
+			SlowTask.EnterProgressFrame(1.f, FText::FromString(Jobs[JobIndex].StaticMesh->GetName()));
+			BakeJob(JobIndex);
+		}
+	}
+	else
+	{
+		SlowTask.EnterProgressFrame(Jobs.Num());
+		ParallelFor(Jobs.Num(), BakeJob, CPUBakeOptions.bForceSingleThread);
+	}
+
+	// Assets can only be created on game thread
+	for (FShadowFakeryBakeJob& Job : Jobs)
+	{
+		SlowTask.EnterProgressFrame(1.f, FText::FromString(Job.PackageName));
+		if (!Job.bSucceeded)
+		{
+			UE_LOG(LogShadowFakeryBake, Warning, TEXT("Failed to bake ShadowFakery texture of %s"), *Job.StaticMesh->GetName());
+			continue;
+		}
+
+		if (UTexture2D* Texture = UGenerateDistanceFieldTexture::SaveDistanceFieldTexture(Job.PackageName, Job.TextureSize, Job.Pixels, Job.BakeHash))
+		{
+			MeshTextures[Job.StaticMesh] = Texture;
+			++BakedCount;
+		}
+		// Release pixels early, library may have hundreds of meshes
+		Job.Pixels.Empty();
+	}
+
+	OutTextures.Init(nullptr, StaticMeshes.Num());
+	for (int32 MeshIndex = 0; MeshIndex < StaticMeshes.Num(); ++MeshIndex)
+	{
+		if (UTexture2D** Texture = MeshTextures.Find(StaticMeshes[MeshIndex]))
+		{
+			OutTextures[MeshIndex] = *Texture;
+		}
+	}
+
+	return BakedCount;
+}
+
+int32 UShadowFakeryBatchBaker::BakeFoliageTypes(const TArray<UFoliageType*>& FoliageTypes, const FShadowFakeryBakeSettings& Settings, TArray<UTexture2D*>& OutTextures)
+{
+	TArray<UStaticMesh*> StaticMeshes;
+	StaticMeshes.Reserve(FoliageTypes.Num());
+	for (UFoliageType* FoliageType : FoliageTypes)
+	{
+		UFoliageType_InstancedStaticMesh* MeshFoliageType = Cast<UFoliageType_InstancedStaticMesh>(FoliageType);
+		StaticMeshes.Add(MeshFoliageType ? MeshFoliageType->GetStaticMesh() : nullptr);
+	}
+
+	return BakeStaticMeshes(StaticMeshes, Settings, OutTextures);
+}
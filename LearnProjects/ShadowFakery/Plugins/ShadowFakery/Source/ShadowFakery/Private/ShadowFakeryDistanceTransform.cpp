@@ -0,0 +1,161 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ShadowFakeryDistanceTransform.h"
+#include "Async/ParallelFor.h"
+
+// Used as infinity, it still keeps the math of the envelope finite
+static const float DistanceTransformInfinity = 1e20f;
+
+/**
+ * 1D squared distance transform of sampled function, compute the lower envelope of parabolas rooted at every sample.
+ * Locations and Boundaries are scratch buffers, they should have Num and Num + 1 elements.
+ */
+static void DistanceTransform1D(const float* Function, float* OutDistance, int32 Num, int32* Locations, float* Boundaries)
+{
+	int32 K = 0;
+	Locations[0] = 0;
+	Boundaries[0] = -DistanceTransformInfinity;
+	Boundaries[1] = DistanceTransformInfinity;
+
+	auto Intersection = [Function, Locations](int32 Q, int32 CurK)
+	{
+		const int32 V = Locations[CurK];
+		return ((Function[Q] + Q * Q) - (Function[V] + V * V)) / (2.f * Q - 2.f * V);
+	};
+
+	for (int32 Q = 1; Q < Num; ++Q)
+	{
+		float S = Intersection(Q, K);
+		while (S <= Boundaries[K])
+		{
+			--K;
+			S = Intersection(Q, K);
+		}
+		++K;
+		Locations[K] = Q;
+		Boundaries[K] = S;
+		Boundaries[K + 1] = DistanceTransformInfinity;
+	}
+
+	K = 0;
+	for (int32 Q = 0; Q < Num; ++Q)
+	{
+		while (Boundaries[K + 1] < Q)
+		{
+			++K;
+		}
+		const int32 V = Locations[K];
+		OutDistance[Q] = (Q - V) * (Q - V) + Function[V];
+	}
+}
+
+/** Run 1D transform along columns then along rows for Count fields stored interleaved, Fields[Texel * Count + Field] */
+static void DistanceTransform2D(int32 SizeX, int32 SizeY, int32 Count, TArray<float>& Fields, bool bForceSingleThread)
+{
+	// Columns
+	ParallelFor(SizeX, [&](int32 X)
+	{
+		TArray<float> Function, Distance, Boundaries;
+		TArray<int32> Locations;
+		Function.SetNumUninitialized(SizeY);
+		Distance.SetNumUninitialized(SizeY);
+		Boundaries.SetNumUninitialized(SizeY + 1);
+		Locations.SetNumUninitialized(SizeY);
+
+		for (int32 Field = 0; Field < Count; ++Field)
+		{
+			for (int32 Y = 0; Y < SizeY; ++Y)
+			{
+				Function[Y] = Fields[(Y * SizeX + X) * Count + Field];
+			}
+			DistanceTransform1D(Function.GetData(), Distance.GetData(), SizeY, Locations.GetData(), Boundaries.GetData());
+			for (int32 Y = 0; Y < SizeY; ++Y)
+			{
+				Fields[(Y * SizeX + X) * Count + Field] = Distance[Y];
+			}
+		}
+	}, bForceSingleThread);
+
+	// Rows
+	ParallelFor(SizeY, [&](int32 Y)
+	{
+		TArray<float> Function, Distance, Boundaries;
+		TArray<int32> Locations;
+		Function.SetNumUninitialized(SizeX);
+		Distance.SetNumUninitialized(SizeX);
+		Boundaries.SetNumUninitialized(SizeX + 1);
+		Locations.SetNumUninitialized(SizeX);
+
+		for (int32 Field = 0; Field < Count; ++Field)
+		{
+			for (int32 X = 0; X < SizeX; ++X)
+			{
+				Function[X] = Fields[(Y * SizeX + X) * Count + Field];
+			}
+			DistanceTransform1D(Function.GetData(), Distance.GetData(), SizeX, Locations.GetData(), Boundaries.GetData());
+			for (int32 X = 0; X < SizeX; ++X)
+			{
+				Fields[(Y * SizeX + X) * Count + Field] = Distance[X];
+			}
+		}
+	}, bForceSingleThread);
+}
+
+void FShadowFakeryDistanceTransform::ComputeSquaredDistance(int32 SizeX, int32 SizeY, TFunctionRef<bool(int32)> IsFeature, TArray<float>& OutSquaredDistance, bool bForceSingleThread)
+{
+	OutSquaredDistance.SetNumUninitialized(SizeX * SizeY);
+	for (int32 Index = 0; Index < OutSquaredDistance.Num(); ++Index)
+	{
+		OutSquaredDistance[Index] = IsFeature(Index) ? 0.f : DistanceTransformInfinity;
+	}
+
+	DistanceTransform2D(SizeX, SizeY, 1, OutSquaredDistance, bForceSingleThread);
+}
+
+void FShadowFakeryDistanceTransform::ComputeSignedDistance(int32 SizeX, int32 SizeY, const TArray<FVector4>& Occupancy, float MaxRadius, TArray<FVector4>& OutSignedDistance, bool bForceSingleThread)
+{
+	check(Occupancy.Num() == SizeX * SizeY);
+	check(MaxRadius > 0.f);
+
+	// 8 fields per texel, for each channel the distance to occluded texels and the distance to unoccluded texels
+	static const int32 FieldCount = 8;
+	TArray<float> Fields;
+	Fields.SetNumUninitialized(Occupancy.Num() * FieldCount);
+	for (int32 Index = 0; Index < Occupancy.Num(); ++Index)
+	{
+		for (int32 Channel = 0; Channel < 4; ++Channel)
+		{
+			const bool bOccluded = Occupancy[Index][Channel] == 0.f;
+			Fields[Index * FieldCount + Channel * 2 + 0] = bOccluded ? 0.f : DistanceTransformInfinity;
+			Fields[Index * FieldCount + Channel * 2 + 1] = bOccluded ? DistanceTransformInfinity : 0.f;
+		}
+	}
+
+	DistanceTransform2D(SizeX, SizeY, FieldCount, Fields, bForceSingleThread);
+
+	OutSignedDistance.SetNumUninitialized(Occupancy.Num());
+	for (int32 Index = 0; Index < Occupancy.Num(); ++Index)
+	{
+		FVector4& SignedDistance = OutSignedDistance[Index];
+		for (int32 Channel = 0; Channel < 4; ++Channel)
+		{
+			const bool bOccluded = Occupancy[Index][Channel] == 0.f;
+			// Occluded texel measures to the nearest unoccluded texel and vice versa
+			const float SquaredDistance = Fields[Index * FieldCount + Channel * 2 + (bOccluded ? 1 : 0)];
+			const float Distance = FMath::Min(FMath::Sqrt(SquaredDistance), MaxRadius) / MaxRadius;
+			SignedDistance[Channel] = bOccluded ? -Distance : Distance;
+		}
+	}
+}
+
+void FShadowFakeryDistanceTransform::QuantizeToBGRA8(const TArray<FVector4>& SignedDistance, TArray<FColor>& OutColors)
+{
+	OutColors.SetNumUninitialized(SignedDistance.Num());
+	for (int32 Index = 0; Index < SignedDistance.Num(); ++Index)
+	{
+		// Same as "1.f - 0.5f * (Unsigned - Signed + 1.f)" then "uint(Color * 255.f)" in MergeToAtlasCS
+		const FVector4 Color = FVector4(1.f, 1.f, 1.f, 1.f) - (SignedDistance[Index] + FVector4(1.f, 1.f, 1.f, 1.f)) * 0.5f;
+		OutColors[Index] = FColor((uint8)(uint32)(Color.X * 255.f), (uint8)(uint32)(Color.Y * 255.f), (uint8)(uint32)(Color.Z * 255.f), (uint8)(uint32)(Color.W * 255.f));
+	}
+}
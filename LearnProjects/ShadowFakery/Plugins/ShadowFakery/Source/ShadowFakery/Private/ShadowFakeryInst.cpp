@@ -7,6 +7,7 @@
 #include "Engine/DirectionalLight.h"
 #include "Materials/MaterialInstanceDynamic.h"
 #include "GenerateDistanceFieldTexture.h"
+#include "ShadowFakeryBatchBaker.h"
 #include "ShadowFakeryStaticMeshComponent.h"
 #include "InstancedFoliageActor.h"
 #include "ShadowFakeryFoliageSMComponent.h"
@@ -22,6 +23,12 @@ static TAutoConsoleVariable<bool> CVarUseShadowFakery(
 	TEXT("b"),
 	ECVF_Default);
 
+static TAutoConsoleVariable<float> CVarShadowFakeryLightUpdateThreshold(
+	TEXT("r.ShadowFakery.LightUpdateThreshold"),
+	0.05f,
+	TEXT("Angle in degrees the light has to rotate before the shadow state is pushed to the shadow components again."),
+	ECVF_Default);
+
 // Sets default values
 AShadowFakeryInst::AShadowFakeryInst()
 {
@@ -38,8 +45,14 @@ AShadowFakeryInst::AShadowFakeryInst()
 	ShadowMaskCutOffset = 90.f;
 	SunYawParam = TEXT("SunYaw");
 	SunDirectionParam = TEXT("SunForwardDirection");
-	bHasInit = false;
+	ShadowCellSize = 8192.f;
+	ShadowCullDistance = 30000.f;
+	ShadowLength = 3000.f;
 	bSwitchShadowFakery = false;
+	LastLightDir = FVector::ZeroVector;
+	LastActorQuat = FQuat::Identity;
+	bLightStateDirty = true;
+	bShadowCellsDirty = true;
 }
 
 // Called when the game starts or when spawned
@@ -49,11 +62,77 @@ void AShadowFakeryInst::BeginPlay()
 	
 }
 
+void AShadowFakeryInst::PostRegisterAllComponents()
+{
+	Super::PostRegisterAllComponents();
+
+	// Also ticks in editor, so the delegates are bound with components instead of BeginPlay
+	if (!LevelAddedHandle.IsValid())
+	{
+		LevelAddedHandle = FWorldDelegates::LevelAddedToWorld.AddUObject(this, &AShadowFakeryInst::OnLevelChanged);
+		LevelRemovedHandle = FWorldDelegates::LevelRemovedFromWorld.AddUObject(this, &AShadowFakeryInst::OnLevelChanged);
+	}
+#if WITH_EDITOR
+	// Foliage tools modify the foliage actor and its components, detail panel edits and undo come as property changes
+	if (GIsEditor && !ObjectModifiedHandle.IsValid())
+	{
+		ObjectModifiedHandle = FCoreUObjectDelegates::OnObjectModified.AddUObject(this, &AShadowFakeryInst::OnFoliageObjectChanged);
+		ObjectPropertyChangedHandle = FCoreUObjectDelegates::OnObjectPropertyChanged.AddUObject(this, &AShadowFakeryInst::OnObjectPropertyChanged);
+	}
+#endif
+	bShadowCellsDirty = true;
+}
+
+void AShadowFakeryInst::PostUnregisterAllComponents()
+{
+	FWorldDelegates::LevelAddedToWorld.Remove(LevelAddedHandle);
+	FWorldDelegates::LevelRemovedFromWorld.Remove(LevelRemovedHandle);
+	LevelAddedHandle.Reset();
+	LevelRemovedHandle.Reset();
+#if WITH_EDITOR
+	FCoreUObjectDelegates::OnObjectModified.Remove(ObjectModifiedHandle);
+	FCoreUObjectDelegates::OnObjectPropertyChanged.Remove(ObjectPropertyChangedHandle);
+	ObjectModifiedHandle.Reset();
+	ObjectPropertyChangedHandle.Reset();
+#endif
+
+	Super::PostUnregisterAllComponents();
+}
+
+void AShadowFakeryInst::OnLevelChanged(ULevel* Level, UWorld* World)
+{
+	if (World == GetWorld())
+	{
+		bShadowCellsDirty = true;
+	}
+}
+
 #if WITH_EDITOR
 void AShadowFakeryInst::PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent)
 {
 	Super::PostEditChangeProperty(PropertyChangedEvent);
 }
+
+void AShadowFakeryInst::OnFoliageObjectChanged(UObject* Object)
+{
+	AInstancedFoliageActor* FoliageActor = Cast<AInstancedFoliageActor>(Object);
+	if (!FoliageActor)
+	{
+		UActorComponent* Component = Cast<UActorComponent>(Object);
+		FoliageActor = Component ? Cast<AInstancedFoliageActor>(Component->GetOwner()) : nullptr;
+	}
+
+	if (FoliageActor && FoliageActor->GetWorld() == GetWorld())
+	{
+		DirtyFoliageActors.Add(FoliageActor);
+		bShadowCellsDirty = true;
+	}
+}
+
+void AShadowFakeryInst::OnObjectPropertyChanged(UObject* Object, FPropertyChangedEvent& PropertyChangedEvent)
+{
+	OnFoliageObjectChanged(Object);
+}
 #endif
 
 // Called every frame
@@ -61,27 +140,15 @@ void AShadowFakeryInst::Tick(float DeltaTime)
 {
 	Super::Tick(DeltaTime);
 
-	AInstancedFoliageActor* FoliageActor = AInstancedFoliageActor::GetInstancedFoliageActorForCurrentLevel(GetWorld(), true);
-	TUniqueObj<FFoliageInfo>* CurFoliageInfo = FoliageActor->FoliageInfos.Find(CurFoliageType);
+	// Never create a foliage actor from tick, a level without foliage has nothing to switch
+	AInstancedFoliageActor* FoliageActor = AInstancedFoliageActor::GetInstancedFoliageActorForCurrentLevel(GetWorld(), false);
 	
-	if (CurFoliageInfo && !bHasInit && ShadowMeshCompentType)
+	if (CurFoliageType && ShadowMeshCompentType && bShadowCellsDirty)
 	{
-		FBox Box(FVector(-25200.f, -25200.f, 0.f), FVector(25200.f, 25200.f, 10000.f));
-		TArray<FTransform> OutTransforms;
-		FoliageActor->GetOverlappingBoxTransforms(CurFoliageType, Box, OutTransforms);
-		ShadowFakeryStaticMesh = NewObject<UShadowFakeryStaticMeshComponent>(this, ShadowMeshCompentType);
-		ShadowFakeryStaticMesh->RegisterComponent();
-		ShadowFakeryStaticMesh->NumCustomDataFloats = 5;
-		ShadowFakeryStaticMesh->SetWorldLocationAndRotation(FVector::ZeroVector, FRotator::ZeroRotator);
-
-		for (auto& Iter : OutTransforms)
-		{
-			ShadowFakeryStaticMesh->AddInstance(FTransform(Iter.GetRotation(), Iter.GetLocation() + FVector::UpVector * 20.f));
-		}
-		bHasInit = true;
+		UpdateShadowCells();
 	}
 
-	UShadowFakeryFoliageSMComponent* CurFoliage = FoliageActor->FindComponentByClass<UShadowFakeryFoliageSMComponent>();
+	UShadowFakeryFoliageSMComponent* CurFoliage = FoliageActor ? FoliageActor->FindComponentByClass<UShadowFakeryFoliageSMComponent>() : nullptr;
 	if (CurFoliage && bSwitchShadowFakery != CVarUseShadowFakery.GetValueOnGameThread())
 	{
 		if (!CVarUseShadowFakery.GetValueOnGameThread())
@@ -112,6 +179,19 @@ void AShadowFakeryInst::Tick(float DeltaTime)
 		}
 	}
 
+	if (SceneLight)
+	{
+		// Only push the state when the light or the actor rotates, so an idle sun costs nothing
+		const FVector CurLightDir = SceneLight->GetActorRotation().Vector();
+		const float ThresholdCos = FMath::Cos(FMath::DegreesToRadians(FMath::Max(CVarShadowFakeryLightUpdateThreshold.GetValueOnGameThread(), 0.f)));
+		if (!bLightStateDirty && FVector::DotProduct(CurLightDir, LastLightDir) >= ThresholdCos && GetActorQuat().Equals(LastActorQuat))
+			return;
+
+		LastLightDir = CurLightDir;
+		LastActorQuat = GetActorQuat();
+		bLightStateDirty = false;
+	}
+
 	if (SceneLight/* && MaterialInst*/)
 	{
 		const float OffsetRadian = FMath::DegreesToRadians(ShadowMaskCutOffset);
@@ -132,13 +212,9 @@ void AShadowFakeryInst::Tick(float DeltaTime)
 		const FVector LightSize = LightDir.GetSafeNormal2D() * FMath::Abs(FMath::Tan(FMath::DegreesToRadians(90.f - FMath::Abs(SunYaw))));
 		//ShadowMeshCompent->UpdateShadowState(LightSize, 1500, 1500);
 
-		const TArray<float> CustomData = { LightSize.X, LightSize.Y, SunYaw, 3000.f, 0 };
-		if (ShadowFakeryStaticMesh)
+		for (UShadowFakeryStaticMeshComponent* ShadowCell : AllShadowStaticMesh)
 		{
-			for (int32 i = 0; i < ShadowFakeryStaticMesh->GetInstanceCount(); ++i)
-			{
-				ShadowFakeryStaticMesh->SetCustomData(i, CustomData, true);
-			}
+			ShadowCell->SetShadowLightState(FVector2D(LightSize), SunYaw, ShadowLength);
 		}
 		
 		GSunYaw = SunYaw;
@@ -149,9 +225,105 @@ void AShadowFakeryInst::Tick(float DeltaTime)
 	}
 }
 
+void AShadowFakeryInst::UpdateShadowCells()
+{
+	// Every streamed level has its own foliage actor, cells are built when it is loaded and destroyed when it is unloaded
+	bShadowCellsDirty = false;
+#if WITH_EDITOR
+	// Edited foliage actors are built again from their current instances below
+	for (const TWeakObjectPtr<AInstancedFoliageActor>& FoliageActor : DirtyFoliageActors)
+	{
+		if (TArray<UShadowFakeryStaticMeshComponent*>* ShadowCells = FoliageShadowCells.Find(FoliageActor))
+		{
+			DestroyShadowCells(*ShadowCells);
+			FoliageShadowCells.Remove(FoliageActor);
+		}
+	}
+	DirtyFoliageActors.Reset();
+#endif
+
+	TSet<AInstancedFoliageActor*> LoadedFoliageActors;
+	for (TActorIterator<AInstancedFoliageActor> Iter(GetWorld()); Iter; ++Iter)
+	{
+		LoadedFoliageActors.Add(*Iter);
+		if (!FoliageShadowCells.Contains(*Iter))
+		{
+			BuildShadowCells(*Iter);
+		}
+	}
+
+	for (auto Iter = FoliageShadowCells.CreateIterator(); Iter; ++Iter)
+	{
+		if (Iter.Key().IsValid() && LoadedFoliageActors.Contains(Iter.Key().Get()))
+			continue;
+
+		DestroyShadowCells(Iter.Value());
+		Iter.RemoveCurrent();
+	}
+}
+
+void AShadowFakeryInst::DestroyShadowCells(TArray<UShadowFakeryStaticMeshComponent*>& ShadowCells)
+{
+	for (UShadowFakeryStaticMeshComponent* ShadowCell : ShadowCells)
+	{
+		AllShadowStaticMesh.Remove(ShadowCell);
+		ShadowCell->DestroyComponent();
+	}
+	ShadowCells.Reset();
+}
+
+void AShadowFakeryInst::BuildShadowCells(AInstancedFoliageActor* FoliageActor)
+{
+	TArray<UShadowFakeryStaticMeshComponent*>& ShadowCells = FoliageShadowCells.Add(FoliageActor);
+	if (!FoliageActor->FoliageInfos.Find(CurFoliageType))
+		return;
+
+	TArray<FTransform> OutTransforms;
+	FoliageActor->GetOverlappingBoxTransforms(CurFoliageType, FBox(FVector(-HALF_WORLD_MAX), FVector(HALF_WORLD_MAX)), OutTransforms);
+
+	// Bucket instances into square cells on XY, so every cell has tight bounds and is culled on its own
+	const float CellSize = FMath::Max(ShadowCellSize, 100.f);
+	TMap<FIntPoint, TArray<FTransform>> CellTransforms;
+	for (const FTransform& Iter : OutTransforms)
+	{
+		const FIntPoint CellCoord(FMath::FloorToInt(Iter.GetLocation().X / CellSize), FMath::FloorToInt(Iter.GetLocation().Y / CellSize));
+		CellTransforms.FindOrAdd(CellCoord).Add(FTransform(Iter.GetRotation(), Iter.GetLocation() + FVector::UpVector * 20.f));
+	}
+
+	for (auto& Cell : CellTransforms)
+	{
+		UShadowFakeryStaticMeshComponent* ShadowCell = NewObject<UShadowFakeryStaticMeshComponent>(this, ShadowMeshCompentType);
+		ShadowCell->SetupLightStateCustomData();
+		ShadowCell->SetWorldLocationAndRotation(FVector::ZeroVector, FRotator::ZeroRotator);
+		ShadowCell->SetCullDistance(ShadowCullDistance);
+		ShadowCell->SetVisibility(CVarUseShadowFakery.GetValueOnGameThread());
+		// Instances are added before register, so the render state is created only once
+		for (const FTransform& Transform : Cell.Value)
+		{
+			ShadowCell->AddShadowInstance(Transform);
+		}
+		ShadowCell->RegisterComponent();
+
+		ShadowCells.Add(ShadowCell);
+		AllShadowStaticMesh.Add(ShadowCell);
+	}
+
+	bLightStateDirty = true;
+}
+
 void AShadowFakeryInst::GenerateShadowDistanceField()
 {
-	if (ObjectMeshCompent)
-		UGenerateDistanceFieldTexture::GenerateDistanceFieldTexture(this, ObjectMeshCompent->GetStaticMesh(), nullptr, ShadowDistanceFieldSize, ShadowMaskCutOffset, 16.f, true);
+	if (ObjectMeshCompent && ObjectMeshCompent->GetStaticMesh())
+	{
+		FShadowFakeryBakeSettings Settings;
+		Settings.DistanceFieldSize = ShadowDistanceFieldSize;
+		Settings.StartDegree = ShadowMaskCutOffset;
+		Settings.MakeDFRadius = 16.f;
+		Settings.bUseGPU = true;
+		Settings.bAsyncReadback = true;
+
+		TArray<UTexture2D*> Textures;
+		UShadowFakeryBatchBaker::BakeStaticMeshes({ ObjectMeshCompent->GetStaticMesh() }, Settings, Textures);
+	}
 }
 
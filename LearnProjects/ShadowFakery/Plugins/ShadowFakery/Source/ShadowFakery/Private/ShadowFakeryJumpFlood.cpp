@@ -0,0 +1,217 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ShadowFakeryJumpFlood.h"
+#include "ShadowFakeryDistanceTransform.h"
+#include "Async/ParallelFor.h"
+
+// Same as the divisor in RevertToDistanceFieldShaderPS
+const float FShadowFakeryJumpFlood::MaxDistance = 0.1f;
+
+/** Seed uv of the 4 channels of every texel, same as the 2 mask targets, x and y are apart so a texel is loaded as 2 registers */
+struct FJumpFloodSeeds
+{
+	TArray<FVector4> X;
+	TArray<FVector4> Y;
+
+	void Init(int32 Num)
+	{
+		X.SetNumZeroed(Num);
+		Y.SetNumZeroed(Num);
+	}
+};
+
+/** One pass of FastStepJF, seed at (0, 0) is treated as no seed like GetBestCoordUV */
+static void JumpFloodPass(int32 Size, int32 StepWidth, const FJumpFloodSeeds& Source, FJumpFloodSeeds& Dest, bool bForceSingleThread)
+{
+	ParallelFor(Size, [&](int32 Y)
+	{
+		const VectorRegister Zero = VectorZero();
+		const VectorRegister CurUVY = VectorSetFloat1((Y + 0.5f) / Size);
+		for (int32 X = 0; X < Size; ++X)
+		{
+			const VectorRegister CurUVX = VectorSetFloat1((X + 0.5f) / Size);
+			VectorRegister BestDistanceSquared = VectorOne();
+			VectorRegister BestX = Zero;
+			VectorRegister BestY = Zero;
+
+			// Same order as the shader, so ties are resolved the same way
+			for (int32 OffsetY = -1; OffsetY <= 1; ++OffsetY)
+			{
+				const int32 SampleY = FMath::Clamp(Y + OffsetY * StepWidth, 0, Size - 1);
+				for (int32 OffsetX = -1; OffsetX <= 1; ++OffsetX)
+				{
+					const int32 SampleIndex = SampleY * Size + FMath::Clamp(X + OffsetX * StepWidth, 0, Size - 1);
+					const VectorRegister SeedX = VectorLoad(&Source.X[SampleIndex]);
+					const VectorRegister SeedY = VectorLoad(&Source.Y[SampleIndex]);
+					const VectorRegister DeltaX = VectorSubtract(SeedX, CurUVX);
+					const VectorRegister DeltaY = VectorSubtract(SeedY, CurUVY);
+					// Squared distance keeps the order of distance, so no sqrt is needed here
+					const VectorRegister DistanceSquared = VectorAdd(VectorMultiply(DeltaX, DeltaX), VectorMultiply(DeltaY, DeltaY));
+
+					const VectorRegister HasSeed = VectorBitwiseOr(VectorCompareNE(SeedX, Zero), VectorCompareNE(SeedY, Zero));
+					const VectorRegister IsCloser = VectorBitwiseAnd(VectorCompareGT(BestDistanceSquared, DistanceSquared), HasSeed);
+					BestDistanceSquared = VectorSelect(IsCloser, DistanceSquared, BestDistanceSquared);
+					BestX = VectorSelect(IsCloser, SeedX, BestX);
+					BestY = VectorSelect(IsCloser, SeedY, BestY);
+				}
+			}
+
+			VectorStore(BestX, &Dest.X[Y * Size + X]);
+			VectorStore(BestY, &Dest.Y[Y * Size + X]);
+		}
+	}, bForceSingleThread);
+}
+
+/** All levels of jump flood, the pass count is the same as GenerateDistanceFieldAtlas and the step width the same as FastStepJF */
+static void JumpFlood(int32 Size, FJumpFloodSeeds& Seeds, FJumpFloodSeeds& Scratch, bool bForceSingleThread)
+{
+	const int32 PassCount = FMath::RoundToInt(FMath::Log2(Size) + 0.5f);
+	const float ShaderMaxLevel = FMath::FloorToFloat(FMath::Log2(Size) + 0.5f);
+
+	for (int32 Level = 1; Level <= PassCount; ++Level)
+	{
+		const float ClampedLevel = FMath::Clamp(Level - 1.f, 0.f, ShaderMaxLevel);
+		const int32 StepWidth = FMath::FloorToInt(FMath::Exp2(ShaderMaxLevel - ClampedLevel) + 0.5f);
+		JumpFloodPass(Size, StepWidth, Seeds, Scratch, bForceSingleThread);
+		Swap(Seeds.X, Scratch.X);
+		Swap(Seeds.Y, Scratch.Y);
+	}
+}
+
+/** RevertToDistanceFieldShaderPS, distance to the seed divided by MaxDistance and clamped to 0-1 */
+static void RevertToDistance(int32 Size, const FJumpFloodSeeds& Seeds, TArray<FVector4>& OutDistance)
+{
+	OutDistance.SetNumUninitialized(Size * Size);
+	for (int32 Y = 0; Y < Size; ++Y)
+	{
+		const float CurUVY = (Y + 0.5f) / Size;
+		for (int32 X = 0; X < Size; ++X)
+		{
+			const float CurUVX = (X + 0.5f) / Size;
+			const int32 Index = Y * Size + X;
+			for (int32 Channel = 0; Channel < 4; ++Channel)
+			{
+				const float DeltaX = Seeds.X[Index][Channel] - CurUVX;
+				const float DeltaY = Seeds.Y[Index][Channel] - CurUVY;
+				OutDistance[Index][Channel] = FMath::Clamp(FMath::Sqrt(DeltaX * DeltaX + DeltaY * DeltaY) / FShadowFakeryJumpFlood::MaxDistance, 0.f, 1.f);
+			}
+		}
+	}
+}
+
+void FShadowFakeryJumpFlood::BakeTile(int32 TileSize, const TArray<FVector4>& Occupancy, TArray<FColor>& OutColors, bool bForceSingleThread)
+{
+	check(Occupancy.Num() == TileSize * TileSize);
+
+	FJumpFloodSeeds Seeds;
+	FJumpFloodSeeds Scratch;
+	Seeds.Init(Occupancy.Num());
+	Scratch.Init(Occupancy.Num());
+
+	// GenerateMeshMaskShaderPS, the covered texels store their uv, which is at the corner of texel not the center
+	for (int32 Y = 0; Y < TileSize; ++Y)
+	{
+		for (int32 X = 0; X < TileSize; ++X)
+		{
+			const int32 Index = Y * TileSize + X;
+			for (int32 Channel = 0; Channel < 4; ++Channel)
+			{
+				const bool bOccluded = Occupancy[Index][Channel] == 0.f;
+				Seeds.X[Index][Channel] = bOccluded ? (float)X / TileSize : 0.f;
+				Seeds.Y[Index][Channel] = bOccluded ? (float)Y / TileSize : 0.f;
+			}
+		}
+	}
+
+	JumpFlood(TileSize, Seeds, Scratch, bForceSingleThread);
+	TArray<FVector4> UnsignedDistance;
+	RevertToDistance(TileSize, Seeds, UnsignedDistance);
+
+	// ReconstructDistanceFieldShaderPS, texels far enough from the mesh become the seeds of the reversed field
+	const float DistanceOffset = 1.f / TileSize * 8.f;
+	for (int32 Y = 0; Y < TileSize; ++Y)
+	{
+		for (int32 X = 0; X < TileSize; ++X)
+		{
+			const int32 Index = Y * TileSize + X;
+			for (int32 Channel = 0; Channel < 4; ++Channel)
+			{
+				const bool bSeed = UnsignedDistance[Index][Channel] - DistanceOffset > 0.f;
+				Seeds.X[Index][Channel] = bSeed ? (X + 0.5f) / TileSize : 0.f;
+				Seeds.Y[Index][Channel] = bSeed ? (Y + 0.5f) / TileSize : 0.f;
+			}
+		}
+	}
+
+	JumpFlood(TileSize, Seeds, Scratch, bForceSingleThread);
+	TArray<FVector4> ReversedDistance;
+	RevertToDistance(TileSize, Seeds, ReversedDistance);
+
+	// MergeToAtlasCS encodes "Unsigned + (-Signed)" with the same quantization as the distance transform
+	TArray<FVector4> SignedDistance;
+	SignedDistance.SetNumUninitialized(Occupancy.Num());
+	for (int32 Index = 0; Index < SignedDistance.Num(); ++Index)
+	{
+		SignedDistance[Index] = UnsignedDistance[Index] - ReversedDistance[Index];
+	}
+	FShadowFakeryDistanceTransform::QuantizeToBGRA8(SignedDistance, OutColors);
+}
+
+void FShadowFakeryJumpFlood::CopyTileToAtlas(int32 TileSize, int32 TileIndex, const TArray<FColor>& TileColors, int32 AtlasSize, TArray<FColor>& AtlasColors)
+{
+	check(TileColors.Num() == TileSize * TileSize);
+	check(AtlasColors.Num() == AtlasSize * AtlasSize);
+
+	const int32 TileCountPerSide = AtlasSize / TileSize;
+	const int32 DestX = (TileIndex % TileCountPerSide) * TileSize;
+	const int32 DestY = (TileIndex / TileCountPerSide) * TileSize;
+	check(DestY + TileSize <= AtlasSize);
+
+	for (int32 Y = 0; Y < TileSize; ++Y)
+	{
+		FMemory::Memcpy(&AtlasColors[(DestY + Y) * AtlasSize + DestX], &TileColors[Y * TileSize], TileSize * sizeof(FColor));
+	}
+}
+
+FShadowFakeryCompareReport FShadowFakeryJumpFlood::Compare(int32 SizeX, const TArray<FColor>& Colors, const TArray<FColor>& Reference, int32 Tolerance)
+{
+	FShadowFakeryCompareReport Report;
+	Report.Tolerance = Tolerance;
+	if (Colors.Num() != Reference.Num() || SizeX <= 0)
+		return Report;
+
+	Report.NumTexels = Colors.Num();
+	int32 MaxError = -1;
+	uint64 ErrorSum = 0;
+	for (int32 Index = 0; Index < Colors.Num(); ++Index)
+	{
+		const FColor& Color = Colors[Index];
+		const FColor& ReferenceColor = Reference[Index];
+		const int32 Errors[4] = { FMath::Abs(Color.R - ReferenceColor.R), FMath::Abs(Color.G - ReferenceColor.G), FMath::Abs(Color.B - ReferenceColor.B), FMath::Abs(Color.A - ReferenceColor.A) };
+
+		bool bMismatched = false;
+		for (int32 Channel = 0; Channel < 4; ++Channel)
+		{
+			Report.MaxChannelError[Channel] = FMath::Max(Report.MaxChannelError[Channel], Errors[Channel]);
+			if (Errors[Channel] > MaxError)
+			{
+				MaxError = Errors[Channel];
+				Report.MaxErrorTexel = FIntPoint(Index % SizeX, Index / SizeX);
+			}
+			bMismatched |= Errors[Channel] > Tolerance;
+			ErrorSum += Errors[Channel];
+		}
+		Report.NumMismatched += bMismatched ? 1 : 0;
+	}
+
+	Report.MeanError = (double)ErrorSum / (Report.NumTexels * 4.0);
+	return Report;
+}
+
+FString FShadowFakeryCompareReport::ToString() const
+{
+	return FString::Printf(TEXT("%d of %d texels beyond tolerance %d (%.3f%%), max error R %d G %d B %d A %d at (%d, %d), mean error %.4f"),
+		NumMismatched, NumTexels, Tolerance, NumTexels > 0 ? 100.0 * NumMismatched / NumTexels : 0.0,
+		MaxChannelError[0], MaxChannelError[1], MaxChannelError[2], MaxChannelError[3], MaxErrorTexel.X, MaxErrorTexel.Y, MeanError);
+}
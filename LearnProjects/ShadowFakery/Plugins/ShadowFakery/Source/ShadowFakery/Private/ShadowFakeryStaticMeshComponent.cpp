@@ -10,40 +10,34 @@ extern FVector GLightDirWithSize;
 extern FName GSunYawName;
 extern FName GSunDirectionName;
 
+static TAutoConsoleVariable<int32> CVarShadowFakeryPerInstanceLightData(
+	TEXT("r.ShadowFakery.PerInstanceLightData"),
+	0,
+	TEXT("0: light state is a shared custom instance data slot, only the proxy is recreated when the light moves (default).\n")
+	TEXT("1: light state is stored in the instance buffer and written to every instance, for debugging the shared slot.\n")
+	TEXT("Applies to shadow cells built afterwards."),
+	ECVF_Default);
+
 UShadowFakeryStaticMeshComponent::UShadowFakeryStaticMeshComponent()
 {
 	PrimaryComponentTick.bCanEverTick = true;
+	LightDir = FVector::ZeroVector;
+	CurShadowLength = 0.f;
+	CurShadowWidth = 0.f;
 }
 
 FBoxSphereBounds UShadowFakeryStaticMeshComponent::CalcBounds(const FTransform& LocalToWorld) const
 {
-	FBoxSphereBounds CurBounds = Super::CalcBounds(LocalToWorld);
-
-	if (GetStaticMesh())
+	if (GetStaticMesh() && GetInstanceCount() > 0)
 	{
-		FVector TempLightDir, Origin, Extent;
-		if (LightDir.Size() * CurShadowLength < CurShadowWidth)
+		// Bounds of all instances, extruded along the light by the shadow length so the shadow quads are never culled early
+		FBox ShadowBox = Super::CalcBounds(LocalToWorld).GetBox().ExpandBy(CurShadowWidth * 0.5f);
+		if (LightDir.Size() * CurShadowLength >= CurShadowWidth)
 		{
-			TempLightDir = LightDir.GetSafeNormal2D() * CurShadowWidth;
-			FVector NewDir = LocalToWorld.InverseTransformVector(TempLightDir);
-			Origin = LocalToWorld.GetLocation();
-			Extent = FVector(CurShadowWidth * 0.5f);
+			const FVector ShadowOffset = FMath::Clamp(CurShadowLength * LightDir.Size2D(), CurShadowWidth, 10000.f) * LightDir.GetSafeNormal2D();
+			ShadowBox += ShadowBox.ShiftBy(ShadowOffset);
 		}
-		else
-		{
-			TempLightDir = FMath::Clamp(CurShadowLength * LightDir.Size2D(), CurShadowWidth, 10000.f) * LightDir.GetSafeNormal2D();
-			FVector NewDir = LocalToWorld.InverseTransformVector(TempLightDir);
-			Extent = NewDir / 2.f;
-			Extent.Z = CurShadowWidth;
-			Origin = LocalToWorld.GetLocation() + Extent;
-		}
-		//FBoxSphereBounds NewBounds(Origin, Extent, CurShadowWidth);
-		//NewBounds.TransformBy(LocalToWorld);
-		CurBounds.BoxExtent = FVector(10000.f);
-		CurBounds.SphereRadius = CurShadowWidth;
-		//UE_LOG(LogTemp, Log, TEXT("Bound Size: %4.4f"), CurBounds.BoxExtent.X);
-
-		return CurBounds;
+		return FBoxSphereBounds(ShadowBox);
 	}
 	else
 	{
@@ -57,6 +51,37 @@ void UShadowFakeryStaticMeshComponent::UpdateShadowState(const FVector& NewLight
 	CurShadowLength = ShadowLength;
 	CurShadowWidth = ShadowWidth;
 	UpdateBounds();
+	// Bounds only reach the proxy with the transform, otherwise the cell is culled with its old bounds
+	MarkRenderTransformDirty();
+}
+
+void UShadowFakeryStaticMeshComponent::SetupLightStateCustomData()
+{
+	check(GetInstanceCount() == 0);
+
+	CustomInstanceDataNum = 2;
+	CustomInstanceSharedData = { FVector4(0.f, 0.f, 0.f, 0.f) };
+	CustomInstanceSharedDataNum = CVarShadowFakeryPerInstanceLightData.GetValueOnGameThread() ? 0 : 1;
+
+	// Flag and normalized yaw fit in unorm8, the light state does not, so the small format is only used when slot 0 is shared
+	CustomInstanceDataFormat = GetCustomInstanceSharedDataNum() > 0 ? ECustomInstanceDataFormat::UNorm8 : ECustomInstanceDataFormat::Float;
+}
+
+int32 UShadowFakeryStaticMeshComponent::AddShadowInstance(const FTransform& InstanceTransform, float Flag)
+{
+	const float InstanceYaw = FRotator::NormalizeAxis(InstanceTransform.Rotator().Yaw) / 360.f + 0.5f;
+	const FVector4 LightState = CustomInstanceSharedData.Num() > 0 ? CustomInstanceSharedData[0] : FVector4(0.f, 0.f, 0.f, 0.f);
+	return AddInstance_ShadowFakery(InstanceTransform, { LightState, FVector4(Flag, InstanceYaw, 0.f, 0.f) });
+}
+
+void UShadowFakeryStaticMeshComponent::SetShadowLightState(const FVector2D& LightSize, float SunYaw, float ShadowLength)
+{
+	UpdateShadowState(FVector(LightSize, 0.f), ShadowLength, GetStaticMesh() ? GetStaticMesh()->GetBounds().SphereRadius * 2.f : 0.f);
+
+	if (CustomInstanceDataNum > 0)
+	{
+		SetCustomInstanceSharedData(0, FVector4(LightSize.X, LightSize.Y, SunYaw, ShadowLength));
+	}
 }
 
 void UShadowFakeryStaticMeshComponent::TickComponent(float DeltaTime, enum ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
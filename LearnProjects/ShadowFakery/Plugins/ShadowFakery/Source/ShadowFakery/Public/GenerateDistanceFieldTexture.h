@@ -8,6 +8,22 @@
 
 class UStaticMesh;
 class UTexture2D;
+struct FShadowFakeryCompareReport;
+
+/** Console variables of the CPU bake, read once on game thread so the bake itself can run on worker threads */
+struct SHADOWFAKERY_API FShadowFakeryCPUBakeOptions
+{
+	/** Size in texels of the tiles the trace is split into, r.ShadowFakery.CPUBakeTileSize */
+	int32 TileSize = 64;
+	/** Run tiles and passes on the calling thread only, r.ShadowFakery.ParallelCPUBake 0 */
+	bool bForceSingleThread = false;
+
+	/** Read the console variables, game thread only */
+	static FShadowFakeryCPUBakeOptions FromConsoleVariables();
+};
+
+/** Called on game thread when an async bake is saved, Texture is nullptr if the bake failed */
+DECLARE_DELEGATE_OneParam(FOnShadowFakeryBakeCompleted, UTexture2D* /*Texture*/);
 
 /**
  * Make Distance Field for a primitive, more in MeshDistanceFieldUtilities.cpp
@@ -27,5 +43,41 @@ public:
 	UFUNCTION(BlueprintCallable, meta=(WorldContext="WorldContextObject"))
 	static void GenerateDistanceFieldTexture(const UObject* WorldContextObject, UStaticMesh* GenerateStaticMesh, class UTextureRenderTarget* OutputRenderTarget, int32 DistanceFieldSize,  float StartDegree = 90.f, float MakeDFRadius = 16.f, bool bUseGPU = true);
 
+	/**
+	 * Bake the distance field texture of mesh to B8G8R8A8 pixels without creating any asset, returns false if failed.
+	 * DistanceFieldSize is rounded up to power of two, OutTextureSize is the final size of the texture (atlas size of GPU bake).
+	 * CPU bake can be called from worker threads, GPU bake only from game thread.
+	 */
+	static bool BakeDistanceFieldPixels(UStaticMesh* GenerateStaticMesh, class UTextureRenderTarget* OutputRenderTarget, int32 DistanceFieldSize, float StartDegree, float MakeDFRadius, bool bUseGPU, const FShadowFakeryCPUBakeOptions& CPUBakeOptions, TArray<FColor>& OutPixels, int32& OutTextureSize);
+
+	/**
+	 * Bake the same 4x4 atlas as GPU without GPU, masks are traced with embree and go through the CPU reference of the jump flood passes,
+	 * so build machines without GPU give the same textures. OutTextureSize is the atlas size.
+	 */
+	static bool BakeDistanceFieldAtlasCPU(UStaticMesh* GenerateStaticMesh, int32 DistanceFieldSize, float StartDegree, const FShadowFakeryCPUBakeOptions& CPUBakeOptions, TArray<FColor>& OutPixels, int32& OutTextureSize);
+
+	/**
+	 * Bake the tile at StartDegree with both jump flood and the exact distance transform of the CPU bake and compare them texel by texel,
+	 * Tolerance is in 8 bit steps. Returns false if the mesh can not be traced.
+	 */
+	static bool CompareJumpFloodToDistanceTransform(UStaticMesh* GenerateStaticMesh, int32 DistanceFieldSize, float StartDegree, int32 Tolerance, const FShadowFakeryCPUBakeOptions& CPUBakeOptions, FShadowFakeryCompareReport& OutReport);
+
+	/**
+	 * Create the texture in package from baked pixels and save it, texture is named as the asset name of package.
+	 * BakeHash is saved in the meta data of package if it is not empty, so we can find out whether a rebake is needed.
+	 */
+	static UTexture2D* SaveDistanceFieldTexture(const FString& PackageName, int32 TextureSize, const TArray<FColor>& Pixels, const FString& BakeHash = FString());
+
+	/**
+	 * Bake on GPU without blocking game thread, the atlas is copied to a staging texture and read back when its fence is signaled.
+	 * The staging surface is copied straight into the locked mip of the texture, which is saved and passed to OnCompleted only
+	 * when it has pixels, a failed bake discards it.
+	 * @return False if the bake can not start, OnCompleted is not called then
+	 */
+	static bool BakeDistanceFieldTextureAsync(UStaticMesh* GenerateStaticMesh, int32 DistanceFieldSize, float StartDegree, const FString& PackageName, const FString& BakeHash, FOnShadowFakeryBakeCompleted OnCompleted);
+
+	/** The hash saved with texture by SaveDistanceFieldTexture, empty if there is none */
+	static FString GetDistanceFieldTextureBakeHash(UTexture2D* Texture);
+
 	//~UGenerateDistanceFieldTexture();
 };
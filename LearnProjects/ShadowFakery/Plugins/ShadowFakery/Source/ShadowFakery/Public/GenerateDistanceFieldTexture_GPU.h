@@ -8,6 +8,9 @@
 
 #define GENERATE_TEXTURE_DF 1
 
+// Tile count per side of the baked atlas, every tile is one sun angle
+#define SHADOWFAKERY_ATLAS_TILE_COUNT 4
+
 /**
  * 
  */
@@ -0,0 +1,75 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Kismet/BlueprintFunctionLibrary.h"
+#include "ShadowFakeryBatchBaker.generated.h"
+
+class UStaticMesh;
+class UTexture2D;
+class UFoliageType;
+
+USTRUCT(BlueprintType)
+struct SHADOWFAKERY_API FShadowFakeryBakeSettings
+{
+	GENERATED_BODY()
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ShadowFakery")
+	int32 DistanceFieldSize = 512;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ShadowFakery")
+	float StartDegree = 90.f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ShadowFakery")
+	float MakeDFRadius = 16.f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ShadowFakery")
+	bool bUseGPU = true;
+
+	/** CPU only, bake the same atlas as GPU with the CPU reference of jump flood instead of the single exact distance field tile */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ShadowFakery")
+	bool bCPUReferenceAtlas = false;
+
+	/** GPU only, read back the atlases asynchronously so game thread is not blocked, textures are saved when their readback finishes */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ShadowFakery")
+	bool bAsyncReadback = false;
+
+	/** Long package path the textures are saved to */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ShadowFakery")
+	FString OutputPath = TEXT("/Game/ShadowFakeryTextures");
+
+	/** Bake even if the existing texture has the same hash */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ShadowFakery")
+	bool bForceRebake = false;
+};
+
+/**
+ * Bake ShadowFakery textures for many meshes, every texture is keyed by a hash of mesh data and bake settings,
+ * meshes whose hash matches the existing texture are skipped, so only changed meshes are baked again.
+ */
+UCLASS()
+class SHADOWFAKERY_API UShadowFakeryBatchBaker : public UBlueprintFunctionLibrary
+{
+	GENERATED_BODY()
+
+public:
+	/**
+	 * Bake all meshes, OutTextures has the same order as StaticMeshes (nullptr if failed).
+	 * CPU bakes run concurrently, GPU bakes are queued one by one because they share the render target pool.
+	 * With bAsyncReadback the textures of baked meshes are nullptr, they are saved to their packages when the readback finishes.
+	 * @return Number of meshes actually baked, cached ones are not counted
+	 */
+	UFUNCTION(BlueprintCallable, Category = "ShadowFakery")
+	static int32 BakeStaticMeshes(const TArray<UStaticMesh*>& StaticMeshes, const FShadowFakeryBakeSettings& Settings, TArray<UTexture2D*>& OutTextures);
+
+	/** Bake the static mesh of every foliage type, same as BakeStaticMeshes */
+	UFUNCTION(BlueprintCallable, Category = "ShadowFakery")
+	static int32 BakeFoliageTypes(const TArray<UFoliageType*>& FoliageTypes, const FShadowFakeryBakeSettings& Settings, TArray<UTexture2D*>& OutTextures);
+
+	/** Hash of LOD0 vertex data and the settings which affect the result */
+	static FString ComputeBakeHash(UStaticMesh* StaticMesh, const FShadowFakeryBakeSettings& Settings);
+
+	/** Package the texture of mesh is saved to, named after the mesh and a crc of its full path so equal mesh names do not collide */
+	static FString GetTexturePackageName(UStaticMesh* StaticMesh, const FShadowFakeryBakeSettings& Settings);
+};
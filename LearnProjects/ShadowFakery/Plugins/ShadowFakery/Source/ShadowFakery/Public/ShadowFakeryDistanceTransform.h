@@ -0,0 +1,27 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * Exact euclidean distance transform on CPU, it is separable (Felzenszwalb and Huttenlocher),
+ * so the cost is linear to texel count and does not grow with the search radius.
+ */
+struct SHADOWFAKERY_API FShadowFakeryDistanceTransform
+{
+	/**
+	 * Squared distance from every texel to the nearest feature texel, feature texels get 0.
+	 * If there is no feature texel, the distance is a huge value (larger than any distance in the texture).
+	 */
+	static void ComputeSquaredDistance(int32 SizeX, int32 SizeY, TFunctionRef<bool(int32)> IsFeature, TArray<float>& OutSquaredDistance, bool bForceSingleThread = false);
+
+	/**
+	 * Signed distance of the 4 channels packed in FVector4 in one pass, each channel is a binary occupancy (0 is occluded).
+	 * The distance is to the nearest texel with different value, clamped to MaxRadius and normalized to -1~1, occluded texels are negative.
+	 */
+	static void ComputeSignedDistance(int32 SizeX, int32 SizeY, const TArray<FVector4>& Occupancy, float MaxRadius, TArray<FVector4>& OutSignedDistance, bool bForceSingleThread = false);
+
+	/** Encode signed distance to B8G8R8A8 with exactly the same quantization as MergeToAtlasCS in ProcessShadowFakery.usf */
+	static void QuantizeToBGRA8(const TArray<FVector4>& SignedDistance, TArray<FColor>& OutColors);
+};
@@ -23,7 +23,9 @@ protected:
 	virtual void PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent)override;
 #endif
 
-	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason)override;
+	virtual void PostRegisterAllComponents()override;
+
+	virtual void PostUnregisterAllComponents()override;
 
 public:	
 	// Called every frame
@@ -36,6 +38,25 @@ public:
 
 	UFUNCTION(BlueprintCallable)
 	void GenerateShadowDistanceField();
+
+private:
+	/** Build the cells of newly loaded foliage actors and destroy the cells of unloaded ones */
+	void UpdateShadowCells();
+
+	void BuildShadowCells(class AInstancedFoliageActor* FoliageActor);
+
+	/** Streamed levels bring and take their foliage actors, cells are updated on next tick */
+	void OnLevelChanged(class ULevel* Level, class UWorld* World);
+
+	void DestroyShadowCells(TArray<class UShadowFakeryStaticMeshComponent*>& ShadowCells);
+
+#if WITH_EDITOR
+	/** Foliage painted or edited in editor, the cells of its foliage actor are rebuilt on next tick */
+	void OnFoliageObjectChanged(UObject* Object);
+
+	void OnObjectPropertyChanged(UObject* Object, FPropertyChangedEvent& PropertyChangedEvent);
+#endif
+
 public:
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, meta = (AllowPrivateAccess = "true"))
 	class UStaticMeshComponent* ObjectMeshCompent;
@@ -51,6 +72,18 @@ public:
 
 	UPROPERTY(EditAnywhere)
 	float ShadowMaskCutOffset;
+
+	/** Size of the square cells shadow instances are bucketed into, every cell is one component */
+	UPROPERTY(EditAnywhere, Category = "ShadowCells")
+	float ShadowCellSize;
+
+	/** Cells farther than it are culled, 0 means never */
+	UPROPERTY(EditAnywhere, Category = "ShadowCells")
+	float ShadowCullDistance;
+
+	/** Length of the shadow quad, the bounds of cells are extruded by it along the light */
+	UPROPERTY(EditAnywhere, Category = "ShadowCells")
+	float ShadowLength;
 	 
 	UPROPERTY(EditAnywhere)
 	FName SunYawParam;
@@ -63,13 +96,34 @@ private:
 
 	FVector MaskCutDir;
 
-	class UShadowFakeryStaticMeshComponent* ShadowFakeryStaticMesh = nullptr;
+	TArray<class UShadowFakeryStaticMeshComponent*> AllShadowStaticMesh;
+
+	/** Shadow cells of every loaded foliage actor */
+	TMap<TWeakObjectPtr<class AInstancedFoliageActor>, TArray<UShadowFakeryStaticMeshComponent*>> FoliageShadowCells;
+
+	/** Light direction and actor rotation the shadow state was last pushed with */
+	FVector LastLightDir;
+
+	FQuat LastActorQuat;
+
+	/** Push the shadow state on next tick even if the light does not move */
+	bool bLightStateDirty;
 
-	TArray<UShadowFakeryStaticMeshComponent*> AllShadowStaticMesh;
+	/** Levels were added or removed, foliage actors are gathered again on next tick */
+	bool bShadowCellsDirty;
 
-	UShadowFakeryStaticMeshComponent* ShadowFakeryStaticMesh;
+	FDelegateHandle LevelAddedHandle;
 
-	bool bHasInit;
+	FDelegateHandle LevelRemovedHandle;
+
+#if WITH_EDITOR
+	/** Foliage actors whose instances were edited, their cells are rebuilt by UpdateShadowCells */
+	TSet<TWeakObjectPtr<class AInstancedFoliageActor>> DirtyFoliageActors;
+
+	FDelegateHandle ObjectModifiedHandle;
+
+	FDelegateHandle ObjectPropertyChangedHandle;
+#endif
 
 	bool bSwitchShadowFakery;
 };
@@ -0,0 +1,53 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/** Result of comparing two B8G8R8A8 bakes texel by texel, errors are in 8 bit steps */
+struct SHADOWFAKERY_API FShadowFakeryCompareReport
+{
+	int32 NumTexels = 0;
+
+	/** Texels with error larger than Tolerance in any channel */
+	int32 NumMismatched = 0;
+
+	int32 Tolerance = 0;
+
+	/** Max error of R, G, B, A */
+	int32 MaxChannelError[4] = { 0, 0, 0, 0 };
+
+	/** First texel with the largest error */
+	FIntPoint MaxErrorTexel = FIntPoint::ZeroValue;
+
+	/** Mean error of all channels of all texels */
+	double MeanError = 0.0;
+
+	bool IsWithinTolerance() const { return NumTexels > 0 && NumMismatched == 0; }
+
+	FString ToString() const;
+};
+
+/**
+ * CPU reference of the GPU distance field passes, the jump flood (FastStepJF in ShadowFakery.usf), RevertToDistanceFieldShaderPS,
+ * ReconstructDistanceFieldShaderPS and MergeToAtlasCS in ProcessShadowFakery.usf are done in the same order with the same math,
+ * so bakes without GPU give the same atlas and the shaders can be checked against it.
+ * The 4 channels of a texel are processed together in one vector register.
+ */
+struct SHADOWFAKERY_API FShadowFakeryJumpFlood
+{
+	/** Distance in uv of tile which is mapped to 1 by RevertToDistanceFieldShaderPS */
+	static const float MaxDistance;
+
+	/**
+	 * Run the whole chain for one tile, Occupancy is the mask of the 4 channels (0 is occluded, same as the CPU trace).
+	 * The result is encoded the same as MergeToAtlasCS.
+	 */
+	static void BakeTile(int32 TileSize, const TArray<FVector4>& Occupancy, TArray<FColor>& OutColors, bool bForceSingleThread = false);
+
+	/** Copy the tile to its place in atlas like MergeToAtlasCS, AtlasColors must already have AtlasSize * AtlasSize texels */
+	static void CopyTileToAtlas(int32 TileSize, int32 TileIndex, const TArray<FColor>& TileColors, int32 AtlasSize, TArray<FColor>& AtlasColors);
+
+	/** Compare Colors against Reference, both have the same size */
+	static FShadowFakeryCompareReport Compare(int32 SizeX, const TArray<FColor>& Colors, const TArray<FColor>& Reference, int32 Tolerance);
+};
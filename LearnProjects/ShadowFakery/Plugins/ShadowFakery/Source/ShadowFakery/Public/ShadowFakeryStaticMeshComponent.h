@@ -17,11 +17,25 @@ class SHADOWFAKERY_API UShadowFakeryStaticMeshComponent : public UInstancedStati
 public:
 	UShadowFakeryStaticMeshComponent();
 
-	/**We need to use custom bounds to prevent it from being culled*/
+	/** Bounds of instances extruded along the light by the shadow set in UpdateShadowState, so shadow quads are culled with the cell */
 	virtual FBoxSphereBounds CalcBounds(const FTransform& LocalToWorld) const override;
 
 	void UpdateShadowState(const FVector& NewLightDir, float ShadowLength, float ShadowWidth);
 
+	/**
+	 * Custom instance data layout read by shadow material:
+	 * slot 0: light size x, light size y, sun yaw, shadow length. Shared by all instances when the platform allows it.
+	 * slot 1: flag, instance yaw / 360 + 0.5. Stored per instance, as unorm8 when slot 0 is shared.
+	 * Must be called before instances are added.
+	 */
+	void SetupLightStateCustomData();
+
+	/** Add a shadow instance with its per instance slot filled from the transform */
+	int32 AddShadowInstance(const FTransform& InstanceTransform, float Flag = 0.f);
+
+	/** Push the light state read by shadow material to slot 0, cost does not depend on instance count when the slot is shared */
+	void SetShadowLightState(const FVector2D& LightSize, float SunYaw, float ShadowLength);
+
 	virtual void TickComponent(float DeltaTime, enum ELevelTick TickType, FActorComponentTickFunction *ThisTickFunction)override;
 
 private:
@@ -0,0 +1,131 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ShadowFakeryBakeCommandlet.h"
+#include "ShadowFakeryBatchBaker.h"
+#include "ShadowFakeryJumpFlood.h"
+#include "GenerateDistanceFieldTexture.h"
+#include "AssetRegistryModule.h"
+#include "Engine/StaticMesh.h"
+#include "Engine/Texture2D.h"
+#include "FoliageType.h"
+#include "FoliageType_InstancedStaticMesh.h"
+#include "Misc/App.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogShadowFakeryBakeCommandlet, Log, All);
+
+UShadowFakeryBakeCommandlet::UShadowFakeryBakeCommandlet()
+{
+	IsClient = false;
+	IsEditor = true;
+	IsServer = false;
+	LogToConsole = true;
+}
+
+int32 UShadowFakeryBakeCommandlet::Main(const FString& Params)
+{
+	FString SearchPath = TEXT("/Game");
+	FParse::Value(*Params, TEXT("Path="), SearchPath);
+
+	FShadowFakeryBakeSettings Settings;
+	FParse::Value(*Params, TEXT("Size="), Settings.DistanceFieldSize);
+	FParse::Value(*Params, TEXT("StartDegree="), Settings.StartDegree);
+	FParse::Value(*Params, TEXT("Radius="), Settings.MakeDFRadius);
+	FParse::Value(*Params, TEXT("OutputPath="), Settings.OutputPath);
+	Settings.bCPUReferenceAtlas = FParse::Param(*Params, TEXT("CPUReference"));
+	Settings.bUseGPU = !FParse::Param(*Params, TEXT("CPU")) && !Settings.bCPUReferenceAtlas;
+	Settings.bForceRebake = FParse::Param(*Params, TEXT("Force"));
+
+	FAssetRegistryModule& AssetRegistryModule = FModuleManager::LoadModuleChecked<FAssetRegistryModule>(TEXT("AssetRegistry"));
+	IAssetRegistry& AssetRegistry = AssetRegistryModule.Get();
+	AssetRegistry.SearchAllAssets(true);
+
+	FARFilter Filter;
+	Filter.PackagePaths.Add(*SearchPath);
+	Filter.bRecursivePaths = true;
+	Filter.bRecursiveClasses = true;
+	Filter.ClassNames.Add(UStaticMesh::StaticClass()->GetFName());
+	Filter.ClassNames.Add(UFoliageType_InstancedStaticMesh::StaticClass()->GetFName());
+
+	TArray<FAssetData> Assets;
+	AssetRegistry.GetAssets(Filter, Assets);
+
+	TArray<UStaticMesh*> StaticMeshes;
+	for (const FAssetData& Asset : Assets)
+	{
+		UObject* Object = Asset.GetAsset();
+		if (UStaticMesh* StaticMesh = Cast<UStaticMesh>(Object))
+		{
+			StaticMeshes.AddUnique(StaticMesh);
+		}
+		else if (UFoliageType_InstancedStaticMesh* FoliageType = Cast<UFoliageType_InstancedStaticMesh>(Object))
+		{
+			if (FoliageType->GetStaticMesh())
+				StaticMeshes.AddUnique(FoliageType->GetStaticMesh());
+		}
+	}
+
+	UE_LOG(LogShadowFakeryBakeCommandlet, Display, TEXT("Found %d meshes under %s"), StaticMeshes.Num(), *SearchPath);
+
+	// Jump flood is approximate and the GPU math is not bitwise the same, so allow a few steps by default
+	int32 CompareTolerance = 2;
+	if (FParse::Value(*Params, TEXT("Compare="), CompareTolerance) || FParse::Param(*Params, TEXT("Compare")))
+	{
+		return CompareBakes(StaticMeshes, Settings, CompareTolerance);
+	}
+
+	TArray<UTexture2D*> Textures;
+	const int32 BakedCount = UShadowFakeryBatchBaker::BakeStaticMeshes(StaticMeshes, Settings, Textures);
+
+	int32 FailedCount = 0;
+	for (UTexture2D* Texture : Textures)
+	{
+		if (!Texture)
+			++FailedCount;
+	}
+
+	UE_LOG(LogShadowFakeryBakeCommandlet, Display, TEXT("Baked %d, up to date %d, failed %d"), BakedCount, Textures.Num() - BakedCount - FailedCount, FailedCount);
+	return FailedCount == 0 ? 0 : 1;
+}
+
+int32 UShadowFakeryBakeCommandlet::CompareBakes(const TArray<UStaticMesh*>& StaticMeshes, const FShadowFakeryBakeSettings& Settings, int32 Tolerance)
+{
+	// GPU atlas can only be baked with a real RHI
+	const bool bCompareGPU = FApp::CanEverRender();
+	const FShadowFakeryCPUBakeOptions CPUBakeOptions = FShadowFakeryCPUBakeOptions::FromConsoleVariables();
+	int32 FailedCount = 0;
+
+	for (UStaticMesh* StaticMesh : StaticMeshes)
+	{
+		FShadowFakeryCompareReport Report;
+		if (!UGenerateDistanceFieldTexture::CompareJumpFloodToDistanceTransform(StaticMesh, Settings.DistanceFieldSize, Settings.StartDegree, Tolerance, CPUBakeOptions, Report))
+		{
+			UE_LOG(LogShadowFakeryBakeCommandlet, Warning, TEXT("%s: failed to trace mesh"), *StaticMesh->GetName());
+			++FailedCount;
+			continue;
+		}
+		UE_LOG(LogShadowFakeryBakeCommandlet, Display, TEXT("%s: jump flood vs distance transform, %s"), *StaticMesh->GetName(), *Report.ToString());
+		FailedCount += Report.IsWithinTolerance() ? 0 : 1;
+
+		if (!bCompareGPU)
+			continue;
+
+		TArray<FColor> CPUPixels, GPUPixels;
+		int32 CPUTextureSize = 0, GPUTextureSize = 0;
+		if (!UGenerateDistanceFieldTexture::BakeDistanceFieldAtlasCPU(StaticMesh, Settings.DistanceFieldSize, Settings.StartDegree, CPUBakeOptions, CPUPixels, CPUTextureSize)
+			|| !UGenerateDistanceFieldTexture::BakeDistanceFieldPixels(StaticMesh, nullptr, Settings.DistanceFieldSize, Settings.StartDegree, Settings.MakeDFRadius, true, CPUBakeOptions, GPUPixels, GPUTextureSize)
+			|| CPUTextureSize != GPUTextureSize)
+		{
+			UE_LOG(LogShadowFakeryBakeCommandlet, Warning, TEXT("%s: failed to bake atlas on CPU or GPU"), *StaticMesh->GetName());
+			++FailedCount;
+			continue;
+		}
+
+		Report = FShadowFakeryJumpFlood::Compare(GPUTextureSize, GPUPixels, CPUPixels, Tolerance);
+		UE_LOG(LogShadowFakeryBakeCommandlet, Display, TEXT("%s: GPU vs CPU reference atlas, %s"), *StaticMesh->GetName(), *Report.ToString());
+		FailedCount += Report.IsWithinTolerance() ? 0 : 1;
+	}
+
+	UE_LOG(LogShadowFakeryBakeCommandlet, Display, TEXT("Compared %d meshes, %d beyond tolerance or failed"), StaticMeshes.Num(), FailedCount);
+	return FailedCount == 0 ? 0 : 1;
+}
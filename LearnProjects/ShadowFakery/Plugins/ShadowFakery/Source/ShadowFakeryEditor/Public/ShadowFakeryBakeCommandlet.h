@@ -0,0 +1,29 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "ShadowFakeryBakeCommandlet.generated.h"
+
+/**
+ * Bake ShadowFakery textures headless, e.g.
+ * UE4Editor-Cmd.exe Project.uproject -run=ShadowFakeryBake -Path=/Game/Foliage -Size=512 -StartDegree=90 -Radius=16 [-CPU] [-CPUReference] [-Force] [-OutputPath=/Game/ShadowFakeryTextures]
+ * All static meshes and foliage types under Path are baked, meshes which are not changed since last bake are skipped.
+ * -CPUReference bakes the GPU atlas on CPU (works with -nullrhi).
+ * -Compare[=Tolerance] does not save anything, it reports the difference of jump flood to the exact distance transform for every mesh,
+ * and the difference of GPU atlas to the CPU reference atlas if the GPU is available. Returns 1 if any mesh is beyond the tolerance.
+ */
+UCLASS()
+class UShadowFakeryBakeCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	UShadowFakeryBakeCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+
+private:
+	int32 CompareBakes(const TArray<class UStaticMesh*>& StaticMeshes, const struct FShadowFakeryBakeSettings& Settings, int32 Tolerance);
+};
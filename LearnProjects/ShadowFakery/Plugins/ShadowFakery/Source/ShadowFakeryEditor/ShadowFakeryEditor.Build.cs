@@ -20,6 +20,7 @@ namespace UnrealBuildTool.Rules
                     "RHI",
                     "AssetTools",
                     "AssetRegistry",
+                    "Foliage",
                     "ShadowFakery"
                 }
 				);